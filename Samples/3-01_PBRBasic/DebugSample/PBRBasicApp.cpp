@@ -499,7 +499,11 @@ void PBRBasicApp::AppInit()
     // Create vulkan surface from the glfw window.
     VK_CHECK(glfwCreateWindowSurface(m_instance, m_pWindow, nullptr, &m_surface));
 
-    InitPhysicalDevice();
+    // We need the swap chain device extension and the dynamic rendering extension.
+    const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+                                                        VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME };
+
+    InitPhysicalDevice(deviceExtensions);
     InitGfxQueueFamilyIdx();
     InitPresentQueueFamilyIdx();
 
@@ -507,9 +511,6 @@ void PBRBasicApp::AppInit()
     // https://vulkan.lunarg.com/doc/view/1.2.198.0/windows/1.2-extensions/vkspec.html#VUID-VkDeviceCreateInfo-queueFamilyIndex-02802
     std::vector<VkDeviceQueueCreateInfo> deviceQueueInfos = CreateDeviceQueueInfos({ m_graphicsQueueFamilyIdx,
                                                                                      m_presentQueueFamilyIdx });
-    // We need the swap chain device extension and the dynamic rendering extension.
-    const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-                                                        VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME };
 
     VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeature{};
     {
@@ -526,6 +527,7 @@ void PBRBasicApp::AppInit()
     InitGfxCommandPool();
     InitGfxCommandBuffers(SharedLib::MAX_FRAMES_IN_FLIGHT);
 
+    InitResourceRegistry();
     InitSwapchain();
     
     // Create the graphics pipeline
@@ -25,8 +25,6 @@ int main()
     // Main Loop
     while (!app.WindowShouldClose())
     {
-        VkDevice device = app.GetVkDevice();
-        VkFence inFlightFence = app.GetCurrentFrameFence();
         VkCommandBuffer currentCmdBuffer = app.GetCurrentFrameGfxCmdBuffer();
 
         VkDescriptorSet currentSkyboxPipelineDesSet0 = app.GetCurrentFrameDescriptorSet0();
@@ -35,7 +33,7 @@ int main()
         app.FrameStart();
 
         // Wait for the resources from the possible on flight frame
-        vkWaitForFences(device, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
+        app.WaitForCurrentFrame();
 
         // Get next available image from the swapchain
         uint32_t imageIndex;
@@ -45,7 +43,6 @@ int main()
         }
 
         // Reset unused previous frame's resource
-        vkResetFences(device, 1, &inFlightFence);
         vkResetCommandBuffer(currentCmdBuffer, 0);
 
         // Fill the command buffer
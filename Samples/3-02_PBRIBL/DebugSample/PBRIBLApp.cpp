@@ -57,9 +57,11 @@ PBRIBLApp::PBRIBLApp() :
     m_envBrdfImgView(VK_NULL_HANDLE),
     m_envBrdfImgSampler(VK_NULL_HANDLE),
     m_envBrdfImgAlloc(VK_NULL_HANDLE),
-    m_hdrImgCubemap(),
-    m_diffuseIrradianceCubemapImgInfo(),
-    m_envBrdfImgInfo(),
+    m_hdrCubemapKtx2(),
+    m_diffuseIrradianceCubemapKtx2(),
+    m_prefilterEnvCubemapKtx2(),
+    m_isPrefilterOctahedral(false),
+    m_envBrdfLutHeader(),
     m_vertBufferData(),
     m_idxBufferData(),
     m_vertBuffer(VK_NULL_HANDLE),
@@ -89,13 +91,6 @@ void PBRIBLApp::DestroyHdrRenderObjs()
 {
     DestroySphereVertexIndexBuffers();
 
-    delete m_diffuseIrradianceCubemapImgInfo.pData;
-    for (auto itr : m_prefilterEnvCubemapImgsInfo)
-    {
-        delete itr.pData;
-    }
-    delete m_envBrdfImgInfo.pData;
-
     vmaDestroyImage(*m_pAllocator, m_diffuseIrradianceCubemap, m_diffuseIrradianceCubemapAlloc);
     vkDestroyImageView(m_device, m_diffuseIrradianceCubemapImgView, nullptr);
     vkDestroySampler(m_device, m_diffuseIrradianceCubemapSampler, nullptr);
@@ -122,12 +117,6 @@ void PBRIBLApp::DestroyCameraUboObjects()
     }
 }
 
-// ================================================================================================================
-VkDeviceSize PBRIBLApp::GetHdrByteNum()
-{
-    return 3 * sizeof(float) * m_hdrImgCubemap.pixWidth * m_hdrImgCubemap.pixHeight;
-}
-
 // ================================================================================================================
 void PBRIBLApp::GetCameraData(
     float* pBuffer)
@@ -175,6 +164,19 @@ void PBRIBLApp::GetCameraPos(
     m_pCamera->GetPos(pOut);
 }
 
+// ================================================================================================================
+// The GenIBL's KTX2 cubemaps are uploaded as they are stored, so the images take their format, extent and mips.
+static void OpenIblCubemapKtx2(
+    const std::string&   namePath,
+    SharedLib::Ktx2File& ktx2File)
+{
+    if ((ktx2File.Open(namePath) == false) || (ktx2File.GetDesc().faceCnt != 6))
+    {
+        std::cerr << "Cannot read the IBL cubemap: " << namePath << ". Run the GenIBL with the ktx2 outputs." << std::endl;
+        exit(1);
+    }
+}
+
 // ================================================================================================================
 void PBRIBLApp::InitHdrRenderObjects()
 {
@@ -184,13 +186,8 @@ void PBRIBLApp::InitHdrRenderObjects()
 
     // Read in and init background cubemap
     {
-        std::string cubemapPathName = hdriFilePath + "iblOutput/background_cubemap.hdr";
-
-        int width, height, nrComponents;
-        m_hdrImgCubemap.pData = stbi_loadf(cubemapPathName.c_str(), &width, &height, &nrComponents, 0);
-
-        m_hdrImgCubemap.pixWidth = (uint32_t)width;
-        m_hdrImgCubemap.pixHeight = (uint32_t)height;
+        OpenIblCubemapKtx2(hdriFilePath + "iblOutput/background_cubemap.ktx2", m_hdrCubemapKtx2);
+        const SharedLib::Ktx2ImageDesc& desc = m_hdrCubemapKtx2.GetDesc();
 
         VmaAllocationCreateInfo hdrAllocInfo{};
         {
@@ -200,10 +197,8 @@ void PBRIBLApp::InitHdrRenderObjects()
 
         VkExtent3D extent{};
         {
-            // extent.width = m_hdrImgWidth / 6;
-            // extent.height = m_hdrImgHeight;
-            extent.width = m_hdrImgCubemap.pixWidth;
-            extent.height = m_hdrImgCubemap.pixWidth;
+            extent.width = desc.width;
+            extent.height = desc.height;
             extent.depth = 1;
         }
 
@@ -211,12 +206,12 @@ void PBRIBLApp::InitHdrRenderObjects()
         {
             cubeMapImgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
             cubeMapImgInfo.imageType = VK_IMAGE_TYPE_2D;
-            cubeMapImgInfo.format = VK_FORMAT_R32G32B32_SFLOAT;
+            cubeMapImgInfo.format = (VkFormat)desc.format;
             cubeMapImgInfo.extent = extent;
             cubeMapImgInfo.mipLevels = 1;
             cubeMapImgInfo.arrayLayers = 6;
             cubeMapImgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-            cubeMapImgInfo.tiling = VK_IMAGE_TILING_LINEAR;
+            cubeMapImgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
             cubeMapImgInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
             cubeMapImgInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
             cubeMapImgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -234,7 +229,7 @@ void PBRIBLApp::InitHdrRenderObjects()
             info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
             info.image = m_hdrCubeMapImage;
             info.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
-            info.format = VK_FORMAT_R32G32B32_SFLOAT;
+            info.format = (VkFormat)desc.format;
             info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
             info.subresourceRange.levelCount = 1;
             info.subresourceRange.layerCount = 6;
@@ -259,13 +254,8 @@ void PBRIBLApp::InitHdrRenderObjects()
     
     // Read in and init diffuse irradiance cubemap
     {
-        std::string diffIrradiancePathName = hdriFilePath + "iblOutput/diffuse_irradiance_cubemap.hdr";
-        int width, height, nrComponents;
-        m_diffuseIrradianceCubemapImgInfo.pData = stbi_loadf(diffIrradiancePathName.c_str(),
-                                                             &width, &height, &nrComponents, 0);
-
-        m_diffuseIrradianceCubemapImgInfo.pixWidth = (uint32_t)width;
-        m_diffuseIrradianceCubemapImgInfo.pixHeight = (uint32_t)height;
+        OpenIblCubemapKtx2(hdriFilePath + "iblOutput/diffuse_irradiance_cubemap.ktx2", m_diffuseIrradianceCubemapKtx2);
+        const SharedLib::Ktx2ImageDesc& desc = m_diffuseIrradianceCubemapKtx2.GetDesc();
 
         VmaAllocationCreateInfo diffIrrAllocInfo{};
         {
@@ -275,8 +265,8 @@ void PBRIBLApp::InitHdrRenderObjects()
 
         VkExtent3D extent{};
         {
-            extent.width = m_diffuseIrradianceCubemapImgInfo.pixWidth;
-            extent.height = m_diffuseIrradianceCubemapImgInfo.pixWidth;
+            extent.width = desc.width;
+            extent.height = desc.height;
             extent.depth = 1;
         }
 
@@ -284,12 +274,12 @@ void PBRIBLApp::InitHdrRenderObjects()
         {
             cubeMapImgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
             cubeMapImgInfo.imageType = VK_IMAGE_TYPE_2D;
-            cubeMapImgInfo.format = VK_FORMAT_R32G32B32_SFLOAT;
+            cubeMapImgInfo.format = (VkFormat)desc.format;
             cubeMapImgInfo.extent = extent;
             cubeMapImgInfo.mipLevels = 1;
             cubeMapImgInfo.arrayLayers = 6;
             cubeMapImgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-            cubeMapImgInfo.tiling = VK_IMAGE_TILING_LINEAR;
+            cubeMapImgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
             cubeMapImgInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
             cubeMapImgInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
             cubeMapImgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -307,7 +297,7 @@ void PBRIBLApp::InitHdrRenderObjects()
             info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
             info.image = m_diffuseIrradianceCubemap;
             info.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
-            info.format = VK_FORMAT_R32G32B32_SFLOAT;
+            info.format = (VkFormat)desc.format;
             info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
             info.subresourceRange.levelCount = 1;
             info.subresourceRange.layerCount = 6;
@@ -332,26 +322,16 @@ void PBRIBLApp::InitHdrRenderObjects()
 
     // Read in and init prefilter environment cubemap
     {
-        std::string prefilterEnvPath = hdriFilePath + "iblOutput/prefilterEnvMaps/";
-        std::vector<std::string> mipImgNames;
-        SharedLib::GetAllFileNames(prefilterEnvPath, mipImgNames);
-
-        const uint32_t mipCnts = mipImgNames.size();
-
-        m_prefilterEnvCubemapImgsInfo.resize(mipCnts);
-
-        for (uint32_t i = 0; i < mipCnts; i++)
+        // All the roughness levels are the mips of one file. The octahedral map of the GenIBL --octahedral is preferred,
+        // since it's one 2D image with 2/3 of the cubemap texels.
+        m_isPrefilterOctahedral = m_prefilterEnvCubemapKtx2.Open(hdriFilePath + "iblOutput/prefilterEnvMapOct.ktx2") &&
+                                  (m_prefilterEnvCubemapKtx2.GetDesc().faceCnt == 1);
+        if (m_isPrefilterOctahedral == false)
         {
-            int width, height, nrComponents;
-            std::string prefilterEnvMipImgPathName = hdriFilePath +
-                                                     "iblOutput/prefilterEnvMaps/prefilterMip" +
-                                                     std::to_string(i) + ".hdr";
-
-            m_prefilterEnvCubemapImgsInfo[i].pData = stbi_loadf(prefilterEnvMipImgPathName.c_str(),
-                                                                &width, &height, &nrComponents, 0);
-            m_prefilterEnvCubemapImgsInfo[i].pixWidth = width;
-            m_prefilterEnvCubemapImgsInfo[i].pixHeight = height;
+            OpenIblCubemapKtx2(hdriFilePath + "iblOutput/prefilterEnvMap.ktx2", m_prefilterEnvCubemapKtx2);
         }
+        const SharedLib::Ktx2ImageDesc& desc = m_prefilterEnvCubemapKtx2.GetDesc();
+        const uint32_t mipCnts = desc.levelCnt;
 
         VmaAllocationCreateInfo prefilterEnvCubemapAllocInfo{};
         {
@@ -361,8 +341,8 @@ void PBRIBLApp::InitHdrRenderObjects()
 
         VkExtent3D extent{};
         {
-            extent.width = m_prefilterEnvCubemapImgsInfo[0].pixWidth;
-            extent.height = m_prefilterEnvCubemapImgsInfo[0].pixWidth;
+            extent.width = desc.width;
+            extent.height = desc.height;
             extent.depth = 1;
         }
 
@@ -370,14 +350,14 @@ void PBRIBLApp::InitHdrRenderObjects()
         {
             cubeMapImgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
             cubeMapImgInfo.imageType = VK_IMAGE_TYPE_2D;
-            cubeMapImgInfo.format = VK_FORMAT_R32G32B32_SFLOAT;
+            cubeMapImgInfo.format = (VkFormat)desc.format;
             cubeMapImgInfo.extent = extent;
             cubeMapImgInfo.mipLevels = mipCnts;
-            cubeMapImgInfo.arrayLayers = 6;
+            cubeMapImgInfo.arrayLayers = desc.faceCnt;
             cubeMapImgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-            cubeMapImgInfo.tiling = VK_IMAGE_TILING_LINEAR;
+            cubeMapImgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
             cubeMapImgInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-            cubeMapImgInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+            cubeMapImgInfo.flags = m_isPrefilterOctahedral ? 0 : VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
             cubeMapImgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
         }
 
@@ -392,11 +372,11 @@ void PBRIBLApp::InitHdrRenderObjects()
         {
             info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
             info.image = m_prefilterEnvCubemap;
-            info.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
-            info.format = VK_FORMAT_R32G32B32_SFLOAT;
+            info.viewType = m_isPrefilterOctahedral ? VK_IMAGE_VIEW_TYPE_2D : VK_IMAGE_VIEW_TYPE_CUBE;
+            info.format = (VkFormat)desc.format;
             info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
             info.subresourceRange.levelCount = mipCnts;
-            info.subresourceRange.layerCount = 6;
+            info.subresourceRange.layerCount = desc.faceCnt;
         }
         VK_CHECK(vkCreateImageView(m_device, &info, nullptr, &m_prefilterEnvCubemapView));
 
@@ -418,11 +398,16 @@ void PBRIBLApp::InitHdrRenderObjects()
 
     // Read in and init environment brdf map
     {
-        std::string envBrdfMapPathName = hdriFilePath + "iblOutput/envBrdf.hdr";
-        int width, height, nrComponents;
-        m_envBrdfImgInfo.pData = stbi_loadf(envBrdfMapPathName.c_str(), &width, &height, &nrComponents, 0);
-        m_envBrdfImgInfo.pixWidth = width;
-        m_envBrdfImgInfo.pixHeight = height;
+        // The GenIBL's two channel LUT. It's uploaded as it is stored.
+        std::string envBrdfMapPathName = hdriFilePath + "iblOutput/envBrdf.bin";
+        if (SharedLib::ReadEnvBrdfLut(envBrdfMapPathName, m_envBrdfLutHeader, m_envBrdfLutTexels) == false)
+        {
+            std::cerr << "Cannot read the env brdf LUT: " << envBrdfMapPathName << std::endl;
+            exit(1);
+        }
+
+        VkFormat envBrdfFormat = (m_envBrdfLutHeader.format == SharedLib::EnvBrdfLutFormat::RG16F) ?
+                                 VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R32G32_SFLOAT;
 
         VmaAllocationCreateInfo envBrdfMapAllocInfo{};
         {
@@ -432,8 +417,8 @@ void PBRIBLApp::InitHdrRenderObjects()
 
         VkExtent3D extent{};
         {
-            extent.width = m_envBrdfImgInfo.pixWidth;
-            extent.height = m_envBrdfImgInfo.pixHeight;
+            extent.width = m_envBrdfLutHeader.width;
+            extent.height = m_envBrdfLutHeader.height;
             extent.depth = 1;
         }
 
@@ -441,12 +426,12 @@ void PBRIBLApp::InitHdrRenderObjects()
         {
             envBrdfImgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
             envBrdfImgInfo.imageType = VK_IMAGE_TYPE_2D;
-            envBrdfImgInfo.format = VK_FORMAT_R32G32B32_SFLOAT;
+            envBrdfImgInfo.format = envBrdfFormat;
             envBrdfImgInfo.extent = extent;
             envBrdfImgInfo.mipLevels = 1;
             envBrdfImgInfo.arrayLayers = 1;
             envBrdfImgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-            envBrdfImgInfo.tiling = VK_IMAGE_TILING_LINEAR;
+            envBrdfImgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
             envBrdfImgInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
             envBrdfImgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
         }
@@ -463,7 +448,7 @@ void PBRIBLApp::InitHdrRenderObjects()
             info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
             info.image = m_envBrdfImg;
             info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-            info.format = VK_FORMAT_R32G32B32_SFLOAT;
+            info.format = envBrdfFormat;
             info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
             info.subresourceRange.levelCount = 1;
             info.subresourceRange.layerCount = 1;
@@ -698,17 +683,20 @@ void PBRIBLApp::AppInit()
     // Create vulkan surface from the glfw window.
     VK_CHECK(glfwCreateWindowSurface(m_instance, m_pWindow, nullptr, &m_surface));
 
-    InitPhysicalDevice();
+    // We need the swap chain device extension and the dynamic rendering extension.
+    const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+                                                        VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME };
+
+    InitPhysicalDevice(deviceExtensions);
     InitGfxQueueFamilyIdx();
     InitPresentQueueFamilyIdx();
+    InitUploadQueueFamilyIdx();
 
     // Queue family index should be unique in vk1.2:
     // https://vulkan.lunarg.com/doc/view/1.2.198.0/windows/1.2-extensions/vkspec.html#VUID-VkDeviceCreateInfo-queueFamilyIndex-02802
     std::vector<VkDeviceQueueCreateInfo> deviceQueueInfos = CreateDeviceQueueInfos({ m_graphicsQueueFamilyIdx,
-                                                                                     m_presentQueueFamilyIdx });
-    // We need the swap chain device extension and the dynamic rendering extension.
-    const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-                                                        VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME };
+                                                                                     m_presentQueueFamilyIdx,
+                                                                                     m_uploadQueueFamilyIdx });
 
     VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeature{};
     {
@@ -720,11 +708,15 @@ void PBRIBLApp::AppInit()
     InitVmaAllocator();
     InitGraphicsQueue();
     InitPresentQueue();
+    InitUploadQueue();
     InitDescriptorPool();
 
     InitGfxCommandPool();
     InitGfxCommandBuffers(SharedLib::MAX_FRAMES_IN_FLIGHT);
+    InitUploadCommandPool();
+    InitUploadManager();
 
+    InitResourceRegistry();
     InitSwapchain();
     InitSphereVertexIndexBuffers();
     InitVpMatBuffer();
@@ -978,7 +970,7 @@ void PBRIBLApp::InitIblPipelineLayout()
 void PBRIBLApp::InitIblShaderModules()
 {
     m_vsIblShaderModule = CreateShaderModule("./hlsl/ibl_vert.spv");
-    m_psIblShaderModule = CreateShaderModule("./hlsl/ibl_frag.spv");
+    m_psIblShaderModule = CreateShaderModule(m_isPrefilterOctahedral ? "./hlsl/iblOct_frag.spv" : "./hlsl/ibl_frag.spv");
 }
 
 // ================================================================================================================
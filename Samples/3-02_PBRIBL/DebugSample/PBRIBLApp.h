@@ -1,6 +1,8 @@
 #pragma once
 #include "../../../SharedLibrary/Application/GlfwApplication.h"
 #include "../../../SharedLibrary/Pipeline/Pipeline.h"
+#include "../../../SharedLibrary/Utils/DiskOpsUtils.h"
+#include "../../../SharedLibrary/Utils/Ktx2Utils.h"
 
 VK_DEFINE_HANDLE(VmaAllocation);
 
@@ -9,13 +11,6 @@ namespace SharedLib
     class Camera;
 }
 
-struct ImgInfo
-{
-    uint32_t pixWidth;
-    uint32_t pixHeight;
-    float* pData;
-};
-
 const uint32_t VpMatBytesCnt = 4 * 4 * sizeof(float);
 
 class PBRIBLApp : public SharedLib::GlfwApplication
@@ -29,19 +24,16 @@ public:
     void UpdateCameraAndGpuBuffer();
 
     void GetCameraPos(float* pOut);
-    uint32_t GetMaxMipLevel() { return m_prefilterEnvCubemapImgsInfo.size(); }
+    uint32_t GetMaxMipLevel() { return m_prefilterEnvCubemapKtx2.GetDesc().levelCnt; }
 
-    VkDeviceSize GetHdrByteNum();
-    void* GetHdrDataPointer() { return m_hdrImgCubemap.pData; }
     VkImage GetCubeMapImage() { return m_hdrCubeMapImage; }
-    VkExtent2D GetHdrImgExtent() 
-        { return VkExtent2D{ m_hdrImgCubemap.pixWidth, m_hdrImgCubemap.pixHeight }; }
-    ImgInfo GetBackgroundCubemapInfo() { return m_hdrImgCubemap; }
-    ImgInfo GetDiffuseIrradianceImgInfo() { return m_diffuseIrradianceCubemapImgInfo; }
+    const SharedLib::Ktx2File& GetBackgroundCubemapKtx2() { return m_hdrCubemapKtx2; }
+    const SharedLib::Ktx2File& GetDiffuseIrradianceKtx2() { return m_diffuseIrradianceCubemapKtx2; }
     VkImage GetDiffuseIrradianceCubemap() { return m_diffuseIrradianceCubemap; }
-    std::vector<ImgInfo> GetPrefilterEnvImgsInfo() { return m_prefilterEnvCubemapImgsInfo; }
+    const SharedLib::Ktx2File& GetPrefilterEnvKtx2() { return m_prefilterEnvCubemapKtx2; }
     VkImage GetPrefilterEnvCubemap() { return m_prefilterEnvCubemap; }
-    ImgInfo GetEnvBrdfImgInfo() { return m_envBrdfImgInfo; }
+    const SharedLib::EnvBrdfLutHeader& GetEnvBrdfLutHeader() { return m_envBrdfLutHeader; }
+    std::vector<char>& GetEnvBrdfLutTexels() { return m_envBrdfLutTexels; } // Tightly packed RG texels.
     VkImage GetEnvBrdf() { return m_envBrdfImg; }
 
     VkFence GetFence(uint32_t i) { return m_inFlightFences[i]; }
@@ -106,7 +98,7 @@ private:
     VkSampler       m_hdrSampler;
     VmaAllocation   m_hdrCubeMapAlloc;
 
-    ImgInfo m_hdrImgCubemap;
+    SharedLib::Ktx2File m_hdrCubemapKtx2;
 
     std::vector<float>    m_vertBufferData;
     std::vector<uint32_t> m_idxBufferData;
@@ -137,21 +129,23 @@ private:
     std::vector<VkDescriptorSet> m_iblPipelineDescriptorSet0s; // For different frames.
     SharedLib::Pipeline          m_iblPipeline;
 
-    VkImage       m_diffuseIrradianceCubemap;
-    VkImageView   m_diffuseIrradianceCubemapImgView;
-    VkSampler     m_diffuseIrradianceCubemapSampler;
-    VmaAllocation m_diffuseIrradianceCubemapAlloc;
-    ImgInfo       m_diffuseIrradianceCubemapImgInfo;
+    VkImage             m_diffuseIrradianceCubemap;
+    VkImageView         m_diffuseIrradianceCubemapImgView;
+    VkSampler           m_diffuseIrradianceCubemapSampler;
+    VmaAllocation       m_diffuseIrradianceCubemapAlloc;
+    SharedLib::Ktx2File m_diffuseIrradianceCubemapKtx2;
 
     VkImage              m_prefilterEnvCubemap;
     VkImageView          m_prefilterEnvCubemapView;
     VkSampler            m_prefilterEnvCubemapSampler;
     VmaAllocation        m_prefilterEnvCubemapAlloc;
-    std::vector<ImgInfo> m_prefilterEnvCubemapImgsInfo;
+    SharedLib::Ktx2File  m_prefilterEnvCubemapKtx2;
+    bool                 m_isPrefilterOctahedral; // A 2D octahedral map instead of a cubemap.
 
     VkImage       m_envBrdfImg;
     VkImageView   m_envBrdfImgView;
     VkSampler     m_envBrdfImgSampler;
     VmaAllocation m_envBrdfImgAlloc;
-    ImgInfo       m_envBrdfImgInfo;
+    SharedLib::EnvBrdfLutHeader m_envBrdfLutHeader;
+    std::vector<char>           m_envBrdfLutTexels;
 };
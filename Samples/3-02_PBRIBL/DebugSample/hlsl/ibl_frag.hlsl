@@ -1,4 +1,5 @@
 #include <GGXModel.hlsl>
+#include <octahedral.hlsl>
 
 const static float3 Albedo = float3(0.56, 0.57, 0.58); 
 
@@ -10,7 +11,12 @@ struct SceneInfoUbo
 TextureCube i_diffuseCubeMapTexture : register(t1);
 SamplerState i_diffuseCubemapSamplerState : register(s1);
 
+// The iblOct_frag.hlsl defines it for the octahedral prefilter env map of the GenIBL --octahedral.
+#ifdef PREFILTER_OCTAHEDRAL
+Texture2D i_prefilterEnvCubeMapTexture : register(t2);
+#else
 TextureCube i_prefilterEnvCubeMapTexture : register(t2);
+#endif
 SamplerState i_prefilterEnvCubeMapSamplerState : register(s2);
 
 Texture2D    i_envBrdfTexture : register(t3);
@@ -36,8 +42,13 @@ float4 main(
 
     float3 diffuseIrradiance = i_diffuseCubeMapTexture.Sample(i_diffuseCubemapSamplerState, N).xyz;
 
+#ifdef PREFILTER_OCTAHEDRAL
+    float3 prefilterEnv = i_prefilterEnvCubeMapTexture.SampleLevel(i_prefilterEnvCubeMapSamplerState,
+                                                                   DirToOctahedralUv(R), roughness * i_sceneInfo.maxMipLevel).xyz;
+#else
     float3 prefilterEnv = i_prefilterEnvCubeMapTexture.SampleLevel(i_prefilterEnvCubeMapSamplerState,
                                                                    R, roughness * i_sceneInfo.maxMipLevel).xyz;
+#endif
 
     float2 envBrdf = i_envBrdfTexture.Sample(i_envBrdfSamplerState, float2(NoV, roughness)).xy;
 
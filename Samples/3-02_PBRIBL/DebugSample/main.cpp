@@ -46,17 +46,13 @@ int main()
     // - Copy IBL images to vulkan images;
     {
         // Shared resources
-        VmaAllocator* pAllocator = app.GetVmaAllocator();
         VkCommandBuffer stagingCmdBuffer = app.GetGfxCmdBuffer(0);
-        VkQueue gfxQueue = app.GetGfxQueue();
-        VkExtent2D backgroundImgExtent = app.GetHdrImgExtent();
-        VkDevice device = app.GetVkDevice();
 
-        // Background cubemap image info
-        ImgInfo backgroundCubemapImgInfo = app.GetBackgroundCubemapInfo();
-        VkExtent2D backgroundCubemapExtent = app.GetHdrImgExtent();
-        VkImage backgroundCubemapImage = app.GetCubeMapImage();
-        const uint32_t backgroundCubemapDwords = 3 * backgroundCubemapExtent.width * backgroundCubemapExtent.height;
+        // The copies are queued in the upload manager and flushed once on the upload queue. The images are released to
+        // the graphics queue family, which acquires them in the layout transitions below.
+        SharedLib::UploadManager& uploadManager = app.GetUploadManager();
+        const uint32_t uploadQueueFamilyIdx = app.GetUploadQueueFamilyIdx();
+        const uint32_t gfxQueueFamilyIdx = app.GetGfxQueueFamilyIdx();
 
         // Cubemap's 6 layers SubresourceRange
         VkImageSubresourceRange cubemap1MipSubResRange{};
@@ -68,159 +64,35 @@ int main()
             cubemap1MipSubResRange.layerCount = 6;
         }
 
-        // Copy the data from buffer to the image
-        // - Our tool outputs vStrip, which is more convenient for IO. This example also uses vStrip.
-        VkBufferImageCopy backgroundBufToImgCopy{};
-        {
-            VkExtent3D extent{};
-            {
-                extent.width = backgroundImgExtent.width;
-                extent.height = backgroundImgExtent.height / 6;
-                extent.depth = 1;
-            }
-
-            backgroundBufToImgCopy.bufferRowLength = backgroundImgExtent.width;
-            backgroundBufToImgCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            backgroundBufToImgCopy.imageSubresource.mipLevel = 0;
-            backgroundBufToImgCopy.imageSubresource.baseArrayLayer = 0;
-            backgroundBufToImgCopy.imageSubresource.layerCount = 6;
-            backgroundBufToImgCopy.imageExtent = extent;
-        }
-
-        SharedLib::SendImgDataToGpu(stagingCmdBuffer, 
-                                    device,
-                                    gfxQueue,
-                                    backgroundCubemapImgInfo.pData,
-                                    backgroundCubemapDwords * sizeof(float),
-                                    app.GetCubeMapImage(),
-                                    cubemap1MipSubResRange,
-                                    VK_IMAGE_LAYOUT_UNDEFINED,
-                                    backgroundBufToImgCopy,
-                                    *pAllocator);
-
-        // - In the `cmftStudio`, you can choose hStrip. The code below is an example of using the hStrip.
-        // - The buffer data of the image cannot be interleaved (The data of a separate image should be continues in the buffer address space.)
-        // - However, our cubemap data (hStrip) is interleaved. 
-        // - So, we have multiple choices to put them into the cubemap image. Here, I choose to offset the buffer starting point, specify the
-        // -     long row length and copy that for 6 times.
-        /*
-        VkBufferImageCopy hdrBufToImgCopies[6];
-        memset(hdrBufToImgCopies, 0, sizeof(hdrBufToImgCopies));
-        for (uint32_t i = 0; i < 6; i++)
-        {
-            VkExtent3D extent{};
-            {
-                extent.width = hdrImgExtent.width / 6;
-                extent.height = hdrImgExtent.height;
-                extent.depth = 1;
-            }
-
-            hdrBufToImgCopies[i].bufferRowLength = hdrImgExtent.width;
-            // hdrBufToImgCopies[i].bufferImageHeight = hdrImgExtent.height;
-            hdrBufToImgCopies[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            hdrBufToImgCopies[i].imageSubresource.mipLevel = 0;
-            hdrBufToImgCopies[i].imageSubresource.baseArrayLayer = i;
-            hdrBufToImgCopies[i].imageSubresource.layerCount = 1;
-
-            hdrBufToImgCopies[i].imageExtent = extent;
-            // In the unit of bytes:
-            hdrBufToImgCopies[i].bufferOffset = i * (hdrImgExtent.width / 6) * sizeof(float) * 3;
-        }
-
-        vkCmdCopyBufferToImage(
-            stagingCmdBuffer,
-            stagingBuffer,
-            cubeMapImage,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            6, hdrBufToImgCopies);
-        */
+        // The GenIBL's KTX2 files are already in the Vulkan face and level order and in the image format, so each
+        // cubemap goes from its file mapping to the image with all its faces and mips in one copy.
+        // Background cubemap
+        VkImage backgroundCubemapImage = app.GetCubeMapImage();
+        uploadManager.QueueKtx2Upload(app.GetBackgroundCubemapKtx2(),
+                                      backgroundCubemapImage,
+                                      VK_IMAGE_LAYOUT_UNDEFINED,
+                                      gfxQueueFamilyIdx);
 
         // Copy IBL images to VkImage
         // Diffuse Irradiance
-        ImgInfo diffIrrImgInfo = app.GetDiffuseIrradianceImgInfo();
         VkImage diffIrrCubemap = app.GetDiffuseIrradianceCubemap();
-        const uint32_t diffIrrDwords = diffIrrImgInfo.pixWidth * diffIrrImgInfo.pixHeight * 3;
-
-        VkBufferImageCopy diffIrrBufToImgCopy{};
-        {
-            VkExtent3D extent{};
-            {
-                extent.width = diffIrrImgInfo.pixWidth;
-                extent.height = diffIrrImgInfo.pixWidth;
-                extent.depth = 1;
-            }
-
-            diffIrrBufToImgCopy.bufferRowLength = extent.width;
-            diffIrrBufToImgCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            diffIrrBufToImgCopy.imageSubresource.mipLevel = 0;
-            diffIrrBufToImgCopy.imageSubresource.baseArrayLayer = 0;
-            diffIrrBufToImgCopy.imageSubresource.layerCount = 6;
-            diffIrrBufToImgCopy.imageExtent = extent;
-        }
-
-        SharedLib::SendImgDataToGpu(stagingCmdBuffer, 
-                                    device,
-                                    gfxQueue,
-                                    diffIrrImgInfo.pData,
-                                    diffIrrDwords * sizeof(float),
-                                    diffIrrCubemap,
-                                    cubemap1MipSubResRange,
-                                    VK_IMAGE_LAYOUT_UNDEFINED,
-                                    diffIrrBufToImgCopy,
-                                    *pAllocator);
+        uploadManager.QueueKtx2Upload(app.GetDiffuseIrradianceKtx2(),
+                                      diffIrrCubemap,
+                                      VK_IMAGE_LAYOUT_UNDEFINED,
+                                      gfxQueueFamilyIdx);
 
         // Prefilter environment
-        std::vector<ImgInfo> prefilterEnvMips = app.GetPrefilterEnvImgsInfo();
         VkImage prefilterEnvCubemap = app.GetPrefilterEnvCubemap();
-        const uint32_t mipLevelCnt = prefilterEnvMips.size();
-
-        for (uint32_t i = 0; i < prefilterEnvMips.size(); i++)
-        {
-            ImgInfo mipImgInfo = prefilterEnvMips[i];
-            uint32_t mipDwordsCnt = 3 * mipImgInfo.pixWidth * mipImgInfo.pixHeight;
-
-            VkImageSubresourceRange prefilterEnvMipISubResRange{};
-            {
-                prefilterEnvMipISubResRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                prefilterEnvMipISubResRange.baseMipLevel = i;
-                prefilterEnvMipISubResRange.levelCount = 1;
-                prefilterEnvMipISubResRange.baseArrayLayer = 0;
-                prefilterEnvMipISubResRange.layerCount = 6;
-            }
-
-            VkBufferImageCopy prefilterEnvMipIBufToImgCopy{};
-            {
-                VkExtent3D extent{};
-                {
-                    extent.width = mipImgInfo.pixWidth;
-                    extent.height = mipImgInfo.pixWidth;
-                    extent.depth = 1;
-                }
-
-                prefilterEnvMipIBufToImgCopy.bufferRowLength = mipImgInfo.pixWidth;
-                prefilterEnvMipIBufToImgCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                prefilterEnvMipIBufToImgCopy.imageSubresource.mipLevel = i;
-                prefilterEnvMipIBufToImgCopy.imageSubresource.baseArrayLayer = 0;
-                prefilterEnvMipIBufToImgCopy.imageSubresource.layerCount = 6;
-                prefilterEnvMipIBufToImgCopy.imageExtent = extent;
-            }
-
-            SharedLib::SendImgDataToGpu(stagingCmdBuffer,
-                                        device,
-                                        gfxQueue,
-                                        mipImgInfo.pData,
-                                        mipDwordsCnt * sizeof(float),
-                                        prefilterEnvCubemap,
-                                        prefilterEnvMipISubResRange,
-                                        VK_IMAGE_LAYOUT_UNDEFINED,
-                                        prefilterEnvMipIBufToImgCopy,
-                                        *pAllocator);
-        }
+        const uint32_t mipLevelCnt = app.GetMaxMipLevel();
+        uploadManager.QueueKtx2Upload(app.GetPrefilterEnvKtx2(),
+                                      prefilterEnvCubemap,
+                                      VK_IMAGE_LAYOUT_UNDEFINED,
+                                      gfxQueueFamilyIdx);
 
         // Environment BRDF
-        ImgInfo envBrdfImgInfo = app.GetEnvBrdfImgInfo();
+        const SharedLib::EnvBrdfLutHeader& envBrdfLutHeader = app.GetEnvBrdfLutHeader();
+        std::vector<char>& envBrdfLutTexels = app.GetEnvBrdfLutTexels();
         VkImage envBrdfImg = app.GetEnvBrdf();
-        const uint32_t envBrdfDwordsCnt = 3 * envBrdfImgInfo.pixHeight * envBrdfImgInfo.pixWidth;
 
         // The envBrdf 2D texture SubresourceRange
         VkImageSubresourceRange tex2dSubResRange{};
@@ -236,8 +108,8 @@ int main()
         {
             VkExtent3D extent{};
             {
-                extent.width = envBrdfImgInfo.pixWidth;
-                extent.height = envBrdfImgInfo.pixWidth;
+                extent.width = envBrdfLutHeader.width;
+                extent.height = envBrdfLutHeader.height;
                 extent.depth = 1;
             }
 
@@ -249,17 +121,16 @@ int main()
             envBrdfBufToImgCopy.imageExtent = extent;
         }
 
-        SharedLib::SendImgDataToGpu(stagingCmdBuffer, 
-                                    device,
-                                    gfxQueue,
-                                    envBrdfImgInfo.pData,
-                                    envBrdfDwordsCnt * sizeof(float),
-                                    envBrdfImg,
-                                    tex2dSubResRange,
-                                    VK_IMAGE_LAYOUT_UNDEFINED,
-                                    envBrdfBufToImgCopy,
-                                    *pAllocator);
+        uploadManager.QueueImgUpload(envBrdfLutTexels.data(),
+                                     uint32_t(envBrdfLutTexels.size()),
+                                     envBrdfImg,
+                                     tex2dSubResRange,
+                                     VK_IMAGE_LAYOUT_UNDEFINED,
+                                     { envBrdfBufToImgCopy },
+                                     gfxQueueFamilyIdx);
 
+        // All the copies above go to the GPU in one submit, which runs while the barriers below are recorded.
+        const uint64_t uploadTicket = uploadManager.Flush();
 
         // Transform all images layout to shader read optimal.
         VkCommandBufferBeginInfo beginInfo{};
@@ -295,7 +166,7 @@ int main()
             {
                 imgResMemBarriers[2].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
                 imgResMemBarriers[2].subresourceRange.baseArrayLayer = 0;
-                imgResMemBarriers[2].subresourceRange.layerCount = 6;
+                imgResMemBarriers[2].subresourceRange.layerCount = app.GetPrefilterEnvKtx2().GetDesc().faceCnt;
                 imgResMemBarriers[2].subresourceRange.baseMipLevel = 0;
                 imgResMemBarriers[2].subresourceRange.levelCount = mipLevelCnt;
             }
@@ -314,6 +185,20 @@ int main()
             imgResMemBarriers[3].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
         }
 
+        // The acquires have the same subresources and layouts as the releases of the uploads.
+        for (const VkImageMemoryBarrier& imgResMemBarrier : imgResMemBarriers)
+        {
+            SharedLib::CmdAcquireImgOwnership(stagingCmdBuffer,
+                                              imgResMemBarrier.image,
+                                              imgResMemBarrier.subresourceRange,
+                                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                              uploadQueueFamilyIdx,
+                                              gfxQueueFamilyIdx,
+                                              VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                              VK_ACCESS_TRANSFER_WRITE_BIT);
+        }
+
         vkCmdPipelineBarrier(
             stagingCmdBuffer,
             VK_PIPELINE_STAGE_TRANSFER_BIT,
@@ -326,7 +211,10 @@ int main()
         // End the command buffer and submit the packets
         vkEndCommandBuffer(stagingCmdBuffer);
 
-        SharedLib::SubmitCmdBufferAndWait(device, gfxQueue, stagingCmdBuffer);
+        // The graphics submit waits for the upload batch on the GPU through the upload timeline, so the host only waits
+        // once for the graphics timeline.
+        SharedLib::SemaphoreWait uploadWait = app.GetUploadTimeline().WaitPoint(uploadTicket, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        app.GetGfxTimeline().SubmitAndWait(stagingCmdBuffer, { uploadWait });
 
         // Copy camera data to ubo buffer
         for (uint32_t i = 0; i < SharedLib::MAX_FRAMES_IN_FLIGHT; i++)
@@ -349,8 +237,6 @@ int main()
     // Second draw draws GUI. GUI would use the image drawn from the first draw.
     while (!app.WindowShouldClose())
     {
-        VkDevice device = app.GetVkDevice();
-        VkFence inFlightFence = app.GetCurrentFrameFence();
         VkCommandBuffer currentCmdBuffer = app.GetCurrentFrameGfxCmdBuffer();
         VkDescriptorSet currentSkyboxPipelineDesSet0 = app.GetSkyboxCurrentFrameDescriptorSet0();
         VkDescriptorSet currentIblPipelineDesSet0 = app.GetIblCurrentFrameDescriptorSet0();
@@ -361,7 +247,7 @@ int main()
         app.FrameStart();
 
         // Wait for the resources from the possible on flight frame
-        vkWaitForFences(device, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
+        app.WaitForCurrentFrame();
 
         // Get next available image from the swapchain
         uint32_t imageIndex;
@@ -371,7 +257,6 @@ int main()
         }
 
         // Reset unused previous frame's resource
-        vkResetFences(device, 1, &inFlightFence);
         vkResetCommandBuffer(currentCmdBuffer, 0);
 
         // Fill the command buffer
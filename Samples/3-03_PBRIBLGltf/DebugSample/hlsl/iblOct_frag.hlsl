@@ -0,0 +1,3 @@
+// The ibl_frag.hlsl that samples the prefilter env map as an octahedral 2D map instead of a cubemap.
+#define PREFILTER_OCTAHEDRAL
+#include "ibl_frag.hlsl"
@@ -1,6 +1,7 @@
 #pragma pack_matrix(row_major)
 
 #include <GGXModel.hlsl>
+#include <octahedral.hlsl>
 
 // NOTE: [[vk::binding(X[, Y])]] -- X: binding number, Y: descriptor set.
 // NOTE: We assume that the metallic, roughness and occlusion are in the same texture. x: occlusion, y: roughness, z: metal.
@@ -15,7 +16,12 @@ struct SceneInfoUbo
 [[vk::binding(0, 1)]] TextureCube i_diffuseCubeMapTexture;
 [[vk::binding(0, 1)]] SamplerState i_diffuseCubemapSamplerState;
 
+// The iblOct_frag.hlsl defines it for the octahedral prefilter env map of the GenIBL --octahedral.
+#ifdef PREFILTER_OCTAHEDRAL
+[[vk::binding(1, 1)]] Texture2D i_prefilterEnvCubeMapTexture;
+#else
 [[vk::binding(1, 1)]] TextureCube i_prefilterEnvCubeMapTexture;
+#endif
 [[vk::binding(1, 1)]] SamplerState i_prefilterEnvCubeMapSamplerState;
 
 [[vk::binding(2, 1)]] Texture2D    i_envBrdfTexture;
@@ -68,8 +74,13 @@ float4 main(
 
     float3 diffuseIrradiance = i_diffuseCubeMapTexture.Sample(i_diffuseCubemapSamplerState, N).xyz;
 
+#ifdef PREFILTER_OCTAHEDRAL
+    float3 prefilterEnv = i_prefilterEnvCubeMapTexture.SampleLevel(i_prefilterEnvCubeMapSamplerState,
+                                                                   DirToOctahedralUv(R), roughness * i_sceneInfo.maxMipLevel).xyz;
+#else
     float3 prefilterEnv = i_prefilterEnvCubeMapTexture.SampleLevel(i_prefilterEnvCubeMapSamplerState,
                                                                    R, roughness * i_sceneInfo.maxMipLevel).xyz;
+#endif
 
     float2 envBrdf = i_envBrdfTexture.Sample(i_envBrdfSamplerState, float2(NoV, roughness)).xy;
 
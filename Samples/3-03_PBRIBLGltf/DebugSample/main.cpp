@@ -52,17 +52,13 @@ int main()
     const std::vector<Mesh>& gltfMeshes = app.GetModelMeshes();
     {
         // Shared resources
-        VmaAllocator* pAllocator = app.GetVmaAllocator();
         VkCommandBuffer stagingCmdBuffer = app.GetGfxCmdBuffer(0);
-        VkQueue gfxQueue = app.GetGfxQueue();
-        VkExtent2D backgroundImgExtent = app.GetHdrImgExtent();
-        VkDevice device = app.GetVkDevice();
 
-        // Background cubemap image info
-        ImgInfo backgroundCubemapImgInfo = app.GetBackgroundCubemapInfo();
-        VkExtent2D backgroundCubemapExtent = app.GetHdrImgExtent();
-        VkImage backgroundCubemapImage = app.GetCubeMapImage();
-        const uint32_t backgroundCubemapDwords = 3 * backgroundCubemapExtent.width * backgroundCubemapExtent.height;
+        // The copies are queued in the upload manager and flushed once on the upload queue. The images are released to
+        // the graphics queue family, which acquires them in the layout transitions below.
+        SharedLib::UploadManager& uploadManager = app.GetUploadManager();
+        const uint32_t uploadQueueFamilyIdx = app.GetUploadQueueFamilyIdx();
+        const uint32_t gfxQueueFamilyIdx = app.GetGfxQueueFamilyIdx();
 
         // Cubemap's 6 layers SubresourceRange
         VkImageSubresourceRange cubemap1MipSubResRange{};
@@ -74,122 +70,35 @@ int main()
             cubemap1MipSubResRange.layerCount = 6;
         }
 
-        // Copy the data from buffer to the image
-        // - Our tool outputs vStrip, which is more convenient for IO. This example also uses vStrip.
-        VkBufferImageCopy backgroundBufToImgCopy{};
-        {
-            VkExtent3D extent{};
-            {
-                extent.width = backgroundImgExtent.width;
-                extent.height = backgroundImgExtent.height / 6;
-                extent.depth = 1;
-            }
-
-            backgroundBufToImgCopy.bufferRowLength = backgroundImgExtent.width;
-            backgroundBufToImgCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            backgroundBufToImgCopy.imageSubresource.mipLevel = 0;
-            backgroundBufToImgCopy.imageSubresource.baseArrayLayer = 0;
-            backgroundBufToImgCopy.imageSubresource.layerCount = 6;
-            backgroundBufToImgCopy.imageExtent = extent;
-        }
-
-        SharedLib::SendImgDataToGpu(stagingCmdBuffer, 
-                                    device,
-                                    gfxQueue,
-                                    backgroundCubemapImgInfo.pData,
-                                    backgroundCubemapDwords * sizeof(float),
-                                    app.GetCubeMapImage(),
-                                    cubemap1MipSubResRange,
-                                    VK_IMAGE_LAYOUT_UNDEFINED,
-                                    backgroundBufToImgCopy,
-                                    *pAllocator);
+        // The GenIBL's KTX2 files are already in the Vulkan face and level order and in the image format, so each
+        // cubemap goes from its file mapping to the image with all its faces and mips in one copy.
+        // Background cubemap
+        VkImage backgroundCubemapImage = app.GetCubeMapImage();
+        uploadManager.QueueKtx2Upload(app.GetBackgroundCubemapKtx2(),
+                                      backgroundCubemapImage,
+                                      VK_IMAGE_LAYOUT_UNDEFINED,
+                                      gfxQueueFamilyIdx);
 
         // Copy IBL images to VkImage
         // Diffuse Irradiance
-        ImgInfo diffIrrImgInfo = app.GetDiffuseIrradianceImgInfo();
         VkImage diffIrrCubemap = app.GetDiffuseIrradianceCubemap();
-        const uint32_t diffIrrDwords = diffIrrImgInfo.pixWidth * diffIrrImgInfo.pixHeight * 3;
-
-        VkBufferImageCopy diffIrrBufToImgCopy{};
-        {
-            VkExtent3D extent{};
-            {
-                extent.width = diffIrrImgInfo.pixWidth;
-                extent.height = diffIrrImgInfo.pixWidth;
-                extent.depth = 1;
-            }
-
-            diffIrrBufToImgCopy.bufferRowLength = extent.width;
-            diffIrrBufToImgCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            diffIrrBufToImgCopy.imageSubresource.mipLevel = 0;
-            diffIrrBufToImgCopy.imageSubresource.baseArrayLayer = 0;
-            diffIrrBufToImgCopy.imageSubresource.layerCount = 6;
-            diffIrrBufToImgCopy.imageExtent = extent;
-        }
-
-        SharedLib::SendImgDataToGpu(stagingCmdBuffer, 
-                                    device,
-                                    gfxQueue,
-                                    diffIrrImgInfo.pData,
-                                    diffIrrDwords * sizeof(float),
-                                    diffIrrCubemap,
-                                    cubemap1MipSubResRange,
-                                    VK_IMAGE_LAYOUT_UNDEFINED,
-                                    diffIrrBufToImgCopy,
-                                    *pAllocator);
+        uploadManager.QueueKtx2Upload(app.GetDiffuseIrradianceKtx2(),
+                                      diffIrrCubemap,
+                                      VK_IMAGE_LAYOUT_UNDEFINED,
+                                      gfxQueueFamilyIdx);
 
         // Prefilter environment
-        std::vector<ImgInfo> prefilterEnvMips = app.GetPrefilterEnvImgsInfo();
         VkImage prefilterEnvCubemap = app.GetPrefilterEnvCubemap();
-        const uint32_t mipLevelCnt = prefilterEnvMips.size();
-
-        for (uint32_t i = 0; i < prefilterEnvMips.size(); i++)
-        {
-            ImgInfo mipImgInfo = prefilterEnvMips[i];
-            uint32_t mipDwordsCnt = 3 * mipImgInfo.pixWidth * mipImgInfo.pixHeight;
-
-            VkImageSubresourceRange prefilterEnvMipISubResRange{};
-            {
-                prefilterEnvMipISubResRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                prefilterEnvMipISubResRange.baseMipLevel = i;
-                prefilterEnvMipISubResRange.levelCount = 1;
-                prefilterEnvMipISubResRange.baseArrayLayer = 0;
-                prefilterEnvMipISubResRange.layerCount = 6;
-            }
-
-            VkBufferImageCopy prefilterEnvMipIBufToImgCopy{};
-            {
-                VkExtent3D extent{};
-                {
-                    extent.width = mipImgInfo.pixWidth;
-                    extent.height = mipImgInfo.pixWidth;
-                    extent.depth = 1;
-                }
-
-                prefilterEnvMipIBufToImgCopy.bufferRowLength = mipImgInfo.pixWidth;
-                prefilterEnvMipIBufToImgCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                prefilterEnvMipIBufToImgCopy.imageSubresource.mipLevel = i;
-                prefilterEnvMipIBufToImgCopy.imageSubresource.baseArrayLayer = 0;
-                prefilterEnvMipIBufToImgCopy.imageSubresource.layerCount = 6;
-                prefilterEnvMipIBufToImgCopy.imageExtent = extent;
-            }
-
-            SharedLib::SendImgDataToGpu(stagingCmdBuffer,
-                                        device,
-                                        gfxQueue,
-                                        mipImgInfo.pData,
-                                        mipDwordsCnt * sizeof(float),
-                                        prefilterEnvCubemap,
-                                        prefilterEnvMipISubResRange,
-                                        VK_IMAGE_LAYOUT_UNDEFINED,
-                                        prefilterEnvMipIBufToImgCopy,
-                                        *pAllocator);
-        }
+        const uint32_t mipLevelCnt = app.GetMaxMipLevel();
+        uploadManager.QueueKtx2Upload(app.GetPrefilterEnvKtx2(),
+                                      prefilterEnvCubemap,
+                                      VK_IMAGE_LAYOUT_UNDEFINED,
+                                      gfxQueueFamilyIdx);
 
         // Environment BRDF
-        ImgInfo envBrdfImgInfo = app.GetEnvBrdfImgInfo();
+        const SharedLib::EnvBrdfLutHeader& envBrdfLutHeader = app.GetEnvBrdfLutHeader();
+        std::vector<char>& envBrdfLutTexels = app.GetEnvBrdfLutTexels();
         VkImage envBrdfImg = app.GetEnvBrdf();
-        const uint32_t envBrdfDwordsCnt = 3 * envBrdfImgInfo.pixHeight * envBrdfImgInfo.pixWidth;
 
         // The envBrdf 2D texture SubresourceRange
         VkImageSubresourceRange tex2dSubResRange{};
@@ -205,8 +114,8 @@ int main()
         {
             VkExtent3D extent{};
             {
-                extent.width = envBrdfImgInfo.pixWidth;
-                extent.height = envBrdfImgInfo.pixWidth;
+                extent.width = envBrdfLutHeader.width;
+                extent.height = envBrdfLutHeader.height;
                 extent.depth = 1;
             }
 
@@ -218,16 +127,13 @@ int main()
             envBrdfBufToImgCopy.imageExtent = extent;
         }
 
-        SharedLib::SendImgDataToGpu(stagingCmdBuffer, 
-                                    device,
-                                    gfxQueue,
-                                    envBrdfImgInfo.pData,
-                                    envBrdfDwordsCnt * sizeof(float),
-                                    envBrdfImg,
-                                    tex2dSubResRange,
-                                    VK_IMAGE_LAYOUT_UNDEFINED,
-                                    envBrdfBufToImgCopy,
-                                    *pAllocator);
+        uploadManager.QueueImgUpload(envBrdfLutTexels.data(),
+                                     uint32_t(envBrdfLutTexels.size()),
+                                     envBrdfImg,
+                                     tex2dSubResRange,
+                                     VK_IMAGE_LAYOUT_UNDEFINED,
+                                     { envBrdfBufToImgCopy },
+                                     gfxQueueFamilyIdx);
 
         // Send model's textures to GPU
         for (const auto& mesh : gltfMeshes)
@@ -250,16 +156,13 @@ int main()
                 baseColorBufToImgCopy.imageExtent = extent;
             }
 
-            SharedLib::SendImgDataToGpu(stagingCmdBuffer,
-                                        device,
-                                        gfxQueue,
-                                        (void*) mesh.baseColorTex.dataVec.data(),
-                                        mesh.baseColorTex.dataVec.size(),
-                                        mesh.baseColorImg,
-                                        tex2dSubResRange,
-                                        VK_IMAGE_LAYOUT_UNDEFINED,
-                                        baseColorBufToImgCopy,
-                                        *pAllocator);
+            uploadManager.QueueImgUpload(mesh.baseColorTex.dataVec.data(),
+                                         mesh.baseColorTex.dataVec.size(),
+                                         mesh.baseColorImg,
+                                         tex2dSubResRange,
+                                         VK_IMAGE_LAYOUT_UNDEFINED,
+                                         { baseColorBufToImgCopy },
+                                         gfxQueueFamilyIdx);
 
             // Normal
             VkBufferImageCopy normalBufToImgCopy{};
@@ -279,16 +182,13 @@ int main()
                 normalBufToImgCopy.imageExtent = extent;
             }
 
-            SharedLib::SendImgDataToGpu(stagingCmdBuffer,
-                                        device,
-                                        gfxQueue,
-                                        (void*) mesh.normalTex.dataVec.data(),
-                                        mesh.normalTex.dataVec.size(),
-                                        mesh.normalImg,
-                                        tex2dSubResRange,
-                                        VK_IMAGE_LAYOUT_UNDEFINED,
-                                        normalBufToImgCopy,
-                                        *pAllocator);
+            uploadManager.QueueImgUpload(mesh.normalTex.dataVec.data(),
+                                         mesh.normalTex.dataVec.size(),
+                                         mesh.normalImg,
+                                         tex2dSubResRange,
+                                         VK_IMAGE_LAYOUT_UNDEFINED,
+                                         { normalBufToImgCopy },
+                                         gfxQueueFamilyIdx);
 
             // Roughness metallic
             VkBufferImageCopy roughnessMetallicBufToImgCopy{};
@@ -308,16 +208,13 @@ int main()
                 roughnessMetallicBufToImgCopy.imageExtent = extent;
             }
 
-            SharedLib::SendImgDataToGpu(stagingCmdBuffer,
-                                        device,
-                                        gfxQueue,
-                                        (void*) mesh.metallicRoughnessTex.dataVec.data(),
-                                        mesh.metallicRoughnessTex.dataVec.size(),
-                                        mesh.metallicRoughnessImg,
-                                        tex2dSubResRange,
-                                        VK_IMAGE_LAYOUT_UNDEFINED,
-                                        roughnessMetallicBufToImgCopy,
-                                        *pAllocator);
+            uploadManager.QueueImgUpload(mesh.metallicRoughnessTex.dataVec.data(),
+                                         mesh.metallicRoughnessTex.dataVec.size(),
+                                         mesh.metallicRoughnessImg,
+                                         tex2dSubResRange,
+                                         VK_IMAGE_LAYOUT_UNDEFINED,
+                                         { roughnessMetallicBufToImgCopy },
+                                         gfxQueueFamilyIdx);
 
             // Occlusion
             VkBufferImageCopy occlusionBufToImgCopy{};
@@ -337,18 +234,18 @@ int main()
                 occlusionBufToImgCopy.imageExtent = extent;
             }
 
-            SharedLib::SendImgDataToGpu(stagingCmdBuffer,
-                                        device,
-                                        gfxQueue,
-                                        (void*) mesh.occlusionTex.dataVec.data(),
-                                        mesh.occlusionTex.dataVec.size(),
-                                        mesh.occlusionImg,
-                                        tex2dSubResRange,
-                                        VK_IMAGE_LAYOUT_UNDEFINED,
-                                        occlusionBufToImgCopy,
-                                        *pAllocator);
+            uploadManager.QueueImgUpload(mesh.occlusionTex.dataVec.data(),
+                                         mesh.occlusionTex.dataVec.size(),
+                                         mesh.occlusionImg,
+                                         tex2dSubResRange,
+                                         VK_IMAGE_LAYOUT_UNDEFINED,
+                                         { occlusionBufToImgCopy },
+                                         gfxQueueFamilyIdx);
         }
 
+        // All the copies above go to the GPU in one submit, which runs while the barriers below are recorded.
+        const uint64_t uploadTicket = uploadManager.Flush();
+
         // Transform all images layout to shader read optimal.
         VkCommandBufferBeginInfo beginInfo{};
         {
@@ -356,130 +253,69 @@ int main()
         }
         VK_CHECK(vkBeginCommandBuffer(stagingCmdBuffer, &beginInfo));
 
-        // Transform the layout of the image to shader access resource
-        // VkImageMemoryBarrier imgResMemBarriers[4] = {};
-        std::vector<VkImageMemoryBarrier> imgResMemBarriers;
-        uint32_t modelTexCnt = app.GetModelTexCnt();
-        imgResMemBarriers.resize(4 + modelTexCnt);
+        // The images are tracked from their acquires, which are their last writes in the TRANSFER_DST, and go to the
+        // fragment shader reads in one barrier.
+        VkImageSubresourceRange prefilterEnvSubResRange{};
         {
-            // Background cubemap
-            imgResMemBarriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            imgResMemBarriers[0].image = app.GetCubeMapImage();
-            imgResMemBarriers[0].subresourceRange = cubemap1MipSubResRange;
-            imgResMemBarriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            imgResMemBarriers[0].dstAccessMask = VK_ACCESS_NONE;
-            imgResMemBarriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            imgResMemBarriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-            // Diffuse irradiance
-            imgResMemBarriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            imgResMemBarriers[1].image = diffIrrCubemap;
-            imgResMemBarriers[1].subresourceRange = cubemap1MipSubResRange;
-            imgResMemBarriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            imgResMemBarriers[1].dstAccessMask = VK_ACCESS_NONE;
-            imgResMemBarriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            imgResMemBarriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-            // Prefilter environment map
-            imgResMemBarriers[2].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            imgResMemBarriers[2].image = prefilterEnvCubemap;
-            {
-                imgResMemBarriers[2].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                imgResMemBarriers[2].subresourceRange.baseArrayLayer = 0;
-                imgResMemBarriers[2].subresourceRange.layerCount = 6;
-                imgResMemBarriers[2].subresourceRange.baseMipLevel = 0;
-                imgResMemBarriers[2].subresourceRange.levelCount = mipLevelCnt;
-            }
-            imgResMemBarriers[2].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            imgResMemBarriers[2].dstAccessMask = VK_ACCESS_NONE;
-            imgResMemBarriers[2].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            imgResMemBarriers[2].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-            // Environment brdf
-            imgResMemBarriers[3].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            imgResMemBarriers[3].image = envBrdfImg;
-            imgResMemBarriers[3].subresourceRange = tex2dSubResRange;
-            imgResMemBarriers[3].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            imgResMemBarriers[3].dstAccessMask = VK_ACCESS_NONE;
-            imgResMemBarriers[3].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            imgResMemBarriers[3].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-            // Others models' textures
-            uint32_t modelTexTransReadyCnt = 0;
-            for (const auto& mesh : gltfMeshes)
-            {
-                // Base color
-                if (mesh.baseColorImg != VK_NULL_HANDLE)
-                {
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].image = mesh.baseColorImg;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].subresourceRange = tex2dSubResRange;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].dstAccessMask = VK_ACCESS_NONE;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-                    modelTexTransReadyCnt++;
-                }
-
-                // Normal
-                if (mesh.normalImg != VK_NULL_HANDLE)
-                {
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].image = mesh.normalImg;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].subresourceRange = tex2dSubResRange;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].dstAccessMask = VK_ACCESS_NONE;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-                    modelTexTransReadyCnt++;
-                }
+            prefilterEnvSubResRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            prefilterEnvSubResRange.baseMipLevel = 0;
+            prefilterEnvSubResRange.levelCount = mipLevelCnt;
+            prefilterEnvSubResRange.baseArrayLayer = 0;
+            prefilterEnvSubResRange.layerCount = app.GetPrefilterEnvKtx2().GetDesc().faceCnt;
+        }
 
-                // Metallic roughness
-                if (mesh.metallicRoughnessImg != VK_NULL_HANDLE)
-                {
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].image = mesh.metallicRoughnessImg;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].subresourceRange = tex2dSubResRange;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].dstAccessMask = VK_ACCESS_NONE;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-                    modelTexTransReadyCnt++;
-                }
+        std::vector<std::pair<VkImage, VkImageSubresourceRange>> uploadedImgs = {
+            { app.GetCubeMapImage(), cubemap1MipSubResRange },
+            { diffIrrCubemap,        cubemap1MipSubResRange },
+            { prefilterEnvCubemap,   prefilterEnvSubResRange },
+            { envBrdfImg,            tex2dSubResRange }
+        };
 
-                // Occlusion
-                if (mesh.occlusionImg != VK_NULL_HANDLE)
+        // Others models' textures
+        for (const auto& mesh : gltfMeshes)
+        {
+            for (VkImage texImg : { mesh.baseColorImg, mesh.normalImg, mesh.metallicRoughnessImg, mesh.occlusionImg })
+            {
+                if (texImg != VK_NULL_HANDLE)
                 {
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].image = mesh.occlusionImg;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].subresourceRange = tex2dSubResRange;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].dstAccessMask = VK_ACCESS_NONE;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                    imgResMemBarriers[modelTexTransReadyCnt + 4].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-                    modelTexTransReadyCnt++;
+                    uploadedImgs.push_back({ texImg, tex2dSubResRange });
                 }
             }
         }
 
-        vkCmdPipelineBarrier(
-            stagingCmdBuffer,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-            0,
-            0, nullptr,
-            0, nullptr,
-            imgResMemBarriers.size(),
-            imgResMemBarriers.data());
+        // The acquires have the same subresources and layouts as the releases of the uploads.
+        SharedLib::ImgStateTracker& imgStateTracker = app.GetImgStateTracker();
+        for (const auto& [img, subResRange] : uploadedImgs)
+        {
+            SharedLib::CmdAcquireImgOwnership(stagingCmdBuffer,
+                                              img,
+                                              subResRange,
+                                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                              uploadQueueFamilyIdx,
+                                              gfxQueueFamilyIdx,
+                                              VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                              VK_ACCESS_TRANSFER_WRITE_BIT);
+
+            imgStateTracker.TrackImg(img,
+                                     subResRange.aspectMask,
+                                     subResRange.levelCount,
+                                     subResRange.layerCount,
+                                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                     VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                                     VK_ACCESS_2_TRANSFER_WRITE_BIT);
+            imgStateTracker.Use(img, SharedLib::ImgUsage::FragmentShaderRead);
+        }
+
+        imgStateTracker.CmdFlush(stagingCmdBuffer);
 
         // End the command buffer and submit the packets
         vkEndCommandBuffer(stagingCmdBuffer);
 
-        SharedLib::SubmitCmdBufferAndWait(device, gfxQueue, stagingCmdBuffer);
+        // The graphics submit waits for the upload batch on the GPU through the upload timeline, so the host only waits
+        // once for the graphics timeline.
+        SharedLib::SemaphoreWait uploadWait = app.GetUploadTimeline().WaitPoint(uploadTicket, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        app.GetGfxTimeline().SubmitAndWait(stagingCmdBuffer, { uploadWait });
 
         // Copy camera data to ubo buffer
         for (uint32_t i = 0; i < SharedLib::MAX_FRAMES_IN_FLIGHT; i++)
@@ -493,8 +329,6 @@ int main()
     // Second draw draws GUI. GUI would use the image drawn from the first draw.
     while (!app.WindowShouldClose())
     {
-        VkDevice device = app.GetVkDevice();
-        VkFence inFlightFence = app.GetCurrentFrameFence();
         VkCommandBuffer currentCmdBuffer = app.GetCurrentFrameGfxCmdBuffer();
         VkDescriptorSet currentSkyboxPipelineDesSet0 = app.GetSkyboxCurrentFrameDescriptorSet0();
         VkDescriptorSet currentIblPipelineUboDesSet = app.GetIblCurrentFrameUboDescriptorSet();
@@ -504,7 +338,7 @@ int main()
         app.FrameStart();
 
         // Wait for the resources from the possible on flight frame
-        vkWaitForFences(device, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
+        app.WaitForCurrentFrame();
 
         // Get next available image from the swapchain
         uint32_t imageIndex;
@@ -514,7 +348,6 @@ int main()
         }
 
         // Reset unused previous frame's resource
-        vkResetFences(device, 1, &inFlightFence);
         vkResetCommandBuffer(currentCmdBuffer, 0);
 
         // Fill the command buffer
@@ -527,40 +360,24 @@ int main()
         // Update the camera according to mouse input and sent camera data to the UBO
         app.UpdateCameraAndGpuBuffer();
 
-        // Transform the layout of the swapchain from undefined to render target.
-        VkImageMemoryBarrier swapchainRenderTargetTransBarrier{};
-        {
-            swapchainRenderTargetTransBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            swapchainRenderTargetTransBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-            swapchainRenderTargetTransBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            swapchainRenderTargetTransBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-            swapchainRenderTargetTransBarrier.image = app.GetSwapchainColorImage(imageIndex);
-            swapchainRenderTargetTransBarrier.subresourceRange = swapchainPresentSubResRange;
-        }
-
-        // NOTE: This barrier is only needed at the beginning of the swapchain creation.
-        VkImageMemoryBarrier swapchainDepthTargetTransBarrier{};
+        // The swapchain image is discarded and ready at the wait stage of its acquire semaphore. The depth image keeps its
+        // state across the frames, so its clear waits for the depth tests of the last frame that used it.
+        SharedLib::ImgStateTracker& imgStateTracker = app.GetImgStateTracker();
+        VkImage swapchainColorImg = app.GetSwapchainColorImage(imageIndex);
+        VkImage swapchainDepthImg = app.GetSwapchainDepthImage(imageIndex);
+        imgStateTracker.TrackImg(swapchainColorImg,
+                                 swapchainPresentSubResRange.aspectMask,
+                                 1, 1,
+                                 VK_IMAGE_LAYOUT_UNDEFINED,
+                                 VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
+        if (imgStateTracker.IsTracked(swapchainDepthImg) == false)
         {
-            swapchainDepthTargetTransBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            swapchainDepthTargetTransBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-            swapchainDepthTargetTransBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            swapchainDepthTargetTransBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            swapchainDepthTargetTransBarrier.image = app.GetSwapchainDepthImage(imageIndex);
-            swapchainDepthTargetTransBarrier.subresourceRange = swapchainDepthSubResRange;
+            imgStateTracker.TrackImg(swapchainDepthImg, swapchainDepthSubResRange.aspectMask, 1, 1);
         }
 
-        VkImageMemoryBarrier swapchainImgTrans[2] = {
-            swapchainRenderTargetTransBarrier, swapchainDepthTargetTransBarrier
-        };
-
-        vkCmdPipelineBarrier(
-            currentCmdBuffer,
-            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-            0,
-            0, nullptr,
-            0, nullptr,
-            2, swapchainImgTrans);
+        imgStateTracker.Use(swapchainColorImg, SharedLib::ImgUsage::ColorAttachment);
+        imgStateTracker.Use(swapchainDepthImg, SharedLib::ImgUsage::TransferDst);
+        imgStateTracker.CmdFlush(currentCmdBuffer);
 
         // Draw the scene
         VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
@@ -650,31 +467,15 @@ int main()
         }
 
         vkCmdClearDepthStencilImage(currentCmdBuffer,
-                                    app.GetSwapchainDepthImage(imageIndex),
+                                    swapchainDepthImg,
                                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                                     &clearDepthStencilVal, 1, &swapchainDepthSubResRange);
 
-        // Transfer the depth stencil swapchain image back to depth attachment
-        VkImageMemoryBarrier swapchainTransDstToDepthTargetBarrier{};
-        {
-            swapchainTransDstToDepthTargetBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            swapchainTransDstToDepthTargetBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
-                                                                  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-            swapchainTransDstToDepthTargetBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            swapchainTransDstToDepthTargetBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-            swapchainTransDstToDepthTargetBarrier.image = app.GetSwapchainDepthImage(imageIndex);
-            swapchainTransDstToDepthTargetBarrier.subresourceRange = swapchainDepthSubResRange;
-        }
-
         // Render models' meshes
-        // Let IBL render in the color attachment after the skybox rendering completes.
-        vkCmdPipelineBarrier(currentCmdBuffer,
-            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-            0,
-            0, nullptr,
-            0, nullptr,
-            1, &swapchainTransDstToDepthTargetBarrier);
+        // Let IBL render in the color attachment after the skybox rendering completes, and with the cleared depth.
+        imgStateTracker.Use(swapchainColorImg, SharedLib::ImgUsage::ColorAttachment);
+        imgStateTracker.Use(swapchainDepthImg, SharedLib::ImgUsage::DepthAttachment);
+        imgStateTracker.CmdFlush(currentCmdBuffer);
 
         // for (const auto& mesh : gltfMeshes)
         for(uint32_t i = 0; i < gltfMeshes.size(); i++)
@@ -739,25 +540,8 @@ int main()
         // app.CmdCopyPresentImgToLogAnim(currentCmdBuffer, imageIndex);
 
         // Transform the swapchain image layout from render target to present.
-        // Transform the layout of the swapchain from undefined to render target.
-        VkImageMemoryBarrier swapchainPresentTransBarrier{};
-        {
-            swapchainPresentTransBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            swapchainPresentTransBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-            swapchainPresentTransBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-            swapchainPresentTransBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-            swapchainPresentTransBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-            swapchainPresentTransBarrier.image = app.GetSwapchainColorImage(imageIndex);
-            swapchainPresentTransBarrier.subresourceRange = swapchainPresentSubResRange;
-        }
-
-        vkCmdPipelineBarrier(currentCmdBuffer,
-            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-            VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT,
-            0,
-            0, nullptr,
-            0, nullptr,
-            1, &swapchainPresentTransBarrier);
+        imgStateTracker.Use(swapchainColorImg, SharedLib::ImgUsage::Present);
+        imgStateTracker.CmdFlush(currentCmdBuffer);
 
         VK_CHECK(vkEndCommandBuffer(currentCmdBuffer));
 
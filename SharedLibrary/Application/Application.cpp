@@ -3,7 +3,10 @@
 
 #include "Application.h"
 #include "VulkanDbgUtils.h"
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <cstdlib>
 
 namespace SharedLib
 {
@@ -15,7 +18,17 @@ namespace SharedLib
         m_device(VK_NULL_HANDLE),
         m_descriptorPool(VK_NULL_HANDLE),
         m_graphicsQueue(VK_NULL_HANDLE),
-        m_pAllocator(nullptr)
+        m_uploadQueueFamilyIdx(-1),
+        m_uploadQueue(VK_NULL_HANDLE),
+        m_uploadCmdPool(VK_NULL_HANDLE),
+        m_debugMessenger(VK_NULL_HANDLE),
+        m_pAllocator(nullptr),
+        m_phyDeviceSelector(),
+        m_gfxTimeline(),
+        m_uploadTimeline(),
+        m_uploadManager(),
+        m_readbackManager(),
+        m_resourceRegistry()
     {
         m_pAllocator = new VmaAllocator();
     }
@@ -23,8 +36,22 @@ namespace SharedLib
     // ================================================================================================================
     Application::~Application()
     {
-        // Destroy the command pool
+        // The upload and readback managers wait for their work and free their command buffers before the pools are
+        // destroyed. The resource registry destroys its resources before the allocator.
+        m_uploadManager.Destroy();
+        m_readbackManager.Destroy();
+        m_resourceRegistry.Destroy();
+
+        // The timelines wait for their last submits, so nothing below is in use by the GPU.
+        m_uploadTimeline.Destroy();
+        m_gfxTimeline.Destroy();
+
+        // Destroy the command pools
         vkDestroyCommandPool(m_device, m_gfxCmdPool, nullptr);
+        if (m_uploadCmdPool != VK_NULL_HANDLE)
+        {
+            vkDestroyCommandPool(m_device, m_uploadCmdPool, nullptr);
+        }
 
         // Destroy the descriptor pool
         vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
@@ -102,23 +129,24 @@ namespace SharedLib
             debugCreateInfo.pfnUserCallback = debug_utils_messenger_callback;
         }
 
-        // Verify that the validation layer for Khronos validation is supported
+        // Verify that the validation layer for Khronos validation is supported. It's optional, since the headless
+        // machines that only have a CPU implementation like the lavapipe often don't have the SDK.
         uint32_t layerNum;
         VK_CHECK(vkEnumerateInstanceLayerProperties(&layerNum, nullptr));
-        assert(layerNum >= 1);
         std::vector<VkLayerProperties> layers(layerNum);
         VK_CHECK(vkEnumerateInstanceLayerProperties(&layerNum, layers.data()));
+        bool hasValidationLayer = false;
         for (uint32_t i = 0; i < layerNum; ++i)
         {
             if (strcmp("VK_LAYER_KHRONOS_validation", layers[i].layerName) == 0)
             {
+                hasValidationLayer = true;
                 break;
             }
-            if (i == layerNum - 1)
-            {
-                std::cout << "Something went very wrong, cannot find VK_LAYER_KHRONOS_validation extension" << std::endl;
-                exit(1);
-            }
+        }
+        if (hasValidationLayer == false)
+        {
+            std::cout << "Cannot find the VK_LAYER_KHRONOS_validation layer. Run without the validation." << std::endl;
         }
 
         // Initialize instance and application
@@ -142,7 +170,7 @@ namespace SharedLib
             instanceCreateInfo.pApplicationInfo = &appInfo;
             instanceCreateInfo.enabledExtensionCount = instanceExtsCnt + 1;
             instanceCreateInfo.ppEnabledExtensionNames = instExtensions.data();
-            instanceCreateInfo.enabledLayerCount = 1;
+            instanceCreateInfo.enabledLayerCount = hasValidationLayer ? 1 : 0;
             instanceCreateInfo.ppEnabledLayerNames = &validationLayerName;
         }
         VK_CHECK(vkCreateInstance(&instanceCreateInfo, nullptr, &m_instance));
@@ -157,15 +185,263 @@ namespace SharedLib
     }
 
     // ================================================================================================================
-    void Application::InitPhysicalDevice()
+    static std::string ToLower(
+        std::string str)
+    {
+        std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        return str;
+    }
+
+    // ================================================================================================================
+    static std::string GetEnvVar(
+        const char* pName)
+    {
+#ifdef _WIN32
+        char* pValue = nullptr;
+        size_t len = 0;
+        if ((_dupenv_s(&pValue, &len, pName) != 0) || (pValue == nullptr))
+        {
+            return std::string();
+        }
+        std::string value(pValue);
+        free(pValue);
+        return value;
+#else
+        const char* pValue = std::getenv(pName);
+        return (pValue == nullptr) ? std::string() : std::string(pValue);
+#endif
+    }
+
+    // ================================================================================================================
+    static const char* PhysicalDeviceTypeName(
+        VkPhysicalDeviceType type)
+    {
+        switch (type)
+        {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   return "discrete";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    return "virtual";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:            return "cpu";
+        default:                                     return "other";
+        }
+    }
+
+    // ================================================================================================================
+    // The CPU implementations rank last, so they are only picked on the machines without a GPU or by the selector.
+    static uint64_t PhysicalDeviceTypeRank(
+        VkPhysicalDeviceType type)
+    {
+        switch (type)
+        {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   return 4;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 3;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    return 2;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:            return 1;
+        default:                                     return 0;
+        }
+    }
+
+    // ================================================================================================================
+    // Empty when the device can run the apps. Otherwise, the first thing that it misses.
+    static std::string PhysicalDeviceMissingSupport(
+        VkPhysicalDevice                  phyDevice,
+        const VkPhysicalDeviceProperties& props,
+        const std::vector<const char*>&   requiredDeviceExts)
+    {
+        // The feature structs of the newer versions cannot be queried below the 1.3.
+        if (props.apiVersion < VK_API_VERSION_1_3)
+        {
+            return "Vulkan 1.3";
+        }
+
+        VkPhysicalDeviceVulkan13Features vulkan13Features{};
+        {
+            vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+        }
+
+        VkPhysicalDeviceVulkan12Features vulkan12Features{};
+        {
+            vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+            vulkan12Features.pNext = &vulkan13Features;
+        }
+
+        VkPhysicalDeviceVulkan11Features vulkan11Features{};
+        {
+            vulkan11Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+            vulkan11Features.pNext = &vulkan12Features;
+        }
+
+        VkPhysicalDeviceFeatures2 features{};
+        {
+            features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features.pNext = &vulkan11Features;
+        }
+        vkGetPhysicalDeviceFeatures2(phyDevice, &features);
+
+        if (vulkan13Features.dynamicRendering == VK_FALSE)
+        {
+            return "dynamic rendering";
+        }
+
+        if (vulkan11Features.multiview == VK_FALSE)
+        {
+            return "multiview";
+        }
+
+        if (vulkan12Features.timelineSemaphore == VK_FALSE)
+        {
+            return "timeline semaphores";
+        }
+
+        if (vulkan13Features.synchronization2 == VK_FALSE)
+        {
+            return "synchronization2";
+        }
+
+        uint32_t extCnt = 0;
+        VK_CHECK(vkEnumerateDeviceExtensionProperties(phyDevice, nullptr, &extCnt, nullptr));
+        std::vector<VkExtensionProperties> exts(extCnt);
+        VK_CHECK(vkEnumerateDeviceExtensionProperties(phyDevice, nullptr, &extCnt, exts.data()));
+        for (const char* pRequiredExt : requiredDeviceExts)
+        {
+            auto itr = std::find_if(exts.begin(), exts.end(), [pRequiredExt](const VkExtensionProperties& ext)
+            {
+                return strcmp(ext.extensionName, pRequiredExt) == 0;
+            });
+
+            if (itr == exts.end())
+            {
+                return pRequiredExt;
+            }
+        }
+
+        uint32_t queueFamilyPropCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(phyDevice, &queueFamilyPropCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilyProps(queueFamilyPropCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(phyDevice, &queueFamilyPropCount, queueFamilyProps.data());
+        bool hasGraphicsQueue = std::any_of(queueFamilyProps.begin(), queueFamilyProps.end(), [](const VkQueueFamilyProperties& prop)
+        {
+            return (prop.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+        });
+
+        if (hasGraphicsQueue == false)
+        {
+            return "a graphics queue";
+        }
+
+        return std::string();
+    }
+
+    // ================================================================================================================
+    // The type decides first, so a discrete GPU beats an integrated one with a larger shared heap. Then the largest
+    // device local heap, and then the queue families that can overlap with the graphics queue.
+    static uint64_t ScorePhysicalDevice(
+        VkPhysicalDevice                  phyDevice,
+        const VkPhysicalDeviceProperties& props)
+    {
+        VkPhysicalDeviceMemoryProperties memProps{};
+        vkGetPhysicalDeviceMemoryProperties(phyDevice, &memProps);
+        VkDeviceSize maxDeviceLocalHeapBytes = 0;
+        for (uint32_t i = 0; i < memProps.memoryHeapCount; i++)
+        {
+            if (memProps.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+            {
+                maxDeviceLocalHeapBytes = std::max(maxDeviceLocalHeapBytes, memProps.memoryHeaps[i].size);
+            }
+        }
+
+        uint32_t queueFamilyPropCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(phyDevice, &queueFamilyPropCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilyProps(queueFamilyPropCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(phyDevice, &queueFamilyPropCount, queueFamilyProps.data());
+        bool hasAsyncCompute = false;
+        bool hasTransferOnly = false;
+        for (const VkQueueFamilyProperties& prop : queueFamilyProps)
+        {
+            bool isGraphics = (prop.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+            bool isCompute = (prop.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+            hasAsyncCompute |= (isCompute && (isGraphics == false));
+            hasTransferOnly |= ((prop.queueFlags & VK_QUEUE_TRANSFER_BIT) && (isCompute == false) && (isGraphics == false));
+        }
+
+        // 4 bits of the type, 58 bits of the heap MB and 2 bits of the queue families.
+        uint64_t heapMB = std::min<uint64_t>(maxDeviceLocalHeapBytes >> 20, (1ull << 58) - 1);
+        uint64_t queueRank = uint64_t(hasAsyncCompute) + uint64_t(hasTransferOnly);
+        return (PhysicalDeviceTypeRank(props.deviceType) << 60) | (heapMB << 2) | queueRank;
+    }
+
+    // ================================================================================================================
+    void Application::InitPhysicalDevice(
+        const std::vector<const char*>& requiredDeviceExts)
     {
-        // Enumerate the physicalDevices, select the first one and display the name of it.
         uint32_t phyDeviceCount;
         VK_CHECK(vkEnumeratePhysicalDevices(m_instance, &phyDeviceCount, nullptr));
         assert(phyDeviceCount >= 1);
         std::vector<VkPhysicalDevice> phyDeviceVec(phyDeviceCount);
         VK_CHECK(vkEnumeratePhysicalDevices(m_instance, &phyDeviceCount, phyDeviceVec.data()));
-        m_physicalDevice = phyDeviceVec[0];
+
+        std::string selector = m_phyDeviceSelector.empty() ? GetEnvVar("VULKAN_DICT_DEVICE") : m_phyDeviceSelector;
+        const bool isIdxSelector = (selector.empty() == false) &&
+                                   std::all_of(selector.begin(), selector.end(), [](unsigned char c) { return std::isdigit(c) != 0; });
+        const std::string lowerSelector = ToLower(selector);
+
+        // Print all the devices, so the selector has the names and the indices at hand.
+        int32_t  chosenIdx = -1;
+        uint64_t chosenScore = 0;
+        for (uint32_t i = 0; i < phyDeviceCount; i++)
+        {
+            VkPhysicalDeviceProperties props;
+            vkGetPhysicalDeviceProperties(phyDeviceVec[i], &props);
+
+            std::string missingSupport = PhysicalDeviceMissingSupport(phyDeviceVec[i], props, requiredDeviceExts);
+            if (missingSupport.empty() && (IsPresentSupported(phyDeviceVec[i]) == false))
+            {
+                missingSupport = "present to the surface";
+            }
+
+            uint64_t score = ScorePhysicalDevice(phyDeviceVec[i], props);
+            std::cout << "Device " << i << ": " << props.deviceName << " (" << PhysicalDeviceTypeName(props.deviceType) << ")";
+            if (missingSupport.empty() == false)
+            {
+                std::cout << " cannot run the app without " << missingSupport << ".";
+            }
+            std::cout << std::endl;
+
+            bool isSelected = true;
+            if (isIdxSelector)
+            {
+                isSelected = (std::strtoul(selector.c_str(), nullptr, 10) == i);
+            }
+            else if (lowerSelector == "cpu")
+            {
+                isSelected = (props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU);
+            }
+            else if (selector.empty() == false)
+            {
+                isSelected = (ToLower(props.deviceName).find(lowerSelector) != std::string::npos);
+            }
+
+            if (isSelected && missingSupport.empty() && ((chosenIdx == -1) || (score > chosenScore)))
+            {
+                chosenIdx = (int32_t)i;
+                chosenScore = score;
+            }
+        }
+
+        if (chosenIdx == -1)
+        {
+            if (selector.empty())
+            {
+                std::cerr << "No physical device can run the app." << std::endl;
+            }
+            else
+            {
+                std::cerr << "No physical device that can run the app matches the device selector: " << selector << std::endl;
+            }
+            exit(1);
+        }
+
+        m_physicalDevice = phyDeviceVec[chosenIdx];
         VkPhysicalDeviceProperties physicalDevProperties;
         vkGetPhysicalDeviceProperties(m_physicalDevice, &physicalDevProperties);
         std::cout << "Device name:" << physicalDevProperties.deviceName << std::endl;
@@ -195,6 +471,53 @@ namespace SharedLib
         assert(foundGraphics);
     }
 
+    // ================================================================================================================
+    // The transfer only families are the DMA engines on the discrete GPUs, so their copies run beside the graphics work.
+    // The transfer bit is implied on the graphics and compute families, so it is not required in their flags.
+    void Application::InitUploadQueueFamilyIdx()
+    {
+        uint32_t queueFamilyPropCount;
+        vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyPropCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilyProps(queueFamilyPropCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyPropCount, queueFamilyProps.data());
+
+        m_uploadQueueFamilyIdx = m_graphicsQueueFamilyIdx;
+
+        int transferOnlyFamilyIdx = -1;
+        int computeFamilyIdx = -1;
+        for (uint32_t i = 0; i < queueFamilyPropCount; i++)
+        {
+            const VkQueueFamilyProperties& props = queueFamilyProps[i];
+            const VkExtent3D& granularity = props.minImageTransferGranularity;
+            const bool isAnyGranularity = (granularity.width == 1) && (granularity.height == 1) && (granularity.depth == 1);
+            if ((props.queueCount == 0) || (isAnyGranularity == false) || (props.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+            {
+                continue;
+            }
+
+            if (props.queueFlags & VK_QUEUE_COMPUTE_BIT)
+            {
+                computeFamilyIdx = (computeFamilyIdx < 0) ? int(i) : computeFamilyIdx;
+            }
+            else if (props.queueFlags & VK_QUEUE_TRANSFER_BIT)
+            {
+                transferOnlyFamilyIdx = (transferOnlyFamilyIdx < 0) ? int(i) : transferOnlyFamilyIdx;
+            }
+        }
+
+        if (transferOnlyFamilyIdx >= 0)
+        {
+            m_uploadQueueFamilyIdx = uint32_t(transferOnlyFamilyIdx);
+        }
+        else if (computeFamilyIdx >= 0)
+        {
+            m_uploadQueueFamilyIdx = uint32_t(computeFamilyIdx);
+        }
+
+        std::cout << "Upload queue family:" << m_uploadQueueFamilyIdx
+                  << (HasDedicatedUploadQueue() ? "" : " (the graphics queue)") << std::endl;
+    }
+
     // ================================================================================================================
     void Application::InitDevice(
         const std::vector<const char*>&             deviceExts,
@@ -208,11 +531,61 @@ namespace SharedLib
             dynamic_rendering_feature.dynamicRendering = VK_TRUE;
         }
 
+        // The queue timelines need the timeline semaphores and the ImgStateTracker needs the synchronization2, which the
+        // InitPhysicalDevice(...) has checked. The bits are set on the 1.2/1.3 or feature structs of the app's chain when
+        // it has them, since a feature struct cannot be chained twice.
+        bool hasTimelineSemaphoreFeatures = false;
+        bool hasSynchronization2Features = false;
+        for (VkBaseOutStructure* pFeatures = static_cast<VkBaseOutStructure*>(pNext);
+             pFeatures != nullptr;
+             pFeatures = pFeatures->pNext)
+        {
+            if (pFeatures->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES)
+            {
+                reinterpret_cast<VkPhysicalDeviceVulkan12Features*>(pFeatures)->timelineSemaphore = VK_TRUE;
+                hasTimelineSemaphoreFeatures = true;
+            }
+            else if (pFeatures->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES)
+            {
+                reinterpret_cast<VkPhysicalDeviceTimelineSemaphoreFeatures*>(pFeatures)->timelineSemaphore = VK_TRUE;
+                hasTimelineSemaphoreFeatures = true;
+            }
+            else if (pFeatures->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES)
+            {
+                reinterpret_cast<VkPhysicalDeviceVulkan13Features*>(pFeatures)->synchronization2 = VK_TRUE;
+                hasSynchronization2Features = true;
+            }
+            else if (pFeatures->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES)
+            {
+                reinterpret_cast<VkPhysicalDeviceSynchronization2Features*>(pFeatures)->synchronization2 = VK_TRUE;
+                hasSynchronization2Features = true;
+            }
+        }
+        void* pDeviceInfoNext = pNext;
+
+        VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures{};
+        if (hasTimelineSemaphoreFeatures == false)
+        {
+            timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+            timelineSemaphoreFeatures.pNext = pDeviceInfoNext;
+            timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+            pDeviceInfoNext = &timelineSemaphoreFeatures;
+        }
+
+        VkPhysicalDeviceSynchronization2Features synchronization2Features{};
+        if (hasSynchronization2Features == false)
+        {
+            synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
+            synchronization2Features.pNext = pDeviceInfoNext;
+            synchronization2Features.synchronization2 = VK_TRUE;
+            pDeviceInfoNext = &synchronization2Features;
+        }
+
         // Assembly the info into the device create info
         VkDeviceCreateInfo deviceInfo{};
         {
             deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-            deviceInfo.pNext = pNext;
+            deviceInfo.pNext = pDeviceInfoNext;
             deviceInfo.queueCreateInfoCount = uint32_t(queueCreateInfos.size());
             deviceInfo.pQueueCreateInfos = queueCreateInfos.data();
             deviceInfo.enabledExtensionCount = deviceExtsCnt;
@@ -227,6 +600,19 @@ namespace SharedLib
     void Application::InitGraphicsQueue()
     {
         vkGetDeviceQueue(m_device, m_graphicsQueueFamilyIdx, 0, &m_graphicsQueue);
+        m_gfxTimeline.Init(m_device, m_graphicsQueue);
+    }
+
+    // ================================================================================================================
+    // When the upload family is the graphics family, the upload queue is the graphics queue, because the
+    // CreateDeviceQueueInfos(...) creates one queue per family. Then it shares the graphics timeline.
+    void Application::InitUploadQueue()
+    {
+        vkGetDeviceQueue(m_device, m_uploadQueueFamilyIdx, 0, &m_uploadQueue);
+        if (HasDedicatedUploadQueue())
+        {
+            m_uploadTimeline.Init(m_device, m_uploadQueue);
+        }
     }
 
     // ================================================================================================================
@@ -311,6 +697,53 @@ namespace SharedLib
         VK_CHECK(vkAllocateCommandBuffers(m_device, &commandBufferAllocInfo, m_gfxCmdBufs.data()));
     }
 
+    // ================================================================================================================
+    void Application::InitUploadCommandPool()
+    {
+        // Create the command pool belongs to the upload queue
+        VkCommandPoolCreateInfo commandPoolInfo{};
+        {
+            commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+            commandPoolInfo.queueFamilyIndex = m_uploadQueueFamilyIdx;
+        }
+        VK_CHECK(vkCreateCommandPool(m_device, &commandPoolInfo, nullptr, &m_uploadCmdPool));
+    }
+
+    // ================================================================================================================
+    void Application::InitUploadCommandBuffers(
+        const uint32_t cmdBufCnt)
+    {
+        m_uploadCmdBufs.resize(cmdBufCnt);
+        VkCommandBufferAllocateInfo commandBufferAllocInfo{};
+        {
+            commandBufferAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            commandBufferAllocInfo.commandPool = m_uploadCmdPool;
+            commandBufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            commandBufferAllocInfo.commandBufferCount = (uint32_t)m_uploadCmdBufs.size();
+        }
+        VK_CHECK(vkAllocateCommandBuffers(m_device, &commandBufferAllocInfo, m_uploadCmdBufs.data()));
+    }
+
+    // ================================================================================================================
+    void Application::InitUploadManager(
+        VkDeviceSize ringBytesCnt)
+    {
+        m_uploadManager.Init(m_device, *m_pAllocator, GetUploadTimeline(), m_uploadQueueFamilyIdx, m_uploadCmdPool, ringBytesCnt);
+    }
+
+    // ================================================================================================================
+    void Application::InitReadbackManager()
+    {
+        m_readbackManager.Init(m_device, *m_pAllocator, m_gfxTimeline, m_gfxCmdPool);
+    }
+
+    // ================================================================================================================
+    void Application::InitResourceRegistry()
+    {
+        m_resourceRegistry.Init(m_device, *m_pAllocator, m_gfxTimeline);
+    }
+
     // ================================================================================================================
     VkShaderModule Application::CreateShaderModule(
         const std::string& spvName)
@@ -434,4 +867,11 @@ namespace SharedLib
         vkWaitForFences(m_device, 1, &signalFence, VK_TRUE, UINT64_MAX);
         vkResetCommandBuffer(cmdBuf, 0);
     }
+
+    // ================================================================================================================
+    uint64_t Application::SubmitCmdBufToUploadQueue(
+        VkCommandBuffer cmdBuf)
+    {
+        return GetUploadTimeline().Submit(cmdBuf);
+    }
 }
\ No newline at end of file
@@ -2,8 +2,14 @@
 
 #include <vulkan/vulkan.h>
 #include <fstream>
+#include <string>
 #include <vector>
 #include <set>
+#include "UploadUtils.h"
+#include "ReadbackUtils.h"
+#include "SyncUtils.h"
+#include "ResourceUtils.h"
+#include "BarrierUtils.h"
 
 VK_DEFINE_HANDLE(VmaAllocator)
 VK_DEFINE_HANDLE(VmaAllocation)
@@ -20,9 +26,7 @@ typedef VkFlags VmaAllocationCreateFlags;
 //   shouldn't be in the class, but can be created by the public interface.
 // - Sync, CmdBuffer operations should be explicit in the main.cpp.
 // TODO1: I may need a standalone pipeline class.
-// TODO2: Dictionary Vma/VkBuffer/VkImage Management -- Need explicit create/destroy; return internal ids; element: id - {alloc, vkBuffer}.
 // TODO3: GPU image format should have more information like currnet GPU image format.
-// TODO4: A queue/vector to collect all image trans barriers so that we can init their formats easiler.
 namespace SharedLib
 {
     // Base Vulkan application without a swapchain -- Basically abstract.
@@ -55,12 +59,52 @@ namespace SharedLib
 
         void SubmitCmdBufToGfxQueue(VkCommandBuffer cmdBuf, VkFence signalFence);
 
+        // Unlike the SubmitCmdBufToGfxQueue(...), it doesn't wait. It returns the upload timeline value of the submit,
+        // which is reached before the cmdBuf or the staging memory can be reused, so the uploads can be in flight while
+        // the graphics queue renders.
+        uint64_t SubmitCmdBufToUploadQueue(VkCommandBuffer cmdBuf);
+
         VmaAllocator* GetVmaAllocator() { return m_pAllocator; }
         VkCommandBuffer GetGfxCmdBuffer(uint32_t i) { return m_gfxCmdBufs[i]; }
         VkDevice GetVkDevice() { return m_device; }
         VkQueue GetGfxQueue() { return m_graphicsQueue; }
         VkDescriptorPool GetDescriptorPool() { return m_descriptorPool; }
         VkCommandPool GetGfxCmdPool() { return m_gfxCmdPool; }
+        uint32_t GetGfxQueueFamilyIdx() { return m_graphicsQueueFamilyIdx; }
+
+        // The upload queue is the graphics queue when the device has no other transfer capable family. The images written
+        // on it have to be released to the GetGfxQueueFamilyIdx() and acquired on the graphics queue, which the
+        // CmdReleaseImgOwnership(...) and CmdAcquireImgOwnership(...) of the CmdBufUtils.h do.
+        VkQueue GetUploadQueue() { return m_uploadQueue; }
+        uint32_t GetUploadQueueFamilyIdx() { return m_uploadQueueFamilyIdx; }
+        VkCommandBuffer GetUploadCmdBuffer(uint32_t i) { return m_uploadCmdBufs[i]; }
+        VkCommandPool GetUploadCmdPool() { return m_uploadCmdPool; }
+        bool HasDedicatedUploadQueue() { return m_uploadQueueFamilyIdx != m_graphicsQueueFamilyIdx; }
+
+        // One timeline semaphore per queue. The upload timeline is the graphics timeline when the upload queue is the
+        // graphics queue, so a queue always has one counter.
+        QueueTimeline& GetGfxTimeline() { return m_gfxTimeline; }
+        QueueTimeline& GetUploadTimeline() { return HasDedicatedUploadQueue() ? m_uploadTimeline : m_gfxTimeline; }
+
+        // The uploads that are queued and flushed together through a staging ring on the upload queue.
+        UploadManager& GetUploadManager() { return m_uploadManager; }
+
+        // The image readbacks on the graphics queue, which complete asynchronously into reused staging buffers.
+        ReadbackManager& GetReadbackManager() { return m_readbackManager; }
+
+        // The buffers, images, views and samplers behind the generational handles. Their releases are deferred until the
+        // graphics timeline retires them.
+        ResourceRegistry& GetResourceRegistry() { return m_resourceRegistry; }
+
+        // The layouts and accesses of the images that are used on the graphics queue, which batches their barriers.
+        ImgStateTracker& GetImgStateTracker() { return m_imgStateTracker; }
+
+        // Overrides the physical device choice. It is called before the AppInit() and takes precedence over the
+        // VULKAN_DICT_DEVICE environment variable. The selector is one of:
+        // - An index of the vkEnumeratePhysicalDevices(...) order, which the InitPhysicalDevice() prints.
+        // - "cpu" for the best CPU implementation, e.g. the lavapipe for the headless runs.
+        // - A case insensitive part of the device name, e.g. "lavapipe" or "RTX".
+        void SetPhysicalDeviceSelector(const std::string& selector) { m_phyDeviceSelector = selector; }
 
     protected:
         // VkInstance, VkPhysicalDevice, VkDevice, gfxFamilyQueueIdx, presentFamilyQueueIdx,
@@ -70,20 +114,39 @@ namespace SharedLib
         void InitInstance(const std::vector<const char*>& instanceExts,
                           const uint32_t                  instanceExtsCnt);
 
-        void InitPhysicalDevice();
+        // Picks the physical device of the selector or the best scored one that can run the app. A device can run it
+        // with the Vulkan 1.3, the dynamic rendering, the multiview, the timeline semaphores, the synchronization2, a
+        // graphics queue, the requiredDeviceExts and IsPresentSupported(...). The score is the device type (discrete,
+        // integrated, virtual, CPU), then the largest device local heap, then the async compute and transfer queue
+        // families.
+        void InitPhysicalDevice(const std::vector<const char*>& requiredDeviceExts = {});
+
+        // The apps with a surface override it, so a device that cannot present to the surface is not picked.
+        virtual bool IsPresentSupported(VkPhysicalDevice /* phyDevice */) { return true; }
 
         void InitGfxQueueFamilyIdx();
+
+        // Called after the InitGfxQueueFamilyIdx(). It prefers a transfer only family, then a compute family without the
+        // graphics, and falls back to the graphics family. A family has to copy at any texel granularity to be picked.
+        // Its index has to be in the CreateDeviceQueueInfos(...) set.
+        void InitUploadQueueFamilyIdx();
         
         void InitDevice(const std::vector<const char*>&             deviceExts,
                         const uint32_t                              deviceExtsCnt,
                         const std::vector<VkDeviceQueueCreateInfo>& queueCreateInfos,
                         void*                                       pNext);
 
-        void InitGraphicsQueue();
+        void InitGraphicsQueue(); // It also creates the graphics queue timeline.
         void InitVmaAllocator();
         void InitDescriptorPool();
         void InitGfxCommandPool();
         void InitGfxCommandBuffers(const uint32_t cmdBufCnt);
+        void InitUploadQueue(); // After the InitGraphicsQueue(). It also creates the upload queue timeline.
+        void InitUploadCommandPool();
+        void InitUploadCommandBuffers(const uint32_t cmdBufCnt);
+        void InitUploadManager(VkDeviceSize ringBytesCnt = DefaultUploadRingBytesCnt); // After the InitUploadCommandPool().
+        void InitReadbackManager(); // After the InitGfxCommandPool().
+        void InitResourceRegistry(); // After the InitVmaAllocator() and the InitGraphicsQueue().
 
         // CreateXXX(...) functions are more flexible. They are utility functions for children classes.
         // CreateXXX(...) cannot initialize any member objects. They have to return objects.
@@ -100,14 +163,27 @@ namespace SharedLib
         VkDescriptorPool m_descriptorPool;
         VkQueue          m_graphicsQueue;
         VkCommandPool    m_gfxCmdPool;
+        unsigned int     m_uploadQueueFamilyIdx;
+        VkQueue          m_uploadQueue;
+        VkCommandPool    m_uploadCmdPool;
         
         VkDebugUtilsMessengerEXT     m_debugMessenger;
         VmaAllocator*                m_pAllocator;
         std::vector<VkCommandBuffer> m_gfxCmdBufs;
+        std::vector<VkCommandBuffer> m_uploadCmdBufs;
 
         std::vector<void*> m_heapMemPtrVec; // Manage heap memory -- Auto delete at the end.
         std::vector<void*> m_heapArrayMemPtrVec;
 
-        std::vector<VkImageMemoryBarrier> m_imgTransBarriers; // A queue to collect all barriers to run at one time to simpliy coding.
+        std::string m_phyDeviceSelector; // Empty to score the devices.
+
+        QueueTimeline m_gfxTimeline;
+        QueueTimeline m_uploadTimeline; // Only created when the HasDedicatedUploadQueue().
+
+        static constexpr VkDeviceSize DefaultUploadRingBytesCnt = 64 * 1024 * 1024;
+        UploadManager m_uploadManager;
+        ReadbackManager m_readbackManager;
+        ResourceRegistry m_resourceRegistry;
+        ImgStateTracker m_imgStateTracker;
     };
 }
\ No newline at end of file
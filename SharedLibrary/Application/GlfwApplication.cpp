@@ -38,7 +38,9 @@ namespace SharedLib
     // ================================================================================================================
     GlfwApplication::~GlfwApplication()
     {
+        // The registry destroys the released swapchain at once, since it has to go before the surface.
         CleanupSwapchain();
+        m_resourceRegistry.Destroy();
 
         // Cleanup syn objects
         for (auto itr : m_imageAvailableSemaphores)
@@ -51,11 +53,6 @@ namespace SharedLib
             vkDestroySemaphore(m_device, itr, nullptr);
         }
 
-        for (auto itr : m_inFlightFences)
-        {
-            vkDestroyFence(m_device, itr, nullptr);
-        }
-
         // Destroy vulkan surface
         vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
 
@@ -97,6 +94,7 @@ namespace SharedLib
     void GlfwApplication::FrameStart()
     {
         glfwPollEvents();
+        m_resourceRegistry.CollectGarbage();
     }
 
     // ================================================================================================================
@@ -131,22 +129,18 @@ namespace SharedLib
     // ================================================================================================================
     void GlfwApplication::GfxCmdBufferFrameSubmitAndPresent()
     {
-        // Submit the filled command buffer to the graphics queue to draw the image
-        VkSubmitInfo submitInfo{};
-        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+        // Submit the filled command buffer to the graphics queue to draw the image. This draw would wait for the image
+        // available semaphore at the color output stage and signal the render finished semaphore for the present. Its
+        // graphics timeline value retires the frame.
+        SemaphoreWait imgAvailableWait{};
         {
-            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            // This draw would wait at dstStage and wait for the waitSemaphores
-            submitInfo.waitSemaphoreCount = 1;
-            submitInfo.pWaitSemaphores = &m_imageAvailableSemaphores[m_currentFrame];
-            submitInfo.pWaitDstStageMask = waitStages;
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &m_gfxCmdBufs[m_currentFrame];
-            // This draw would let the signalSemaphore sign when it finishes
-            submitInfo.signalSemaphoreCount = 1;
-            submitInfo.pSignalSemaphores = &m_renderFinishedSemaphores[m_currentFrame];
+            imgAvailableWait.semaphore = m_imageAvailableSemaphores[m_currentFrame];
+            imgAvailableWait.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
         }
-        VK_CHECK(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_inFlightFences[m_currentFrame]));
+
+        m_inFlightFrameValues[m_currentFrame] = m_gfxTimeline.Submit(m_gfxCmdBufs[m_currentFrame],
+                                                                     { imgAvailableWait },
+                                                                     { m_renderFinishedSemaphores[m_currentFrame] });
 
         // Put the swapchain into the present info and wait for the graphics queue previously before presenting.
         VkPresentInfoKHR presentInfo{};
@@ -193,24 +187,17 @@ namespace SharedLib
         // Create Sync objects
         m_imageAvailableSemaphores.resize(SharedLib::MAX_FRAMES_IN_FLIGHT);
         m_renderFinishedSemaphores.resize(SharedLib::MAX_FRAMES_IN_FLIGHT);
-        m_inFlightFences.resize(SharedLib::MAX_FRAMES_IN_FLIGHT);
+        m_inFlightFrameValues.resize(SharedLib::MAX_FRAMES_IN_FLIGHT, 0);
 
         VkSemaphoreCreateInfo semaphoreInfo{};
         {
             semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
         }
 
-        VkFenceCreateInfo fenceInfo{};
-        {
-            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-            fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-        }
-
         for (size_t i = 0; i < SharedLib::MAX_FRAMES_IN_FLIGHT; i++)
         {
             VK_CHECK(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_imageAvailableSemaphores[i]));
             VK_CHECK(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_renderFinishedSemaphores[i]));
-            VK_CHECK(vkCreateFence(m_device, &fenceInfo, nullptr, &m_inFlightFences[i]));
         }
     }
 
@@ -240,6 +227,24 @@ namespace SharedLib
         assert(foundPresent);
     }
 
+    // ================================================================================================================
+    bool GlfwApplication::IsPresentSupported(
+        VkPhysicalDevice phyDevice)
+    {
+        uint32_t queueFamilyPropCount;
+        vkGetPhysicalDeviceQueueFamilyProperties(phyDevice, &queueFamilyPropCount, nullptr);
+        for (unsigned int i = 0; i < queueFamilyPropCount; ++i)
+        {
+            VkBool32 supportPresentSurface = VK_FALSE;
+            vkGetPhysicalDeviceSurfaceSupportKHR(phyDevice, i, m_surface, &supportPresentSurface);
+            if (supportPresentSurface)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
     // ================================================================================================================
     void GlfwApplication::InitPresentQueue()
     {
@@ -341,6 +346,7 @@ namespace SharedLib
             swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
             swapchainCreateInfo.presentMode = choisenPresentMode;
             swapchainCreateInfo.clipped = VK_TRUE;
+            swapchainCreateInfo.oldSwapchain = m_swapchain; // VK_NULL_HANDLE or the released one on a recreation.
         }
         VK_CHECK(vkCreateSwapchainKHR(m_device, &swapchainCreateInfo, nullptr, &m_swapchain));
 
@@ -376,22 +382,12 @@ namespace SharedLib
             depthImgsInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
         }
 
-        VmaAllocationCreateInfo depthImgsAllocInfo{};
-        {
-            depthImgsAllocInfo.usage = VMA_MEMORY_USAGE_AUTO;
-            depthImgsAllocInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
-        }
-
         m_swapchainDepthImages.resize(swapchainImageCount);
-        m_swapchainDepthImagesAllocs.resize(swapchainImageCount);
         for (uint32_t i = 0; i < swapchainImageCount; i++)
         {
-            vmaCreateImage(*m_pAllocator,
-                &depthImgsInfo,
-                &depthImgsAllocInfo,
-                &m_swapchainDepthImages[i],
-                &m_swapchainDepthImagesAllocs[i],
-                nullptr);
+            m_swapchainDepthImages[i] = m_resourceRegistry.CreateImage(VMA_MEMORY_USAGE_AUTO,
+                                                                       VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
+                                                                       depthImgsInfo);
         }
     }
 
@@ -425,41 +421,43 @@ namespace SharedLib
                 colorImgViewInfo.subresourceRange.baseArrayLayer = 0;
                 colorImgViewInfo.subresourceRange.layerCount = 1;
             }
-            VK_CHECK(vkCreateImageView(m_device, &colorImgViewInfo, nullptr, &m_swapchainColorImageViews[i]));
+            m_swapchainColorImageViews[i] = m_resourceRegistry.CreateImageView(colorImgViewInfo);
 
             // Create the depth images views
             VkImageViewCreateInfo depthImgViewInfo{};
             {
                 depthImgViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-                depthImgViewInfo.image = m_swapchainDepthImages[i];
+                depthImgViewInfo.image = m_resourceRegistry.GetImage(m_swapchainDepthImages[i]);
                 depthImgViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
                 depthImgViewInfo.format = VK_FORMAT_D16_UNORM;
                 depthImgViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
                 depthImgViewInfo.subresourceRange.levelCount = 1;
                 depthImgViewInfo.subresourceRange.layerCount = 1;
             }
-            VK_CHECK(vkCreateImageView(m_device, &depthImgViewInfo, nullptr, &m_swapchainDepthImageViews[i]));
+            m_swapchainDepthImageViews[i] = m_resourceRegistry.CreateImageView(depthImgViewInfo);
         }
     }
 
     // ================================================================================================================
+    // The views, the depth images and the swapchain are released to the registry, so they are destroyed once the frames
+    // that use them retire. The m_swapchain stays valid until then, so the recreation passes it as the oldSwapchain.
     void GlfwApplication::CleanupSwapchain()
     {
-        // Cleanup the swap chain
-        // Clean the image views
-        for (auto imgView : m_swapchainColorImageViews)
+        for (uint32_t i = 0; i < m_swapchainColorImageViews.size(); i++)
         {
-            vkDestroyImageView(m_device, imgView, nullptr);
-        }
+            m_imgStateTracker.UntrackImg(m_swapchainColorImages[i]);
+            m_imgStateTracker.UntrackImg(m_resourceRegistry.GetImage(m_swapchainDepthImages[i]));
 
-        for (uint32_t i = 0; i < m_swapchainDepthImageViews.size(); i++)
-        {
-            vkDestroyImageView(m_device, m_swapchainDepthImageViews[i], nullptr);
-            vmaDestroyImage(*m_pAllocator, m_swapchainDepthImages[i], m_swapchainDepthImagesAllocs[i]);
+            m_resourceRegistry.Release(m_swapchainColorImageViews[i]);
+            m_resourceRegistry.Release(m_swapchainDepthImageViews[i]);
+            m_resourceRegistry.Release(m_swapchainDepthImages[i]);
         }
 
-        // Destroy the swapchain
-        vkDestroySwapchainKHR(m_device, m_swapchain, nullptr);
+        // The presents are not on the graphics timeline. The old swapchain retires with the next frame, which is the
+        // common practice without the VK_EXT_swapchain_maintenance1.
+        VkDevice device = m_device;
+        VkSwapchainKHR swapchain = m_swapchain;
+        m_resourceRegistry.DeferRelease([device, swapchain]() { vkDestroySwapchainKHR(device, swapchain, nullptr); });
     }
 
     // ================================================================================================================
@@ -473,7 +471,7 @@ namespace SharedLib
             glfwWaitEvents();
         }
 
-        vkDeviceWaitIdle(m_device);
+        // No device idle. The frames in flight keep the old resources alive until the graphics timeline retires them.
         CleanupSwapchain();
         InitSwapchain();
     }
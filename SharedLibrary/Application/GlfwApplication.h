@@ -28,22 +28,27 @@ namespace SharedLib
 
         void GfxCmdBufferFrameSubmitAndPresent();
 
-        VkFence GetCurrentFrameFence() { return m_inFlightFences[m_currentFrame]; }
+        // Waits for the graphics timeline value of the last submit of the current frame, so its command buffer and its
+        // per frame resources can be reused.
+        void WaitForCurrentFrame() { m_gfxTimeline.Wait(m_inFlightFrameValues[m_currentFrame]); }
         VkCommandBuffer GetCurrentFrameGfxCmdBuffer() { return m_gfxCmdBufs[m_currentFrame]; }
         uint32_t GetCurrentFrame() { return m_currentFrame; }
         VkImage GetSwapchainColorImage(uint32_t i) { return m_swapchainColorImages[i]; }
-        VkImageView GetSwapchainColorImageView(uint32_t i) { return m_swapchainColorImageViews[i]; }
-        VkImage GetSwapchainDepthImage(uint32_t i) { return m_swapchainDepthImages[i]; }
-        VkImageView GetSwapchainDepthImageView(uint32_t i) { return m_swapchainDepthImageViews[i]; }
+        VkImageView GetSwapchainColorImageView(uint32_t i) { return m_resourceRegistry.GetImageView(m_swapchainColorImageViews[i]); }
+        VkImage GetSwapchainDepthImage(uint32_t i) { return m_resourceRegistry.GetImage(m_swapchainDepthImages[i]); }
+        VkImageView GetSwapchainDepthImageView(uint32_t i) { return m_resourceRegistry.GetImageView(m_swapchainDepthImageViews[i]); }
         VkExtent2D GetSwapchainImageExtent() { return m_swapchainImageExtent; }
 
     protected:
-        void InitSwapchain();
+        void InitSwapchain(); // After the InitResourceRegistry(), which owns the swapchain views and depth images.
         void InitPresentQueueFamilyIdx();
         void InitPresentQueue();
         void InitSwapchainSyncObjects();
         void InitGlfwWindowAndCallbacks();
 
+        // It needs the m_surface, so the InitPhysicalDevice(...) goes after the surface creation.
+        virtual bool IsPresentSupported(VkPhysicalDevice phyDevice) override;
+
         HEvent CreateMiddleMouseEvent(bool isDown);
 
         // The class manages both of the creation and destruction of the objects below.
@@ -57,15 +62,14 @@ namespace SharedLib
         VkExtent2D               m_swapchainImageExtent;
         VkQueue                  m_presentQueue;
 
-        std::vector<VkImageView>   m_swapchainColorImageViews;
-        std::vector<VkImage>       m_swapchainColorImages;
-        std::vector<VkImageView>   m_swapchainDepthImageViews;
-        std::vector<VkImage>       m_swapchainDepthImages;
-        std::vector<VmaAllocation> m_swapchainDepthImagesAllocs;
+        std::vector<ImageViewHandle> m_swapchainColorImageViews;
+        std::vector<VkImage>         m_swapchainColorImages;
+        std::vector<ImageViewHandle> m_swapchainDepthImageViews;
+        std::vector<ImageHandle>     m_swapchainDepthImages;
 
         std::vector<VkSemaphore> m_imageAvailableSemaphores;
         std::vector<VkSemaphore> m_renderFinishedSemaphores;
-        std::vector<VkFence>     m_inFlightFences;
+        std::vector<uint64_t>    m_inFlightFrameValues; // The graphics timeline values of the frames in flight.
 
     private:
         void CreateSwapchainImageViews();
@@ -26,6 +26,8 @@ def SelectProfile(srcFileName):
         return 'vs_6_1'
     elif(srcFileName.find('_frag') != -1):
         return 'ps_6_1'
+    elif(srcFileName.find('_comp') != -1):
+        return 'cs_6_1'
     else:
         sys.exit('Unrecogonized shader type.')
 
@@ -60,7 +62,7 @@ if __name__ == "__main__":
     profile = SelectProfile(srcName)
     dxcCmdStr = SelectDxc()
 
-    subprocess.check_output([
+    dxcArgs = [
         dxcCmdStr,
         '-spirv',
         '-T', profile,
@@ -69,8 +71,13 @@ if __name__ == "__main__":
         '-fspv-extension=SPV_KHR_ray_tracing',
         '-fspv-extension=SPV_KHR_multiview',
         '-fspv-extension=SPV_KHR_shader_draw_parameters',
-        '-fspv-extension=SPV_EXT_descriptor_indexing',
-        args.src,
-        '-Fo', dstPathName
-    ])
+        '-fspv-extension=SPV_EXT_descriptor_indexing'
+    ]
+
+    # Specialization constants in numthreads are emitted as LocalSizeId, which needs SPIR-V 1.6.
+    if profile.startswith('cs_'):
+        dxcArgs.append('-fspv-target-env=vulkan1.3')
+
+    dxcArgs += [args.src, '-Fo', dstPathName]
+    subprocess.check_output(dxcArgs)
     
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef OCTAHEDRAL_HLSL
+#define OCTAHEDRAL_HLSL
+
+// The octahedral environment map of the SharedLib OctahedralUtils.h. The +Y hemisphere is the inner diamond and the -Y
+// hemisphere is folded into the four corners. The directions are the cubemap sampling directions.
+
+// The folding of the lower hemisphere to the corners is its own inverse.
+float2 OctahedralWrap(float2 v)
+{
+    float2 signs = float2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    return (1.0 - abs(v.yx)) * signs;
+}
+
+// Any non-zero direction to the uv in [0, 1]^2.
+float2 DirToOctahedralUv(float3 dir)
+{
+    float3 n = dir / (abs(dir.x) + abs(dir.y) + abs(dir.z));
+    float2 p = n.xz;
+    if (n.y < 0.0)
+    {
+        p = OctahedralWrap(p);
+    }
+    return p * 0.5 + 0.5;
+}
+
+// The uv in [0, 1]^2 to the normalized direction.
+float3 OctahedralUvToDir(float2 uv)
+{
+    float2 p = uv * 2.0 - 1.0;
+    float3 n = float3(p.x, 1.0 - abs(p.x) - abs(p.y), p.y);
+    if (n.y < 0.0)
+    {
+        n.xz = OctahedralWrap(n.xz);
+    }
+    return normalize(n);
+}
+
+#endif
@@ -2,6 +2,7 @@
 #include "../../SharedLibrary/Utils/VulkanDbgUtils.h"
 #include "../../SharedLibrary/Utils/CmdBufUtils.h"
 #include "../../SharedLibrary/Utils/DiskOpsUtils.h"
+#include "../../SharedLibrary/Utils/TraceUtils.h"
 #include <fstream>
 #include <cassert>
 
@@ -637,7 +638,10 @@ namespace SharedLib
 
         // Convert data from 4 elements to 3 elements data
         float* pImgData3Ele = new float[3 * m_inputCubemapExtent.width * m_inputCubemapExtent.height * 6];
-        Img4EleTo3Ele(pImgData, pImgData3Ele, m_inputCubemapExtent.width * m_inputCubemapExtent.height * 6);
+        {
+            ScopedTraceTimer convertTimer("Img4EleTo3Ele");
+            Img4EleTo3Ele(pImgData, pImgData3Ele, m_inputCubemapExtent.width * m_inputCubemapExtent.height * 6);
+        }
 
         SaveImgHdr(outputCubemapPathName, m_inputCubemapExtent.width, m_inputCubemapExtent.height * 6, 3, pImgData3Ele);
 
@@ -659,6 +663,8 @@ namespace SharedLib
         uint32_t                 srcImgChannelByteCnt,
         void*                    pDst)
     {
+        ScopedTraceTimer readbackTimer("CopyImgToRam");
+
         // Copy the rendered images to a buffer.
         VkBuffer stagingBuffer;
         VmaAllocation stagingBufferAlloc;
@@ -668,7 +674,7 @@ namespace SharedLib
         {
             stagingBufAllocInfo.usage = VMA_MEMORY_USAGE_AUTO;
             stagingBufAllocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT |
-                                        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+                                        VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT; // Host cached for the reads.
         }
 
         VkBufferCreateInfo stgBufInfo{};
@@ -706,7 +712,10 @@ namespace SharedLib
 
         SharedLib::SubmitCmdBufferAndWait(device, gfxQueue, cmdBuffer);
 
+        AddTraceBytes(TraceReadbackBytes, bufferBytesCnt);
+
         // Copy the data from buffer out.
+        VK_CHECK(vmaInvalidateAllocation(allocator, stagingBufferAlloc, 0, VK_WHOLE_SIZE));
         void* pBufferMapped;
         vmaMapMemory(allocator, stagingBufferAlloc, &pBufferMapped);
         memcpy(pDst, pBufferMapped, bufferBytesCnt);
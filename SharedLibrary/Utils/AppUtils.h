@@ -8,6 +8,7 @@ namespace SharedLib
 {
     // Assume that each channel is a float.
     // The input image's layout should be VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL.
+    // It blocks on its own submit. The ReadbackManager is for the readbacks that are repeated or batched.
     void CopyImgToRam(VkCommandBuffer          cmdBuffer,
                       VkDevice                 device,
                       VkQueue                  gfxQueue,
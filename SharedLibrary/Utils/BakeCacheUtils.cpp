@@ -0,0 +1,266 @@
+#include "BakeCacheUtils.h"
+#include "MathUtils.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace SharedLib
+{
+    // Bump it when the entry layout changes.
+    static constexpr uint32_t BakeCacheVersion = 1;
+    static constexpr const char* BakeCacheManifestName = "bake.manifest";
+    static constexpr uint64_t BakeCacheHashChunkBytes = 4 * 1024 * 1024;
+
+    // ================================================================================================================
+    static std::string ToHex(
+        uint64_t val,
+        uint32_t digitsCnt)
+    {
+        char buf[17] = {};
+        snprintf(buf, sizeof(buf), "%0*llx", (int)digitsCnt, (unsigned long long)val);
+        return buf;
+    }
+
+    // ================================================================================================================
+    // Hard links are free and fast. They fail across volumes, and then the file is copied.
+    static bool LinkOrCopyFile(
+        const std::filesystem::path& src,
+        const std::filesystem::path& dst)
+    {
+        std::error_code errCode;
+        std::filesystem::create_directories(dst.parent_path(), errCode);
+        std::filesystem::remove(dst, errCode);
+
+        std::filesystem::create_hard_link(src, dst, errCode);
+        if (errCode)
+        {
+            errCode.clear();
+            std::filesystem::copy_file(src, dst, std::filesystem::copy_options::overwrite_existing, errCode);
+        }
+        return !errCode;
+    }
+
+    // ================================================================================================================
+    bool MakeBakeCacheKey(
+        const std::string& inputPathName,
+        const std::string& params,
+        BakeCacheKey&      key)
+    {
+        std::ifstream ifd(inputPathName, std::ios::binary);
+        if (ifd.is_open() == false)
+        {
+            std::cerr << "Cannot open the input to hash: " << inputPathName << std::endl;
+            return false;
+        }
+
+        std::vector<char> chunk(BakeCacheHashChunkBytes);
+        uint32_t crc = 0;
+        uint64_t bytesCnt = 0;
+        while (ifd)
+        {
+            ifd.read(chunk.data(), chunk.size());
+            uint64_t readCnt = (uint64_t)ifd.gcount();
+            crc = Crc32(chunk.data(), readCnt, crc);
+            bytesCnt += readCnt;
+        }
+
+        if (ifd.bad())
+        {
+            std::cerr << "Cannot read the input to hash: " << inputPathName << std::endl;
+            return false;
+        }
+
+        key.inputCrc = crc;
+        key.inputBytesCnt = bytesCnt;
+        key.params = params;
+        return true;
+    }
+
+    // ================================================================================================================
+    std::string GetBakeCacheEntryDir(
+        const std::string&  cacheDir,
+        const BakeCacheKey& key)
+    {
+        uint32_t paramsCrc = Crc32(key.params.data(), key.params.size());
+        return cacheDir + "/" + ToHex(key.inputCrc, 8) + "_" + ToHex(key.inputBytesCnt, 1) + "_" + ToHex(paramsCrc, 8);
+    }
+
+    // ================================================================================================================
+    bool FetchBakeCacheEntry(
+        const std::string&  cacheDir,
+        const BakeCacheKey& key,
+        const std::string&  outputDir)
+    {
+        std::filesystem::path entryDir = GetBakeCacheEntryDir(cacheDir, key);
+
+        std::ifstream manifest(entryDir / BakeCacheManifestName);
+        if (manifest.is_open() == false)
+        {
+            return false;
+        }
+
+        // The header lines have to be exactly what this key would have stored.
+        std::string line;
+        std::getline(manifest, line);
+        if (line != "BakeCache " + std::to_string(BakeCacheVersion))
+        {
+            return false;
+        }
+
+        std::getline(manifest, line);
+        if (line != "params " + key.params)
+        {
+            return false;
+        }
+
+        std::getline(manifest, line);
+        if (line != "input " + ToHex(key.inputCrc, 8) + " " + std::to_string(key.inputBytesCnt))
+        {
+            return false;
+        }
+
+        // file <bytes count> <relative path>
+        std::vector<std::string> files;
+        while (std::getline(manifest, line))
+        {
+            std::istringstream fileLine(line);
+            std::string tag;
+            uint64_t bytesCnt = 0;
+            fileLine >> tag >> bytesCnt;
+            fileLine.get();
+
+            std::string relPathName;
+            std::getline(fileLine, relPathName);
+            if ((tag != "file") || relPathName.empty())
+            {
+                return false;
+            }
+
+            // A file that was rewritten in place through a link doesn't match its size anymore.
+            std::error_code errCode;
+            uint64_t cachedBytesCnt = std::filesystem::file_size(entryDir / relPathName, errCode);
+            if (errCode || (cachedBytesCnt != bytesCnt))
+            {
+                std::cerr << "The bake cache entry is damaged: " << entryDir.string() << std::endl;
+                return false;
+            }
+            files.push_back(relPathName);
+        }
+
+        for (const std::string& relPathName : files)
+        {
+            if (LinkOrCopyFile(entryDir / relPathName, std::filesystem::path(outputDir) / relPathName) == false)
+            {
+                std::cerr << "Cannot fetch " << relPathName << " from the bake cache entry: " << entryDir.string() << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // ================================================================================================================
+    bool StoreBakeCacheEntry(
+        const std::string&              cacheDir,
+        const BakeCacheKey&             key,
+        const std::string&              outputDir,
+        const std::vector<std::string>& files)
+    {
+        std::filesystem::path entryDir = GetBakeCacheEntryDir(cacheDir, key);
+
+        // Unique among the processes and the threads that may store the same entry at the same time.
+        static std::atomic<uint32_t> storeCnt = 0;
+        uint64_t uniqueId = std::hash<std::thread::id>{}(std::this_thread::get_id()) ^
+                            (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count() ^
+                            storeCnt.fetch_add(1);
+        std::filesystem::path tmpEntryDir = entryDir.string() + ".tmp" + ToHex(uniqueId, 16);
+
+        std::error_code errCode;
+        std::filesystem::create_directories(tmpEntryDir, errCode);
+        if (errCode)
+        {
+            std::cerr << "Cannot create the bake cache folder: " << tmpEntryDir.string() << std::endl;
+            return false;
+        }
+
+        auto discardTmpEntry = [&tmpEntryDir]()
+        {
+            std::error_code removeErrCode;
+            std::filesystem::remove_all(tmpEntryDir, removeErrCode);
+        };
+
+        {
+            std::ofstream manifest(tmpEntryDir / BakeCacheManifestName, std::ios::trunc);
+            manifest << "BakeCache " << BakeCacheVersion << "\n";
+            manifest << "params " << key.params << "\n";
+            manifest << "input " << ToHex(key.inputCrc, 8) << " " << key.inputBytesCnt << "\n";
+
+            for (const std::string& relPathName : files)
+            {
+                std::filesystem::path srcPathName = std::filesystem::path(outputDir) / relPathName;
+                uint64_t bytesCnt = std::filesystem::file_size(srcPathName, errCode);
+                if (errCode || (LinkOrCopyFile(srcPathName, tmpEntryDir / relPathName) == false))
+                {
+                    std::cerr << "Cannot store " << srcPathName.string() << " in the bake cache." << std::endl;
+                    manifest.close();
+                    discardTmpEntry();
+                    return false;
+                }
+                manifest << "file " << bytesCnt << " " << relPathName << "\n";
+            }
+
+            if (manifest.good() == false)
+            {
+                std::cerr << "Cannot write the bake cache manifest: " << tmpEntryDir.string() << std::endl;
+                manifest.close();
+                discardTmpEntry();
+                return false;
+            }
+        }
+
+        // A damaged entry that failed to fetch is replaced. It's renamed aside before it's removed, so a concurrent fetch
+        // sees the whole old entry or a miss but never a half removed one. If another run has just stored the same entry,
+        // the rename below fails and its entry is as good as this one.
+        std::filesystem::path oldEntryDir = entryDir.string() + ".old" + ToHex(uniqueId, 16);
+        std::filesystem::rename(entryDir, oldEntryDir, errCode);
+        bool hasOldEntry = (errCode.value() == 0);
+
+        std::filesystem::rename(tmpEntryDir, entryDir, errCode);
+        bool isRenamed = (errCode.value() == 0);
+
+        if (hasOldEntry)
+        {
+            std::filesystem::remove_all(oldEntryDir, errCode);
+        }
+
+        if (isRenamed == false)
+        {
+            discardTmpEntry();
+            if (std::filesystem::exists(entryDir / BakeCacheManifestName) == false)
+            {
+                std::cerr << "Cannot rename the bake cache entry to: " << entryDir.string() << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // ================================================================================================================
+    void UnlinkBakeOutputs(
+        const std::string&              outputDir,
+        const std::vector<std::string>& files)
+    {
+        for (const std::string& relPathName : files)
+        {
+            std::error_code errCode;
+            std::filesystem::remove(std::filesystem::path(outputDir) / relPathName, errCode);
+        }
+    }
+}
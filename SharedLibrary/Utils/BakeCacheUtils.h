@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace SharedLib
+{
+    // A content addressed cache of the tool outputs. An entry is a folder named after the input bytes and the bake
+    // parameters, so an unchanged input with unchanged parameters reuses the outputs instead of baking them again:
+    //     <cacheDir>/<input crc>_<input bytes count>_<params crc>/
+    //         bake.manifest -- The params text, the input and the relative path and size of every output.
+    //         <the outputs, in the same layout as the output folder>
+    // The params text is compared on a hit, so only an input CRC collision with the same size can return a wrong entry.
+    struct BakeCacheKey
+    {
+        uint32_t    inputCrc;
+        uint64_t    inputBytesCnt;
+        std::string params; // The tool, its output version and every parameter that changes the outputs.
+    };
+
+    // Hashes the whole input file. Returns false when it cannot be read.
+    bool MakeBakeCacheKey(const std::string& inputPathName, const std::string& params, BakeCacheKey& key);
+
+    std::string GetBakeCacheEntryDir(const std::string& cacheDir, const BakeCacheKey& key);
+
+    // Hard links the outputs of the entry into the outputDir, or copies them when the two are on different volumes.
+    // Returns false on a miss or on an entry that doesn't match its manifest.
+    bool FetchBakeCacheEntry(const std::string& cacheDir, const BakeCacheKey& key, const std::string& outputDir);
+
+    // Puts the files (relative to the outputDir) into a new entry. The entry is filled in a temporary folder and renamed
+    // in one step, so a reader or a crashed run never leaves a partial entry behind. An existing entry is renamed aside
+    // before it's removed, so a concurrent fetch never reads a half removed one. A failure only costs a bake next
+    // time, so it's reported but not fatal.
+    bool StoreBakeCacheEntry(const std::string& cacheDir, const BakeCacheKey& key, const std::string& outputDir, const std::vector<std::string>& files);
+
+    // The fetched or stored outputs share their data with the cache entry. Unlink them before they are written again, so
+    // a new bake never rewrites a cached file in place.
+    void UnlinkBakeOutputs(const std::string& outputDir, const std::vector<std::string>& files);
+}
@@ -0,0 +1,329 @@
+#include "BarrierUtils.h"
+#include <cstdlib>
+#include <iostream>
+
+namespace SharedLib
+{
+    struct ImgUsageInfo
+    {
+        VkPipelineStageFlags2 stageMask;
+        VkAccessFlags2        accessMask;
+        VkImageLayout         layout;
+        bool                  isWrite;
+    };
+
+    // Only the write bits make the memory available, so they are the ones kept as the source of a later barrier.
+    static constexpr VkAccessFlags2 WriteAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT |
+                                                      VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+                                                      VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+                                                      VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                                                      VK_ACCESS_2_TRANSFER_WRITE_BIT |
+                                                      VK_ACCESS_2_HOST_WRITE_BIT |
+                                                      VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+    // ================================================================================================================
+    // The present waits for the semaphore of the submit, so its barrier has no destination stage or access.
+    static ImgUsageInfo GetImgUsageInfo(
+        ImgUsage usage)
+    {
+        switch (usage)
+        {
+        case ImgUsage::TransferSrc:
+            return { VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                     VK_ACCESS_2_TRANSFER_READ_BIT,
+                     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false };
+        case ImgUsage::TransferDst:
+            return { VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                     VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true };
+        case ImgUsage::ColorAttachment:
+            return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                     VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                     VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true };
+        case ImgUsage::DepthAttachment:
+            return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                     VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                     VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true };
+        case ImgUsage::FragmentShaderRead:
+            return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                     VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+        case ImgUsage::ComputeShaderRead:
+            return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                     VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+        case ImgUsage::ComputeShaderWrite:
+            return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                     VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                     VK_IMAGE_LAYOUT_GENERAL, true };
+        case ImgUsage::Present:
+            return { VK_PIPELINE_STAGE_2_NONE,
+                     VK_ACCESS_2_NONE,
+                     VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, false };
+        }
+
+        std::cerr << "Unknown image usage: " << int(usage) << std::endl;
+        exit(1);
+    }
+
+    // ================================================================================================================
+    static bool IsSameTransition(
+        const VkImageMemoryBarrier2& barrier0,
+        const VkImageMemoryBarrier2& barrier1)
+    {
+        return (barrier0.srcStageMask == barrier1.srcStageMask) &&
+               (barrier0.srcAccessMask == barrier1.srcAccessMask) &&
+               (barrier0.dstStageMask == barrier1.dstStageMask) &&
+               (barrier0.dstAccessMask == barrier1.dstAccessMask) &&
+               (barrier0.oldLayout == barrier1.oldLayout) &&
+               (barrier0.newLayout == barrier1.newLayout);
+    }
+
+    // ================================================================================================================
+    ImgStateTracker::ImgStateTracker() :
+        m_flushIdx(1)
+    {}
+
+    // ================================================================================================================
+    void ImgStateTracker::TrackImg(
+        VkImage               img,
+        VkImageAspectFlags    aspectMask,
+        uint32_t              mipCnt,
+        uint32_t              layerCnt,
+        VkImageLayout         layout,
+        VkPipelineStageFlags2 stageMask,
+        VkAccessFlags2        accessMask)
+    {
+        SubresState subresState{};
+        {
+            subresState.layout = layout;
+            subresState.writeStages = stageMask;
+            subresState.writeAccess = accessMask & WriteAccessMask;
+            subresState.readStages = VK_PIPELINE_STAGE_2_NONE;
+            subresState.readAccess = VK_ACCESS_2_NONE;
+            subresState.flushIdx = 0;
+        }
+
+        TrackedImg trackedImg{};
+        {
+            trackedImg.aspectMask = aspectMask;
+            trackedImg.mipCnt = mipCnt;
+            trackedImg.layerCnt = layerCnt;
+            trackedImg.subresStates.resize(mipCnt * layerCnt, subresState);
+        }
+        m_imgs[img] = std::move(trackedImg);
+    }
+
+    // ================================================================================================================
+    void ImgStateTracker::UntrackImg(
+        VkImage img)
+    {
+        m_imgs.erase(img);
+    }
+
+    // ================================================================================================================
+    void ImgStateTracker::Use(
+        VkImage img,
+        ImgUsage usage)
+    {
+        VkImageSubresourceRange subResRange{};
+        {
+            subResRange.baseMipLevel = 0;
+            subResRange.levelCount = VK_REMAINING_MIP_LEVELS;
+            subResRange.baseArrayLayer = 0;
+            subResRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+        }
+        Use(img, usage, subResRange);
+    }
+
+    // ================================================================================================================
+    // The consecutive layers of a level with the same transition are one barrier, which the AddBarrier(...) merges with
+    // the same layers of the level above.
+    void ImgStateTracker::Use(
+        VkImage                        img,
+        ImgUsage                       usage,
+        const VkImageSubresourceRange& subResRange)
+    {
+        auto itr = m_imgs.find(img);
+        if (itr == m_imgs.end())
+        {
+            std::cerr << "An untracked image is used." << std::endl;
+            exit(1);
+        }
+        TrackedImg& trackedImg = itr->second;
+
+        const ImgUsageInfo usageInfo = GetImgUsageInfo(usage);
+        const uint32_t levelCnt = (subResRange.levelCount == VK_REMAINING_MIP_LEVELS) ?
+                                  trackedImg.mipCnt - subResRange.baseMipLevel : subResRange.levelCount;
+        const uint32_t layerCnt = (subResRange.layerCount == VK_REMAINING_ARRAY_LAYERS) ?
+                                  trackedImg.layerCnt - subResRange.baseArrayLayer : subResRange.layerCount;
+
+        for (uint32_t mip = subResRange.baseMipLevel; mip < subResRange.baseMipLevel + levelCnt; mip++)
+        {
+            VkImageMemoryBarrier2 runBarrier{};
+            bool isInRun = false;
+
+            for (uint32_t layer = subResRange.baseArrayLayer; layer < subResRange.baseArrayLayer + layerCnt; layer++)
+            {
+                SubresState& state = trackedImg.subresStates[mip * trackedImg.layerCnt + layer];
+                const bool isLayoutChange = (state.layout != usageInfo.layout);
+
+                VkImageMemoryBarrier2 barrier{};
+                {
+                    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+                    barrier.dstStageMask = usageInfo.stageMask;
+                    barrier.dstAccessMask = usageInfo.accessMask;
+                    barrier.oldLayout = state.layout;
+                    barrier.newLayout = usageInfo.layout;
+                    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                    barrier.image = img;
+                    barrier.subresourceRange.aspectMask = trackedImg.aspectMask;
+                    barrier.subresourceRange.baseMipLevel = mip;
+                    barrier.subresourceRange.levelCount = 1;
+                    barrier.subresourceRange.baseArrayLayer = layer;
+                    barrier.subresourceRange.layerCount = 1;
+                }
+
+                bool needsBarrier = true;
+                if ((usageInfo.isWrite == false) && (isLayoutChange == false))
+                {
+                    // A read only waits for the last write, and only once per stage.
+                    const bool isVisible = ((usageInfo.stageMask & ~state.readStages) == 0) &&
+                                           ((usageInfo.accessMask & ~state.readAccess) == 0);
+                    needsBarrier = (isVisible == false) && (state.writeStages != VK_PIPELINE_STAGE_2_NONE);
+                    barrier.srcStageMask = state.writeStages;
+                    barrier.srcAccessMask = state.writeAccess;
+                }
+                else if (state.readStages != VK_PIPELINE_STAGE_2_NONE)
+                {
+                    // The reads already wait for the last write, so the write after them only needs their stages.
+                    barrier.srcStageMask = state.readStages;
+                    barrier.srcAccessMask = VK_ACCESS_2_NONE;
+                }
+                else
+                {
+                    barrier.srcStageMask = state.writeStages;
+                    barrier.srcAccessMask = state.writeAccess;
+                }
+
+                if (needsBarrier == false)
+                {
+                    state.readStages |= usageInfo.stageMask;
+                    state.readAccess |= usageInfo.accessMask;
+
+                    if (isInRun)
+                    {
+                        AddBarrier(runBarrier);
+                        isInRun = false;
+                    }
+                    continue;
+                }
+
+                if (state.flushIdx == m_flushIdx)
+                {
+                    std::cerr << "A subresource changes twice between two flushes. Mip: " << mip
+                              << ", layer: " << layer << std::endl;
+                    exit(1);
+                }
+
+                // A layout transition is a write in the destination stages, which the later reads in other stages wait
+                // for.
+                state.layout = usageInfo.layout;
+                state.flushIdx = m_flushIdx;
+                if (usageInfo.isWrite)
+                {
+                    state.writeStages = usageInfo.stageMask;
+                    state.writeAccess = usageInfo.accessMask & WriteAccessMask;
+                    state.readStages = VK_PIPELINE_STAGE_2_NONE;
+                    state.readAccess = VK_ACCESS_2_NONE;
+                }
+                else if (isLayoutChange)
+                {
+                    state.writeStages = usageInfo.stageMask;
+                    state.writeAccess = VK_ACCESS_2_NONE;
+                    state.readStages = usageInfo.stageMask;
+                    state.readAccess = usageInfo.accessMask;
+                }
+                else
+                {
+                    state.readStages |= usageInfo.stageMask;
+                    state.readAccess |= usageInfo.accessMask;
+                }
+
+                if (isInRun && IsSameTransition(runBarrier, barrier))
+                {
+                    runBarrier.subresourceRange.layerCount++;
+                }
+                else
+                {
+                    if (isInRun)
+                    {
+                        AddBarrier(runBarrier);
+                    }
+                    runBarrier = barrier;
+                    isInRun = true;
+                }
+            }
+
+            if (isInRun)
+            {
+                AddBarrier(runBarrier);
+            }
+        }
+    }
+
+    // ================================================================================================================
+    VkImageLayout ImgStateTracker::GetLayout(
+        VkImage  img,
+        uint32_t mipLevel,
+        uint32_t layer) const
+    {
+        const TrackedImg& trackedImg = m_imgs.at(img);
+        return trackedImg.subresStates[mipLevel * trackedImg.layerCnt + layer].layout;
+    }
+
+    // ================================================================================================================
+    void ImgStateTracker::CmdFlush(
+        VkCommandBuffer cmdBuffer)
+    {
+        if (m_pendingBarriers.empty())
+        {
+            return;
+        }
+
+        VkDependencyInfo dependencyInfo{};
+        {
+            dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+            dependencyInfo.imageMemoryBarrierCount = (uint32_t)m_pendingBarriers.size();
+            dependencyInfo.pImageMemoryBarriers = m_pendingBarriers.data();
+        }
+        vkCmdPipelineBarrier2(cmdBuffer, &dependencyInfo);
+
+        m_pendingBarriers.clear();
+        m_flushIdx++;
+    }
+
+    // ================================================================================================================
+    // The barriers of an image are at the back, so the search stops at the first barrier of another image.
+    void ImgStateTracker::AddBarrier(
+        const VkImageMemoryBarrier2& barrier)
+    {
+        for (auto itr = m_pendingBarriers.rbegin();
+             (itr != m_pendingBarriers.rend()) && (itr->image == barrier.image);
+             itr++)
+        {
+            const VkImageSubresourceRange& range = itr->subresourceRange;
+            if (IsSameTransition(*itr, barrier) &&
+                (range.baseArrayLayer == barrier.subresourceRange.baseArrayLayer) &&
+                (range.layerCount == barrier.subresourceRange.layerCount) &&
+                (range.baseMipLevel + range.levelCount == barrier.subresourceRange.baseMipLevel))
+            {
+                itr->subresourceRange.levelCount += barrier.subresourceRange.levelCount;
+                return;
+            }
+        }
+
+        m_pendingBarriers.push_back(barrier);
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace SharedLib
+{
+    // What a command does with an image. A usage is one layout with the precise stages and accesses of the command.
+    enum class ImgUsage
+    {
+        TransferSrc,
+        TransferDst,
+        ColorAttachment,
+        DepthAttachment,
+        FragmentShaderRead,
+        ComputeShaderRead,
+        ComputeShaderWrite, // The storage image in the VK_IMAGE_LAYOUT_GENERAL.
+        Present
+    };
+
+    // The current layout and accesses of each subresource of the tracked images, which turn the uses of the images into
+    // the barriers that they need.
+    // - A Use(...) before a command records what the command does with the subresources. A read after a read in the same
+    //   layout needs no barrier. A write or a layout change waits for the reads since the last write, or for the last
+    //   write when there is no read.
+    // - The barriers of all the Use(...) since the last CmdFlush(...) go to the command buffer in one
+    //   vkCmdPipelineBarrier2(...). The subresources of an image with the same transition are merged into one range.
+    // - The uses between two flushes must not depend on each other, so a subresource cannot change twice between them.
+    // - The states follow the record order, so the command buffers have to be submitted in that order on one queue. The
+    //   Application owns one for the graphics queue. It is not thread safe.
+    class ImgStateTracker
+    {
+    public:
+        ImgStateTracker();
+        ~ImgStateTracker() {};
+
+        // Starts or restarts the tracking of all the subresources. The stageMask and accessMask are the last write in the
+        // layout, e.g. the acquire of an upload, or the stages that the image is ready at, e.g. the wait stage of the
+        // acquire semaphore of a swapchain image.
+        void TrackImg(VkImage               img,
+                      VkImageAspectFlags    aspectMask,
+                      uint32_t              mipCnt,
+                      uint32_t              layerCnt,
+                      VkImageLayout         layout = VK_IMAGE_LAYOUT_UNDEFINED,
+                      VkPipelineStageFlags2 stageMask = VK_PIPELINE_STAGE_2_NONE,
+                      VkAccessFlags2        accessMask = VK_ACCESS_2_NONE);
+
+        void UntrackImg(VkImage img); // Before the image is destroyed, since a new image can get the same handle.
+        bool IsTracked(VkImage img) const { return m_imgs.count(img) != 0; }
+
+        // The aspectMask of the subResRange is ignored, since the aspects of the TrackImg(...) change together.
+        void Use(VkImage img, ImgUsage usage, const VkImageSubresourceRange& subResRange);
+        void Use(VkImage img, ImgUsage usage); // All the subresources.
+
+        VkImageLayout GetLayout(VkImage img, uint32_t mipLevel = 0, uint32_t layer = 0) const;
+
+        // It is a no-op when there is no pending barrier.
+        void CmdFlush(VkCommandBuffer cmdBuffer);
+
+    private:
+        struct SubresState
+        {
+            VkImageLayout         layout;
+            VkPipelineStageFlags2 writeStages; // The last write or layout transition.
+            VkAccessFlags2        writeAccess;
+            VkPipelineStageFlags2 readStages;  // The reads since the last write, which already wait for it.
+            VkAccessFlags2        readAccess;
+            uint64_t              flushIdx;    // The flush of the last barrier.
+        };
+
+        struct TrackedImg
+        {
+            VkImageAspectFlags       aspectMask;
+            uint32_t                 mipCnt;
+            uint32_t                 layerCnt;
+            std::vector<SubresState> subresStates; // [mipLevel * layerCnt + layer].
+        };
+
+        // Merges the barrier into a pending barrier of the same image and transition when the ranges are adjacent.
+        void AddBarrier(const VkImageMemoryBarrier2& barrier);
+
+        std::unordered_map<VkImage, TrackedImg> m_imgs;
+        std::vector<VkImageMemoryBarrier2>      m_pendingBarriers;
+        uint64_t                                m_flushIdx;
+    };
+}
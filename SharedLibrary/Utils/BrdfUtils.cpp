@@ -0,0 +1,120 @@
+#include <cmath>
+#include "BrdfUtils.h"
+#include "MathUtils.h"
+
+namespace SharedLib
+{
+    // ================================================================================================================
+    float RadicalInverseVdC(
+        uint32_t bits)
+    {
+        bits = (bits << 16u) | (bits >> 16u);
+        bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+        bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+        bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+        bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+        return float(bits) * 2.3283064365386963e-10f; // / 0x100000000
+    }
+
+    // ================================================================================================================
+    void Hammersley(
+        uint32_t i,
+        uint32_t n,
+        float*   pXi)
+    {
+        pXi[0] = float(i) / float(n);
+        pXi[1] = RadicalInverseVdC(i);
+    }
+
+    // ================================================================================================================
+    void ImportanceSampleGGXTangent(
+        const float* pXi,
+        float        roughness,
+        float*       pH)
+    {
+        float a = roughness * roughness + 0.001f;
+
+        float phi = 2.f * float(M_PI) * pXi[0];
+        float cosTheta = sqrtf((1.f - pXi[1]) / (1.f + (a * a - 1.f) * pXi[1]));
+        float sinTheta = sqrtf(1.f - cosTheta * cosTheta);
+
+        pH[0] = cosf(phi) * sinTheta;
+        pH[1] = sinf(phi) * sinTheta;
+        pH[2] = cosTheta;
+    }
+
+    // ================================================================================================================
+    void GGXTangentFrame(
+        const float* pN,
+        float*       pTangent,
+        float*       pBitangent)
+    {
+        float up[3] = { 0.f, 0.f, 1.f };
+        if (fabsf(pN[2]) >= 0.999f)
+        {
+            up[0] = 1.f;
+            up[2] = 0.f;
+        }
+
+        float n[3] = { pN[0], pN[1], pN[2] };
+        CrossProductVec3(up, n, pTangent);
+        NormalizeVec(pTangent, 3);
+        CrossProductVec3(n, pTangent, pBitangent);
+    }
+
+    // ================================================================================================================
+    void ImportanceSampleGGX(
+        const float* pXi,
+        const float* pN,
+        float        roughness,
+        float*       pH)
+    {
+        float hTangent[3];
+        ImportanceSampleGGXTangent(pXi, roughness, hTangent);
+
+        float tangent[3];
+        float bitangent[3];
+        GGXTangentFrame(pN, tangent, bitangent);
+
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            pH[i] = tangent[i] * hTangent[0] + bitangent[i] * hTangent[1] + pN[i] * hTangent[2];
+        }
+        NormalizeVec(pH, 3);
+    }
+
+    // ================================================================================================================
+    float GeometrySchlickGGX(
+        float NdotV,
+        float roughness)
+    {
+        float a = roughness;
+        float k = (a * a) / 2.f;
+
+        float nom = NdotV;
+        float denom = NdotV * (1.f - k) + k;
+
+        return nom / denom;
+    }
+
+    // ================================================================================================================
+    float GeometrySmith(
+        float NdotV,
+        float NdotL,
+        float roughness)
+    {
+        return GeometrySchlickGGX(NdotL, roughness) * GeometrySchlickGGX(NdotV, roughness);
+    }
+
+    // ================================================================================================================
+    float DistributionGGX(
+        float NdotH,
+        float roughness)
+    {
+        float a = roughness * roughness + 0.001f;
+        float a2 = a * a;
+        float denom = NdotH * NdotH * (a2 - 1.f) + 1.f;
+
+        return a2 / (float(M_PI) * denom * denom);
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+
+// Host versions of the SharedLibrary/HLSL/hammersley.hlsl and GGXModel.hlsl. They follow the shader math line by line,
+// so the host generated data can be compared against the shader generated data directly.
+namespace SharedLib
+{
+    float RadicalInverseVdC(uint32_t bits);
+    void Hammersley(uint32_t i, uint32_t n, float* pXi);
+
+    // The GGX half vector in the tangent space, where the normal is +Z.
+    void ImportanceSampleGGXTangent(const float* pXi, float roughness, float* pH);
+
+    // The tangent space basis that the ImportanceSampleGGX(...) uses for the normal pN.
+    void GGXTangentFrame(const float* pN, float* pTangent, float* pBitangent);
+
+    // The GGX half vector in the world space. The result is normalized.
+    void ImportanceSampleGGX(const float* pXi, const float* pN, float roughness, float* pH);
+
+    float GeometrySchlickGGX(float NdotV, float roughness);
+    float GeometrySmith(float NdotV, float NdotL, float roughness);
+
+    // The GGX NDF with the same 'a' as the ImportanceSampleGGX(...). It's the one in the prefilterSampling.hlsl.
+    float DistributionGGX(float NdotH, float roughness);
+}
@@ -1,34 +1,39 @@
 #include "CmdBufUtils.h"
 #include "VulkanDbgUtils.h"
+#include "TraceUtils.h"
+#include <algorithm>
 
 namespace SharedLib
 {
     // ================================================================================================================
-    // The staging buffer has to be freed after the copy finishes, so this func has to control a fence.
-    // Transfer the dstImg to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL.
-    void SendImgDataToGpu(
-        VkCommandBuffer         cmdBuffer,
-        VkDevice                device,
-        VkQueue                 gfxQueue,
-        void*                   pData,
-        uint32_t                bytesCnt,
-        VkImage                 dstImg,
-        VkImageSubresourceRange subResRange,
-        VkImageLayout           dstImgCurrentLayout,
-        VkBufferImageCopy       bufToImgCopyInfo,
-        VmaAllocator            allocator)
+    // Each ring slot owns a mapped staging buffer, a command buffer and a fence. The fences are created signaled, so a
+    // slot is free when its fence is signaled. The first band transfers the level to the TRANSFER_DST and the last band
+    // transfers it to the final layout, so all the bands are in the queue order between them. The last band's barrier is
+    // also the ownership release when the queue families differ.
+    bool StreamRowsToImg(
+        VkDevice                                              device,
+        VkQueue                                               gfxQueue,
+        VkCommandPool                                         cmdPool,
+        VmaAllocator                                          allocator,
+        VkImage                                               dstImg,
+        uint32_t                                              mipLevel,
+        uint32_t                                              layerCnt,
+        VkExtent2D                                            extent,
+        uint32_t                                              texelBytes,
+        VkImageLayout                                         dstImgCurrentLayout,
+        VkImageLayout                                         dstImgFinalLayout,
+        uint64_t                                              stagingBudgetBytes,
+        const std::function<bool(uint32_t, uint32_t, void*)>& fillRows,
+        uint32_t                                              srcQueueFamilyIdx,
+        uint32_t                                              dstQueueFamilyIdx)
     {
-        // Create the staging buffer resources
-        VkBuffer stagingBuffer;
-        VmaAllocation stagingBufAlloc;
-        VkFence stagingFence;
+        constexpr uint32_t MaxSlotCnt = 3;
 
-        VkFenceCreateInfo fenceInfo{};
-        {
-            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-            fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-        }
-        VK_CHECK(vkCreateFence(device, &fenceInfo, nullptr, &stagingFence));
+        const uint64_t rowBytesCnt = uint64_t(extent.width) * texelBytes;
+        const uint32_t rowCnt = layerCnt * extent.height;
+        const uint32_t rowsPerSlot = (uint32_t)std::min<uint64_t>(std::max<uint64_t>(stagingBudgetBytes / MaxSlotCnt / rowBytesCnt, 1), rowCnt);
+        const uint32_t bandCnt = (rowCnt + rowsPerSlot - 1) / rowsPerSlot;
+        const uint32_t slotCnt = std::min(bandCnt, MaxSlotCnt);
 
         VmaAllocationCreateInfo stagingBufAllocInfo{};
         {
@@ -41,73 +46,257 @@ namespace SharedLib
             stgBufInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
             stgBufInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
             stgBufInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-            stgBufInfo.size = bytesCnt;
+            stgBufInfo.size = rowBytesCnt * rowsPerSlot;
+        }
+
+        VkCommandBufferAllocateInfo cmdBufAllocInfo{};
+        {
+            cmdBufAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            cmdBufAllocInfo.commandPool = cmdPool;
+            cmdBufAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            cmdBufAllocInfo.commandBufferCount = slotCnt;
         }
 
-        VK_CHECK(vmaCreateBuffer(allocator, &stgBufInfo, &stagingBufAllocInfo, &stagingBuffer, &stagingBufAlloc, nullptr));
+        VkFenceCreateInfo fenceInfo{};
+        {
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        }
 
-        // Send data to staging Buffer
-        void* pStgData;
-        vmaMapMemory(allocator, stagingBufAlloc, &pStgData);
-        memcpy(pStgData, pData, bytesCnt);
-        vmaUnmapMemory(allocator, stagingBufAlloc);
+        VkBuffer          stagingBuffers[MaxSlotCnt];
+        VmaAllocation     stagingBufAllocs[MaxSlotCnt];
+        VmaAllocationInfo stagingBufInfos[MaxSlotCnt];
+        VkCommandBuffer   cmdBuffers[MaxSlotCnt];
+        VkFence           fences[MaxSlotCnt];
 
-        /* Send staging buffer data to the GPU image. */
-        VkCommandBufferBeginInfo beginInfo{};
+        VK_CHECK(vkAllocateCommandBuffers(device, &cmdBufAllocInfo, cmdBuffers));
+        for (uint32_t slot = 0; slot < slotCnt; slot++)
         {
-            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            VK_CHECK(vmaCreateBuffer(allocator, &stgBufInfo, &stagingBufAllocInfo, &stagingBuffers[slot], &stagingBufAllocs[slot], &stagingBufInfos[slot]));
+            VK_CHECK(vkCreateFence(device, &fenceInfo, nullptr, &fences[slot]));
         }
-        VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
 
-        // Transform the layout of the image to copy source
-        VkImageMemoryBarrier undefToDstBarrier{};
+        VkImageMemoryBarrier levelBarrier{};
         {
-            undefToDstBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            undefToDstBarrier.image = dstImg;
-            undefToDstBarrier.subresourceRange = subResRange;
-            undefToDstBarrier.srcAccessMask = 0;
-            undefToDstBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            undefToDstBarrier.oldLayout = dstImgCurrentLayout;
-            undefToDstBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            levelBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            levelBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            levelBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            levelBarrier.image = dstImg;
+            levelBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            levelBarrier.subresourceRange.baseMipLevel = mipLevel;
+            levelBarrier.subresourceRange.levelCount = 1;
+            levelBarrier.subresourceRange.baseArrayLayer = 0;
+            levelBarrier.subresourceRange.layerCount = layerCnt;
+        }
+
+        bool isDone = true;
+        for (uint32_t band = 0; band < bandCnt; band++)
+        {
+            const uint32_t slot = band % slotCnt;
+            const uint32_t rowBegin = band * rowsPerSlot;
+            const uint32_t bandRowCnt = std::min(rowsPerSlot, rowCnt - rowBegin);
+
+            // The previous copy from this slot has to retire before its staging memory is overwritten.
+            vkWaitForFences(device, 1, &fences[slot], VK_TRUE, UINT64_MAX);
+
+            if (fillRows(rowBegin, bandRowCnt, stagingBufInfos[slot].pMappedData) == false)
+            {
+                isDone = false;
+                break;
+            }
+            vmaFlushAllocation(allocator, stagingBufAllocs[slot], 0, VK_WHOLE_SIZE);
+            AddTraceBytes(TraceUploadBytes, bandRowCnt * rowBytesCnt);
+
+            VK_CHECK(vkResetFences(device, 1, &fences[slot]));
+            VK_CHECK(vkResetCommandBuffer(cmdBuffers[slot], 0));
+
+            VkCommandBufferBeginInfo beginInfo{};
+            {
+                beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            }
+            VK_CHECK(vkBeginCommandBuffer(cmdBuffers[slot], &beginInfo));
+
+            if (band == 0)
+            {
+                levelBarrier.srcAccessMask = 0;
+                levelBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                levelBarrier.oldLayout = dstImgCurrentLayout;
+                levelBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+
+                vkCmdPipelineBarrier(cmdBuffers[slot],
+                                     VK_PIPELINE_STAGE_HOST_BIT,
+                                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                     0,
+                                     0, nullptr,
+                                     0, nullptr,
+                                     1, &levelBarrier);
+            }
+
+            // A band can span several layers, so it is one copy region per layer that it touches.
+            std::vector<VkBufferImageCopy> bandCopies;
+            uint32_t row = rowBegin;
+            while (row < rowBegin + bandRowCnt)
+            {
+                const uint32_t layer = row / extent.height;
+                const uint32_t rowInLayer = row % extent.height;
+                const uint32_t copyRowCnt = std::min(extent.height - rowInLayer, rowBegin + bandRowCnt - row);
+
+                VkBufferImageCopy bandCopy{};
+                {
+                    bandCopy.bufferOffset = (row - rowBegin) * rowBytesCnt;
+                    bandCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                    bandCopy.imageSubresource.mipLevel = mipLevel;
+                    bandCopy.imageSubresource.baseArrayLayer = layer;
+                    bandCopy.imageSubresource.layerCount = 1;
+                    bandCopy.imageOffset = { 0, (int32_t)rowInLayer, 0 };
+                    bandCopy.imageExtent = { extent.width, copyRowCnt, 1 };
+                }
+                bandCopies.push_back(bandCopy);
+                row += copyRowCnt;
+            }
+
+            vkCmdCopyBufferToImage(cmdBuffers[slot],
+                                   stagingBuffers[slot],
+                                   dstImg,
+                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                   (uint32_t)bandCopies.size(),
+                                   bandCopies.data());
+
+            const bool isOwnershipReleased = (srcQueueFamilyIdx != VK_QUEUE_FAMILY_IGNORED) &&
+                                             (dstQueueFamilyIdx != VK_QUEUE_FAMILY_IGNORED) &&
+                                             (srcQueueFamilyIdx != dstQueueFamilyIdx);
+            if ((band == bandCnt - 1) && isOwnershipReleased)
+            {
+                CmdReleaseImgOwnership(cmdBuffers[slot],
+                                       dstImg,
+                                       levelBarrier.subresourceRange,
+                                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                       dstImgFinalLayout,
+                                       srcQueueFamilyIdx,
+                                       dstQueueFamilyIdx);
+            }
+            else if ((band == bandCnt - 1) && (dstImgFinalLayout != VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL))
+            {
+                levelBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                levelBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+                levelBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                levelBarrier.newLayout = dstImgFinalLayout;
+
+                vkCmdPipelineBarrier(cmdBuffers[slot],
+                                     VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                     VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                                     0,
+                                     0, nullptr,
+                                     0, nullptr,
+                                     1, &levelBarrier);
+            }
+
+            VK_CHECK(vkEndCommandBuffer(cmdBuffers[slot]));
+
+            VkSubmitInfo submitInfo{};
+            {
+                submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+                submitInfo.commandBufferCount = 1;
+                submitInfo.pCommandBuffers = &cmdBuffers[slot];
+            }
+            VK_CHECK(vkQueueSubmit(gfxQueue, 1, &submitInfo, fences[slot]));
+        }
+
+        // An aborted upload still has to wait for the bands in flight before their staging buffers are freed.
+        vkWaitForFences(device, slotCnt, fences, VK_TRUE, UINT64_MAX);
+        for (uint32_t slot = 0; slot < slotCnt; slot++)
+        {
+            vkDestroyFence(device, fences[slot], nullptr);
+            vmaDestroyBuffer(allocator, stagingBuffers[slot], stagingBufAllocs[slot]);
+        }
+        vkFreeCommandBuffers(device, cmdPool, slotCnt, cmdBuffers);
+
+        return isDone;
+    }
+
+    // ================================================================================================================
+    // The release only makes the transfer writes available, so its dstStageMask is the BOTTOM_OF_PIPE and its dstAccessMask
+    // is 0. The acquire is the other way round.
+    void CmdReleaseImgOwnership(
+        VkCommandBuffer         cmdBuffer,
+        VkImage                 img,
+        VkImageSubresourceRange subResRange,
+        VkImageLayout           oldLayout,
+        VkImageLayout           newLayout,
+        uint32_t                srcQueueFamilyIdx,
+        uint32_t                dstQueueFamilyIdx)
+    {
+        if ((srcQueueFamilyIdx == dstQueueFamilyIdx) ||
+            (srcQueueFamilyIdx == VK_QUEUE_FAMILY_IGNORED) ||
+            (dstQueueFamilyIdx == VK_QUEUE_FAMILY_IGNORED))
+        {
+            return;
+        }
+
+        VkImageMemoryBarrier releaseBarrier{};
+        {
+            releaseBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            releaseBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            releaseBarrier.dstAccessMask = 0;
+            releaseBarrier.oldLayout = oldLayout;
+            releaseBarrier.newLayout = newLayout;
+            releaseBarrier.srcQueueFamilyIndex = srcQueueFamilyIdx;
+            releaseBarrier.dstQueueFamilyIndex = dstQueueFamilyIdx;
+            releaseBarrier.image = img;
+            releaseBarrier.subresourceRange = subResRange;
         }
 
         vkCmdPipelineBarrier(
             cmdBuffer,
-            VK_PIPELINE_STAGE_HOST_BIT,
             VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
             0,
             0, nullptr,
             0, nullptr,
-            1, &undefToDstBarrier);
-
-        // Copy the data from buffer to the image
-        vkCmdCopyBufferToImage(
-            cmdBuffer,
-            stagingBuffer,
-            dstImg,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1, &bufToImgCopyInfo);
-
-        // End the command buffer and submit the packets
-        vkEndCommandBuffer(cmdBuffer);
+            1, &releaseBarrier);
+    }
 
-        // Submit the filled command buffer to the graphics queue to draw the image
-        VkSubmitInfo submitInfo{};
+    // ================================================================================================================
+    void CmdAcquireImgOwnership(
+        VkCommandBuffer         cmdBuffer,
+        VkImage                 img,
+        VkImageSubresourceRange subResRange,
+        VkImageLayout           oldLayout,
+        VkImageLayout           newLayout,
+        uint32_t                srcQueueFamilyIdx,
+        uint32_t                dstQueueFamilyIdx,
+        VkPipelineStageFlags    dstStageMask,
+        VkAccessFlags           dstAccessMask)
+    {
+        if ((srcQueueFamilyIdx == dstQueueFamilyIdx) ||
+            (srcQueueFamilyIdx == VK_QUEUE_FAMILY_IGNORED) ||
+            (dstQueueFamilyIdx == VK_QUEUE_FAMILY_IGNORED))
         {
-            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &cmdBuffer;
+            return;
         }
-        vkResetFences(device, 1, &stagingFence);
-        VK_CHECK(vkQueueSubmit(gfxQueue, 1, &submitInfo, stagingFence));
 
-        // Wait for the end of all transformation and reset the command buffer. The fence would be waited in the first loop.
-        vkWaitForFences(device, 1, &stagingFence, VK_TRUE, UINT64_MAX);
-        vkResetCommandBuffer(cmdBuffer, 0);
+        VkImageMemoryBarrier acquireBarrier{};
+        {
+            acquireBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            acquireBarrier.srcAccessMask = 0;
+            acquireBarrier.dstAccessMask = dstAccessMask;
+            acquireBarrier.oldLayout = oldLayout;
+            acquireBarrier.newLayout = newLayout;
+            acquireBarrier.srcQueueFamilyIndex = srcQueueFamilyIdx;
+            acquireBarrier.dstQueueFamilyIndex = dstQueueFamilyIdx;
+            acquireBarrier.image = img;
+            acquireBarrier.subresourceRange = subResRange;
+        }
 
-        // Destroy temp resources
-        vmaDestroyBuffer(allocator, stagingBuffer, stagingBufAlloc);
-        vkDestroyFence(device, stagingFence, nullptr);
+        vkCmdPipelineBarrier(
+            cmdBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            dstStageMask,
+            0,
+            0, nullptr,
+            0, nullptr,
+            1, &acquireBarrier);
     }
 
     // ================================================================================================================
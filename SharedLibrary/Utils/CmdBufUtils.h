@@ -1,20 +1,63 @@
 #pragma once
 #include <vulkan/vulkan.h>
 #include "../VMA/vk_mem_alloc.h"
+#include <vector>
+#include <functional>
 
 namespace SharedLib
 {
     // Function names should start with 'Cmd' so their names should be 'CmdXxxx'.
     // Maybe we should only change the layouts at the beginning of CmdXxxx functions.
-    void SendImgDataToGpu(VkCommandBuffer cmdBuffer,
-                             VkDevice device,
-                             VkQueue gfxQueue,
-                             void* pData, uint32_t bytesCnt,
-                             VkImage dstImg,
-                             VkImageSubresourceRange subResRange,
-                             VkImageLayout           dstImgCurrentLayout,
-                             VkBufferImageCopy bufToImgCopyInfo,
-                             VmaAllocator allocator);
+
+    // Streams the rows of one mip level of the dstImg through a bounded ring of staging buffers, so an image of any size
+    // is uploaded with at most stagingBudgetBytes of staging memory. The level is seen as layerCnt x extent.height rows
+    // with the layers one after another, e.g. the 6 faces of a vStrip cubemap level.
+    // - fillRows(rowBegin, rowCnt, pDst) writes the rowCnt tightly packed rows to the mapped staging memory, so a decoder
+    //   can write into it directly. Returning false aborts the upload.
+    // - A band is copied on the GPU while the next bands are being filled. A ring slot is reused after its copy retires.
+    // Transfer the level from the dstImgCurrentLayout to the dstImgFinalLayout. Returns false when the upload is aborted.
+    // When the srcQueueFamilyIdx, which is the family of the gfxQueue argument, differs from the dstQueueFamilyIdx, the
+    // dstImg is released to the dstQueueFamilyIdx at the end and the user has to record the CmdAcquireImgOwnership(...)
+    // before its first use on that family. The other uploads go through the UploadManager (UploadUtils.h).
+    bool StreamRowsToImg(VkDevice                                                device,
+                         VkQueue                                                 gfxQueue,
+                         VkCommandPool                                           cmdPool,
+                         VmaAllocator                                            allocator,
+                         VkImage                                                 dstImg,
+                         uint32_t                                                mipLevel,
+                         uint32_t                                                layerCnt,
+                         VkExtent2D                                              extent,
+                         uint32_t                                                texelBytes,
+                         VkImageLayout                                           dstImgCurrentLayout,
+                         VkImageLayout                                           dstImgFinalLayout,
+                         uint64_t                                                stagingBudgetBytes,
+                         const std::function<bool(uint32_t, uint32_t, void*)>&   fillRows,
+                         uint32_t                                                srcQueueFamilyIdx = VK_QUEUE_FAMILY_IGNORED,
+                         uint32_t                                                dstQueueFamilyIdx = VK_QUEUE_FAMILY_IGNORED);
+
+    // The two halves of a queue family ownership transfer of an EXCLUSIVE image. The release is recorded on a queue of
+    // the srcQueueFamilyIdx after the last transfer write and the acquire is recorded on a queue of the dstQueueFamilyIdx
+    // before the first use. Both have to use the same subResRange and layouts, and the acquire submission has to wait for
+    // the release submission, e.g. with a semaphore or a fence wait on the host. The UploadManager releases with the
+    // TRANSFER_DST as both layouts and the StreamRowsToImg(...) releases from the TRANSFER_DST to its dstImgFinalLayout.
+    // Both are no-ops when the families are the same or either of them is VK_QUEUE_FAMILY_IGNORED.
+    void CmdReleaseImgOwnership(VkCommandBuffer         cmdBuffer,
+                                VkImage                 img,
+                                VkImageSubresourceRange subResRange,
+                                VkImageLayout           oldLayout,
+                                VkImageLayout           newLayout,
+                                uint32_t                srcQueueFamilyIdx,
+                                uint32_t                dstQueueFamilyIdx);
+
+    void CmdAcquireImgOwnership(VkCommandBuffer         cmdBuffer,
+                                VkImage                 img,
+                                VkImageSubresourceRange subResRange,
+                                VkImageLayout           oldLayout,
+                                VkImageLayout           newLayout,
+                                uint32_t                srcQueueFamilyIdx,
+                                uint32_t                dstQueueFamilyIdx,
+                                VkPipelineStageFlags    dstStageMask,
+                                VkAccessFlags           dstAccessMask);
 
     // The output color is always a 3 channels -- RGB.
     // The input image is always 4 channels -- RGBA.
@@ -1,6 +1,8 @@
 #include "DiskOpsUtils.h"
+#include "TraceUtils.h"
 #include <iostream>
 #include <fstream>
+#include <filesystem>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -18,25 +20,48 @@ namespace SharedLib
         int& width,
         int& height)
     {
+        ScopedTraceTimer readTimer("ReadImg", "disk");
+        if (IsTraceOn())
+        {
+            std::error_code errCode;
+            uint64_t fileBytesCnt = std::filesystem::file_size(namePath, errCode);
+            AddTraceBytes(TraceDiskReadBytes, errCode ? 0 : fileBytesCnt);
+        }
         return stbi_loadf(namePath.c_str(), &width, &height, &components, 0);
     }
 
     // ================================================================================================================
-    void SaveImgHdr(
+    void ReleaseImg(
+        float* pData)
+    {
+        stbi_image_free(pData);
+    }
+
+    // ================================================================================================================
+    bool SaveImgHdr(
         const std::string& namePath,
         uint32_t width,
         uint32_t height,
         uint32_t components,
         float* pData)
     {
+        ScopedTraceTimer writeTimer("SaveImgHdr", "disk");
         int res = stbi_write_hdr(namePath.c_str(), width, height, components, pData);
         if (res > 0)
         {
+            if (IsTraceOn())
+            {
+                std::error_code errCode;
+                uint64_t fileBytesCnt = std::filesystem::file_size(namePath, errCode);
+                AddTraceBytes(TraceDiskWriteBytes, errCode ? 0 : fileBytesCnt);
+            }
             std::cout << namePath << ": saves successfully." << std::endl;
+            return true;
         }
         else
         {
             std::cout << "Img fails to save." << std::endl;
+            return false;
         }
     }
 
@@ -78,4 +103,77 @@ namespace SharedLib
         oData.resize(size); // << resize not reserve
         ifd.read(oData.data(), size);
     }
-}
\ No newline at end of file
+
+    // ================================================================================================================
+    uint32_t EnvBrdfLutTexelBytes(
+        EnvBrdfLutFormat format)
+    {
+        return format == EnvBrdfLutFormat::RG16F ? 2 * sizeof(uint16_t) : 2 * sizeof(float);
+    }
+
+    // ================================================================================================================
+    bool SaveEnvBrdfLut(
+        const std::string&      namePath,
+        const EnvBrdfLutHeader& header,
+        const void*             pTexels)
+    {
+        uint64_t texelsBytesCnt = uint64_t(header.width) * header.height * EnvBrdfLutTexelBytes(header.format);
+
+        std::string tmpNamePath = namePath + ".tmp";
+        {
+            std::ofstream ofd(tmpNamePath, std::ios::binary | std::ios::trunc);
+            if (ofd.is_open() == false)
+            {
+                std::cerr << "Cannot open the env brdf LUT file: " << tmpNamePath << std::endl;
+                return false;
+            }
+
+            ofd.write(reinterpret_cast<const char*>(&header), sizeof(EnvBrdfLutHeader));
+            ofd.write(static_cast<const char*>(pTexels), texelsBytesCnt);
+            if (ofd.good() == false)
+            {
+                std::cerr << "Cannot write the env brdf LUT file: " << tmpNamePath << std::endl;
+                return false;
+            }
+        }
+
+        std::error_code errCode;
+        std::filesystem::rename(tmpNamePath, namePath, errCode);
+        if (errCode)
+        {
+            std::cerr << "Cannot rename the env brdf LUT file to: " << namePath << std::endl;
+            std::filesystem::remove(tmpNamePath, errCode);
+            return false;
+        }
+
+        std::cout << namePath << ": saves successfully." << std::endl;
+        return true;
+    }
+
+    // ================================================================================================================
+    bool ReadEnvBrdfLut(
+        const std::string& namePath,
+        EnvBrdfLutHeader&  header,
+        std::vector<char>& texels)
+    {
+        std::ifstream ifd(namePath, std::ios::binary);
+        if (ifd.is_open() == false)
+        {
+            return false;
+        }
+
+        ifd.read(reinterpret_cast<char*>(&header), sizeof(EnvBrdfLutHeader));
+        if ((ifd.gcount() != sizeof(EnvBrdfLutHeader)) ||
+            (header.magic != EnvBrdfLutMagic) ||
+            (header.format != EnvBrdfLutFormat::RG16F && header.format != EnvBrdfLutFormat::RG32F))
+        {
+            return false;
+        }
+
+        uint64_t texelsBytesCnt = uint64_t(header.width) * header.height * EnvBrdfLutTexelBytes(header.format);
+        texels.resize(texelsBytesCnt);
+        ifd.read(texels.data(), texelsBytesCnt);
+
+        return uint64_t(ifd.gcount()) == texelsBytesCnt;
+    }
+}
@@ -5,10 +5,40 @@
 namespace SharedLib
 {
     float* ReadImg(const std::string& namePath, int& components, int& width, int& height);
-    void SaveImgHdr(const std::string& namePath, uint32_t width, uint32_t height, uint32_t components, float* pData);
+    void ReleaseImg(float* pData); // Frees the data returned by ReadImg(...).
+    bool SaveImgHdr(const std::string& namePath, uint32_t width, uint32_t height, uint32_t components, float* pData);
     void SaveImgPng(const std::string& namePath, uint32_t width, uint32_t height, uint32_t components, void* pData, uint32_t strideInByte);
     void ReadBinaryFile(const std::string& namePath, std::vector<char>& oData);
 
+    // The two channel environment BRDF LUT (the scale and the bias of the F0). The file is an EnvBrdfLutHeader followed
+    // by width x height tightly packed RG texels. The rows go with the roughness and the columns go with the NdotV, which
+    // is the (NdotV, roughness) uv of the sampling. It maps 1:1 to a VK_FORMAT_R16G16_SFLOAT/R32G32_SFLOAT upload.
+    enum class EnvBrdfLutFormat : uint32_t
+    {
+        RG16F = 0,
+        RG32F = 1
+    };
+
+    constexpr uint32_t EnvBrdfLutMagic = 0x4C524245; // 'EBRL'
+
+    struct EnvBrdfLutHeader
+    {
+        uint32_t         magic;
+        uint32_t         version;     // The generator version. A different one means a different LUT.
+        uint32_t         width;
+        uint32_t         height;
+        uint32_t         sampleCount; // GGX samples per texel.
+        EnvBrdfLutFormat format;
+    };
+
+    uint32_t EnvBrdfLutTexelBytes(EnvBrdfLutFormat format);
+
+    // Writes to a temporary file first and renames it, so a reader never sees a partial LUT.
+    bool SaveEnvBrdfLut(const std::string& namePath, const EnvBrdfLutHeader& header, const void* pTexels);
+
+    // Returns false when the file is missing, is not a LUT or is truncated.
+    bool ReadEnvBrdfLut(const std::string& namePath, EnvBrdfLutHeader& header, std::vector<char>& texels);
+
     // TODO: An interface to read obj/gltf.
     static void ReadModel() {};
 }
\ No newline at end of file
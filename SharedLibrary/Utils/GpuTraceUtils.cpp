@@ -0,0 +1,146 @@
+#include "GpuTraceUtils.h"
+#include "TraceUtils.h"
+#include "VulkanDbgUtils.h"
+#include <algorithm>
+
+namespace SharedLib
+{
+    // ================================================================================================================
+    GpuTraceTimer::GpuTraceTimer() :
+        m_device(VK_NULL_HANDLE),
+        m_queryPool(VK_NULL_HANDLE),
+        m_timestampPeriod(1.f),
+        m_timestampMask(0)
+    {}
+
+    // ================================================================================================================
+    void GpuTraceTimer::Init(
+        VkPhysicalDevice physicalDevice,
+        VkDevice         device,
+        uint32_t         queueFamilyIdx)
+    {
+        if (IsTraceOn() == false)
+        {
+            return;
+        }
+
+        uint32_t queueFamilyCnt = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCnt, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCnt);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCnt, queueFamilies.data());
+
+        uint32_t validBits = (queueFamilyIdx < queueFamilyCnt) ? queueFamilies[queueFamilyIdx].timestampValidBits : 0;
+        if (validBits == 0)
+        {
+            std::cerr << "The queue family has no timestamps. The trace has no GPU passes." << std::endl;
+            return;
+        }
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        m_device = device;
+        m_timestampPeriod = properties.limits.timestampPeriod;
+        m_timestampMask = (validBits >= 64) ? ~uint64_t(0) : ((uint64_t(1) << validBits) - 1);
+
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        {
+            queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            queryPoolInfo.queryCount = 2 * MaxPassCnt;
+        }
+        VK_CHECK(vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &m_queryPool));
+    }
+
+    // ================================================================================================================
+    void GpuTraceTimer::Destroy()
+    {
+        if (m_queryPool != VK_NULL_HANDLE)
+        {
+            vkDestroyQueryPool(m_device, m_queryPool, nullptr);
+            m_queryPool = VK_NULL_HANDLE;
+        }
+        m_passNames.clear();
+        m_openPasses.clear();
+    }
+
+    // ================================================================================================================
+    // A pass over the pool size is dropped, but it still has to be ended.
+    void GpuTraceTimer::CmdBeginPass(
+        VkCommandBuffer    cmdBuffer,
+        const std::string& name)
+    {
+        if ((m_queryPool == VK_NULL_HANDLE) || (m_passNames.size() == MaxPassCnt))
+        {
+            m_openPasses.push_back(MaxPassCnt);
+            return;
+        }
+
+        uint32_t passIdx = (uint32_t)m_passNames.size();
+        m_passNames.push_back(name);
+        m_openPasses.push_back(passIdx);
+
+        vkCmdResetQueryPool(cmdBuffer, m_queryPool, 2 * passIdx, 2);
+        vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, 2 * passIdx);
+    }
+
+    // ================================================================================================================
+    void GpuTraceTimer::CmdEndPass(
+        VkCommandBuffer cmdBuffer)
+    {
+        if (m_openPasses.empty())
+        {
+            return;
+        }
+
+        uint32_t passIdx = m_openPasses.back();
+        m_openPasses.pop_back();
+        if (passIdx != MaxPassCnt)
+        {
+            vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 2 * passIdx + 1);
+        }
+    }
+
+    // ================================================================================================================
+    void GpuTraceTimer::Resolve()
+    {
+        if (m_passNames.empty())
+        {
+            return;
+        }
+
+        uint32_t queryCnt = 2 * (uint32_t)m_passNames.size();
+        std::vector<uint64_t> timestamps(queryCnt);
+        VK_CHECK(vkGetQueryPoolResults(m_device,
+                                       m_queryPool,
+                                       0,
+                                       queryCnt,
+                                       sizeof(uint64_t) * queryCnt,
+                                       timestamps.data(),
+                                       sizeof(uint64_t),
+                                       VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+
+        uint64_t firstBegin = ~uint64_t(0);
+        uint64_t lastEnd = 0;
+        for (uint32_t i = 0; i < queryCnt; i++)
+        {
+            timestamps[i] &= m_timestampMask;
+            firstBegin = std::min(firstBegin, timestamps[i]);
+            lastEnd = std::max(lastEnd, timestamps[i]);
+        }
+
+        auto ticksToUs = [this](uint64_t ticks) { return (uint64_t)(double(ticks) * m_timestampPeriod / 1000.0); };
+
+        uint64_t nowUs = TraceNowUs();
+        uint64_t spanUs = ticksToUs(lastEnd - firstBegin);
+        uint64_t anchorUs = (nowUs > spanUs) ? (nowUs - spanUs) : 0;
+        for (uint32_t passIdx = 0; passIdx < m_passNames.size(); passIdx++)
+        {
+            uint64_t begin = timestamps[2 * passIdx];
+            uint64_t end = std::max(timestamps[2 * passIdx + 1], begin);
+            AddTraceEvent(m_passNames[passIdx], "gpu", anchorUs + ticksToUs(begin - firstBegin), ticksToUs(end - begin), GpuTraceTrackId);
+        }
+
+        m_passNames.clear();
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+namespace SharedLib
+{
+    // Timestamp queries around the GPU passes of a submit, recorded on the GPU track of the trace (TraceUtils.h).
+    // - CmdBeginPass(...) has to be outside of any rendering, because it resets the queries of the pass. The tools
+    //   record it right after vkBeginCommandBuffer(...).
+    // - Resolve() reads the passes back after the submit is waited. The GPU clock is not the CPU clock, so the passes of
+    //   a submit are placed to end at the Resolve() time. Their durations and the gaps between them are exact.
+    // All of it is a no-op when the trace is off at Init(...) or when the queue family has no timestamps.
+    class GpuTraceTimer
+    {
+    public:
+        GpuTraceTimer();
+        ~GpuTraceTimer() {};
+
+        void Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIdx);
+        void Destroy();
+
+        void CmdBeginPass(VkCommandBuffer cmdBuffer, const std::string& name);
+        void CmdEndPass(VkCommandBuffer cmdBuffer); // Ends the latest pass that is not ended yet.
+
+        void Resolve();
+
+    private:
+        static constexpr uint32_t MaxPassCnt = 64;
+
+        VkDevice                 m_device;
+        VkQueryPool              m_queryPool;
+        float                    m_timestampPeriod; // Nanoseconds per tick.
+        uint64_t                 m_timestampMask;
+        std::vector<std::string> m_passNames;       // The pass i owns the queries 2i and 2i + 1.
+        std::vector<uint32_t>    m_openPasses;
+    };
+}
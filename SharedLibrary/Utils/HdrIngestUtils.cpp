@@ -0,0 +1,286 @@
+#include "HdrIngestUtils.h"
+#include "MathUtils.h"
+#include "ThreadUtils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HDR_INGEST_SSE2
+#include <emmintrin.h>
+// The MSVC doesn't define the __F16C__, but every AVX2 CPU has the F16C.
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define HDR_INGEST_F16C
+#include <immintrin.h>
+#endif
+#endif
+
+namespace SharedLib
+{
+    // The largest finite binary16.
+    static constexpr float HalfMax = 65504.f;
+
+    // Rows of an ingest task. Small enough to spread a band of a few hundred rows among the workers.
+    static constexpr uint32_t RowsPerTask = 16;
+
+    // ================================================================================================================
+    uint32_t HdrIngestTexelBytes(
+        HdrIngestFormat format)
+    {
+        return (format == HdrIngestFormat::RGBA16F) ? 4 * sizeof(uint16_t) : 4 * sizeof(float);
+    }
+
+    // ================================================================================================================
+    // The NaN fails the compare, so it becomes 0 like a negative value.
+    static float ClampRadiance(
+        float val,
+        float radianceClamp)
+    {
+        return (val > 0.f) ? std::min(val, radianceClamp) : 0.f;
+    }
+
+    // ================================================================================================================
+    static void StoreRgbaScalar(
+        const float*    pRgb,
+        HdrIngestFormat format,
+        void*           pDst,
+        uint64_t        texelIdx)
+    {
+        if (format == HdrIngestFormat::RGBA32F)
+        {
+            float* pTexel = static_cast<float*>(pDst) + 4 * texelIdx;
+            pTexel[0] = pRgb[0];
+            pTexel[1] = pRgb[1];
+            pTexel[2] = pRgb[2];
+            pTexel[3] = 1.f;
+        }
+        else
+        {
+            uint16_t* pTexel = static_cast<uint16_t*>(pDst) + 4 * texelIdx;
+            pTexel[0] = FloatToHalf(pRgb[0]);
+            pTexel[1] = FloatToHalf(pRgb[1]);
+            pTexel[2] = FloatToHalf(pRgb[2]);
+            pTexel[3] = FloatToHalf(1.f);
+        }
+    }
+
+    // ================================================================================================================
+    // The maxRgb is updated with the clamped texel.
+    static void IngestTexelScalar(
+        const float*    pRgb,
+        HdrIngestFormat format,
+        float           radianceClamp,
+        void*           pDst,
+        uint64_t        texelIdx,
+        float&          maxRgb)
+    {
+        float rgb[3];
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            rgb[i] = ClampRadiance(pRgb[i], radianceClamp);
+            maxRgb = std::max(maxRgb, rgb[i]);
+        }
+        StoreRgbaScalar(rgb, format, pDst, texelIdx);
+    }
+
+#ifdef HDR_INGEST_SSE2
+    // ================================================================================================================
+    // The lane 3 of the rgbx is ignored and comes back as 0. The max(...) returns its second operand for a NaN, so a NaN
+    // becomes 0.
+    static inline __m128 ClampRgb(
+        __m128 rgbx,
+        __m128 clampVec)
+    {
+        const __m128 rgbMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+        return _mm_and_ps(_mm_min_ps(_mm_max_ps(rgbx, _mm_setzero_ps()), clampVec), rgbMask);
+    }
+
+    // ================================================================================================================
+    static inline void StoreRgba(
+        __m128          rgb,
+        HdrIngestFormat format,
+        void*           pDst,
+        uint64_t        texelIdx)
+    {
+        __m128 rgba = _mm_or_ps(rgb, _mm_set_ps(1.f, 0.f, 0.f, 0.f));
+        if (format == HdrIngestFormat::RGBA32F)
+        {
+            _mm_storeu_ps(static_cast<float*>(pDst) + 4 * texelIdx, rgba);
+        }
+        else
+        {
+#ifdef HDR_INGEST_F16C
+            __m128i half4 = _mm_cvtps_ph(rgba, _MM_FROUND_TO_NEAREST_INT);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(static_cast<uint16_t*>(pDst) + 4 * texelIdx), half4);
+#else
+            alignas(16) float texel[4];
+            _mm_store_ps(texel, rgba);
+            StoreRgbaScalar(texel, format, pDst, texelIdx);
+#endif
+        }
+    }
+
+    // ================================================================================================================
+    static inline float MaxRgb(
+        __m128 maxVec)
+    {
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, maxVec);
+        return std::max(std::max(lanes[0], lanes[1]), lanes[2]);
+    }
+#endif
+
+    // ================================================================================================================
+    float IngestRgbeTexels(
+        const uint8_t*  pRgbe,
+        uint64_t        texelCnt,
+        HdrIngestFormat format,
+        float           radianceClamp,
+        void*           pDst)
+    {
+        if (format == HdrIngestFormat::RGBA16F)
+        {
+            radianceClamp = std::min(radianceClamp, HalfMax);
+        }
+
+#ifdef HDR_INGEST_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i scaleExpBias = _mm_set1_epi32((128 + 8) - 127);
+        const __m128 clampVec = _mm_set1_ps(radianceClamp);
+        __m128 maxVec = _mm_setzero_ps();
+
+        for (uint64_t i = 0; i < texelCnt; i++)
+        {
+            int32_t texel;
+            memcpy(&texel, pRgbe + 4 * i, sizeof(texel));
+            __m128i channels = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(texel), zero), zero);
+
+            // The scale 2^(e - 136) is built from its float bits. An exponent that would be a denormal scale, and the 0 of
+            // a black texel, give a 0 scale.
+            __m128i scaleExp = _mm_sub_epi32(_mm_shuffle_epi32(channels, 0xFF), scaleExpBias);
+            scaleExp = _mm_and_si128(scaleExp, _mm_cmpgt_epi32(scaleExp, zero));
+            __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(scaleExp, 23));
+
+            __m128 rgb = ClampRgb(_mm_mul_ps(_mm_cvtepi32_ps(channels), scale), clampVec);
+            maxVec = _mm_max_ps(maxVec, rgb);
+            StoreRgba(rgb, format, pDst, i);
+        }
+        return MaxRgb(maxVec);
+#else
+        float maxRgb = 0.f;
+        for (uint64_t i = 0; i < texelCnt; i++)
+        {
+            const uint8_t* pTexel = pRgbe + 4 * i;
+            float scale = (pTexel[3] != 0) ? ldexpf(1.f, (int)pTexel[3] - (128 + 8)) : 0.f;
+            float rgb[3] = { pTexel[0] * scale, pTexel[1] * scale, pTexel[2] * scale };
+            IngestTexelScalar(rgb, format, radianceClamp, pDst, i, maxRgb);
+        }
+        return maxRgb;
+#endif
+    }
+
+    // ================================================================================================================
+    // A texel is loaded with the red of the next one in the lane 3, so the last texel is done in the scalar loop to not
+    // read past the input.
+    float IngestRgbTexels(
+        const float*    pRgb,
+        uint64_t        texelCnt,
+        HdrIngestFormat format,
+        float           radianceClamp,
+        void*           pDst)
+    {
+        if (format == HdrIngestFormat::RGBA16F)
+        {
+            radianceClamp = std::min(radianceClamp, HalfMax);
+        }
+
+        uint64_t i = 0;
+        float maxRgb = 0.f;
+
+#ifdef HDR_INGEST_SSE2
+        const __m128 clampVec = _mm_set1_ps(radianceClamp);
+        __m128 maxVec = _mm_setzero_ps();
+        for (; i + 1 < texelCnt; i++)
+        {
+            __m128 rgb = ClampRgb(_mm_loadu_ps(pRgb + 3 * i), clampVec);
+            maxVec = _mm_max_ps(maxVec, rgb);
+            StoreRgba(rgb, format, pDst, i);
+        }
+        maxRgb = MaxRgb(maxVec);
+#endif
+
+        for (; i < texelCnt; i++)
+        {
+            IngestTexelScalar(pRgb + 3 * i, format, radianceClamp, pDst, i, maxRgb);
+        }
+        return maxRgb;
+    }
+
+    // ================================================================================================================
+    // Every task keeps its own max, so the workers never share a cache line until the end.
+    template<typename IngestTask>
+    static float IngestRowsParallel(
+        uint32_t    rowCnt,
+        ThreadPool& threadPool,
+        IngestTask  ingestTask)
+    {
+        uint32_t taskCnt = (rowCnt + RowsPerTask - 1) / RowsPerTask;
+        std::vector<float> taskMaxRgb(taskCnt, 0.f);
+        threadPool.ParallelFor(taskCnt, [&](uint32_t taskIdx)
+        {
+            uint32_t rowBegin = taskIdx * RowsPerTask;
+            uint32_t rowEnd = std::min(rowBegin + RowsPerTask, rowCnt);
+            taskMaxRgb[taskIdx] = ingestTask(rowBegin, rowEnd - rowBegin);
+        });
+
+        float maxRgb = 0.f;
+        for (float taskMax : taskMaxRgb)
+        {
+            maxRgb = std::max(maxRgb, taskMax);
+        }
+        return maxRgb;
+    }
+
+    // ================================================================================================================
+    float IngestRgbeRows(
+        const uint8_t*  pRgbe,
+        uint32_t        rowCnt,
+        uint32_t        width,
+        HdrIngestFormat format,
+        float           radianceClamp,
+        void*           pDst,
+        ThreadPool&     threadPool)
+    {
+        const uint64_t dstRowBytesCnt = uint64_t(width) * HdrIngestTexelBytes(format);
+        return IngestRowsParallel(rowCnt, threadPool, [=](uint32_t rowBegin, uint32_t taskRowCnt)
+        {
+            return IngestRgbeTexels(pRgbe + 4 * uint64_t(rowBegin) * width,
+                                    uint64_t(taskRowCnt) * width,
+                                    format,
+                                    radianceClamp,
+                                    static_cast<char*>(pDst) + rowBegin * dstRowBytesCnt);
+        });
+    }
+
+    // ================================================================================================================
+    float IngestRgbRows(
+        const float*    pRgb,
+        uint32_t        rowCnt,
+        uint32_t        width,
+        HdrIngestFormat format,
+        float           radianceClamp,
+        void*           pDst,
+        ThreadPool&     threadPool)
+    {
+        const uint64_t dstRowBytesCnt = uint64_t(width) * HdrIngestTexelBytes(format);
+        return IngestRowsParallel(rowCnt, threadPool, [=](uint32_t rowBegin, uint32_t taskRowCnt)
+        {
+            return IngestRgbTexels(pRgb + 3 * uint64_t(rowBegin) * width,
+                                   uint64_t(taskRowCnt) * width,
+                                   format,
+                                   radianceClamp,
+                                   static_cast<char*>(pDst) + rowBegin * dstRowBytesCnt);
+        });
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+
+namespace SharedLib
+{
+    class ThreadPool;
+
+    // The load time preprocessing of an HDR input in one pass: the decoded texels are clamped, checked and written in
+    // the GPU upload layout, usually straight into a mapped staging buffer. It replaces the separate clamp, range check
+    // and RGB to RGBA padding passes over a whole float copy of the input.
+    // - Every channel is clamped to [0, radianceClamp]. The negative values and the NaNs become 0, and the RGBA16F also
+    //   clamps to the largest finite half, so the upload never has an Inf.
+    // - The alpha is always 1.
+    // - The return value is the largest channel after the clamp, so e.g. an "above 1" check needs no other pass.
+    // The kernels are SSE2 with one RGBA texel per register. The RGBA16F uses the F16C conversion when the library is
+    // built with it (e.g. /arch:AVX2 or -mf16c), and the FloatToHalf(...) otherwise.
+
+    // The values are the VkFormat ones, so a caller can cast them to VkFormat.
+    enum class HdrIngestFormat : uint32_t
+    {
+        RGBA16F = 97, // VK_FORMAT_R16G16B16A16_SFLOAT
+        RGBA32F = 109 // VK_FORMAT_R32G32B32A32_SFLOAT
+    };
+
+    uint32_t HdrIngestTexelBytes(HdrIngestFormat format);
+
+    // pRgbe is the raw Radiance texels (8 bits RGB mantissas and a shared exponent), as the HdrScanlineReader reads them.
+    // The decode matches the stb_image one. The SSE2 path flushes the values under 2^-118 to 0.
+    float IngestRgbeTexels(const uint8_t* pRgbe, uint64_t texelCnt, HdrIngestFormat format, float radianceClamp, void* pDst);
+
+    // pRgb is tightly packed RGB32F texels, e.g. the ReadImg(...) output of a non-Radiance input.
+    float IngestRgbTexels(const float* pRgb, uint64_t texelCnt, HdrIngestFormat format, float radianceClamp, void* pDst);
+
+    // The same in row tasks spread among the threadPool workers and the calling thread. A row is width texels.
+    float IngestRgbeRows(const uint8_t*  pRgbe,
+                         uint32_t        rowCnt,
+                         uint32_t        width,
+                         HdrIngestFormat format,
+                         float           radianceClamp,
+                         void*           pDst,
+                         ThreadPool&     threadPool);
+
+    float IngestRgbRows(const float*    pRgb,
+                        uint32_t        rowCnt,
+                        uint32_t        width,
+                        HdrIngestFormat format,
+                        float           radianceClamp,
+                        void*           pDst,
+                        ThreadPool&     threadPool);
+}
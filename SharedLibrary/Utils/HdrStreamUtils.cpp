@@ -0,0 +1,234 @@
+#include "HdrStreamUtils.h"
+#include "TraceUtils.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace SharedLib
+{
+    static constexpr size_t HdrFileBufferBytes = 256 * 1024;
+
+    // ================================================================================================================
+    HdrScanlineReader::HdrScanlineReader() :
+        m_fileBufferPos(0),
+        m_fileBufferEnd(0),
+        m_width(0),
+        m_height(0),
+        m_nextRow(0),
+        m_isFlat(false)
+    {}
+
+    // ================================================================================================================
+    bool HdrScanlineReader::ReadByte(
+        uint8_t& val)
+    {
+        if (m_fileBufferPos == m_fileBufferEnd)
+        {
+            m_file.read(reinterpret_cast<char*>(m_fileBuffer.data()), m_fileBuffer.size());
+            m_fileBufferPos = 0;
+            m_fileBufferEnd = (size_t)m_file.gcount();
+            AddTraceBytes(TraceDiskReadBytes, m_fileBufferEnd);
+            if (m_fileBufferEnd == 0)
+            {
+                return false;
+            }
+        }
+
+        val = m_fileBuffer[m_fileBufferPos++];
+        return true;
+    }
+
+    // ================================================================================================================
+    bool HdrScanlineReader::ReadLine(
+        std::string& line)
+    {
+        line.clear();
+        uint8_t val;
+        while (ReadByte(val))
+        {
+            if (val == '\n')
+            {
+                return true;
+            }
+            line.push_back((char)val);
+        }
+        return false;
+    }
+
+    // ================================================================================================================
+    void HdrScanlineReader::Close()
+    {
+        m_file.close();
+        m_fileBuffer.clear();
+        m_fileBuffer.shrink_to_fit();
+        m_fileBufferPos = 0;
+        m_fileBufferEnd = 0;
+        m_width = 0;
+        m_height = 0;
+        m_nextRow = 0;
+        m_isFlat = false;
+    }
+
+    // ================================================================================================================
+    bool HdrScanlineReader::Open(
+        const std::string& namePath)
+    {
+        Close();
+
+        m_file.open(namePath, std::ios::binary);
+        if (m_file.is_open() == false)
+        {
+            return false;
+        }
+        m_fileBuffer.resize(HdrFileBufferBytes);
+
+        std::string line;
+        if ((ReadLine(line) == false) || ((line != "#?RADIANCE") && (line != "#?RGBE")))
+        {
+            Close();
+            return false;
+        }
+
+        // The header ends with an empty line. Only the RLE RGBE texels are supported, as in the stb_image.
+        bool isRgbe = false;
+        while (ReadLine(line) && (line.empty() == false))
+        {
+            if (line == "FORMAT=32-bit_rle_rgbe")
+            {
+                isRgbe = true;
+            }
+        }
+
+        int height = 0;
+        int width = 0;
+        if ((isRgbe == false) ||
+            (ReadLine(line) == false) ||
+            (sscanf(line.c_str(), "-Y %d +X %d", &height, &width) != 2) ||
+            (width <= 0) || (height <= 0))
+        {
+            std::cerr << "The Radiance file is not in the -Y <height> +X <width> layout: " << namePath << std::endl;
+            Close();
+            return false;
+        }
+
+        m_width = (uint32_t)width;
+        m_height = (uint32_t)height;
+
+        // The RLE scanlines need a width that fits in their 15 bits length.
+        m_isFlat = (m_width < 8) || (m_width >= 32768);
+        return true;
+    }
+
+    // ================================================================================================================
+    // A RLE scanline starts with 2, 2 and its 16 bits width. Otherwise, those 4 bytes are already the first texel and the
+    // rest of the file is plain RGBE.
+    bool HdrScanlineReader::ReadRgbeRow(
+        uint8_t* pRow)
+    {
+        uint32_t texelBegin = 0;
+
+        if (m_isFlat == false)
+        {
+            uint8_t head[4];
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                if (ReadByte(head[i]) == false)
+                {
+                    return false;
+                }
+            }
+
+            if ((head[0] != 2) || (head[1] != 2) || (head[2] & 0x80))
+            {
+                memcpy(pRow, head, 4);
+                texelBegin = 1;
+                m_isFlat = true;
+            }
+            else
+            {
+                uint32_t rleWidth = (uint32_t(head[2]) << 8) | head[3];
+                if (rleWidth != m_width)
+                {
+                    return false;
+                }
+
+                // The 4 channels are stored one after another. Each one is runs and literal spans.
+                for (uint32_t channel = 0; channel < 4; channel++)
+                {
+                    uint32_t texel = 0;
+                    while (texel < m_width)
+                    {
+                        uint8_t count;
+                        if (ReadByte(count) == false)
+                        {
+                            return false;
+                        }
+
+                        if (count > 128)
+                        {
+                            count -= 128;
+                            uint8_t val;
+                            if ((count > m_width - texel) || (ReadByte(val) == false))
+                            {
+                                return false;
+                            }
+
+                            for (uint32_t i = 0; i < count; i++)
+                            {
+                                pRow[4 * (texel + i) + channel] = val;
+                            }
+                        }
+                        else
+                        {
+                            if ((count == 0) || (count > m_width - texel))
+                            {
+                                return false;
+                            }
+
+                            for (uint32_t i = 0; i < count; i++)
+                            {
+                                if (ReadByte(pRow[4 * (texel + i) + channel]) == false)
+                                {
+                                    return false;
+                                }
+                            }
+                        }
+                        texel += count;
+                    }
+                }
+                return true;
+            }
+        }
+
+        for (uint64_t i = 4 * uint64_t(texelBegin); i < GetRgbeRowBytesCnt(); i++)
+        {
+            if (ReadByte(pRow[i]) == false)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // ================================================================================================================
+    bool HdrScanlineReader::ReadRgbeRows(
+        uint32_t rowCnt,
+        uint8_t* pRgbe)
+    {
+        if ((m_file.is_open() == false) || (rowCnt > m_height - m_nextRow))
+        {
+            return false;
+        }
+
+        for (uint32_t row = 0; row < rowCnt; row++)
+        {
+            if (ReadRgbeRow(pRgbe + uint64_t(row) * GetRgbeRowBytesCnt()) == false)
+            {
+                std::cerr << "The Radiance file is truncated or damaged at the row " << m_nextRow << "." << std::endl;
+                return false;
+            }
+            m_nextRow++;
+        }
+        return true;
+    }
+}
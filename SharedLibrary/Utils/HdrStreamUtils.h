@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace SharedLib
+{
+    // A Radiance .hdr decoder that goes through the image in row bands, so a huge panorama never has to be in the host
+    // memory as a whole. Only a small file read buffer is kept. The rows are the raw RGBE texels with the run lengths
+    // undone, in the top to bottom order of the file ("-Y <height> +X <width>"). The IngestRgbeRows(...) (HdrIngestUtils.h)
+    // turns them to the same values as ReadImg(...) in the GPU upload layout.
+    class HdrScanlineReader
+    {
+    public:
+        HdrScanlineReader();
+        ~HdrScanlineReader() {};
+
+        // Returns false when the file is missing or is not a Radiance file in the layout above. The caller can still
+        // decode such an input as a whole with ReadImg(...).
+        bool Open(const std::string& namePath);
+        void Close();
+
+        uint32_t GetWidth() const { return m_width; }
+        uint32_t GetHeight() const { return m_height; }
+        uint32_t GetNextRow() const { return m_nextRow; }
+        uint64_t GetRgbeRowBytesCnt() const { return 4 * uint64_t(m_width); } // One RGBE row.
+
+        // Decodes the next rowCnt rows to pRgbe as tightly packed RGBE texels. Returns false on a truncated or a damaged
+        // file, or when there are less than rowCnt rows left.
+        bool ReadRgbeRows(uint32_t rowCnt, uint8_t* pRgbe);
+
+    private:
+        bool ReadRgbeRow(uint8_t* pRow);
+        bool ReadByte(uint8_t& val);
+        bool ReadLine(std::string& line);
+
+        std::ifstream        m_file;
+        std::vector<uint8_t> m_fileBuffer;
+        size_t               m_fileBufferPos;
+        size_t               m_fileBufferEnd;
+
+        uint32_t             m_width;
+        uint32_t             m_height;
+        uint32_t             m_nextRow;
+        bool                 m_isFlat; // A file without the RLE scanlines stores all its texels as plain RGBE.
+    };
+}
@@ -0,0 +1,388 @@
+#include "Ktx2Utils.h"
+#include "TraceUtils.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace SharedLib
+{
+    static constexpr uint8_t Ktx2Identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+    // The identifier, the header and the index. The level index follows them.
+    struct Ktx2Header
+    {
+        uint8_t  identifier[12];
+        uint32_t vkFormat;
+        uint32_t typeSize;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t layerCount;
+        uint32_t faceCount;
+        uint32_t levelCount;
+        uint32_t supercompressionScheme;
+        uint32_t dfdByteOffset;
+        uint32_t dfdByteLength;
+        uint32_t kvdByteOffset;
+        uint32_t kvdByteLength;
+        uint64_t sgdByteOffset;
+        uint64_t sgdByteLength;
+    };
+    static_assert(sizeof(Ktx2Header) == 80, "The KTX2 header has to be tightly packed.");
+
+    struct Ktx2LevelIndex
+    {
+        uint64_t byteOffset;
+        uint64_t byteLength;
+        uint64_t uncompressedByteLength;
+    };
+
+    // ================================================================================================================
+    static bool IsKtx2FormatSupported(
+        uint32_t vkFormat)
+    {
+        return (vkFormat == (uint32_t)Ktx2Format::RG16F) ||
+               (vkFormat == (uint32_t)Ktx2Format::RGBA16F) ||
+               (vkFormat == (uint32_t)Ktx2Format::RG32F) ||
+               (vkFormat == (uint32_t)Ktx2Format::RGBA32F);
+    }
+
+    // ================================================================================================================
+    uint32_t Ktx2ChannelCnt(
+        Ktx2Format format)
+    {
+        return ((format == Ktx2Format::RG16F) || (format == Ktx2Format::RG32F)) ? 2 : 4;
+    }
+
+    // ================================================================================================================
+    uint32_t Ktx2ChannelBytes(
+        Ktx2Format format)
+    {
+        return ((format == Ktx2Format::RG16F) || (format == Ktx2Format::RGBA16F)) ? 2 : 4;
+    }
+
+    // ================================================================================================================
+    uint32_t Ktx2TexelBytes(
+        Ktx2Format format)
+    {
+        return Ktx2ChannelCnt(format) * Ktx2ChannelBytes(format);
+    }
+
+    // ================================================================================================================
+    uint64_t Ktx2LevelBytesCnt(
+        const Ktx2ImageDesc& desc,
+        uint32_t             level)
+    {
+        uint64_t width = std::max(desc.width >> level, 1u);
+        uint64_t height = std::max(desc.height >> level, 1u);
+        return width * height * desc.faceCnt * Ktx2TexelBytes(desc.format);
+    }
+
+    // ================================================================================================================
+    // The basic data format descriptor of the unpacked signed float formats (Khronos Data Format Specification 1.3 --
+    // Section 5). Every channel is one sample with the FLOAT and SIGNED qualifiers and the linear transfer function.
+    static void AppendKtx2Dfd(
+        Ktx2Format             format,
+        std::vector<uint32_t>& words)
+    {
+        uint32_t channelCnt = Ktx2ChannelCnt(format);
+        uint32_t channelBits = 8 * Ktx2ChannelBytes(format);
+        uint32_t blockBytes = 24 + 16 * channelCnt;
+
+        words.push_back(4 + blockBytes); // dfdTotalSize
+        words.push_back(0);              // vendorId = KHRONOS, descriptorType = BASICFORMAT
+        words.push_back(2 | (blockBytes << 16)); // versionNumber = 1.3
+        words.push_back(1 | (1 << 8) | (1 << 16)); // RGBSDA, BT709 primaries, linear transfer, straight alpha
+        words.push_back(0);              // A 1x1x1x1 texel block
+        words.push_back(Ktx2TexelBytes(format));
+        words.push_back(0);
+
+        constexpr uint32_t ChannelIds[4] = { 0, 1, 2, 15 }; // R, G, B, A
+        constexpr uint32_t FloatSignedQualifiers = 0x80 | 0x40;
+        for (uint32_t c = 0; c < channelCnt; c++)
+        {
+            words.push_back((c * channelBits) | ((channelBits - 1) << 16) | ((ChannelIds[c] | FloatSignedQualifiers) << 24));
+            words.push_back(0);           // samplePosition
+            words.push_back(0xBF800000u); // sampleLower = -1.f
+            words.push_back(0x3F800000u); // sampleUpper = 1.f
+        }
+    }
+
+    // ================================================================================================================
+    bool SaveKtx2(
+        const std::string&   namePath,
+        const Ktx2ImageDesc& desc,
+        const void* const*   ppLevels)
+    {
+        ScopedTraceTimer writeTimer("SaveKtx2", "disk");
+        if ((desc.faceCnt != 1 && desc.faceCnt != 6) || (desc.levelCnt == 0))
+        {
+            std::cerr << "Unsupported KTX2 image layout: " << namePath << std::endl;
+            return false;
+        }
+
+        uint32_t texelBytes = Ktx2TexelBytes(desc.format);
+
+        // Data format descriptor and the key/value data right after the level index.
+        std::vector<uint32_t> dfdWords;
+        AppendKtx2Dfd(desc.format, dfdWords);
+
+        const char KtxWriterKv[] = "KTXwriter\0Vulkan-Samples-Dictionary SharedLib";
+        uint32_t kvBytesCnt = sizeof(KtxWriterKv);
+        uint32_t kvdBytesCnt = (4 + kvBytesCnt + 3) & ~3u;
+
+        Ktx2Header header{};
+        {
+            memcpy(header.identifier, Ktx2Identifier, sizeof(Ktx2Identifier));
+            header.vkFormat = (uint32_t)desc.format;
+            header.typeSize = Ktx2ChannelBytes(desc.format);
+            header.pixelWidth = desc.width;
+            header.pixelHeight = desc.height;
+            header.faceCount = desc.faceCnt;
+            header.levelCount = desc.levelCnt;
+            header.dfdByteOffset = uint32_t(sizeof(Ktx2Header) + desc.levelCnt * sizeof(Ktx2LevelIndex));
+            header.dfdByteLength = uint32_t(dfdWords.size() * sizeof(uint32_t));
+            header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+            header.kvdByteLength = kvdBytesCnt;
+        }
+
+        // The levels go from the smallest to the largest and each one starts at a multiple of the texel size, which is
+        // also a multiple of 4 for all the supported formats.
+        std::vector<Ktx2LevelIndex> levelIndices(desc.levelCnt);
+        uint64_t fileBytesCnt = header.kvdByteOffset + header.kvdByteLength;
+        for (int32_t level = desc.levelCnt - 1; level >= 0; level--)
+        {
+            fileBytesCnt = (fileBytesCnt + texelBytes - 1) / texelBytes * texelBytes;
+            levelIndices[level].byteOffset = fileBytesCnt;
+            levelIndices[level].byteLength = Ktx2LevelBytesCnt(desc, level);
+            levelIndices[level].uncompressedByteLength = levelIndices[level].byteLength;
+            fileBytesCnt += levelIndices[level].byteLength;
+        }
+
+        std::string tmpNamePath = namePath + ".tmp";
+        {
+            std::ofstream ofd(tmpNamePath, std::ios::binary | std::ios::trunc);
+            if (ofd.is_open() == false)
+            {
+                std::cerr << "Cannot open the KTX2 file: " << tmpNamePath << std::endl;
+                return false;
+            }
+
+            ofd.write(reinterpret_cast<const char*>(&header), sizeof(Ktx2Header));
+            ofd.write(reinterpret_cast<const char*>(levelIndices.data()), levelIndices.size() * sizeof(Ktx2LevelIndex));
+            ofd.write(reinterpret_cast<const char*>(dfdWords.data()), header.dfdByteLength);
+
+            std::vector<char> kvd(kvdBytesCnt, 0);
+            memcpy(kvd.data(), &kvBytesCnt, sizeof(uint32_t));
+            memcpy(kvd.data() + 4, KtxWriterKv, kvBytesCnt);
+            ofd.write(kvd.data(), kvd.size());
+
+            uint64_t writtenBytesCnt = header.kvdByteOffset + header.kvdByteLength;
+            const char padding[16] = {};
+            for (int32_t level = desc.levelCnt - 1; level >= 0; level--)
+            {
+                ofd.write(padding, levelIndices[level].byteOffset - writtenBytesCnt);
+                ofd.write(static_cast<const char*>(ppLevels[level]), levelIndices[level].byteLength);
+                writtenBytesCnt = levelIndices[level].byteOffset + levelIndices[level].byteLength;
+            }
+
+            if (ofd.good() == false)
+            {
+                std::cerr << "Cannot write the KTX2 file: " << tmpNamePath << std::endl;
+                return false;
+            }
+        }
+
+        std::error_code errCode;
+        std::filesystem::rename(tmpNamePath, namePath, errCode);
+        if (errCode)
+        {
+            std::cerr << "Cannot rename the KTX2 file to: " << namePath << std::endl;
+            std::filesystem::remove(tmpNamePath, errCode);
+            return false;
+        }
+
+        AddTraceBytes(TraceDiskWriteBytes, fileBytesCnt);
+        std::cout << namePath << ": saves successfully." << std::endl;
+        return true;
+    }
+
+    // ================================================================================================================
+    Ktx2File::Ktx2File() :
+        m_pMapped(nullptr),
+        m_mappedBytesCnt(0),
+        m_fileHandle(nullptr),
+        m_mappingHandle(nullptr),
+        m_desc(),
+        m_levelOffsets(),
+        m_levelsOffset(0),
+        m_levelsBytesCnt(0)
+    {}
+
+    // ================================================================================================================
+    Ktx2File::~Ktx2File()
+    {
+        Close();
+    }
+
+    // ================================================================================================================
+    bool Ktx2File::Open(
+        const std::string& namePath)
+    {
+        Close();
+
+#ifdef _WIN32
+        HANDLE file = CreateFileA(namePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        m_fileHandle = file;
+
+        LARGE_INTEGER fileBytesCnt{};
+        if ((GetFileSizeEx(file, &fileBytesCnt) == FALSE) || (fileBytesCnt.QuadPart < (LONGLONG)sizeof(Ktx2Header)))
+        {
+            Close();
+            return false;
+        }
+
+        m_mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mappingHandle == nullptr)
+        {
+            Close();
+            return false;
+        }
+
+        m_pMapped = static_cast<const uint8_t*>(MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+        m_mappedBytesCnt = (uint64_t)fileBytesCnt.QuadPart;
+#else
+        int fd = open(namePath.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat fileStat{};
+        if ((fstat(fd, &fileStat) != 0) || (fileStat.st_size < (off_t)sizeof(Ktx2Header)))
+        {
+            close(fd);
+            return false;
+        }
+
+        // The mapping keeps the file alive, so the descriptor isn't needed after it.
+        void* pMapped = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (pMapped != MAP_FAILED)
+        {
+            m_pMapped = static_cast<const uint8_t*>(pMapped);
+            m_mappedBytesCnt = (uint64_t)fileStat.st_size;
+        }
+#endif
+
+        if (m_pMapped == nullptr)
+        {
+            Close();
+            return false;
+        }
+
+        Ktx2Header header{};
+        memcpy(&header, m_pMapped, sizeof(Ktx2Header));
+
+        uint32_t levelCnt = std::max(header.levelCount, 1u);
+        bool isSupported = (memcmp(header.identifier, Ktx2Identifier, sizeof(Ktx2Identifier)) == 0) &&
+                           IsKtx2FormatSupported(header.vkFormat) &&
+                           (header.supercompressionScheme == 0) &&
+                           (header.pixelDepth == 0) &&
+                           (header.layerCount <= 1) &&
+                           ((header.faceCount == 1) || (header.faceCount == 6 && header.pixelWidth == header.pixelHeight)) &&
+                           (header.pixelWidth > 0) && (header.pixelHeight > 0) &&
+                           (levelCnt <= MaxLevelCnt) &&
+                           (sizeof(Ktx2Header) + levelCnt * sizeof(Ktx2LevelIndex) <= m_mappedBytesCnt);
+        if (isSupported == false)
+        {
+            std::cerr << "Not a supported KTX2 file: " << namePath << std::endl;
+            Close();
+            return false;
+        }
+
+        m_desc.format = (Ktx2Format)header.vkFormat;
+        m_desc.width = header.pixelWidth;
+        m_desc.height = header.pixelHeight;
+        m_desc.faceCnt = header.faceCount;
+        m_desc.levelCnt = levelCnt;
+
+        // Every level has to be exactly as big as its dims say and inside of the file.
+        uint64_t texelBytes = Ktx2TexelBytes(m_desc.format);
+        uint64_t levelsEnd = 0;
+        m_levelsOffset = m_mappedBytesCnt;
+        for (uint32_t level = 0; level < levelCnt; level++)
+        {
+            Ktx2LevelIndex levelIndex{};
+            memcpy(&levelIndex, m_pMapped + sizeof(Ktx2Header) + level * sizeof(Ktx2LevelIndex), sizeof(Ktx2LevelIndex));
+
+            if ((levelIndex.byteLength != Ktx2LevelBytesCnt(m_desc, level)) ||
+                (levelIndex.byteOffset % texelBytes != 0) ||
+                (levelIndex.byteOffset > m_mappedBytesCnt) ||
+                (levelIndex.byteLength > m_mappedBytesCnt - levelIndex.byteOffset))
+            {
+                std::cerr << "The KTX2 level " << level << " is out of the file: " << namePath << std::endl;
+                Close();
+                return false;
+            }
+
+            m_levelOffsets[level] = levelIndex.byteOffset;
+            m_levelsOffset = std::min(m_levelsOffset, levelIndex.byteOffset);
+            levelsEnd = std::max(levelsEnd, levelIndex.byteOffset + levelIndex.byteLength);
+        }
+        m_levelsBytesCnt = levelsEnd - m_levelsOffset;
+
+        return true;
+    }
+
+    // ================================================================================================================
+    void Ktx2File::Close()
+    {
+#ifdef _WIN32
+        if (m_pMapped)
+        {
+            UnmapViewOfFile(m_pMapped);
+        }
+
+        if (m_mappingHandle)
+        {
+            CloseHandle(m_mappingHandle);
+        }
+
+        if (m_fileHandle)
+        {
+            CloseHandle(m_fileHandle);
+        }
+#else
+        if (m_pMapped)
+        {
+            munmap(const_cast<uint8_t*>(m_pMapped), m_mappedBytesCnt);
+        }
+#endif
+
+        m_pMapped = nullptr;
+        m_mappedBytesCnt = 0;
+        m_fileHandle = nullptr;
+        m_mappingHandle = nullptr;
+        m_desc = {};
+        m_levelsOffset = 0;
+        m_levelsBytesCnt = 0;
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace SharedLib
+{
+    // KTX 2.0 files (https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html) in the subset that the tools write:
+    // uncompressed float texels, no supercompression, a 2D image or a cubemap with one array layer and any number of mips.
+    // A level holds its faces one after another in the Vulkan layer order (+X, -X, +Y, -Y, +Z, -Z) with tightly packed
+    // rows, so a level is one VkBufferImageCopy of all the faces.
+
+    // The values are the VkFormat ones, so a reader can cast them to VkFormat.
+    enum class Ktx2Format : uint32_t
+    {
+        RG16F   = 83,  // VK_FORMAT_R16G16_SFLOAT
+        RGBA16F = 97,  // VK_FORMAT_R16G16B16A16_SFLOAT
+        RG32F   = 103, // VK_FORMAT_R32G32_SFLOAT
+        RGBA32F = 109  // VK_FORMAT_R32G32B32A32_SFLOAT
+    };
+
+    struct Ktx2ImageDesc
+    {
+        Ktx2Format format;
+        uint32_t   width;
+        uint32_t   height;
+        uint32_t   faceCnt; // 1 or 6.
+        uint32_t   levelCnt;
+    };
+
+    uint32_t Ktx2ChannelCnt(Ktx2Format format);
+    uint32_t Ktx2ChannelBytes(Ktx2Format format);
+    uint32_t Ktx2TexelBytes(Ktx2Format format);
+
+    // All the faces of the level. The level dims go down to 1.
+    uint64_t Ktx2LevelBytesCnt(const Ktx2ImageDesc& desc, uint32_t level);
+
+    // ppLevels[i] is the level i with Ktx2LevelBytesCnt(desc, i) bytes in the desc.format. Writes to a temporary file
+    // first and renames it, so a reader never sees a partial file.
+    bool SaveKtx2(const std::string& namePath, const Ktx2ImageDesc& desc, const void* const* ppLevels);
+
+    // A read only memory mapping of a KTX2 file. The level data points into the mapping, so it goes to a staging buffer
+    // with one memcpy and without any decode. The levels are stored from the smallest to the largest, so all of them
+    // are one contiguous range of the file.
+    class Ktx2File
+    {
+    public:
+        Ktx2File();
+        ~Ktx2File();
+
+        // Returns false when the file is missing, is not in the subset above or its level index is out of the file.
+        bool Open(const std::string& namePath);
+        void Close();
+
+        const Ktx2ImageDesc& GetDesc() const { return m_desc; }
+
+        // The range of all the levels and the offset of a level in it. The offsets are aligned to the texel size, so
+        // they can be the VkBufferImageCopy::bufferOffset of a staging buffer that holds the range.
+        const uint8_t* GetLevelsData() const { return m_pMapped + m_levelsOffset; }
+        uint64_t       GetLevelsBytesCnt() const { return m_levelsBytesCnt; }
+        uint64_t       GetLevelOffsetInLevels(uint32_t level) const { return m_levelOffsets[level] - m_levelsOffset; }
+        const uint8_t* GetLevelData(uint32_t level) const { return m_pMapped + m_levelOffsets[level]; }
+
+    private:
+        Ktx2File(const Ktx2File&) = delete;
+        Ktx2File& operator=(const Ktx2File&) = delete;
+
+        static constexpr uint32_t MaxLevelCnt = 16;
+
+        const uint8_t* m_pMapped;
+        uint64_t       m_mappedBytesCnt;
+        void*          m_fileHandle;    // The platform file and mapping handles.
+        void*          m_mappingHandle;
+
+        Ktx2ImageDesc  m_desc;
+        uint64_t       m_levelOffsets[MaxLevelCnt];
+        uint64_t       m_levelsOffset;
+        uint64_t       m_levelsBytesCnt;
+    };
+}
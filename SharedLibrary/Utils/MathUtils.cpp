@@ -1,5 +1,5 @@
+#include <cmath>
 #include "MathUtils.h"
-#include <math.h>
 #include <cstring>
 
 namespace SharedLib
@@ -204,4 +204,232 @@ namespace SharedLib
 
         mat4x4[15] = 1.f;
     }
-}
\ No newline at end of file
+
+    // The inverse of the major axis selection: sc and tc are mapped back to the two minor axes of the face.
+    void CubemapTexelDir(
+        uint32_t face,
+        float    u,
+        float    v,
+        float*   pDir)
+    {
+        float sc = 2.f * u - 1.f;
+        float tc = 2.f * v - 1.f;
+
+        switch (face)
+        {
+        case 0: pDir[0] = 1.f;  pDir[1] = -tc;  pDir[2] = -sc;  break;
+        case 1: pDir[0] = -1.f; pDir[1] = -tc;  pDir[2] = sc;   break;
+        case 2: pDir[0] = sc;   pDir[1] = 1.f;  pDir[2] = tc;   break;
+        case 3: pDir[0] = sc;   pDir[1] = -1.f; pDir[2] = -tc;  break;
+        case 4: pDir[0] = sc;   pDir[1] = -tc;  pDir[2] = 1.f;  break;
+        default: pDir[0] = -sc; pDir[1] = -tc;  pDir[2] = -1.f; break;
+        }
+    }
+
+    // Ties go to the x axis first and then the y axis.
+    void CubemapDirToFaceUv(
+        const float* pDir,
+        uint32_t*    pFace,
+        float*       pU,
+        float*       pV)
+    {
+        float ax = fabsf(pDir[0]);
+        float ay = fabsf(pDir[1]);
+        float az = fabsf(pDir[2]);
+
+        float sc, tc, ma;
+        if ((ax >= ay) && (ax >= az))
+        {
+            ma = ax;
+            *pFace = pDir[0] >= 0.f ? 0 : 1;
+            sc = pDir[0] >= 0.f ? -pDir[2] : pDir[2];
+            tc = -pDir[1];
+        }
+        else if (ay >= az)
+        {
+            ma = ay;
+            *pFace = pDir[1] >= 0.f ? 2 : 3;
+            sc = pDir[0];
+            tc = pDir[1] >= 0.f ? pDir[2] : -pDir[2];
+        }
+        else
+        {
+            ma = az;
+            *pFace = pDir[2] >= 0.f ? 4 : 5;
+            sc = pDir[2] >= 0.f ? pDir[0] : -pDir[0];
+            tc = -pDir[1];
+        }
+
+        *pU = 0.5f * (sc / ma + 1.f);
+        *pV = 0.5f * (tc / ma + 1.f);
+    }
+
+    // The area of the projection of [0, x] x [0, y] on the unit sphere. The texel is the difference of its 4 corners.
+    // http://www.rorydriscoll.com/2012/01/15/cubemap-texel-solid-angle/
+    static float CubemapAreaElement(
+        float x,
+        float y)
+    {
+        return atan2f(x * y, sqrtf(x * x + y * y + 1.f));
+    }
+
+    float CubemapTexelSolidAngle(
+        uint32_t x,
+        uint32_t y,
+        uint32_t faceDim)
+    {
+        float invDim = 1.f / float(faceDim);
+
+        float x0 = 2.f * float(x) * invDim - 1.f;
+        float y0 = 2.f * float(y) * invDim - 1.f;
+        float x1 = x0 + 2.f * invDim;
+        float y1 = y0 + 2.f * invDim;
+
+        return CubemapAreaElement(x0, y0) - CubemapAreaElement(x0, y1) - CubemapAreaElement(x1, y0) + CubemapAreaElement(x1, y1);
+    }
+
+    // ================================================================================================================
+    uint16_t FloatToHalf(
+        float val)
+    {
+        uint32_t bits;
+        memcpy(&bits, &val, sizeof(float));
+
+        uint32_t sign = (bits >> 16) & 0x8000;
+        uint32_t absBits = bits & 0x7FFFFFFF;
+
+        // Inf and NaN. NaN keeps a mantissa bit so it doesn't turn into an Inf.
+        if (absBits >= 0x7F800000)
+        {
+            return uint16_t(sign | 0x7C00 | (absBits > 0x7F800000 ? 0x200 : 0));
+        }
+
+        // 65520 and above round to the Inf.
+        if (absBits >= 0x477FF000)
+        {
+            return uint16_t(sign | 0x7C00);
+        }
+
+        // Below the smallest normal half (2^-14) -- The half denormal is the mantissa in 2^-24 units.
+        if (absBits < 0x38800000)
+        {
+            if (absBits < 0x33000000)
+            {
+                return uint16_t(sign);
+            }
+
+            uint32_t exponent = absBits >> 23;
+            uint32_t mantissa = (absBits & 0x7FFFFF) | 0x800000;
+            uint32_t shift = 126 - exponent;
+
+            uint32_t half = mantissa >> shift;
+            uint32_t remainder = mantissa & ((1u << shift) - 1);
+            uint32_t halfway = 1u << (shift - 1);
+            if (remainder > halfway || (remainder == halfway && (half & 1)))
+            {
+                half++;
+            }
+            return uint16_t(sign | half);
+        }
+
+        // Normal numbers: Rebias the exponent from 127 to 15 and round the 13 dropped mantissa bits. A carry out of the
+        // mantissa correctly bumps the exponent.
+        uint32_t half = (absBits - 0x38000000) >> 13;
+        uint32_t remainder = absBits & 0x1FFF;
+        if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+        {
+            half++;
+        }
+        return uint16_t(sign | half);
+    }
+
+    // ================================================================================================================
+    float HalfToFloat(
+        uint16_t val)
+    {
+        uint32_t sign = uint32_t(val & 0x8000) << 16;
+        uint32_t exponent = (val >> 10) & 0x1F;
+        uint32_t mantissa = val & 0x3FF;
+
+        if (exponent == 0)
+        {
+            // Zero and denormals.
+            float res = ldexpf(float(mantissa), -24);
+            return sign ? -res : res;
+        }
+
+        uint32_t bits = 0;
+        if (exponent == 31)
+        {
+            bits = sign | 0x7F800000 | (mantissa << 13);
+        }
+        else
+        {
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        }
+
+        float res;
+        memcpy(&res, &bits, sizeof(float));
+        return res;
+    }
+
+    // ================================================================================================================
+    // Slicing-by-8: The table k maps a byte to its CRC after k more zero bytes, so 8 bytes are folded with 8 lookups
+    // instead of a dependent chain of 8. It reads the words in the little endian order.
+    uint32_t Crc32(
+        const void* pData,
+        uint64_t    bytesCnt,
+        uint32_t    prevCrc)
+    {
+        static const auto sliceTables = []()
+        {
+            cexp::array<cexp::array<uint32_t, 256>, 8> tables{};
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                tables[0][i] = crc32_table[i];
+            }
+
+            for (uint32_t k = 1; k < 8; k++)
+            {
+                for (uint32_t i = 0; i < 256; i++)
+                {
+                    uint32_t prev = tables[k - 1][i];
+                    tables[k][i] = (prev >> 8) ^ tables[0][prev & 0xFF];
+                }
+            }
+            return tables;
+        }();
+
+        const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+        uint32_t crc = ~prevCrc;
+
+        while (bytesCnt >= 8)
+        {
+            uint32_t lo, hi;
+            memcpy(&lo, pBytes, sizeof(uint32_t));
+            memcpy(&hi, pBytes + 4, sizeof(uint32_t));
+            lo ^= crc;
+
+            crc = sliceTables[7][lo & 0xFF] ^
+                  sliceTables[6][(lo >> 8) & 0xFF] ^
+                  sliceTables[5][(lo >> 16) & 0xFF] ^
+                  sliceTables[4][lo >> 24] ^
+                  sliceTables[3][hi & 0xFF] ^
+                  sliceTables[2][(hi >> 8) & 0xFF] ^
+                  sliceTables[1][(hi >> 16) & 0xFF] ^
+                  sliceTables[0][hi >> 24];
+
+            pBytes += 8;
+            bytesCnt -= 8;
+        }
+
+        while (bytesCnt > 0)
+        {
+            crc = sliceTables[0][(crc ^ *pBytes) & 0xFF] ^ (crc >> 8);
+            pBytes++;
+            bytesCnt--;
+        }
+
+        return ~crc;
+    }
+}
@@ -246,4 +246,26 @@ namespace SharedLib
     void GenRotationMatZ(float radien, float* pResMat);
 
     void Mat3x3ToMat4x4(float* mat3x3, float* mat4x4);
-}
\ No newline at end of file
+
+    // Cubemap texel helpers in the Vulkan cube map face convention (Vulkan spec -- Cube Map Face Selection).
+    // Faces are in the layer order: +X, -X, +Y, -Y, +Z, -Z. (u, v) are in [0, 1] with v going down the rows.
+    // The output direction is not normalized.
+    void CubemapTexelDir(uint32_t face, float u, float v, float* pDir);
+
+    // The cube map face selection itself: The face that pDir hits and the (u, v) in [0, 1] on it. The inverse of the
+    // CubemapTexelDir(...). pDir doesn't have to be normalized.
+    void CubemapDirToFaceUv(const float* pDir, uint32_t* pFace, float* pU, float* pV);
+
+    // The exact solid angle that the texel (x, y) of a faceDim x faceDim face covers.
+    float CubemapTexelSolidAngle(uint32_t x, uint32_t y, uint32_t faceDim);
+
+    // IEEE 754 binary16 conversions, which is what the VK_FORMAT_*16_SFLOAT stores. FloatToHalf(...) rounds to the
+    // nearest even. The values out of the half range become infinities and the denormals are kept.
+    uint16_t FloatToHalf(float val);
+    float HalfToFloat(uint16_t val);
+
+    // The CRC-32 of a byte range with the same polynomial as the crc32(...) above, so they agree on the same bytes. It's
+    // slicing-by-8, which keeps up with the disk when a whole file is hashed. Pass the previous result as the prevCrc to
+    // continue over the next chunk.
+    uint32_t Crc32(const void* pData, uint64_t bytesCnt, uint32_t prevCrc = 0);
+}
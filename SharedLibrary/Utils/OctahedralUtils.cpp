@@ -0,0 +1,173 @@
+#include "OctahedralUtils.h"
+#include <algorithm>
+#include <cmath>
+
+namespace SharedLib
+{
+    // The n x n bilinear samples of an output texel of the CubemapToOctahedral(...).
+    static constexpr uint32_t OctahedralSubsampleDim = 2;
+
+    // ================================================================================================================
+    // The folding of the lower hemisphere to the corners is its own inverse.
+    static void OctahedralWrap(
+        float& a,
+        float& b)
+    {
+        float wrappedA = (1.f - fabsf(b)) * (a >= 0.f ? 1.f : -1.f);
+        float wrappedB = (1.f - fabsf(a)) * (b >= 0.f ? 1.f : -1.f);
+        a = wrappedA;
+        b = wrappedB;
+    }
+
+    // ================================================================================================================
+    void OctahedralUvToDir(
+        float  u,
+        float  v,
+        float* pDir)
+    {
+        float x = 2.f * u - 1.f;
+        float z = 2.f * v - 1.f;
+        float y = 1.f - fabsf(x) - fabsf(z);
+        if (y < 0.f)
+        {
+            OctahedralWrap(x, z);
+        }
+
+        float invLen = 1.f / sqrtf(x * x + y * y + z * z);
+        pDir[0] = x * invLen;
+        pDir[1] = y * invLen;
+        pDir[2] = z * invLen;
+    }
+
+    // ================================================================================================================
+    void DirToOctahedralUv(
+        const float* pDir,
+        float&       u,
+        float&       v)
+    {
+        float invL1 = 1.f / (fabsf(pDir[0]) + fabsf(pDir[1]) + fabsf(pDir[2]));
+        float x = pDir[0] * invL1;
+        float z = pDir[2] * invL1;
+        if (pDir[1] < 0.f)
+        {
+            OctahedralWrap(x, z);
+        }
+
+        u = 0.5f * x + 0.5f;
+        v = 0.5f * z + 0.5f;
+    }
+
+    // ================================================================================================================
+    // The Vulkan cube map face selection: The major axis picks the face and the other two axes are its (s, t).
+    static void DirToCubemapFaceUv(
+        const float* pDir,
+        uint32_t&    face,
+        float&       u,
+        float&       v)
+    {
+        float absX = fabsf(pDir[0]);
+        float absY = fabsf(pDir[1]);
+        float absZ = fabsf(pDir[2]);
+
+        float sc, tc, ma;
+        if ((absX >= absY) && (absX >= absZ))
+        {
+            face = (pDir[0] >= 0.f) ? 0 : 1;
+            sc = (pDir[0] >= 0.f) ? -pDir[2] : pDir[2];
+            tc = -pDir[1];
+            ma = absX;
+        }
+        else if (absY >= absZ)
+        {
+            face = (pDir[1] >= 0.f) ? 2 : 3;
+            sc = pDir[0];
+            tc = (pDir[1] >= 0.f) ? pDir[2] : -pDir[2];
+            ma = absY;
+        }
+        else
+        {
+            face = (pDir[2] >= 0.f) ? 4 : 5;
+            sc = (pDir[2] >= 0.f) ? pDir[0] : -pDir[0];
+            tc = -pDir[1];
+            ma = absZ;
+        }
+
+        u = 0.5f * (sc / ma + 1.f);
+        v = 0.5f * (tc / ma + 1.f);
+    }
+
+    // ================================================================================================================
+    // The VK_FILTER_LINEAR with the VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE on one face. The result is added to pSum.
+    static void AddFaceBilinear(
+        const float* pFace,
+        uint32_t     faceDim,
+        float        u,
+        float        v,
+        float*       pSum)
+    {
+        float texelX = u * faceDim - 0.5f;
+        float texelY = v * faceDim - 0.5f;
+        float floorX = floorf(texelX);
+        float floorY = floorf(texelY);
+        float tx = texelX - floorX;
+        float ty = texelY - floorY;
+
+        const int32_t maxIdx = (int32_t)faceDim - 1;
+        int32_t x0 = std::clamp((int32_t)floorX, 0, maxIdx);
+        int32_t y0 = std::clamp((int32_t)floorY, 0, maxIdx);
+        int32_t x1 = std::clamp((int32_t)floorX + 1, 0, maxIdx);
+        int32_t y1 = std::clamp((int32_t)floorY + 1, 0, maxIdx);
+
+        const float* p00 = pFace + 4 * (uint64_t(y0) * faceDim + x0);
+        const float* p10 = pFace + 4 * (uint64_t(y0) * faceDim + x1);
+        const float* p01 = pFace + 4 * (uint64_t(y1) * faceDim + x0);
+        const float* p11 = pFace + 4 * (uint64_t(y1) * faceDim + x1);
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            float top = p00[c] + (p10[c] - p00[c]) * tx;
+            float bottom = p01[c] + (p11[c] - p01[c]) * tx;
+            pSum[c] += top + (bottom - top) * ty;
+        }
+    }
+
+    // ================================================================================================================
+    void CubemapToOctahedral(
+        const float* pFaces,
+        uint32_t     faceDim,
+        uint32_t     octDim,
+        float*       pOct)
+    {
+        const uint64_t faceTexelCnt = uint64_t(faceDim) * faceDim;
+        const float subsampleWeight = 1.f / (OctahedralSubsampleDim * OctahedralSubsampleDim);
+
+        for (uint32_t y = 0; y < octDim; y++)
+        {
+            for (uint32_t x = 0; x < octDim; x++)
+            {
+                float sum[4] = { 0.f, 0.f, 0.f, 0.f };
+                for (uint32_t sy = 0; sy < OctahedralSubsampleDim; sy++)
+                {
+                    for (uint32_t sx = 0; sx < OctahedralSubsampleDim; sx++)
+                    {
+                        float octU = (x + (sx + 0.5f) / OctahedralSubsampleDim) / octDim;
+                        float octV = (y + (sy + 0.5f) / OctahedralSubsampleDim) / octDim;
+
+                        float dir[3];
+                        OctahedralUvToDir(octU, octV, dir);
+
+                        uint32_t face;
+                        float faceU, faceV;
+                        DirToCubemapFaceUv(dir, face, faceU, faceV);
+                        AddFaceBilinear(pFaces + 4 * face * faceTexelCnt, faceDim, faceU, faceV, sum);
+                    }
+                }
+
+                float* pTexel = pOct + 4 * (uint64_t(y) * octDim + x);
+                for (uint32_t c = 0; c < 4; c++)
+                {
+                    pTexel[c] = sum[c] * subsampleWeight;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+
+namespace SharedLib
+{
+    // The octahedral environment map: The sphere of directions is projected onto the |x| + |y| + |z| = 1 octahedron and
+    // unfolded into one square 2D image. The +Y hemisphere is the inner diamond and the -Y hemisphere is folded into the
+    // four corners. The directions are in the same space as the cubemap sampling directions, so an octahedral map and a
+    // cubemap of the same environment are sampled with the same vector. The octahedral.hlsl has the same functions.
+    // - An octDim of 2 * faceDim keeps about the cubemap angular resolution with 2/3 of its texels.
+    // - A mip chain is a plain 2D mip chain, and every level is still an octahedral map.
+
+    // (u, v) in [0, 1]^2 to the normalized direction.
+    void OctahedralUvToDir(float u, float v, float* pDir);
+
+    // Any non-zero direction to (u, v) in [0, 1]^2.
+    void DirToOctahedralUv(const float* pDir, float& u, float& v);
+
+    inline uint32_t OctahedralDimFromFaceDim(uint32_t faceDim) { return 2 * faceDim; }
+
+    // pFaces is the 6 RGBA32F faces of faceDim in the Vulkan order (X+, X-, Y+, Y-, Z+, Z-) and pOct is the octDim x octDim
+    // RGBA32F output. Every output texel averages 2 x 2 bilinear samples of the faces. The bilinear filter clamps at the
+    // face edges, like a cubemap sampler without the seamless filtering.
+    void CubemapToOctahedral(const float* pFaces, uint32_t faceDim, uint32_t octDim, float* pOct);
+}
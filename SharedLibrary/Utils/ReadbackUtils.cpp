@@ -0,0 +1,333 @@
+#include "ReadbackUtils.h"
+#include "vk_mem_alloc.h"
+#include "VulkanDbgUtils.h"
+#include "TraceUtils.h"
+#include "SyncUtils.h"
+#include <cstdlib>
+#include <iostream>
+
+namespace SharedLib
+{
+    // ================================================================================================================
+    ReadbackManager::ReadbackManager() :
+        m_device(VK_NULL_HANDLE),
+        m_allocator(VK_NULL_HANDLE),
+        m_pTimeline(nullptr),
+        m_cmdPool(VK_NULL_HANDLE),
+        m_nextTicket(1)
+    {}
+
+    // ================================================================================================================
+    void ReadbackManager::Init(
+        VkDevice       device,
+        VmaAllocator   allocator,
+        QueueTimeline& timeline,
+        VkCommandPool  cmdPool)
+    {
+        m_device = device;
+        m_allocator = allocator;
+        m_pTimeline = &timeline;
+        m_cmdPool = cmdPool;
+    }
+
+    // ================================================================================================================
+    void ReadbackManager::Destroy()
+    {
+        if (m_device == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        // The command buffers of the done requests are already back in the free list.
+        for (auto& [ticket, request] : m_requests)
+        {
+            m_pTimeline->Wait(request.timelineValue);
+
+            if (request.ownedCmdBuffer != VK_NULL_HANDLE)
+            {
+                m_freeCmdBuffers.push_back(request.ownedCmdBuffer);
+            }
+        }
+        m_requests.clear();
+
+        if (m_freeCmdBuffers.empty() == false)
+        {
+            vkFreeCommandBuffers(m_device, m_cmdPool, (uint32_t)m_freeCmdBuffers.size(), m_freeCmdBuffers.data());
+            m_freeCmdBuffers.clear();
+        }
+
+        for (const StagingBuffer& stagingBuffer : m_stagingBuffers)
+        {
+            vmaDestroyBuffer(m_allocator, stagingBuffer.buffer, stagingBuffer.alloc);
+        }
+        m_stagingBuffers.clear();
+
+        m_device = VK_NULL_HANDLE;
+    }
+
+    // ================================================================================================================
+    // The consecutive regions of the same image are one vkCmdCopyImageToBuffer(...).
+    uint64_t ReadbackManager::CmdReadImgs(
+        VkCommandBuffer                    cmdBuffer,
+        const std::vector<ReadbackRegion>& regions,
+        const ReadbackCallback&            onComplete)
+    {
+        ReadbackRequest request{};
+        request.onComplete = onComplete;
+
+        VkDeviceSize bytesCnt = 0;
+        for (const ReadbackRegion& region : regions)
+        {
+            VkDeviceSize offset = (bytesCnt + RegionAlignment - 1) / RegionAlignment * RegionAlignment;
+            request.data.regionOffsets.push_back(offset);
+            bytesCnt = offset + VkDeviceSize(region.texelBytes) * region.extent.width * region.extent.height *
+                                region.extent.depth * region.subres.layerCount;
+        }
+        request.bytesCnt = bytesCnt;
+        request.stagingIdx = AcquireStagingBuffer(bytesCnt);
+        request.data.pData = m_stagingBuffers[request.stagingIdx].pMapped;
+
+        const VkBuffer stagingBuffer = m_stagingBuffers[request.stagingIdx].buffer;
+        std::vector<VkBufferImageCopy> imgCopies;
+        for (uint32_t i = 0; i < regions.size(); i++)
+        {
+            VkBufferImageCopy imgCopy{};
+            {
+                imgCopy.bufferOffset = request.data.regionOffsets[i];
+                imgCopy.imageSubresource = regions[i].subres;
+                imgCopy.imageExtent = regions[i].extent;
+            }
+            imgCopies.push_back(imgCopy);
+
+            if ((i + 1 == regions.size()) || (regions[i + 1].srcImg != regions[i].srcImg))
+            {
+                vkCmdCopyImageToBuffer(cmdBuffer,
+                                       regions[i].srcImg,
+                                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                       stagingBuffer,
+                                       (uint32_t)imgCopies.size(), imgCopies.data());
+                imgCopies.clear();
+            }
+        }
+
+        // The host reads after the timeline wait, but the transfer writes still have to be made available to the host.
+        VkMemoryBarrier transferToHostBarrier{};
+        {
+            transferToHostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            transferToHostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            transferToHostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        }
+
+        vkCmdPipelineBarrier(cmdBuffer,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_HOST_BIT,
+                             0,
+                             1, &transferToHostBarrier,
+                             0, nullptr,
+                             0, nullptr);
+
+        const uint64_t ticket = m_nextTicket++;
+        m_requests[ticket] = std::move(request);
+        return ticket;
+    }
+
+    // ================================================================================================================
+    void ReadbackManager::Submit(
+        VkCommandBuffer cmdBuffer,
+        uint64_t        ticket)
+    {
+        m_requests.at(ticket).timelineValue = m_pTimeline->Submit(cmdBuffer);
+    }
+
+    // ================================================================================================================
+    uint64_t ReadbackManager::ReadImgs(
+        const std::vector<ReadbackRegion>& regions,
+        const ReadbackCallback&            onComplete)
+    {
+        if (m_freeCmdBuffers.empty())
+        {
+            VkCommandBufferAllocateInfo cmdBufAllocInfo{};
+            {
+                cmdBufAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                cmdBufAllocInfo.commandPool = m_cmdPool;
+                cmdBufAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+                cmdBufAllocInfo.commandBufferCount = 1;
+            }
+            VkCommandBuffer cmdBuffer;
+            VK_CHECK(vkAllocateCommandBuffers(m_device, &cmdBufAllocInfo, &cmdBuffer));
+            m_freeCmdBuffers.push_back(cmdBuffer);
+        }
+        VkCommandBuffer cmdBuffer = m_freeCmdBuffers.back();
+        m_freeCmdBuffers.pop_back();
+
+        VkCommandBufferBeginInfo beginInfo{};
+        {
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        }
+        VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+        uint64_t ticket = CmdReadImgs(cmdBuffer, regions, onComplete);
+        VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+
+        m_requests.at(ticket).ownedCmdBuffer = cmdBuffer;
+        Submit(cmdBuffer, ticket);
+        return ticket;
+    }
+
+    // ================================================================================================================
+    void ReadbackManager::Poll()
+    {
+        // The Complete(...) can release a request, so the reached tickets are collected first.
+        std::vector<uint64_t> reachedTickets;
+        for (const auto& [ticket, request] : m_requests)
+        {
+            if ((request.isDone == false) &&
+                (request.timelineValue != 0) &&
+                m_pTimeline->IsReached(request.timelineValue))
+            {
+                reachedTickets.push_back(ticket);
+            }
+        }
+
+        for (uint64_t ticket : reachedTickets)
+        {
+            Complete(ticket);
+        }
+    }
+
+    // ================================================================================================================
+    void ReadbackManager::Wait(
+        uint64_t ticket)
+    {
+        auto itr = m_requests.find(ticket);
+        if ((itr == m_requests.end()) || itr->second.isDone)
+        {
+            return;
+        }
+
+        if (itr->second.timelineValue == 0)
+        {
+            std::cerr << "The readback request " << ticket << " is waited before its submit." << std::endl;
+            exit(1);
+        }
+
+        m_pTimeline->Wait(itr->second.timelineValue);
+        Complete(ticket);
+    }
+
+    // ================================================================================================================
+    bool ReadbackManager::IsDone(
+        uint64_t ticket)
+    {
+        Poll();
+        auto itr = m_requests.find(ticket);
+        return (itr == m_requests.end()) || itr->second.isDone;
+    }
+
+    // ================================================================================================================
+    // A request in flight is waited for, since the GPU can still copy into its staging buffer and command buffer.
+    void ReadbackManager::Release(
+        uint64_t ticket)
+    {
+        auto itr = m_requests.find(ticket);
+        if (itr == m_requests.end())
+        {
+            return;
+        }
+
+        ReadbackRequest& request = itr->second;
+        if (request.isDone == false)
+        {
+            if (request.timelineValue == 0)
+            {
+                std::cerr << "The readback request " << ticket << " is released before its submit." << std::endl;
+                exit(1);
+            }
+
+            m_pTimeline->Wait(request.timelineValue);
+
+            if (request.ownedCmdBuffer != VK_NULL_HANDLE)
+            {
+                VK_CHECK(vkResetCommandBuffer(request.ownedCmdBuffer, 0));
+                m_freeCmdBuffers.push_back(request.ownedCmdBuffer);
+            }
+        }
+
+        m_stagingBuffers[request.stagingIdx].isInUse = false;
+        m_requests.erase(itr);
+    }
+
+    // ================================================================================================================
+    // The smallest free buffer that fits. A new buffer is only created when none of them fits.
+    uint32_t ReadbackManager::AcquireStagingBuffer(
+        VkDeviceSize bytesCnt)
+    {
+        int bestIdx = -1;
+        for (uint32_t i = 0; i < m_stagingBuffers.size(); i++)
+        {
+            const StagingBuffer& stagingBuffer = m_stagingBuffers[i];
+            if ((stagingBuffer.isInUse == false) &&
+                (stagingBuffer.bytesCnt >= bytesCnt) &&
+                ((bestIdx < 0) || (stagingBuffer.bytesCnt < m_stagingBuffers[bestIdx].bytesCnt)))
+            {
+                bestIdx = int(i);
+            }
+        }
+
+        if (bestIdx < 0)
+        {
+            // The host reads it, so it is in the host cached memory instead of the write combined memory.
+            VmaAllocationCreateInfo stagingBufAllocInfo{};
+            {
+                stagingBufAllocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+                stagingBufAllocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+            }
+
+            VkBufferCreateInfo stgBufInfo{};
+            {
+                stgBufInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+                stgBufInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+                stgBufInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+                stgBufInfo.size = bytesCnt;
+            }
+
+            StagingBuffer stagingBuffer{};
+            VmaAllocationInfo stagingBufInfo{};
+            VK_CHECK(vmaCreateBuffer(m_allocator, &stgBufInfo, &stagingBufAllocInfo, &stagingBuffer.buffer, &stagingBuffer.alloc, &stagingBufInfo));
+            stagingBuffer.bytesCnt = bytesCnt;
+            stagingBuffer.pMapped = static_cast<uint8_t*>(stagingBufInfo.pMappedData);
+
+            m_stagingBuffers.push_back(stagingBuffer);
+            bestIdx = int(m_stagingBuffers.size()) - 1;
+        }
+
+        m_stagingBuffers[bestIdx].isInUse = true;
+        return uint32_t(bestIdx);
+    }
+
+    // ================================================================================================================
+    void ReadbackManager::Complete(
+        uint64_t ticket)
+    {
+        ReadbackRequest& request = m_requests.at(ticket);
+
+        // It is a no-op on the host coherent memory.
+        VK_CHECK(vmaInvalidateAllocation(m_allocator, m_stagingBuffers[request.stagingIdx].alloc, 0, request.bytesCnt));
+        AddTraceBytes(TraceReadbackBytes, request.bytesCnt);
+
+        if (request.ownedCmdBuffer != VK_NULL_HANDLE)
+        {
+            VK_CHECK(vkResetCommandBuffer(request.ownedCmdBuffer, 0));
+            m_freeCmdBuffers.push_back(request.ownedCmdBuffer);
+            request.ownedCmdBuffer = VK_NULL_HANDLE;
+        }
+
+        request.isDone = true;
+
+        if (request.onComplete)
+        {
+            request.onComplete(request.data);
+            Release(ticket);
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+
+VK_DEFINE_HANDLE(VmaAllocator)
+VK_DEFINE_HANDLE(VmaAllocation)
+
+namespace SharedLib
+{
+    class QueueTimeline;
+
+    // A subresource range of an image that is read back. A region with several layers, e.g. the 6 faces of a cubemap
+    // level, is one copy and its layers are back to back in the data.
+    struct ReadbackRegion
+    {
+        VkImage                  srcImg;
+        VkImageSubresourceLayers subres;
+        VkExtent3D               extent;
+        uint32_t                 texelBytes;
+    };
+
+    // The mapped staging memory of a finished request. The regions are tightly packed rows at the regionOffsets.
+    struct ReadbackData
+    {
+        const uint8_t*            pData;
+        std::vector<VkDeviceSize> regionOffsets;
+    };
+
+    using ReadbackCallback = std::function<void(const ReadbackData&)>;
+
+    // The readbacks through a pool of persistently mapped host cached staging buffers. A request copies any number of
+    // regions, e.g. all the faces and mips of the IBL cubemaps, into one staging buffer and completes when the queue
+    // timeline reaches the value of its submit. The data is read from the mapped memory directly.
+    // - The regions have to be in the VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL when the copies run.
+    // - A request with an onComplete callback calls it from the Poll() or the Wait(...) that sees its value reached, and
+    //   then the staging buffer goes back to the pool. A request without it keeps the staging buffer until the
+    //   Release(...), so the GetData(...) is valid until then.
+    // - The staging buffers are reused for the later requests that fit in them. It is not thread safe.
+    class ReadbackManager
+    {
+    public:
+        ReadbackManager();
+        ~ReadbackManager() {};
+
+        void Init(VkDevice device, VmaAllocator allocator, QueueTimeline& timeline, VkCommandPool cmdPool);
+        void Destroy();
+
+        // Records the copies into the cmdBuffer, so they can be in the same submit as the rendering of the regions. The
+        // user ends the cmdBuffer and submits it with the Submit(...).
+        uint64_t CmdReadImgs(VkCommandBuffer                    cmdBuffer,
+                             const std::vector<ReadbackRegion>& regions,
+                             const ReadbackCallback&            onComplete = nullptr);
+        void Submit(VkCommandBuffer cmdBuffer, uint64_t ticket);
+
+        // Records the copies in a command buffer of the manager and submits it.
+        uint64_t ReadImgs(const std::vector<ReadbackRegion>& regions,
+                          const ReadbackCallback&            onComplete = nullptr);
+
+        void Poll(); // Completes the requests whose timeline values are reached. It doesn't wait.
+        void Wait(uint64_t ticket); // The request has to be submitted.
+        bool IsDone(uint64_t ticket);
+
+        const ReadbackData& GetData(uint64_t ticket) { return m_requests.at(ticket).data; }
+
+        // Waits for a request in flight without calling its onComplete. The request has to be submitted.
+        void Release(uint64_t ticket);
+
+    private:
+        static constexpr VkDeviceSize RegionAlignment = 16;
+
+        struct StagingBuffer
+        {
+            VkBuffer      buffer;
+            VmaAllocation alloc;
+            VkDeviceSize  bytesCnt;
+            uint8_t*      pMapped;
+            bool          isInUse;
+        };
+
+        struct ReadbackRequest
+        {
+            uint64_t         timelineValue; // 0 until the request is submitted.
+            VkCommandBuffer  ownedCmdBuffer; // VK_NULL_HANDLE when the user records and owns the command buffer.
+            uint32_t         stagingIdx;
+            VkDeviceSize     bytesCnt;
+            ReadbackData     data;
+            ReadbackCallback onComplete;
+            bool             isDone;
+        };
+
+        uint32_t AcquireStagingBuffer(VkDeviceSize bytesCnt);
+        void     Complete(uint64_t ticket);
+
+        VkDevice       m_device;
+        VmaAllocator   m_allocator;
+        QueueTimeline* m_pTimeline;
+        VkCommandPool  m_cmdPool;
+
+        std::vector<StagingBuffer>          m_stagingBuffers;
+        std::vector<VkCommandBuffer>        m_freeCmdBuffers;
+        std::map<uint64_t, ReadbackRequest> m_requests;
+        uint64_t                            m_nextTicket;
+    };
+}
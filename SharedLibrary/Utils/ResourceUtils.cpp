@@ -0,0 +1,175 @@
+#include "ResourceUtils.h"
+#include "vk_mem_alloc.h"
+#include "VulkanDbgUtils.h"
+#include "SyncUtils.h"
+
+namespace SharedLib
+{
+    // ================================================================================================================
+    ResourceRegistry::ResourceRegistry() :
+        m_device(VK_NULL_HANDLE),
+        m_allocator(VK_NULL_HANDLE),
+        m_pTimeline(nullptr)
+    {}
+
+    // ================================================================================================================
+    void ResourceRegistry::Init(
+        VkDevice       device,
+        VmaAllocator   allocator,
+        QueueTimeline& timeline)
+    {
+        m_device = device;
+        m_allocator = allocator;
+        m_pTimeline = &timeline;
+    }
+
+    // ================================================================================================================
+    void ResourceRegistry::Destroy()
+    {
+        if (m_device == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        // The resources can be used on any queue, and the last releases can wait for a submit that never comes.
+        VK_CHECK(vkDeviceWaitIdle(m_device));
+
+        for (PendingRelease& pendingRelease : m_pendingReleases)
+        {
+            pendingRelease.releaseFn();
+        }
+        m_pendingReleases.clear();
+
+        // The views go before the images that they view.
+        m_imageViews.RemoveAll([this](VkImageView view) { vkDestroyImageView(m_device, view, nullptr); });
+        m_samplers.RemoveAll([this](VkSampler sampler) { vkDestroySampler(m_device, sampler, nullptr); });
+        m_images.RemoveAll([this](const ImageResource& img) { vmaDestroyImage(m_allocator, img.image, img.alloc); });
+        m_buffers.RemoveAll([this](const BufferResource& buf) { vmaDestroyBuffer(m_allocator, buf.buffer, buf.alloc); });
+
+        m_device = VK_NULL_HANDLE;
+    }
+
+    // ================================================================================================================
+    BufferHandle ResourceRegistry::CreateBuffer(
+        VmaMemoryUsage           vmaMemUsage,
+        VmaAllocationCreateFlags vmaAllocFlags,
+        VkBufferUsageFlags       bufferUsageFlag,
+        VkDeviceSize             bytesCnt)
+    {
+        VmaAllocationCreateInfo bufAllocInfo{};
+        {
+            bufAllocInfo.usage = vmaMemUsage;
+            bufAllocInfo.flags = vmaAllocFlags;
+        }
+
+        VkBufferCreateInfo bufInfo{};
+        {
+            bufInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            bufInfo.usage = bufferUsageFlag;
+            bufInfo.size = bytesCnt;
+        }
+
+        BufferResource buffer{};
+        VmaAllocationInfo allocInfo{};
+        VK_CHECK(vmaCreateBuffer(m_allocator, &bufInfo, &bufAllocInfo, &buffer.buffer, &buffer.alloc, &allocInfo));
+        buffer.pMapped = allocInfo.pMappedData;
+
+        return m_buffers.Add(buffer);
+    }
+
+    // ================================================================================================================
+    ImageHandle ResourceRegistry::CreateImage(
+        VmaMemoryUsage           vmaMemUsage,
+        VmaAllocationCreateFlags vmaAllocFlags,
+        const VkImageCreateInfo& imgInfo)
+    {
+        VmaAllocationCreateInfo imgAllocInfo{};
+        {
+            imgAllocInfo.usage = vmaMemUsage;
+            imgAllocInfo.flags = vmaAllocFlags;
+        }
+
+        ImageResource img{};
+        VK_CHECK(vmaCreateImage(m_allocator, &imgInfo, &imgAllocInfo, &img.image, &img.alloc, nullptr));
+
+        return m_images.Add(img);
+    }
+
+    // ================================================================================================================
+    ImageViewHandle ResourceRegistry::CreateImageView(
+        const VkImageViewCreateInfo& viewInfo)
+    {
+        VkImageView view;
+        VK_CHECK(vkCreateImageView(m_device, &viewInfo, nullptr, &view));
+        return m_imageViews.Add(view);
+    }
+
+    // ================================================================================================================
+    SamplerHandle ResourceRegistry::CreateSampler(
+        const VkSamplerCreateInfo& samplerInfo)
+    {
+        VkSampler sampler;
+        VK_CHECK(vkCreateSampler(m_device, &samplerInfo, nullptr, &sampler));
+        return m_samplers.Add(sampler);
+    }
+
+    // ================================================================================================================
+    void ResourceRegistry::Release(
+        BufferHandle& handle)
+    {
+        BufferResource buffer = m_buffers.Remove(handle);
+        DeferRelease([this, buffer]() { vmaDestroyBuffer(m_allocator, buffer.buffer, buffer.alloc); });
+        handle = BufferHandle{};
+    }
+
+    // ================================================================================================================
+    void ResourceRegistry::Release(
+        ImageHandle& handle)
+    {
+        ImageResource img = m_images.Remove(handle);
+        DeferRelease([this, img]() { vmaDestroyImage(m_allocator, img.image, img.alloc); });
+        handle = ImageHandle{};
+    }
+
+    // ================================================================================================================
+    void ResourceRegistry::Release(
+        ImageViewHandle& handle)
+    {
+        VkImageView view = m_imageViews.Remove(handle);
+        DeferRelease([this, view]() { vkDestroyImageView(m_device, view, nullptr); });
+        handle = ImageViewHandle{};
+    }
+
+    // ================================================================================================================
+    void ResourceRegistry::Release(
+        SamplerHandle& handle)
+    {
+        VkSampler sampler = m_samplers.Remove(handle);
+        DeferRelease([this, sampler]() { vkDestroySampler(m_device, sampler, nullptr); });
+        handle = SamplerHandle{};
+    }
+
+    // ================================================================================================================
+    void ResourceRegistry::DeferRelease(
+        const std::function<void()>& releaseFn)
+    {
+        PendingRelease pendingRelease{};
+        {
+            pendingRelease.timelineValue = m_pTimeline->GetLastSubmittedValue() + 1;
+            pendingRelease.releaseFn = releaseFn;
+        }
+        m_pendingReleases.push_back(std::move(pendingRelease));
+    }
+
+    // ================================================================================================================
+    void ResourceRegistry::CollectGarbage()
+    {
+        while ((m_pendingReleases.empty() == false) &&
+               m_pTimeline->IsReached(m_pendingReleases.front().timelineValue))
+        {
+            m_pendingReleases.front().releaseFn();
+            m_pendingReleases.pop_front();
+        }
+    }
+}
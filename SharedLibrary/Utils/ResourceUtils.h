@@ -0,0 +1,205 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+VK_DEFINE_HANDLE(VmaAllocator)
+VK_DEFINE_HANDLE(VmaAllocation)
+
+enum VmaMemoryUsage;
+typedef VkFlags VmaAllocationCreateFlags;
+
+namespace SharedLib
+{
+    class QueueTimeline;
+
+    // A generational handle of a resource in the ResourceRegistry. The idx is a slot of a dense array, and the
+    // generation of the slot changes when the resource is released, so a stale handle is caught instead of silently
+    // aliasing the next resource in the slot. The generation 0 is the null handle.
+    template<typename ResourceTag>
+    struct ResourceHandle
+    {
+        uint32_t idx = 0;
+        uint32_t generation = 0;
+
+        bool IsNull() const { return generation == 0; }
+    };
+
+    using BufferHandle    = ResourceHandle<struct BufferTag>;
+    using ImageHandle     = ResourceHandle<struct ImageTag>;
+    using ImageViewHandle = ResourceHandle<struct ImageViewTag>;
+    using SamplerHandle   = ResourceHandle<struct SamplerTag>;
+
+    // The dense array of one resource type. The released slots are reused, with a new generation.
+    template<typename Resource, typename Handle>
+    class ResourceSlots
+    {
+    public:
+        Handle Add(const Resource& resource)
+        {
+            uint32_t idx;
+            if (m_freeIdxs.empty())
+            {
+                idx = (uint32_t)m_resources.size();
+                m_resources.push_back(resource);
+                m_generations.push_back(1);
+                m_isLive.push_back(true);
+            }
+            else
+            {
+                idx = m_freeIdxs.back();
+                m_freeIdxs.pop_back();
+                m_resources[idx] = resource;
+                m_isLive[idx] = true;
+            }
+
+            Handle handle{};
+            {
+                handle.idx = idx;
+                handle.generation = m_generations[idx];
+            }
+            return handle;
+        }
+
+        bool IsValid(Handle handle) const
+        {
+            return (handle.IsNull() == false) &&
+                   (handle.idx < m_resources.size()) &&
+                   m_isLive[handle.idx] &&
+                   (m_generations[handle.idx] == handle.generation);
+        }
+
+        const Resource& Get(Handle handle) const
+        {
+            if (IsValid(handle) == false)
+            {
+                std::cerr << "A stale or null resource handle is used. Slot: " << handle.idx
+                          << ", generation: " << handle.generation << std::endl;
+                exit(1);
+            }
+            return m_resources[handle.idx];
+        }
+
+        // The generation 0 is skipped on the wrap around, since it is the null handle.
+        Resource Remove(Handle handle)
+        {
+            Resource resource = Get(handle);
+            m_isLive[handle.idx] = false;
+            m_generations[handle.idx] = (m_generations[handle.idx] == UINT32_MAX) ? 1 : m_generations[handle.idx] + 1;
+            m_freeIdxs.push_back(handle.idx);
+            return resource;
+        }
+
+        template<typename Fn>
+        void RemoveAll(Fn fn)
+        {
+            for (uint32_t i = 0; i < m_resources.size(); i++)
+            {
+                if (m_isLive[i])
+                {
+                    fn(m_resources[i]);
+                }
+            }
+            m_resources.clear();
+            m_generations.clear();
+            m_isLive.clear();
+            m_freeIdxs.clear();
+        }
+
+    private:
+        std::vector<Resource> m_resources;
+        std::vector<uint32_t> m_generations;
+        std::vector<bool>     m_isLive;
+        std::vector<uint32_t> m_freeIdxs;
+    };
+
+    // The buffers, images, views and samplers behind the generational handles, with the deferred releases.
+    // - A Release(...) invalidates the handle at once, but the Vulkan objects are destroyed by the CollectGarbage() after
+    //   the graphics timeline reaches the value of the next submit. The resource can still be in the command buffer
+    //   that is being recorded, so the submits that are in flight are not enough.
+    // - Then a resource that is replaced, e.g. on a swapchain resize, doesn't need a device idle. The GlfwApplication
+    //   calls the CollectGarbage() in the FrameStart().
+    // - The Application owns one on the graphics timeline. It is not thread safe.
+    class ResourceRegistry
+    {
+    public:
+        ResourceRegistry();
+        ~ResourceRegistry() {};
+
+        void Init(VkDevice device, VmaAllocator allocator, QueueTimeline& timeline);
+        void Destroy(); // Waits for the device and destroys the pending releases and the resources that are left.
+
+        BufferHandle CreateBuffer(VmaMemoryUsage           vmaMemUsage,
+                                  VmaAllocationCreateFlags vmaAllocFlags,
+                                  VkBufferUsageFlags       bufferUsageFlag,
+                                  VkDeviceSize             bytesCnt);
+
+        ImageHandle CreateImage(VmaMemoryUsage           vmaMemUsage,
+                                VmaAllocationCreateFlags vmaAllocFlags,
+                                const VkImageCreateInfo& imgInfo);
+
+        // The image of the viewInfo can also be an image that is not in the registry, e.g. a swapchain image.
+        ImageViewHandle CreateImageView(const VkImageViewCreateInfo& viewInfo);
+        SamplerHandle CreateSampler(const VkSamplerCreateInfo& samplerInfo);
+
+        VkBuffer GetBuffer(BufferHandle handle) { return m_buffers.Get(handle).buffer; }
+        VmaAllocation GetBufferAlloc(BufferHandle handle) { return m_buffers.Get(handle).alloc; }
+        void* GetBufferMapped(BufferHandle handle) { return m_buffers.Get(handle).pMapped; } // With the MAPPED flag.
+        VkImage GetImage(ImageHandle handle) { return m_images.Get(handle).image; }
+        VmaAllocation GetImageAlloc(ImageHandle handle) { return m_images.Get(handle).alloc; }
+        VkImageView GetImageView(ImageViewHandle handle) { return m_imageViews.Get(handle); }
+        VkSampler GetSampler(SamplerHandle handle) { return m_samplers.Get(handle); }
+
+        bool IsValid(BufferHandle handle) const { return m_buffers.IsValid(handle); }
+        bool IsValid(ImageHandle handle) const { return m_images.IsValid(handle); }
+        bool IsValid(ImageViewHandle handle) const { return m_imageViews.IsValid(handle); }
+        bool IsValid(SamplerHandle handle) const { return m_samplers.IsValid(handle); }
+
+        // The handle is set to the null handle.
+        void Release(BufferHandle& handle);
+        void Release(ImageHandle& handle);
+        void Release(ImageViewHandle& handle);
+        void Release(SamplerHandle& handle);
+
+        // For the objects that are not in the registry but are retired in the same way, e.g. an old swapchain.
+        void DeferRelease(const std::function<void()>& releaseFn);
+
+        // Destroys the released resources whose timeline values are reached. It doesn't wait.
+        void CollectGarbage();
+
+    private:
+        struct BufferResource
+        {
+            VkBuffer      buffer;
+            VmaAllocation alloc;
+            void*         pMapped;
+        };
+
+        struct ImageResource
+        {
+            VkImage       image;
+            VmaAllocation alloc;
+        };
+
+        // The releases are in the order of their timeline values, so the queue retires from the front.
+        struct PendingRelease
+        {
+            uint64_t              timelineValue;
+            std::function<void()> releaseFn;
+        };
+
+        VkDevice       m_device;
+        VmaAllocator   m_allocator;
+        QueueTimeline* m_pTimeline;
+
+        ResourceSlots<BufferResource, BufferHandle>  m_buffers;
+        ResourceSlots<ImageResource, ImageHandle>    m_images;
+        ResourceSlots<VkImageView, ImageViewHandle>  m_imageViews;
+        ResourceSlots<VkSampler, SamplerHandle>      m_samplers;
+        std::deque<PendingRelease>                   m_pendingReleases;
+    };
+}
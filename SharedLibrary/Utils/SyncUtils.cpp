@@ -0,0 +1,160 @@
+#include "SyncUtils.h"
+#include "VulkanDbgUtils.h"
+
+namespace SharedLib
+{
+    // ================================================================================================================
+    QueueTimeline::QueueTimeline() :
+        m_device(VK_NULL_HANDLE),
+        m_queue(VK_NULL_HANDLE),
+        m_semaphore(VK_NULL_HANDLE),
+        m_lastSubmittedValue(0),
+        m_completedValue(0)
+    {}
+
+    // ================================================================================================================
+    void QueueTimeline::Init(
+        VkDevice device,
+        VkQueue  queue)
+    {
+        m_device = device;
+        m_queue = queue;
+
+        VkSemaphoreTypeCreateInfo semaphoreTypeInfo{};
+        {
+            semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+            semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+            semaphoreTypeInfo.initialValue = 0;
+        }
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        {
+            semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+            semaphoreInfo.pNext = &semaphoreTypeInfo;
+        }
+        VK_CHECK(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_semaphore));
+    }
+
+    // ================================================================================================================
+    void QueueTimeline::Destroy()
+    {
+        if (m_semaphore == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        WaitIdle();
+        vkDestroySemaphore(m_device, m_semaphore, nullptr);
+        m_semaphore = VK_NULL_HANDLE;
+    }
+
+    // ================================================================================================================
+    uint64_t QueueTimeline::Submit(
+        VkCommandBuffer                   cmdBuffer,
+        const std::vector<SemaphoreWait>& waits,
+        const std::vector<VkSemaphore>&   binarySignals)
+    {
+        std::vector<VkSemaphore> waitSemaphores(waits.size());
+        std::vector<uint64_t> waitValues(waits.size());
+        std::vector<VkPipelineStageFlags> waitStages(waits.size());
+        for (uint32_t i = 0; i < waits.size(); i++)
+        {
+            waitSemaphores[i] = waits[i].semaphore;
+            waitValues[i] = waits[i].value;
+            waitStages[i] = waits[i].dstStageMask;
+        }
+
+        // The timeline semaphore is the first signal. The values of the binary semaphores are ignored.
+        const uint64_t signalValue = m_lastSubmittedValue + 1;
+        std::vector<VkSemaphore> signalSemaphores(1, m_semaphore);
+        signalSemaphores.insert(signalSemaphores.end(), binarySignals.begin(), binarySignals.end());
+        std::vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+        signalValues[0] = signalValue;
+
+        VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{};
+        {
+            timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            timelineSubmitInfo.waitSemaphoreValueCount = (uint32_t)waitValues.size();
+            timelineSubmitInfo.pWaitSemaphoreValues = waitValues.data();
+            timelineSubmitInfo.signalSemaphoreValueCount = (uint32_t)signalValues.size();
+            timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+        }
+
+        VkSubmitInfo submitInfo{};
+        {
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.pNext = &timelineSubmitInfo;
+            submitInfo.waitSemaphoreCount = (uint32_t)waitSemaphores.size();
+            submitInfo.pWaitSemaphores = waitSemaphores.data();
+            submitInfo.pWaitDstStageMask = waitStages.data();
+            submitInfo.commandBufferCount = (cmdBuffer == VK_NULL_HANDLE) ? 0 : 1;
+            submitInfo.pCommandBuffers = &cmdBuffer;
+            submitInfo.signalSemaphoreCount = (uint32_t)signalSemaphores.size();
+            submitInfo.pSignalSemaphores = signalSemaphores.data();
+        }
+        VK_CHECK(vkQueueSubmit(m_queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+        m_lastSubmittedValue = signalValue;
+        return signalValue;
+    }
+
+    // ================================================================================================================
+    void QueueTimeline::SubmitAndWait(
+        VkCommandBuffer                   cmdBuffer,
+        const std::vector<SemaphoreWait>& waits)
+    {
+        Wait(Submit(cmdBuffer, waits));
+    }
+
+    // ================================================================================================================
+    SemaphoreWait QueueTimeline::WaitPoint(
+        uint64_t             value,
+        VkPipelineStageFlags dstStageMask)
+    {
+        SemaphoreWait wait{};
+        {
+            wait.semaphore = m_semaphore;
+            wait.value = value;
+            wait.dstStageMask = dstStageMask;
+        }
+        return wait;
+    }
+
+    // ================================================================================================================
+    uint64_t QueueTimeline::GetCompletedValue()
+    {
+        VK_CHECK(vkGetSemaphoreCounterValue(m_device, m_semaphore, &m_completedValue));
+        return m_completedValue;
+    }
+
+    // ================================================================================================================
+    bool QueueTimeline::IsReached(
+        uint64_t value)
+    {
+        if (value <= m_completedValue)
+        {
+            return true;
+        }
+        return value <= GetCompletedValue();
+    }
+
+    // ================================================================================================================
+    void QueueTimeline::Wait(
+        uint64_t value)
+    {
+        if (value <= m_completedValue)
+        {
+            return;
+        }
+
+        VkSemaphoreWaitInfo waitInfo{};
+        {
+            waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+            waitInfo.semaphoreCount = 1;
+            waitInfo.pSemaphores = &m_semaphore;
+            waitInfo.pValues = &value;
+        }
+        VK_CHECK(vkWaitSemaphores(m_device, &waitInfo, UINT64_MAX));
+        m_completedValue = value;
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+namespace SharedLib
+{
+    // A semaphore that a submit waits for. The value is the timeline value to reach, and it is ignored for a binary
+    // semaphore, e.g. the image available semaphore of a swapchain.
+    struct SemaphoreWait
+    {
+        VkSemaphore          semaphore;
+        uint64_t             value;
+        VkPipelineStageFlags dstStageMask;
+    };
+
+    // One timeline semaphore per queue. Every submit through it signals the next value of its counter, so the value
+    // returned by a submit is reached when that submit and all the submits before it on the queue are done.
+    // - The resources used by a submit are retired once the IsReached(...) of its value is true. There is no fence
+    //   to create, reset or recycle per submit.
+    // - The submits on another queue wait for a value on the GPU with the WaitPoint(...), without a host round trip.
+    // - The binary semaphores of the swapchain can be waited and signaled in the same submit.
+    // - The Application owns one per queue. It is not thread safe, like the vkQueueSubmit(...) on its queue.
+    class QueueTimeline
+    {
+    public:
+        QueueTimeline();
+        ~QueueTimeline() {};
+
+        void Init(VkDevice device, VkQueue queue);
+        void Destroy();
+
+        // Returns the value that the submit signals. A VK_NULL_HANDLE cmdBuffer submits only the waits and signals.
+        uint64_t Submit(VkCommandBuffer                   cmdBuffer,
+                        const std::vector<SemaphoreWait>& waits = {},
+                        const std::vector<VkSemaphore>&   binarySignals = {});
+
+        // The Submit(...) and a host wait for its value, for the one-off work like the bakes of the tools.
+        void SubmitAndWait(VkCommandBuffer cmdBuffer, const std::vector<SemaphoreWait>& waits = {});
+
+        // The wait for the value of this timeline in a submit on another queue.
+        SemaphoreWait WaitPoint(uint64_t value, VkPipelineStageFlags dstStageMask);
+
+        uint64_t GetCompletedValue(); // Queries the semaphore. It doesn't wait.
+        bool IsReached(uint64_t value);
+        void Wait(uint64_t value);
+        void WaitIdle() { Wait(m_lastSubmittedValue); }
+
+        uint64_t GetLastSubmittedValue() { return m_lastSubmittedValue; }
+        VkSemaphore GetSemaphore() { return m_semaphore; }
+        VkQueue GetQueue() { return m_queue; }
+
+    private:
+        VkDevice    m_device;
+        VkQueue     m_queue;
+        VkSemaphore m_semaphore;
+        uint64_t    m_lastSubmittedValue;
+        uint64_t    m_completedValue; // The latest value seen on the host, so the IsReached(...) often skips the query.
+    };
+}
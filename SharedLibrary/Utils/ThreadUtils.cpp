@@ -0,0 +1,104 @@
+#include "ThreadUtils.h"
+#include <atomic>
+#include <algorithm>
+
+namespace SharedLib
+{
+    // ================================================================================================================
+    ThreadPool::ThreadPool(
+        uint32_t threadCnt) :
+        m_stop(false)
+    {
+        if (threadCnt == 0)
+        {
+            threadCnt = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        m_workers.reserve(threadCnt);
+        for (uint32_t i = 0; i < threadCnt; i++)
+        {
+            m_workers.emplace_back(&ThreadPool::WorkerLoop, this);
+        }
+    }
+
+    // ================================================================================================================
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+
+        for (std::thread& worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    // ================================================================================================================
+    void ThreadPool::WorkerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [this]() { return m_stop || (m_tasks.empty() == false); });
+
+                // Drain the queue before quitting so no submitted future is left broken.
+                if (m_stop && m_tasks.empty())
+                {
+                    return;
+                }
+
+                task = std::move(m_tasks.front());
+                m_tasks.pop();
+            }
+            task();
+        }
+    }
+
+    // ================================================================================================================
+    // Indices are handed out one by one through an atomic counter, so uneven tasks (e.g. the last rows of a tiny
+    // mip) don't stall a worker. The calling thread also pulls indices instead of idling.
+    void ThreadPool::ParallelFor(
+        uint32_t                            taskCnt,
+        const std::function<void(uint32_t)>& func)
+    {
+        if (taskCnt == 0)
+        {
+            return;
+        }
+
+        if (taskCnt == 1)
+        {
+            func(0);
+            return;
+        }
+
+        std::atomic<uint32_t> nextIdx(0);
+        auto pullTasks = [&nextIdx, taskCnt, &func]()
+        {
+            for (uint32_t i = nextIdx.fetch_add(1); i < taskCnt; i = nextIdx.fetch_add(1))
+            {
+                func(i);
+            }
+        };
+
+        uint32_t helperCnt = std::min(GetThreadCnt(), taskCnt - 1);
+        std::vector<std::future<void>> helpers;
+        helpers.reserve(helperCnt);
+        for (uint32_t i = 0; i < helperCnt; i++)
+        {
+            helpers.push_back(Submit(pullTasks));
+        }
+
+        pullTasks();
+
+        for (std::future<void>& helper : helpers)
+        {
+            helper.get();
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+namespace SharedLib
+{
+    // A fixed size worker pool for the host side heavy lifting in tools (Mipmaps, file encoding, etc).
+    // - Tasks are plain callables. Submit(...) returns a future so the caller decides when to sync.
+    // - ParallelFor(...) splits an index range among the workers and the calling thread, and returns after all indices
+    //   are processed.
+    class ThreadPool
+    {
+    public:
+        explicit ThreadPool(uint32_t threadCnt = 0); // 0 means std::thread::hardware_concurrency().
+        ~ThreadPool();
+
+        uint32_t GetThreadCnt() { return (uint32_t)m_workers.size(); }
+
+        template<typename F>
+        std::future<std::invoke_result_t<F>> Submit(F&& task)
+        {
+            using RetType = std::invoke_result_t<F>;
+            auto pTask = std::make_shared<std::packaged_task<RetType()>>(std::forward<F>(task));
+            std::future<RetType> res = pTask->get_future();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_tasks.push([pTask]() { (*pTask)(); });
+            }
+            m_cv.notify_one();
+            return res;
+        }
+
+        // Calls func(i) for every i in [0, taskCnt). Blocks until all calls return.
+        void ParallelFor(uint32_t taskCnt, const std::function<void(uint32_t)>& func);
+
+    private:
+        void WorkerLoop();
+
+        std::vector<std::thread>          m_workers;
+        std::queue<std::function<void()>> m_tasks;
+        std::mutex                        m_mutex;
+        std::condition_variable           m_cv;
+        bool                              m_stop;
+    };
+}
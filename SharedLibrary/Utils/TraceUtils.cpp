@@ -0,0 +1,252 @@
+#include "TraceUtils.h"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace SharedLib
+{
+    // A complete event ('X'), a counter sample ('C') or a track name ('M').
+    struct TraceEvent
+    {
+        std::string name;
+        const char* pCategory;
+        char        phase;
+        uint64_t    beginUs;
+        uint64_t    durationUs; // The counter value of a 'C' event.
+        uint32_t    trackId;
+    };
+
+    struct TraceState
+    {
+        std::mutex                            mutex;
+        std::vector<TraceEvent>               events;
+        std::map<std::string, uint64_t>       counters;
+        std::string                           namePath;
+        std::chrono::steady_clock::time_point beginTime;
+        std::atomic<bool>                     isOn{ false };
+        std::atomic<uint32_t>                 nextTrackId{ GpuTraceTrackId + 1 };
+    };
+
+    // ================================================================================================================
+    static TraceState& GetTraceState()
+    {
+        static TraceState state;
+        return state;
+    }
+
+    // ================================================================================================================
+    // A thread gets its track at its first event, so the threads that never record don't show up.
+    static uint32_t GetThreadTrackId()
+    {
+        thread_local uint32_t trackId = GetTraceState().nextTrackId.fetch_add(1);
+        return trackId;
+    }
+
+    // ================================================================================================================
+    static std::string EscapeJson(
+        const std::string& str)
+    {
+        std::string escaped;
+        escaped.reserve(str.size());
+        for (char c : str)
+        {
+            if ((c == '"') || (c == '\\'))
+            {
+                escaped.push_back('\\');
+                escaped.push_back(c);
+            }
+            else if ((unsigned char)c >= 0x20)
+            {
+                escaped.push_back(c);
+            }
+        }
+        return escaped;
+    }
+
+    // ================================================================================================================
+    void BeginTrace(
+        const std::string& namePath)
+    {
+        TraceState& state = GetTraceState();
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.events.clear();
+            state.counters.clear();
+            state.namePath = namePath;
+            state.beginTime = std::chrono::steady_clock::now();
+            state.events.push_back({ "GPU", "__metadata", 'M', 0, 0, GpuTraceTrackId });
+        }
+        state.isOn = true;
+    }
+
+    // ================================================================================================================
+    bool EndTrace()
+    {
+        TraceState& state = GetTraceState();
+        if (state.isOn.exchange(false) == false)
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(state.mutex);
+        std::ofstream ofd(state.namePath, std::ios::trunc);
+        if (ofd.is_open() == false)
+        {
+            std::cerr << "Cannot write the trace to: " << state.namePath << std::endl;
+            return false;
+        }
+
+        ofd << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        for (size_t i = 0; i < state.events.size(); i++)
+        {
+            const TraceEvent& event = state.events[i];
+            ofd << (i == 0 ? "\n" : ",\n");
+            switch (event.phase)
+            {
+            case 'X':
+                ofd << "{\"name\":\"" << EscapeJson(event.name) << "\",\"cat\":\"" << event.pCategory
+                    << "\",\"ph\":\"X\",\"ts\":" << event.beginUs << ",\"dur\":" << event.durationUs
+                    << ",\"pid\":1,\"tid\":" << event.trackId << "}";
+                break;
+            case 'C':
+                ofd << "{\"name\":\"" << EscapeJson(event.name) << "\",\"ph\":\"C\",\"ts\":" << event.beginUs
+                    << ",\"pid\":1,\"args\":{\"bytes\":" << event.durationUs << "}}";
+                break;
+            default:
+                ofd << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << event.trackId
+                    << ",\"args\":{\"name\":\"" << EscapeJson(event.name) << "\"}}";
+                break;
+            }
+        }
+        ofd << "\n],\"otherData\":{";
+
+        bool isFirst = true;
+        for (const auto& counter : state.counters)
+        {
+            ofd << (isFirst ? "" : ",") << "\"" << EscapeJson(counter.first) << "\":" << counter.second;
+            isFirst = false;
+        }
+        ofd << "}}\n";
+
+        std::cout << "Trace: " << state.namePath << std::endl;
+        return ofd.good();
+    }
+
+    // ================================================================================================================
+    bool IsTraceOn()
+    {
+        return GetTraceState().isOn;
+    }
+
+    // ================================================================================================================
+    uint64_t TraceNowUs()
+    {
+        std::chrono::steady_clock::duration sinceBegin = std::chrono::steady_clock::now() - GetTraceState().beginTime;
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(sinceBegin).count();
+    }
+
+    // ================================================================================================================
+    void SetTraceThreadName(
+        const std::string& name)
+    {
+        TraceState& state = GetTraceState();
+        if (state.isOn)
+        {
+            uint32_t trackId = GetThreadTrackId();
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.events.push_back({ name, "__metadata", 'M', 0, 0, trackId });
+        }
+    }
+
+    // ================================================================================================================
+    void AddTraceEvent(
+        const std::string& name,
+        const char*        pCategory,
+        uint64_t           beginUs,
+        uint64_t           durationUs,
+        uint32_t           trackId)
+    {
+        TraceState& state = GetTraceState();
+        if (state.isOn)
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.events.push_back({ name, pCategory, 'X', beginUs, durationUs, trackId });
+        }
+    }
+
+    // ================================================================================================================
+    void AddTraceBytes(
+        const char* pCounterName,
+        uint64_t    bytesCnt)
+    {
+        TraceState& state = GetTraceState();
+        if (state.isOn)
+        {
+            uint64_t nowUs = TraceNowUs();
+            std::lock_guard<std::mutex> lock(state.mutex);
+            uint64_t& total = state.counters[pCounterName];
+            total += bytesCnt;
+            state.events.push_back({ pCounterName, "bytes", 'C', nowUs, total, 0 });
+        }
+    }
+
+    // ================================================================================================================
+    ScopedTraceTimer::ScopedTraceTimer(
+        const char* pName,
+        const char* pCategory) :
+        m_pCategory(pCategory),
+        m_beginUs(0),
+        m_isOn(IsTraceOn())
+    {
+        if (m_isOn)
+        {
+            m_name = pName;
+            m_beginUs = TraceNowUs();
+        }
+    }
+
+    // ================================================================================================================
+    ScopedTraceTimer::ScopedTraceTimer(
+        const char*        pName,
+        const std::string& detail,
+        const char*        pCategory) :
+        m_pCategory(pCategory),
+        m_beginUs(0),
+        m_isOn(IsTraceOn())
+    {
+        if (m_isOn)
+        {
+            m_name = std::string(pName) + " " + detail;
+            m_beginUs = TraceNowUs();
+        }
+    }
+
+    // ================================================================================================================
+    ScopedTraceTimer::ScopedTraceTimer(
+        const char* pName,
+        uint32_t    detail,
+        const char* pCategory) :
+        m_pCategory(pCategory),
+        m_beginUs(0),
+        m_isOn(IsTraceOn())
+    {
+        if (m_isOn)
+        {
+            m_name = std::string(pName) + " " + std::to_string(detail);
+            m_beginUs = TraceNowUs();
+        }
+    }
+
+    // ================================================================================================================
+    ScopedTraceTimer::~ScopedTraceTimer()
+    {
+        if (m_isOn)
+        {
+            AddTraceEvent(m_name, m_pCategory, m_beginUs, TraceNowUs() - m_beginUs, GetThreadTrackId());
+        }
+    }
+}
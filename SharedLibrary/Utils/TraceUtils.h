@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace SharedLib
+{
+    // A per run trace of where the time and the bytes of a tool go, written in the Chrome tracing JSON format, so it opens
+    // in chrome://tracing or https://ui.perfetto.dev and a script can diff two runs. The recording is off until
+    // BeginTrace(...), so a normal run only pays one branch per timer or counter.
+    // - A CPU scope is a complete event on the track of its thread.
+    // - The GPU passes (GpuTraceTimer) are on their own track.
+    // - A byte counter is cumulative, so its track slope is the throughput. The totals are also in the "otherData".
+
+    // The byte counters that the shared utils update.
+    constexpr const char* TraceUploadBytes    = "upload bytes";
+    constexpr const char* TraceReadbackBytes  = "readback bytes";
+    constexpr const char* TraceDiskReadBytes  = "disk read bytes";
+    constexpr const char* TraceDiskWriteBytes = "disk write bytes";
+
+    // The track of the GPU passes. The CPU threads get the tracks from 1 on.
+    constexpr uint32_t GpuTraceTrackId = 0;
+
+    // Starts recording. The events are kept in the memory and written to the namePath by EndTrace().
+    void BeginTrace(const std::string& namePath);
+
+    // Stops recording and writes the trace. Returns false when the file cannot be written.
+    bool EndTrace();
+
+    bool IsTraceOn();
+
+    // Microseconds since BeginTrace(...).
+    uint64_t TraceNowUs();
+
+    // Names the track of the calling thread, e.g. "decode" for the batch mode decode thread.
+    void SetTraceThreadName(const std::string& name);
+
+    void AddTraceEvent(const std::string& name, const char* pCategory, uint64_t beginUs, uint64_t durationUs, uint32_t trackId);
+    void AddTraceBytes(const char* pCounterName, uint64_t bytesCnt);
+
+    // Records its lifetime as a complete event on the track of the calling thread. The name is only formatted when the
+    // trace is on, e.g. the detail is appended to the pName as "pName detail", so a timer costs one branch when it is off.
+    class ScopedTraceTimer
+    {
+    public:
+        explicit ScopedTraceTimer(const char* pName, const char* pCategory = "cpu");
+        ScopedTraceTimer(const char* pName, const std::string& detail, const char* pCategory = "cpu");
+        ScopedTraceTimer(const char* pName, uint32_t detail, const char* pCategory = "cpu");
+        ~ScopedTraceTimer();
+
+    private:
+        ScopedTraceTimer(const ScopedTraceTimer&) = delete;
+        ScopedTraceTimer& operator=(const ScopedTraceTimer&) = delete;
+
+        std::string m_name;
+        const char* m_pCategory;
+        uint64_t    m_beginUs;
+        bool        m_isOn;
+    };
+}
@@ -0,0 +1,450 @@
+#include "UploadUtils.h"
+#include "vk_mem_alloc.h"
+#include "CmdBufUtils.h"
+#include "VulkanDbgUtils.h"
+#include "Ktx2Utils.h"
+#include "TraceUtils.h"
+#include "SyncUtils.h"
+#include <algorithm>
+#include <cstring>
+
+namespace SharedLib
+{
+    // ================================================================================================================
+    static VkDeviceSize AlignUp(
+        VkDeviceSize value,
+        VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // ================================================================================================================
+    UploadManager::UploadManager() :
+        m_device(VK_NULL_HANDLE),
+        m_allocator(VK_NULL_HANDLE),
+        m_pTimeline(nullptr),
+        m_queueFamilyIdx(VK_QUEUE_FAMILY_IGNORED),
+        m_cmdPool(VK_NULL_HANDLE),
+        m_ringBuffer(VK_NULL_HANDLE),
+        m_ringAlloc(VK_NULL_HANDLE),
+        m_pRingMapped(nullptr),
+        m_ringBytesCnt(0),
+        m_ringHead(0),
+        m_ringTail(0),
+        m_recordingBatch(),
+        m_lastTicket(0)
+    {}
+
+    // ================================================================================================================
+    void UploadManager::Init(
+        VkDevice       device,
+        VmaAllocator   allocator,
+        QueueTimeline& timeline,
+        uint32_t       queueFamilyIdx,
+        VkCommandPool  cmdPool,
+        VkDeviceSize   ringBytesCnt)
+    {
+        m_device = device;
+        m_allocator = allocator;
+        m_pTimeline = &timeline;
+        m_queueFamilyIdx = queueFamilyIdx;
+        m_cmdPool = cmdPool;
+        m_ringBytesCnt = ringBytesCnt;
+
+        VmaAllocationCreateInfo ringAllocInfo{};
+        {
+            ringAllocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+            ringAllocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+        }
+
+        VkBufferCreateInfo ringBufInfo{};
+        {
+            ringBufInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            ringBufInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            ringBufInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            ringBufInfo.size = ringBytesCnt;
+        }
+
+        VmaAllocationInfo ringInfo{};
+        VK_CHECK(vmaCreateBuffer(m_allocator, &ringBufInfo, &ringAllocInfo, &m_ringBuffer, &m_ringAlloc, &ringInfo));
+        m_pRingMapped = static_cast<uint8_t*>(ringInfo.pMappedData);
+    }
+
+    // ================================================================================================================
+    void UploadManager::Destroy()
+    {
+        if (m_device == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        WaitIdle();
+
+        if (m_freeCmdBuffers.empty() == false)
+        {
+            vkFreeCommandBuffers(m_device, m_cmdPool, (uint32_t)m_freeCmdBuffers.size(), m_freeCmdBuffers.data());
+            m_freeCmdBuffers.clear();
+        }
+
+        vmaDestroyBuffer(m_allocator, m_ringBuffer, m_ringAlloc);
+        m_ringBuffer = VK_NULL_HANDLE;
+        m_ringAlloc = VK_NULL_HANDLE;
+        m_pRingMapped = nullptr;
+        m_device = VK_NULL_HANDLE;
+    }
+
+    // ================================================================================================================
+    void UploadManager::QueueImgUpload(
+        const void*                           pData,
+        VkDeviceSize                          bytesCnt,
+        VkImage                               dstImg,
+        VkImageSubresourceRange               subResRange,
+        VkImageLayout                         dstImgCurrentLayout,
+        const std::vector<VkBufferImageCopy>& bufToImgCopyInfos,
+        uint32_t                              dstQueueFamilyIdx,
+        VkDeviceSize                          alignment)
+    {
+        // The allocation can flush the recording batch, so the command buffer is got after it.
+        VkBuffer stagingBuffer;
+        VkDeviceSize stagingOffset;
+        void* pStaging = AllocStaging(bytesCnt, alignment, stagingBuffer, stagingOffset);
+        memcpy(pStaging, pData, bytesCnt);
+        AddTraceBytes(TraceUploadBytes, bytesCnt);
+
+        VkCommandBuffer cmdBuffer = GetRecordingCmdBuffer();
+
+        VkImageMemoryBarrier undefToDstBarrier{};
+        {
+            undefToDstBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            undefToDstBarrier.image = dstImg;
+            undefToDstBarrier.subresourceRange = subResRange;
+            undefToDstBarrier.srcAccessMask = 0;
+            undefToDstBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            undefToDstBarrier.oldLayout = dstImgCurrentLayout;
+            undefToDstBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        }
+
+        vkCmdPipelineBarrier(
+            cmdBuffer,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            0, nullptr,
+            0, nullptr,
+            1, &undefToDstBarrier);
+
+        std::vector<VkBufferImageCopy> stagingCopies(bufToImgCopyInfos);
+        for (VkBufferImageCopy& stagingCopy : stagingCopies)
+        {
+            stagingCopy.bufferOffset += stagingOffset;
+        }
+
+        vkCmdCopyBufferToImage(
+            cmdBuffer,
+            stagingBuffer,
+            dstImg,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            (uint32_t)stagingCopies.size(), stagingCopies.data());
+
+        CmdReleaseImgOwnership(cmdBuffer,
+                               dstImg,
+                               subResRange,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               m_queueFamilyIdx,
+                               dstQueueFamilyIdx);
+    }
+
+    // ================================================================================================================
+    void UploadManager::QueueKtx2Upload(
+        const Ktx2File& ktx2File,
+        VkImage         dstImg,
+        VkImageLayout   dstImgCurrentLayout,
+        uint32_t        dstQueueFamilyIdx)
+    {
+        const Ktx2ImageDesc& desc = ktx2File.GetDesc();
+
+        std::vector<VkBufferImageCopy> levelCopies(desc.levelCnt);
+        for (uint32_t level = 0; level < desc.levelCnt; level++)
+        {
+            VkExtent3D extent{};
+            {
+                extent.width = std::max(desc.width >> level, 1u);
+                extent.height = std::max(desc.height >> level, 1u);
+                extent.depth = 1;
+            }
+
+            levelCopies[level] = {};
+            levelCopies[level].bufferOffset = ktx2File.GetLevelOffsetInLevels(level);
+            levelCopies[level].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            levelCopies[level].imageSubresource.mipLevel = level;
+            levelCopies[level].imageSubresource.baseArrayLayer = 0;
+            levelCopies[level].imageSubresource.layerCount = desc.faceCnt;
+            levelCopies[level].imageExtent = extent;
+        }
+
+        VkImageSubresourceRange allLevelsSubResRange{};
+        {
+            allLevelsSubResRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            allLevelsSubResRange.baseMipLevel = 0;
+            allLevelsSubResRange.levelCount = desc.levelCnt;
+            allLevelsSubResRange.baseArrayLayer = 0;
+            allLevelsSubResRange.layerCount = desc.faceCnt;
+        }
+
+        QueueImgUpload(ktx2File.GetLevelsData(),
+                       ktx2File.GetLevelsBytesCnt(),
+                       dstImg,
+                       allLevelsSubResRange,
+                       dstImgCurrentLayout,
+                       levelCopies,
+                       dstQueueFamilyIdx);
+    }
+
+    // ================================================================================================================
+    void UploadManager::QueueBufferUpload(
+        const void*  pData,
+        VkDeviceSize bytesCnt,
+        VkBuffer     dstBuffer,
+        VkDeviceSize dstOffset,
+        uint32_t     dstQueueFamilyIdx)
+    {
+        VkBuffer stagingBuffer;
+        VkDeviceSize stagingOffset;
+        void* pStaging = AllocStaging(bytesCnt, DefaultAlignment, stagingBuffer, stagingOffset);
+        memcpy(pStaging, pData, bytesCnt);
+        AddTraceBytes(TraceUploadBytes, bytesCnt);
+
+        VkCommandBuffer cmdBuffer = GetRecordingCmdBuffer();
+
+        VkBufferCopy bufCopy{};
+        {
+            bufCopy.srcOffset = stagingOffset;
+            bufCopy.dstOffset = dstOffset;
+            bufCopy.size = bytesCnt;
+        }
+        vkCmdCopyBuffer(cmdBuffer, stagingBuffer, dstBuffer, 1, &bufCopy);
+
+        if ((dstQueueFamilyIdx != VK_QUEUE_FAMILY_IGNORED) && (dstQueueFamilyIdx != m_queueFamilyIdx))
+        {
+            VkBufferMemoryBarrier releaseBarrier{};
+            {
+                releaseBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                releaseBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                releaseBarrier.dstAccessMask = 0;
+                releaseBarrier.srcQueueFamilyIndex = m_queueFamilyIdx;
+                releaseBarrier.dstQueueFamilyIndex = dstQueueFamilyIdx;
+                releaseBarrier.buffer = dstBuffer;
+                releaseBarrier.offset = dstOffset;
+                releaseBarrier.size = bytesCnt;
+            }
+
+            vkCmdPipelineBarrier(
+                cmdBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                0,
+                0, nullptr,
+                1, &releaseBarrier,
+                0, nullptr);
+        }
+    }
+
+    // ================================================================================================================
+    uint64_t UploadManager::Flush()
+    {
+        if (m_recordingBatch.cmdBuffer == VK_NULL_HANDLE)
+        {
+            return m_lastTicket;
+        }
+
+        VK_CHECK(vkEndCommandBuffer(m_recordingBatch.cmdBuffer));
+
+        // It is a no-op on the host coherent memory.
+        vmaFlushAllocation(m_allocator, m_ringAlloc, 0, VK_WHOLE_SIZE);
+        for (VmaAllocation dedicatedAlloc : m_recordingBatch.dedicatedAllocs)
+        {
+            vmaFlushAllocation(m_allocator, dedicatedAlloc, 0, VK_WHOLE_SIZE);
+        }
+
+        m_recordingBatch.ticket = m_pTimeline->Submit(m_recordingBatch.cmdBuffer);
+        m_recordingBatch.ringEnd = m_ringHead;
+        m_lastTicket = m_recordingBatch.ticket;
+        m_inFlightBatches.push_back(std::move(m_recordingBatch));
+        m_recordingBatch = UploadBatch{};
+
+        return m_lastTicket;
+    }
+
+    // ================================================================================================================
+    bool UploadManager::IsRetired(
+        uint64_t ticket)
+    {
+        RetireBatches(false);
+        return m_pTimeline->IsReached(ticket);
+    }
+
+    // ================================================================================================================
+    void UploadManager::Wait(
+        uint64_t ticket)
+    {
+        m_pTimeline->Wait(ticket);
+        RetireBatches(false);
+    }
+
+    // ================================================================================================================
+    void UploadManager::WaitIdle()
+    {
+        Wait(Flush());
+    }
+
+    // ================================================================================================================
+    void* UploadManager::AllocStaging(
+        VkDeviceSize  bytesCnt,
+        VkDeviceSize  alignment,
+        VkBuffer&     stagingBuffer,
+        VkDeviceSize& offset)
+    {
+        if (bytesCnt > m_ringBytesCnt)
+        {
+            VmaAllocationCreateInfo stagingBufAllocInfo{};
+            {
+                stagingBufAllocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+                stagingBufAllocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+            }
+
+            VkBufferCreateInfo stgBufInfo{};
+            {
+                stgBufInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+                stgBufInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+                stgBufInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+                stgBufInfo.size = bytesCnt;
+            }
+
+            VmaAllocation stagingBufAlloc;
+            VmaAllocationInfo stagingBufInfo{};
+            VK_CHECK(vmaCreateBuffer(m_allocator, &stgBufInfo, &stagingBufAllocInfo, &stagingBuffer, &stagingBufAlloc, &stagingBufInfo));
+
+            m_recordingBatch.dedicatedBuffers.push_back(stagingBuffer);
+            m_recordingBatch.dedicatedAllocs.push_back(stagingBufAlloc);
+            offset = 0;
+            return stagingBufInfo.pMappedData;
+        }
+
+        while (TryAllocRing(bytesCnt, alignment, offset) == false)
+        {
+            // The recording batch holds a part of the ring as well, so it is submitted before the waits.
+            Flush();
+            RetireBatches(true);
+        }
+
+        stagingBuffer = m_ringBuffer;
+        return m_pRingMapped + offset;
+    }
+
+    // ================================================================================================================
+    // The used part of the ring is from the tail to the head, and it wraps around when the head is behind the tail. The
+    // head never catches up with the tail from behind, so the head equal to the tail is always an empty ring.
+    bool UploadManager::TryAllocRing(
+        VkDeviceSize  bytesCnt,
+        VkDeviceSize  alignment,
+        VkDeviceSize& offset)
+    {
+        const VkDeviceSize alignedHead = AlignUp(m_ringHead, alignment);
+        if (m_ringHead >= m_ringTail)
+        {
+            if (alignedHead + bytesCnt <= m_ringBytesCnt)
+            {
+                offset = alignedHead;
+            }
+            else if (bytesCnt < m_ringTail)
+            {
+                // The end of the ring is skipped and retired with the batch of the allocation.
+                offset = 0;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (alignedHead + bytesCnt < m_ringTail)
+        {
+            offset = alignedHead;
+        }
+        else
+        {
+            return false;
+        }
+
+        m_ringHead = offset + bytesCnt;
+        return true;
+    }
+
+    // ================================================================================================================
+    VkCommandBuffer UploadManager::GetRecordingCmdBuffer()
+    {
+        if (m_recordingBatch.cmdBuffer != VK_NULL_HANDLE)
+        {
+            return m_recordingBatch.cmdBuffer;
+        }
+
+        if (m_freeCmdBuffers.empty())
+        {
+            VkCommandBufferAllocateInfo cmdBufAllocInfo{};
+            {
+                cmdBufAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                cmdBufAllocInfo.commandPool = m_cmdPool;
+                cmdBufAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+                cmdBufAllocInfo.commandBufferCount = 1;
+            }
+            VkCommandBuffer cmdBuffer;
+            VK_CHECK(vkAllocateCommandBuffers(m_device, &cmdBufAllocInfo, &cmdBuffer));
+            m_freeCmdBuffers.push_back(cmdBuffer);
+        }
+        m_recordingBatch.cmdBuffer = m_freeCmdBuffers.back();
+        m_freeCmdBuffers.pop_back();
+
+        VkCommandBufferBeginInfo beginInfo{};
+        {
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        }
+        VK_CHECK(vkBeginCommandBuffer(m_recordingBatch.cmdBuffer, &beginInfo));
+
+        return m_recordingBatch.cmdBuffer;
+    }
+
+    // ================================================================================================================
+    // The batches retire in the submit order of the timeline values, so the tail moves to the ringEnd of the latest
+    // retired batch.
+    void UploadManager::RetireBatches(
+        bool waitForOldest)
+    {
+        if (waitForOldest && (m_inFlightBatches.empty() == false))
+        {
+            m_pTimeline->Wait(m_inFlightBatches.front().ticket);
+        }
+
+        while ((m_inFlightBatches.empty() == false) && m_pTimeline->IsReached(m_inFlightBatches.front().ticket))
+        {
+            UploadBatch& batch = m_inFlightBatches.front();
+            for (uint32_t i = 0; i < batch.dedicatedBuffers.size(); i++)
+            {
+                vmaDestroyBuffer(m_allocator, batch.dedicatedBuffers[i], batch.dedicatedAllocs[i]);
+            }
+
+            VK_CHECK(vkResetCommandBuffer(batch.cmdBuffer, 0));
+            m_freeCmdBuffers.push_back(batch.cmdBuffer);
+
+            m_ringTail = batch.ringEnd;
+            m_inFlightBatches.pop_front();
+        }
+
+        // Restart from the beginning when the ring is empty, so a large allocation doesn't have to wrap around.
+        if (m_inFlightBatches.empty() && (m_ringHead == m_ringTail))
+        {
+            m_ringHead = 0;
+            m_ringTail = 0;
+        }
+    }
+}
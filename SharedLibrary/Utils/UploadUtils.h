@@ -0,0 +1,113 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+VK_DEFINE_HANDLE(VmaAllocator)
+VK_DEFINE_HANDLE(VmaAllocation)
+
+namespace SharedLib
+{
+    class Ktx2File;
+    class QueueTimeline;
+
+    // The uploads through one persistently mapped staging ring. The QueueXxx(...) copy the data into the ring and record
+    // the copies into one command buffer, and the Flush() submits all of them at once. A flushed batch holds its ring
+    // region until the upload queue timeline reaches its value, so the ring is reused without a new staging buffer or a
+    // host wait per upload.
+    // - The Application owns one on its upload queue. It is not thread safe.
+    // - An upload that is larger than the whole ring gets a dedicated staging buffer, which is freed with its batch.
+    // - A QueueXxx(...) that doesn't fit in the free part of the ring flushes the recording batch and waits for the
+    //   oldest batches to retire.
+    // - The images are left in the VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL. When the dstQueueFamilyIdx is another family,
+    //   they are also released to it and the user acquires them with the CmdAcquireImgOwnership(...) in a submit that
+    //   waits for the batch, e.g. with the WaitPoint(...) of the timeline.
+    class UploadManager
+    {
+    public:
+        UploadManager();
+        ~UploadManager() {};
+
+        void Init(VkDevice       device,
+                  VmaAllocator   allocator,
+                  QueueTimeline& timeline,
+                  uint32_t       queueFamilyIdx,
+                  VkCommandPool  cmdPool,
+                  VkDeviceSize   ringBytesCnt);
+        void Destroy();
+
+        // The bufferOffset of the bufToImgCopyInfos are offsets in the pData. The subResRange has to cover all the
+        // regions. The alignment of the data in the ring has to be a multiple of the texel bytes and of 4.
+        void QueueImgUpload(const void*                           pData,
+                            VkDeviceSize                          bytesCnt,
+                            VkImage                               dstImg,
+                            VkImageSubresourceRange               subResRange,
+                            VkImageLayout                         dstImgCurrentLayout,
+                            const std::vector<VkBufferImageCopy>& bufToImgCopyInfos,
+                            uint32_t                              dstQueueFamilyIdx = VK_QUEUE_FAMILY_IGNORED,
+                            VkDeviceSize                          alignment = DefaultAlignment);
+
+        // All the levels and faces of a mapped KTX2 file to the dstImg, which has to be created with the format, extent,
+        // faces and levels of the file. The levels go from the file mapping to the ring with one memcpy. There is no decode.
+        void QueueKtx2Upload(const Ktx2File& ktx2File,
+                             VkImage         dstImg,
+                             VkImageLayout   dstImgCurrentLayout,
+                             uint32_t        dstQueueFamilyIdx = VK_QUEUE_FAMILY_IGNORED);
+
+        void QueueBufferUpload(const void*  pData,
+                               VkDeviceSize bytesCnt,
+                               VkBuffer     dstBuffer,
+                               VkDeviceSize dstOffset,
+                               uint32_t     dstQueueFamilyIdx = VK_QUEUE_FAMILY_IGNORED);
+
+        // Submits the recorded copies and returns the ticket of the batch, which is its value on the upload queue
+        // timeline. It returns the ticket of the latest batch when nothing is recorded, and 0 when nothing has been
+        // submitted yet.
+        uint64_t Flush();
+
+        bool IsRetired(uint64_t ticket);
+        void Wait(uint64_t ticket);
+        void WaitIdle(); // Flushes and waits for all the batches.
+
+        uint32_t GetQueueFamilyIdx() { return m_queueFamilyIdx; }
+
+    private:
+        static constexpr VkDeviceSize DefaultAlignment = 16;
+
+        // A submitted batch. Its ring region ends at the ringEnd and starts at the ringEnd of the batch before it.
+        struct UploadBatch
+        {
+            uint64_t                   ticket;
+            VkCommandBuffer            cmdBuffer;
+            VkDeviceSize               ringEnd;
+            std::vector<VkBuffer>      dedicatedBuffers;
+            std::vector<VmaAllocation> dedicatedAllocs;
+        };
+
+        // Returns the mapped memory of bytesCnt and the staging buffer and offset of it.
+        void* AllocStaging(VkDeviceSize bytesCnt, VkDeviceSize alignment, VkBuffer& stagingBuffer, VkDeviceSize& offset);
+        bool TryAllocRing(VkDeviceSize bytesCnt, VkDeviceSize alignment, VkDeviceSize& offset);
+
+        VkCommandBuffer GetRecordingCmdBuffer();
+        void RetireBatches(bool waitForOldest);
+
+        VkDevice       m_device;
+        VmaAllocator   m_allocator;
+        QueueTimeline* m_pTimeline;
+        uint32_t       m_queueFamilyIdx;
+        VkCommandPool  m_cmdPool;
+
+        VkBuffer       m_ringBuffer;
+        VmaAllocation  m_ringAlloc;
+        uint8_t*       m_pRingMapped;
+        VkDeviceSize   m_ringBytesCnt;
+        VkDeviceSize   m_ringHead; // The next free byte. The recording batch owns the bytes from the last ringEnd to it.
+        VkDeviceSize   m_ringTail; // The first byte of the oldest batch in flight.
+
+        UploadBatch                  m_recordingBatch; // Its cmdBuffer is VK_NULL_HANDLE when nothing is recorded.
+        std::deque<UploadBatch>      m_inFlightBatches;
+        std::vector<VkCommandBuffer> m_freeCmdBuffers;
+        uint64_t                     m_lastTicket;
+    };
+}
@@ -0,0 +1,277 @@
+#include "CubemapMipChain.h"
+#include "../../SharedLibrary/Utils/ThreadUtils.h"
+#include "../../SharedLibrary/Utils/HdrStreamUtils.h"
+#include "../../SharedLibrary/Utils/HdrIngestUtils.h"
+#include "../../SharedLibrary/Utils/TraceUtils.h"
+#include <cassert>
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GENIBL_SSE2
+#include <emmintrin.h>
+#endif
+
+// The arena is 64 bytes aligned so that every level starts on a cache line and the AVX loads never split one.
+static constexpr std::align_val_t ArenaAlignment{ 64 };
+
+// Rows of a band processed by one task. Small enough to spread a 512x512 face among the workers.
+static constexpr uint32_t RowsPerBand = 32;
+
+// ================================================================================================================
+CubemapMipChain::CubemapMipChain() :
+    m_pArena(nullptr),
+    m_arenaFloatsCnt(0),
+    m_arenaCapacityFloatsCnt(0),
+    m_faceDim(0)
+{}
+
+// ================================================================================================================
+CubemapMipChain::~CubemapMipChain()
+{
+    if (m_pArena != nullptr)
+    {
+        ::operator delete(m_pArena, ArenaAlignment);
+    }
+}
+
+// ================================================================================================================
+// A chain can be initialized again. The arena is only reallocated when the new chain doesn't fit in it, so the batch
+// mode reuses the same memory for inputs of the same size, and a chain of fewer levels keeps the bigger arena.
+void CubemapMipChain::Init(
+    uint32_t faceDim,
+    uint32_t levelCnt)
+{
+    m_faceDim = faceDim;
+    LayoutLevels(levelCnt);
+
+    if ((m_pArena != nullptr) && (m_arenaFloatsCnt > m_arenaCapacityFloatsCnt))
+    {
+        ::operator delete(m_pArena, ArenaAlignment);
+        m_pArena = nullptr;
+    }
+
+    if (m_pArena == nullptr)
+    {
+        m_pArena = static_cast<float*>(::operator new(sizeof(float) * m_arenaFloatsCnt, ArenaAlignment));
+        m_arenaCapacityFloatsCnt = m_arenaFloatsCnt;
+    }
+}
+
+// ================================================================================================================
+// The level 0 is always at the start of the arena, so a reallocation only carries it over.
+void CubemapMipChain::AddLevels(
+    uint32_t levelCnt)
+{
+    uint64_t level0FloatsCnt = m_arenaFloatsCnt;
+    if (GetLevelCnt() > 1)
+    {
+        level0FloatsCnt = m_levelOffsets[1];
+    }
+
+    LayoutLevels(levelCnt);
+
+    if (m_arenaFloatsCnt > m_arenaCapacityFloatsCnt)
+    {
+        float* pArena = static_cast<float*>(::operator new(sizeof(float) * m_arenaFloatsCnt, ArenaAlignment));
+        memcpy(pArena, m_pArena, sizeof(float) * level0FloatsCnt);
+
+        ::operator delete(m_pArena, ArenaAlignment);
+        m_pArena = pArena;
+        m_arenaCapacityFloatsCnt = m_arenaFloatsCnt;
+    }
+}
+
+// ================================================================================================================
+// Each level is a multiple of 16 floats (64 bytes), so the next level stays aligned.
+void CubemapMipChain::LayoutLevels(
+    uint32_t levelCnt)
+{
+    assert((m_faceDim >> (levelCnt - 1)) >= 1);
+    m_levelOffsets.resize(levelCnt);
+
+    uint64_t offset = 0;
+    for (uint32_t level = 0; level < levelCnt; level++)
+    {
+        m_levelOffsets[level] = offset;
+
+        uint64_t levelDim = m_faceDim >> level;
+        offset += 6 * 4 * levelDim * levelDim;
+        offset = (offset + 15) & ~uint64_t(15);
+    }
+    m_arenaFloatsCnt = offset;
+}
+
+// ================================================================================================================
+void CubemapMipChain::Swap(
+    CubemapMipChain& other)
+{
+    std::swap(m_pArena, other.m_pArena);
+    std::swap(m_arenaFloatsCnt, other.m_arenaFloatsCnt);
+    std::swap(m_arenaCapacityFloatsCnt, other.m_arenaCapacityFloatsCnt);
+    std::swap(m_levelOffsets, other.m_levelOffsets);
+    std::swap(m_faceDim, other.m_faceDim);
+}
+
+// ================================================================================================================
+void CubemapMipChain::InitFromRgbVStrip(
+    const float*           pRgbData,
+    uint32_t               faceDim,
+    uint32_t               levelCnt,
+    float                  radianceClamp,
+    SharedLib::ThreadPool& threadPool)
+{
+    SharedLib::ScopedTraceTimer ingestTimer("IngestRgbRows");
+    Init(faceDim, levelCnt);
+
+    SharedLib::IngestRgbRows(pRgbData,
+                             6 * faceDim,
+                             faceDim,
+                             SharedLib::HdrIngestFormat::RGBA32F,
+                             radianceClamp,
+                             GetLevelData(0),
+                             threadPool);
+}
+
+// ================================================================================================================
+// The run length decode of a band is serial, and its texels are spread among the workers.
+bool CubemapMipChain::InitFromHdrStream(
+    SharedLib::HdrScanlineReader& hdrStream,
+    uint32_t                      levelCnt,
+    float                         radianceClamp,
+    uint64_t                      bandBytesCnt,
+    SharedLib::ThreadPool&        threadPool)
+{
+    SharedLib::ScopedTraceTimer streamTimer("InitFromHdrStream");
+    uint32_t faceDim = hdrStream.GetWidth();
+    Init(faceDim, levelCnt);
+
+    uint32_t rowCnt = 6 * faceDim;
+    uint32_t rowsPerBand = (uint32_t)std::min<uint64_t>(std::max<uint64_t>(bandBytesCnt / hdrStream.GetRgbeRowBytesCnt(), 1), rowCnt);
+    std::vector<uint8_t> rgbeBand(rowsPerBand * hdrStream.GetRgbeRowBytesCnt());
+
+    for (uint32_t bandRowBegin = 0; bandRowBegin < rowCnt; bandRowBegin += rowsPerBand)
+    {
+        uint32_t bandRowCnt = std::min(rowsPerBand, rowCnt - bandRowBegin);
+        if (hdrStream.ReadRgbeRows(bandRowCnt, rgbeBand.data()) == false)
+        {
+            return false;
+        }
+
+        SharedLib::IngestRgbeRows(rgbeBand.data(),
+                                  bandRowCnt,
+                                  faceDim,
+                                  SharedLib::HdrIngestFormat::RGBA32F,
+                                  radianceClamp,
+                                  GetLevelData(0) + 4 * uint64_t(bandRowBegin) * faceDim,
+                                  threadPool);
+    }
+    return true;
+}
+
+// ================================================================================================================
+// Levels depend on each other, so they are built one after another. Within a level, all 6 faces and their row bands
+// are independent tasks.
+void CubemapMipChain::BuildMips(
+    SharedLib::ThreadPool&               threadPool,
+    const std::function<void(uint32_t)>& levelDone)
+{
+    SharedLib::ScopedTraceTimer mipsTimer("BuildMips");
+    for (uint32_t level = 1; level < GetLevelCnt(); level++)
+    {
+        uint32_t srcDim = GetLevelDim(level - 1);
+        uint32_t dstDim = GetLevelDim(level);
+        const float* pSrcLevel = GetLevelData(level - 1);
+        float* pDstLevel = GetLevelData(level);
+
+        uint32_t bandsPerFace = (dstDim + RowsPerBand - 1) / RowsPerBand;
+
+        threadPool.ParallelFor(6 * bandsPerFace, [=](uint32_t taskIdx)
+        {
+            uint32_t face = taskIdx / bandsPerFace;
+            uint32_t band = taskIdx % bandsPerFace;
+
+            const float* pFaceSrc = pSrcLevel + uint64_t(4) * face * srcDim * srcDim;
+            float* pFaceDst = pDstLevel + uint64_t(4) * face * dstDim * dstDim;
+
+            uint32_t rowBegin = band * RowsPerBand;
+            uint32_t rowEnd = std::min(rowBegin + RowsPerBand, dstDim);
+
+            DownsampleRgba2x2(pFaceSrc, srcDim, pFaceDst, rowBegin, rowEnd);
+        });
+
+        if (levelDone)
+        {
+            levelDone(level);
+        }
+    }
+}
+
+// ================================================================================================================
+void DownsampleRgba2x2(
+    const float* pSrc,
+    uint32_t     srcDim,
+    float*       pDst,
+    uint32_t     dstRowBegin,
+    uint32_t     dstRowEnd)
+{
+    uint32_t dstDim = srcDim / 2;
+
+    for (uint32_t row = dstRowBegin; row < dstRowEnd; row++)
+    {
+        const float* pSrcRow0 = pSrc + uint64_t(4) * (2 * row) * srcDim;
+        const float* pSrcRow1 = pSrcRow0 + uint64_t(4) * srcDim;
+        float* pDstRow = pDst + uint64_t(4) * row * dstDim;
+
+        uint32_t col = 0;
+
+#if defined(__AVX__)
+        // Two destination texels per iteration. A __m256 holds two adjacent RGBA texels, so after adding two rows,
+        // the lanes are [t0 + t1] pairs that need a cross lane add.
+        const __m256 quarter = _mm256_set1_ps(0.25f);
+        for (; col + 2 <= dstDim; col += 2)
+        {
+            const float* pS0 = pSrcRow0 + 8 * col;
+            const float* pS1 = pSrcRow1 + 8 * col;
+
+            __m256 rowSumA = _mm256_add_ps(_mm256_loadu_ps(pS0), _mm256_loadu_ps(pS1));         // Texels 0, 1.
+            __m256 rowSumB = _mm256_add_ps(_mm256_loadu_ps(pS0 + 8), _mm256_loadu_ps(pS1 + 8)); // Texels 2, 3.
+
+            __m256 lo = _mm256_permute2f128_ps(rowSumA, rowSumB, 0x20); // Texels 0, 2.
+            __m256 hi = _mm256_permute2f128_ps(rowSumA, rowSumB, 0x31); // Texels 1, 3.
+
+            _mm256_storeu_ps(pDstRow + 4 * col, _mm256_mul_ps(_mm256_add_ps(lo, hi), quarter));
+        }
+#endif
+
+#if defined(__AVX__) || defined(GENIBL_SSE2)
+        // One destination texel per iteration. Also handles the 1x1 tail of the AVX path.
+        const __m128 quarter4 = _mm_set1_ps(0.25f);
+        for (; col < dstDim; col++)
+        {
+            const float* pS0 = pSrcRow0 + 8 * col;
+            const float* pS1 = pSrcRow1 + 8 * col;
+
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(pS0), _mm_loadu_ps(pS0 + 4)),
+                                    _mm_add_ps(_mm_loadu_ps(pS1), _mm_loadu_ps(pS1 + 4)));
+
+            _mm_storeu_ps(pDstRow + 4 * col, _mm_mul_ps(sum, quarter4));
+        }
+#endif
+
+        // Scalar fallback.
+        for (; col < dstDim; col++)
+        {
+            const float* pS0 = pSrcRow0 + 8 * col;
+            const float* pS1 = pSrcRow1 + 8 * col;
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                pDstRow[4 * col + c] = (pS0[c] + pS0[4 + c] + pS1[c] + pS1[4 + c]) * 0.25f;
+            }
+        }
+    }
+}
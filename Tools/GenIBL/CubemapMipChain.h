@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <functional>
+
+namespace SharedLib
+{
+    class ThreadPool;
+    class HdrScanlineReader;
+}
+
+// Host side input cubemap mipmap pyramid.
+// - All levels live in one arena that is allocated in Init(...) and only grows.
+// - Texels are RGBA32F so that one texel is one SSE register and the data can be copied to a
+//   VK_FORMAT_R32G32B32A32_SFLOAT image directly.
+// - Each level is a vStrip cubemap: 6 faces of dim x dim stored one after another.
+class CubemapMipChain
+{
+public:
+    CubemapMipChain();
+    ~CubemapMipChain();
+
+    void Init(uint32_t faceDim, uint32_t levelCnt);
+
+    // Extends a chain of fewer levels to levelCnt levels and keeps its level 0, e.g. a chain decoded for the GPU mipmaps
+    // that has to build them on the host after all.
+    void AddLevels(uint32_t levelCnt);
+
+    // Exchanges the arenas, so a chain decoded on another thread can be handed over without a copy.
+    void Swap(CubemapMipChain& other);
+
+    // Init(...) and fill the level 0 with a RGB32F vStrip cubemap. The radiance is clamped in the same pass
+    // (IngestRgbRows(...) in HdrIngestUtils.h).
+    void InitFromRgbVStrip(const float*           pRgbData,
+                           uint32_t               faceDim,
+                           uint32_t               levelCnt,
+                           float                  radianceClamp,
+                           SharedLib::ThreadPool& threadPool);
+
+    // The same as InitFromRgbVStrip(...), but the opened hdrStream is read in row bands of at most bandBytesCnt RGBE bytes
+    // and each band is decoded, clamped and padded straight into the level 0 in one pass. No float copy of the input is
+    // ever in the memory next to the arena. Returns false on a damaged file.
+    bool InitFromHdrStream(SharedLib::HdrScanlineReader& hdrStream,
+                           uint32_t                      levelCnt,
+                           float                         radianceClamp,
+                           uint64_t                      bandBytesCnt,
+                           SharedLib::ThreadPool&        threadPool);
+
+    // The level 0 has to be filled by the caller before building the rest of the levels.
+    // levelDone(level) is called on the calling thread right after a level is finished, so the caller can start consuming
+    // it (e.g. copying it to a staging buffer) while the next levels are being built.
+    void BuildMips(SharedLib::ThreadPool& threadPool, const std::function<void(uint32_t)>& levelDone = nullptr);
+
+    uint32_t GetFaceDim() { return m_faceDim; }
+    float*   GetLevelData(uint32_t level) { return m_pArena + m_levelOffsets[level]; }
+    uint32_t GetLevelDim(uint32_t level) { return m_faceDim >> level; }
+    uint64_t GetLevelBytesCnt(uint32_t level) { return uint64_t(6 * 4 * sizeof(float)) * GetLevelDim(level) * GetLevelDim(level); }
+    uint64_t GetLevelOffsetInBytes(uint32_t level) { return sizeof(float) * m_levelOffsets[level]; }
+    uint64_t GetArenaBytesCnt() { return sizeof(float) * m_arenaFloatsCnt; }
+    uint32_t GetLevelCnt() { return (uint32_t)m_levelOffsets.size(); }
+    float*   GetArena() { return m_pArena; }
+
+private:
+    void LayoutLevels(uint32_t levelCnt); // Fills the m_levelOffsets and the m_arenaFloatsCnt of the m_faceDim.
+
+    float*                m_pArena;
+    uint64_t              m_arenaFloatsCnt;         // Of the current levels.
+    uint64_t              m_arenaCapacityFloatsCnt; // Of the allocation, which can be bigger.
+    std::vector<uint64_t> m_levelOffsets; // In the unit of floats.
+    uint32_t              m_faceDim;
+};
+
+// 2x2 box filter on the rows [dstRowBegin, dstRowEnd) of a single RGBA32F face.
+void DownsampleRgba2x2(const float* pSrc, uint32_t srcDim, float* pDst, uint32_t dstRowBegin, uint32_t dstRowEnd);
@@ -0,0 +1,137 @@
+#include <cmath>
+#include "EnvBrdfLut.h"
+#include "../../SharedLibrary/Utils/MathUtils.h"
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+// ================================================================================================================
+SharedLib::EnvBrdfLutHeader MakeEnvBrdfLutHeader(
+    const EnvBrdfLutParams& params)
+{
+    SharedLib::EnvBrdfLutHeader header{};
+    {
+        header.magic = SharedLib::EnvBrdfLutMagic;
+        header.version = EnvBrdfLutVersion;
+        header.width = params.dim;
+        header.height = params.dim;
+        header.sampleCount = params.sampleCount;
+        header.format = params.format;
+    }
+    return header;
+}
+
+// ================================================================================================================
+std::string GetEnvBrdfLutCachePathName(
+    const std::string&      cacheDir,
+    const EnvBrdfLutParams& params)
+{
+    std::string formatName = params.format == SharedLib::EnvBrdfLutFormat::RG16F ? "rg16f" : "rg32f";
+    return cacheDir + "/envBrdf_" + std::to_string(params.dim) + "_" + std::to_string(params.sampleCount) + "_" +
+           formatName + "_v" + std::to_string(EnvBrdfLutVersion) + ".bin";
+}
+
+// ================================================================================================================
+bool LoadCachedEnvBrdfLut(
+    const std::string&      cacheDir,
+    const EnvBrdfLutParams& params,
+    std::vector<char>&      texels)
+{
+    SharedLib::EnvBrdfLutHeader header{};
+    if (SharedLib::ReadEnvBrdfLut(GetEnvBrdfLutCachePathName(cacheDir, params), header, texels) == false)
+    {
+        return false;
+    }
+
+    // The file name is the key, but a renamed or hand copied file shouldn't be trusted.
+    SharedLib::EnvBrdfLutHeader expected = MakeEnvBrdfLutHeader(params);
+    return (header.version == expected.version) &&
+           (header.width == expected.width) &&
+           (header.height == expected.height) &&
+           (header.sampleCount == expected.sampleCount) &&
+           (header.format == expected.format);
+}
+
+// ================================================================================================================
+void StoreCachedEnvBrdfLut(
+    const std::string&       cacheDir,
+    const EnvBrdfLutParams&  params,
+    const std::vector<char>& texels)
+{
+    std::error_code errCode;
+    std::filesystem::create_directories(cacheDir, errCode);
+    if (errCode)
+    {
+        std::cerr << "Cannot create the cache folder: " << cacheDir << std::endl;
+        return;
+    }
+
+    SharedLib::SaveEnvBrdfLut(GetEnvBrdfLutCachePathName(cacheDir, params), MakeEnvBrdfLutHeader(params), texels.data());
+}
+
+// ================================================================================================================
+void PackEnvBrdfLut(
+    const float*            pSrc,
+    uint32_t                srcComponents,
+    const EnvBrdfLutParams& params,
+    std::vector<char>&      texels)
+{
+    uint64_t texelCnt = uint64_t(params.dim) * params.dim;
+    texels.resize(texelCnt * SharedLib::EnvBrdfLutTexelBytes(params.format));
+
+    if (params.format == SharedLib::EnvBrdfLutFormat::RG16F)
+    {
+        uint16_t* pDst = reinterpret_cast<uint16_t*>(texels.data());
+        for (uint64_t i = 0; i < texelCnt; i++)
+        {
+            pDst[2 * i] = SharedLib::FloatToHalf(pSrc[srcComponents * i]);
+            pDst[2 * i + 1] = SharedLib::FloatToHalf(pSrc[srcComponents * i + 1]);
+        }
+    }
+    else
+    {
+        float* pDst = reinterpret_cast<float*>(texels.data());
+        for (uint64_t i = 0; i < texelCnt; i++)
+        {
+            pDst[2 * i] = pSrc[srcComponents * i];
+            pDst[2 * i + 1] = pSrc[srcComponents * i + 1];
+        }
+    }
+}
+
+// ================================================================================================================
+bool OutputEnvBrdfLut(
+    const std::string&       outputDir,
+    const EnvBrdfLutParams&  params,
+    const std::vector<char>& texels,
+    bool                     saveHdr)
+{
+    if (SharedLib::SaveEnvBrdfLut(outputDir + "/envBrdf.bin", MakeEnvBrdfLutHeader(params), texels.data()) == false)
+    {
+        return false;
+    }
+
+    if (saveHdr)
+    {
+        uint64_t texelCnt = uint64_t(params.dim) * params.dim;
+        std::vector<float> rgbData(3 * texelCnt);
+        for (uint64_t i = 0; i < texelCnt; i++)
+        {
+            if (params.format == SharedLib::EnvBrdfLutFormat::RG16F)
+            {
+                uint16_t rg[2];
+                memcpy(rg, &texels[i * 2 * sizeof(uint16_t)], sizeof(rg));
+                rgbData[3 * i] = SharedLib::HalfToFloat(rg[0]);
+                rgbData[3 * i + 1] = SharedLib::HalfToFloat(rg[1]);
+            }
+            else
+            {
+                memcpy(&rgbData[3 * i], &texels[i * 2 * sizeof(float)], 2 * sizeof(float));
+            }
+            rgbData[3 * i + 2] = 0.f;
+        }
+
+        return SharedLib::SaveImgHdr(outputDir + "/envBrdf.hdr", params.dim, params.dim, 3, rgbData.data());
+    }
+    return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "../../SharedLibrary/Utils/DiskOpsUtils.h"
+#include <string>
+#include <vector>
+
+// Bump it when the env brdf math changes, so the stale cached LUTs are regenerated instead of reused.
+constexpr uint32_t EnvBrdfLutVersion = 1;
+
+// The env brdf LUT doesn't depend on the input HDRI. These are all that it depends on, so they are the cache key.
+struct EnvBrdfLutParams
+{
+    uint32_t                    dim;
+    uint32_t                    sampleCount;
+    SharedLib::EnvBrdfLutFormat format;
+};
+
+SharedLib::EnvBrdfLutHeader MakeEnvBrdfLutHeader(const EnvBrdfLutParams& params);
+
+// <cacheDir>/envBrdf_<dim>_<sampleCount>_<rg16f|rg32f>_v<EnvBrdfLutVersion>.bin
+std::string GetEnvBrdfLutCachePathName(const std::string& cacheDir, const EnvBrdfLutParams& params);
+
+// Returns false when there is no cached LUT generated with exactly these parameters.
+bool LoadCachedEnvBrdfLut(const std::string& cacheDir, const EnvBrdfLutParams& params, std::vector<char>& texels);
+
+// Failing to store only costs a regeneration next time, so it's not an error of the run.
+void StoreCachedEnvBrdfLut(const std::string& cacheDir, const EnvBrdfLutParams& params, const std::vector<char>& texels);
+
+// Packs the first two of the srcComponents floats of every texel to the LUT format.
+void PackEnvBrdfLut(const float* pSrc, uint32_t srcComponents, const EnvBrdfLutParams& params, std::vector<char>& texels);
+
+// Writes the <outputDir>/envBrdf.bin. The saveHdr also writes the old envBrdf.hdr (R = scale, G = bias, B = 0) to view.
+// Returns false when a file isn't written.
+bool OutputEnvBrdfLut(const std::string& outputDir, const EnvBrdfLutParams& params, const std::vector<char>& texels, bool saveHdr);
@@ -4,8 +4,15 @@
 #include "../../SharedLibrary/Event/Event.h"
 #include "../../SharedLibrary/Utils/DiskOpsUtils.h"
 #include "../../SharedLibrary/Utils/CmdBufUtils.h"
+#include "../../SharedLibrary/Utils/HdrStreamUtils.h"
+#include "../../SharedLibrary/Utils/TraceUtils.h"
 #include <cassert>
 #include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <chrono>
+#include <iostream>
 
 #include "vk_mem_alloc.h"
 
@@ -17,6 +24,8 @@ GenIBL::GenIBL() :
     m_hdrCubeMapSampler(VK_NULL_HANDLE),
     m_hdrCubeMapAlloc(VK_NULL_HANDLE),
     m_hdrCubeMapInfo(),
+    m_inputMipGenMode(InputMipGenMode::Host),
+    m_streamBudgetBytes(0),
     m_diffuseIrradiancePipeline(),
     m_preFilterEnvMapPipeline(),
     m_envBrdfPipeline(),
@@ -30,11 +39,53 @@ GenIBL::GenIBL() :
     m_diffuseIrradianceCubemap(VK_NULL_HANDLE),
     m_diffuseIrradianceCubemapAlloc(VK_NULL_HANDLE),
     m_diffuseIrradianceCubemapImageView(VK_NULL_HANDLE),
+    m_irradianceMode(IrradianceMode::Convolution),
+    m_sh9OnGpu(false),
+    m_sh9ProjectCsShaderModule(VK_NULL_HANDLE),
+    m_sh9ProjectPipelineLayout(VK_NULL_HANDLE),
+    m_sh9ProjectPipeline(VK_NULL_HANDLE),
+    m_sh9ProjectDesSetLayout(VK_NULL_HANDLE),
+    m_sh9ProjectDesSet(VK_NULL_HANDLE),
+    m_hdrCubeMapLevel0ArrayView(VK_NULL_HANDLE),
+    m_sh9PartialSumsBuffer(VK_NULL_HANDLE),
+    m_sh9PartialSumsAlloc(VK_NULL_HANDLE),
     m_preFilterEnvMapVsShaderModule(VK_NULL_HANDLE),
     m_preFilterEnvMapPsShaderModule(VK_NULL_HANDLE),
     m_preFilterEnvMapPipelineLayout(VK_NULL_HANDLE),
     m_preFilterEnvMapCubemap(VK_NULL_HANDLE),
-    m_preFilterEnvMapCubemapAlloc(VK_NULL_HANDLE)
+    m_preFilterEnvMapCubemapAlloc(VK_NULL_HANDLE),
+    m_prefilterEnvMapMode(PrefilterEnvMapMode::Compute),
+    m_prefilterFis(false),
+    m_preFilterEnvMapCsShaderModule(VK_NULL_HANDLE),
+    m_preFilterEnvMapComputePipelineLayout(VK_NULL_HANDLE),
+    m_preFilterEnvMapComputePipeline(VK_NULL_HANDLE),
+    m_preFilterEnvMapStorageDesSetLayout(VK_NULL_HANDLE),
+    m_envBrdfLutParams{ EnvBrdfMapDim, EnvBrdfSampleCount, SharedLib::EnvBrdfLutFormat::RG16F },
+    m_genEnvBrdfLut(true),
+    m_envBrdfLutVkFormat(VK_FORMAT_R16G16_SFLOAT),
+    m_envBrdfVsShaderModule(VK_NULL_HANDLE),
+    m_envBrdfPsShaderModule(VK_NULL_HANDLE),
+    m_envBrdfPipelineLayout(VK_NULL_HANDLE),
+    m_envBrdfOutputImg(VK_NULL_HANDLE),
+    m_envBrdfOutputImgAlloc(VK_NULL_HANDLE),
+    m_envBrdfOutputImgView(VK_NULL_HANDLE),
+    m_isEquirectInput(false),
+    m_equirectInput(),
+    m_equirectImage(VK_NULL_HANDLE),
+    m_equirectImageAlloc(VK_NULL_HANDLE),
+    m_equirectImageView(VK_NULL_HANDLE),
+    m_equirectSampler(VK_NULL_HANDLE),
+    m_equirectImageExtent(),
+    m_equirectReprojectCsShaderModule(VK_NULL_HANDLE),
+    m_equirectReprojectDesSetLayout(VK_NULL_HANDLE),
+    m_equirectReprojectDesSet(VK_NULL_HANDLE),
+    m_equirectReprojectPipelineLayout(VK_NULL_HANDLE),
+    m_equirectReprojectPipeline(VK_NULL_HANDLE),
+    m_reprojectedCubemap(VK_NULL_HANDLE),
+    m_reprojectedCubemapAlloc(VK_NULL_HANDLE),
+    m_reprojectedCubemapView(VK_NULL_HANDLE),
+    m_backgroundBuffer(VK_NULL_HANDLE),
+    m_backgroundAlloc(VK_NULL_HANDLE)
 {
     memset(m_screenCameraData, 0, sizeof(m_screenCameraData));
 }
@@ -49,56 +100,181 @@ GenIBL::~GenIBL()
     DestroyCameraScreenUbo();
     DestroyInputCubemapRenderObjs();
     DestroyDiffuseIrradiancePipelineResourses();
+    DestroyDiffuseIrradianceOutputObjects();
+    DestroySH9ProjectResources();
     DestroyPrefilterEnvMapPipelineResourses();
+    DestroyPrefilterEnvMapOutputObjects();
+    DestroyPrefilterEnvMapComputeResources();
     DestroyEnvBrdfPipelineResources();
+    DestroyEquirectReprojectResources();
+    m_gpuTimer.Destroy();
 }
 
 // ================================================================================================================
 void GenIBL::DestroyInputCubemapRenderObjs()
 {
-    for (uint32_t i = 1; i < m_pHdrCubemapMips.size(); i++)
-    {
-        delete m_pHdrCubemapMips[i];
-    }
-
     vmaDestroyImage(*m_pAllocator, m_hdrCubeMapImage, m_hdrCubeMapAlloc);
     vkDestroyImageView(m_device, m_hdrCubeMapView, nullptr);
     vkDestroySampler(m_device, m_hdrCubeMapSampler, nullptr);
 }
 
 // ================================================================================================================
-// Clamp the high radiance so that diffuse irradiance sampling is happy.
-void DataPreprosess(
-    float* pData,
-    uint32_t width,
-    uint32_t height)
+// The input is a vStrip cubemap. It's decoded, clamped and padded to RGBA straight into the level 0 of the mip chain
+// arena in one pass, so the high radiance doesn't ruin the diffuse irradiance sampling. The GPU mipmaps only need the
+// level 0 on the host, so the chain has no room for the rest of the levels in that mode.
+bool GenIBL::DecodeCubemap(
+    const std::string& namePath,
+    CubemapMipChain&   mipChain)
 {
-    for (uint32_t i = 0; i < width * height * 3; i++)
+    SharedLib::ScopedTraceTimer decodeTimer("DecodeCubemap");
+    const uint32_t levelCnt = (m_inputMipGenMode == InputMipGenMode::Gpu) ? 1 : InputCubemapMipLevels;
+
+    // The Radiance files are always read in row bands, so there is no float copy of the input. Other inputs fall back
+    // to the whole image decode.
+    SharedLib::HdrScanlineReader hdrStream;
+    if (hdrStream.Open(namePath))
     {
-        if (pData[i] > 50.f)
+        if (hdrStream.GetHeight() != 6 * hdrStream.GetWidth())
         {
-            pData[i] = 50.f;
+            std::cerr << "The input is not a RGB vStrip cubemap: " << namePath << std::endl;
+            return false;
         }
+
+        uint64_t bandBytesCnt = (m_streamBudgetBytes != 0) ? m_streamBudgetBytes : InputDecodeBandBytes;
+        if (mipChain.InitFromHdrStream(hdrStream, levelCnt, InputRadianceClamp, bandBytesCnt, m_threadPool) == false)
+        {
+            std::cerr << "Cannot read the input cubemap: " << namePath << std::endl;
+            return false;
+        }
+        return true;
     }
+
+    int nrComponents, width, height;
+    float* pRgbData = SharedLib::ReadImg(namePath.c_str(), nrComponents, width, height);
+    if (pRgbData == nullptr)
+    {
+        std::cerr << "Cannot read the input cubemap: " << namePath << std::endl;
+        return false;
+    }
+
+    if ((nrComponents != 3) || (height != 6 * width))
+    {
+        std::cerr << "The input is not a RGB vStrip cubemap: " << namePath << std::endl;
+        SharedLib::ReleaseImg(pRgbData);
+        return false;
+    }
+
+    mipChain.InitFromRgbVStrip(pRgbData, (uint32_t)width, levelCnt, InputRadianceClamp, m_threadPool);
+
+    SharedLib::ReleaseImg(pRgbData);
+    return true;
 }
 
 // ================================================================================================================
-void GenIBL::ReadInCubemap(
-    const std::string& namePath)
+// Before AppInit() only the input info is updated. After it, the resources sized by the input face are recreated when
+// the face dim changes, and the camera UBO that the prefilter overwrote is reset for the next diffuse irradiance.
+void GenIBL::SetInputCubemap(
+    CubemapMipChain& decodedCubemap)
 {
-    int nrComponents, width, height;
-    m_hdrCubeMapInfo.pData = SharedLib::ReadImg(namePath.c_str(), nrComponents, width, height);
+    uint32_t prevFaceDim = m_hdrCubeMapInfo.width;
+
+    m_inputMipChain.Swap(decodedCubemap);
+    m_hdrCubeMapInfo.width = m_inputMipChain.GetFaceDim();
+    m_hdrCubeMapInfo.height = 6 * m_hdrCubeMapInfo.width;
+    m_hdrCubeMapInfo.pData = m_inputMipChain.GetLevelData(0);
+
+    UpdateInputSizeDependentResources(prevFaceDim);
+}
+
+// ================================================================================================================
+// The equirect input has no host level 0. Its arena is handed back like the mip chain one.
+void GenIBL::SetInputEquirect(
+    EquirectInput& decodedEquirect)
+{
+    uint32_t prevFaceDim = m_hdrCubeMapInfo.width;
 
-    m_hdrCubeMapInfo.width = (uint32_t)width;
-    m_hdrCubeMapInfo.height = (uint32_t)height;
+    std::swap(m_equirectInput, decodedEquirect);
+    m_hdrCubeMapInfo.width = m_equirectInput.height / 2;
+    m_hdrCubeMapInfo.height = 6 * m_hdrCubeMapInfo.width;
+    m_hdrCubeMapInfo.pData = nullptr;
+
+    UpdateInputSizeDependentResources(prevFaceDim);
+}
+
+// ================================================================================================================
+void GenIBL::UpdateInputSizeDependentResources(
+    uint32_t prevFaceDim)
+{
+    if (m_hdrCubeMapImage == VK_NULL_HANDLE)
+    {
+        return;
+    }
 
-    DataPreprosess(m_hdrCubeMapInfo.pData, m_hdrCubeMapInfo.width, m_hdrCubeMapInfo.height);
+    if (m_hdrCubeMapInfo.width != prevFaceDim)
+    {
+        RecreateInputSizeDependentResources();
+    }
+
+    UpdateCameraScreenUbo();
+}
+
+// ================================================================================================================
+// The pipelines and the descriptor set layouts don't depend on the input size, so only the images, their views and
+// the descriptor sets pointing at them are rebuilt. The descriptor sets are freed back to the pool and reallocated.
+void GenIBL::RecreateInputSizeDependentResources()
+{
+    VK_CHECK(vkQueueWaitIdle(m_graphicsQueue));
+
+    bool hasSH9ProjectSet = (m_irradianceMode == IrradianceMode::SH9) && m_sh9OnGpu;
+    bool hasPrefilterStorageSets = (m_prefilterEnvMapMode == PrefilterEnvMapMode::Compute);
+
+    // The SH9 array view is created from the input cubemap, so it goes first.
+    VK_CHECK(vkFreeDescriptorSets(m_device, m_descriptorPool, 1, &m_diffIrrPreFilterEnvMapDesSet0));
+    if (hasSH9ProjectSet)
+    {
+        VK_CHECK(vkFreeDescriptorSets(m_device, m_descriptorPool, 1, &m_sh9ProjectDesSet));
+        DestroySH9ProjectInputObjects();
+    }
+
+    if (hasPrefilterStorageSets)
+    {
+        VK_CHECK(vkFreeDescriptorSets(m_device,
+                                      m_descriptorPool,
+                                      (uint32_t)m_preFilterEnvMapStorageDesSets.size(),
+                                      m_preFilterEnvMapStorageDesSets.data()));
+    }
+
+    DestroyInputCubemapRenderObjs();
+    DestroyDiffuseIrradianceOutputObjects();
+    DestroyPrefilterEnvMapOutputObjects();
+
+    InitInputCubemapObjects();
+    InitDiffIrrPreFilterEnvMapDescriptorSets();
+    InitDiffuseIrradianceOutputObjects();
+    InitPrefilterEnvMapOutputObjects();
+
+    // The reprojection set is written before every dispatch, so it's kept.
+    if (m_isEquirectInput)
+    {
+        DestroyEquirectReprojectOutputObjects();
+        InitEquirectReprojectOutputObjects();
+    }
+
+    if (hasPrefilterStorageSets)
+    {
+        AllocPrefilterEnvMapStorageDescriptorSets();
+    }
+
+    if (hasSH9ProjectSet)
+    {
+        AllocSH9ProjectDescriptorSet();
+    }
 }
 
 // ================================================================================================================
 void GenIBL::InitInputCubemapObjects()
 {
-    assert(m_hdrCubeMapInfo.pData != nullptr);
+    assert(m_hdrCubeMapInfo.width != 0);
 
     VmaAllocationCreateInfo hdrAllocInfo{};
     {
@@ -117,9 +293,9 @@ void GenIBL::InitInputCubemapObjects()
     {
         cubeMapImgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
         cubeMapImgInfo.imageType = VK_IMAGE_TYPE_2D;
-        cubeMapImgInfo.format = VK_FORMAT_R32G32B32_SFLOAT;
+        cubeMapImgInfo.format = InputCubemapFormat;
         cubeMapImgInfo.extent = extent;
-        cubeMapImgInfo.mipLevels = 10;
+        cubeMapImgInfo.mipLevels = InputCubemapMipLevels;
         cubeMapImgInfo.arrayLayers = 6;
         cubeMapImgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
         cubeMapImgInfo.tiling = VK_IMAGE_TILING_LINEAR;
@@ -140,9 +316,9 @@ void GenIBL::InitInputCubemapObjects()
         info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         info.image = m_hdrCubeMapImage;
         info.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
-        info.format = VK_FORMAT_R32G32B32_SFLOAT;
+        info.format = InputCubemapFormat;
         info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        info.subresourceRange.levelCount = 10;
+        info.subresourceRange.levelCount = InputCubemapMipLevels;
         info.subresourceRange.layerCount = 6;
     }
     VK_CHECK(vkCreateImageView(m_device, &info, nullptr, &m_hdrCubeMapView));
@@ -157,7 +333,7 @@ void GenIBL::InitInputCubemapObjects()
         sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
         sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
         sampler_info.minLod = 0.f;
-        sampler_info.maxLod = 10.f;
+        sampler_info.maxLod = float(InputCubemapMipLevels);
         sampler_info.maxAnisotropy = 1.0f;
     }
     VK_CHECK(vkCreateSampler(m_device, &sampler_info, nullptr, &m_hdrCubeMapSampler));
@@ -190,45 +366,19 @@ void GenIBL::InitCameraScreenUbo()
                     &m_uboCameraScreenAlloc,
                     nullptr);
 
-    // Prepare data
-    // Front, back, top, bottom, right, left.
-    float views[6 * 4] = 
-    {
-         1.f,  0.f,  0.f, 0.f,
-        -1.f,  0.f,  0.f, 0.f,
-         0.f,  1.f,  0.f, 0.f,
-         0.f, -1.f,  0.f, 0.f,
-         0.f,  0.f,  1.f, 0.f,
-         0.f,  0.f, -1.f, 0.f
-    };
-
-    float rights[6 * 4] =
-    {
-         0.f,  0.f,  1.f, 0.f,
-         0.f,  0.f, -1.f, 0.f,
-         0.f,  0.f,  1.f, 0.f,
-         0.f,  0.f,  1.f, 0.f,
-        -1.f,  0.f,  0.f, 0.f,
-         1.f,  0.f,  0.f, 0.f
-    };
-
-    float ups[6 * 4] =
-    {
-         0.f,  1.f,  0.f, 0.f,
-         0.f,  1.f,  0.f, 0.f,
-        -1.f,  0.f,  0.f, 0.f,
-         1.f,  0.f,  0.f, 0.f,
-         0.f,  1.f,  0.f, 0.f,
-         0.f,  1.f,  0.f, 0.f
-    };
+    UpdateCameraScreenUbo();
+}
 
+// ================================================================================================================
+void GenIBL::UpdateCameraScreenUbo()
+{
     float near = 1.f;
     float nearWidthHeight[2] = {2.f, 2.f};
     float viewportWidthHeight[2] = { m_hdrCubeMapInfo.width, m_hdrCubeMapInfo.width };
 
-    memcpy(m_screenCameraData, views, sizeof(views));
-    memcpy(&m_screenCameraData[24], rights, sizeof(rights));
-    memcpy(&m_screenCameraData[48], ups, sizeof(ups));
+    memcpy(m_screenCameraData, CubemapFaceViews, sizeof(CubemapFaceViews));
+    memcpy(&m_screenCameraData[24], CubemapFaceRights, sizeof(CubemapFaceRights));
+    memcpy(&m_screenCameraData[48], CubemapFaceUps, sizeof(CubemapFaceUps));
     m_screenCameraData[72] = near;
     memcpy(&m_screenCameraData[73], nearWidthHeight, sizeof(nearWidthHeight));
     memcpy(&m_screenCameraData[76], viewportWidthHeight, sizeof(viewportWidthHeight));
@@ -253,7 +403,7 @@ void GenIBL::InitDiffIrrPreFilterEnvMapDescriptorSetLayout()
     VkDescriptorSetLayoutBinding cameraScreenInfoUboBinding{};
     {
         cameraScreenInfoUboBinding.binding = 1;
-        cameraScreenInfoUboBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        cameraScreenInfoUboBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
         cameraScreenInfoUboBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
         cameraScreenInfoUboBinding.descriptorCount = 1;
     }
@@ -262,7 +412,7 @@ void GenIBL::InitDiffIrrPreFilterEnvMapDescriptorSetLayout()
     VkDescriptorSetLayoutBinding hdriSamplerBinding{};
     {
         hdriSamplerBinding.binding = 0;
-        hdriSamplerBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        hdriSamplerBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
         hdriSamplerBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
         hdriSamplerBinding.descriptorCount = 1;
     }
@@ -345,18 +495,44 @@ void GenIBL::AppInit()
     std::vector<const char*> instExtensions;
     InitInstance(instExtensions, 0);
 
-    InitPhysicalDevice();
+    // We need the dynamic rendering extension and the multiview extension.
+    const std::vector<const char*> deviceExtensions = { VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME, VK_KHR_MULTIVIEW_EXTENSION_NAME };
+
+    InitPhysicalDevice(deviceExtensions);
     InitGfxQueueFamilyIdx();
 
+    if ((m_prefilterEnvMapMode == PrefilterEnvMapMode::Compute) && (IsPrefilterEnvMapComputeSupported() == false))
+    {
+        std::cerr << "The device cannot run the compute prefilter environment map. Fall back to the graphics passes." << std::endl;
+        m_prefilterEnvMapMode = PrefilterEnvMapMode::Graphics;
+    }
+
+    // The equirect input only has its level 0 on the GPU, so its mips are blitted and its SH9 is projected there.
+    if (m_isEquirectInput)
+    {
+        if (IsInputCubemapBlitSupported() == false)
+        {
+            std::cerr << "The input cubemap format doesn't support linear blits, which the equirect input needs. Convert the inputs with the SphericalToCubemap instead." << std::endl;
+            exit(1);
+        }
+        m_sh9OnGpu = true;
+    }
+
     // Queue family index should be unique in vk1.2:
     // https://vulkan.lunarg.com/doc/view/1.2.198.0/windows/1.2-extensions/vkspec.html#VUID-VkDeviceCreateInfo-queueFamilyIndex-02802
     std::vector<VkDeviceQueueCreateInfo> deviceQueueInfos = CreateDeviceQueueInfos({ m_graphicsQueueFamilyIdx });
-    // We need the swap chain device extension and the dynamic rendering extension.
-    const std::vector<const char*> deviceExtensions = { VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME, VK_KHR_MULTIVIEW_EXTENSION_NAME };
+
+    // The workgroup size specialization constants of the compute prefilter are emitted as LocalSizeId.
+    VkPhysicalDeviceMaintenance4Features maintenance4Features{};
+    {
+        maintenance4Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_4_FEATURES;
+        maintenance4Features.maintenance4 = VK_TRUE;
+    }
 
     VkPhysicalDeviceVulkan11Features vulkan11Features{};
     {
         vulkan11Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+        vulkan11Features.pNext = (m_prefilterEnvMapMode == PrefilterEnvMapMode::Compute) ? &maintenance4Features : nullptr;
         vulkan11Features.multiview = VK_TRUE;
     }
 
@@ -373,7 +549,9 @@ void GenIBL::AppInit()
     InitDescriptorPool();
 
     InitGfxCommandPool();
-    InitGfxCommandBuffers(1);
+    InitGfxCommandBuffers(2); // The second one is only for the level 0 upload of the host input mipmaps.
+    InitReadbackManager();
+    m_gpuTimer.Init(m_physicalDevice, m_device, m_graphicsQueueFamilyIdx);
 
     InitInputCubemapObjects();
     InitCameraScreenUbo();
@@ -388,153 +566,613 @@ void GenIBL::AppInit()
     InitDiffuseIrradiancePipelineLayout();
     InitDiffuseIrradiancePipeline();
 
+    // Pipeline and resources for the GPU SH9 projection.
+    if ((m_irradianceMode == IrradianceMode::SH9) && m_sh9OnGpu)
+    {
+        InitSH9ProjectDescriptorSet();
+        InitSH9ProjectShaderModule();
+        InitSH9ProjectPipelineLayout();
+        InitSH9ProjectPipeline();
+    }
+
     // Pipeline and resources for the prefilter environment map gen.
     InitPrefilterEnvMapOutputObjects();
     InitPrefilterEnvMapShaderModules();
     InitPrefilterEnvMapPipelineLayout();
     InitPrefilterEnvMapPipeline();
 
+    if (m_prefilterEnvMapMode == PrefilterEnvMapMode::Compute)
+    {
+        InitPrefilterEnvMapStorageDescriptorSets();
+        InitPrefilterEnvMapComputeShaderModule();
+        InitPrefilterEnvMapComputePipelineLayout();
+        InitPrefilterEnvMapComputePipeline();
+    }
+
     // Pipeline and resources for the environment brdf map gen.
-    InitEnvBrdfOutputObjects();
-    InitEnvBrdfShaderModules();
-    InitEnvBrdfPipelineLayout();
-    InitEnvBrdfPipeline();
+    if (m_genEnvBrdfLut)
+    {
+        InitEnvBrdfOutputObjects();
+        InitEnvBrdfShaderModules();
+        InitEnvBrdfPipelineLayout();
+        InitEnvBrdfPipeline();
+    }
+
+    // Pipeline and resources for the equirect input reprojection.
+    if (m_isEquirectInput)
+    {
+        InitEquirectReprojectOutputObjects();
+        InitEquirectReprojectDescriptorSet();
+        InitEquirectReprojectShaderModule();
+        InitEquirectReprojectPipelineLayout();
+        InitEquirectReprojectPipeline();
+    }
 }
 
 // ================================================================================================================
-// Only for the rectangle pic now. 3 channels per color element.
-void GenHalfMipmapLinearMean(
-    float* pSrc,
-    uint32_t srcDim,
-    float* pDst)
+void GenIBL::CmdGenInputCubemapMipMaps(
+    VkCommandBuffer cmdBuffer)
 {
-    uint32_t faceWidth = srcDim / 2;
-    uint32_t faceHeight = srcDim / 2;
-    for (uint32_t row = 0; row < faceHeight; row++)
+    SharedLib::ScopedTraceTimer mipGenTimer("CmdGenInputCubemapMipMaps");
+
+    if (m_inputMipGenMode == InputMipGenMode::Gpu)
     {
-        for (uint32_t col = 0; col < faceWidth; col++)
+        if (IsInputCubemapBlitSupported())
         {
-            uint32_t dstPixelId = row * faceHeight + col;
-
-            uint32_t srcRowId = 2 * row;
-            uint32_t srcColId = 2 * col;
-            uint32_t srcPixelId0 = srcRowId * srcDim + srcColId;
-            uint32_t srcPixelId1 = srcRowId * srcDim + srcColId + 1;
-            uint32_t srcPixelId2 = (srcRowId + 1) * srcDim + srcColId;
-            uint32_t srcPixelId3 = (srcRowId + 1) * srcDim + srcColId + 1;
-
-            pDst[3 * dstPixelId] = (pSrc[srcPixelId0 * 3] +
-                                    pSrc[srcPixelId1 * 3] +
-                                    pSrc[srcPixelId2 * 3] +
-                                    pSrc[srcPixelId3 * 3]) / 4.f;
-
-            pDst[3 * dstPixelId + 1] = (pSrc[srcPixelId0 * 3 + 1] +
-                                        pSrc[srcPixelId1 * 3 + 1] +
-                                        pSrc[srcPixelId2 * 3 + 1] +
-                                        pSrc[srcPixelId3 * 3 + 1]) / 4.f;
-
-            pDst[3 * dstPixelId + 2] = (pSrc[srcPixelId0 * 3 + 2] +
-                                        pSrc[srcPixelId1 * 3 + 2] +
-                                        pSrc[srcPixelId2 * 3 + 2] +
-                                        pSrc[srcPixelId3 * 3 + 2]) / 4.f;
+            CmdGenInputCubemapMipMapsOnGpu(cmdBuffer);
+            return;
         }
+
+        std::cerr << "The input cubemap format doesn't support linear blits. Fall back to the host mipmaps generation." << std::endl;
+
+        // The input was decoded with the level 0 only.
+        m_inputMipChain.AddLevels(InputCubemapMipLevels);
+        m_hdrCubeMapInfo.pData = m_inputMipChain.GetLevelData(0);
     }
+
+    CmdGenInputCubemapMipMapsOnHost(cmdBuffer);
 }
 
 // ================================================================================================================
-// Assume vertical format cubemap
-void GenHalfCubemapMipmapLinearMean(
-    float* pSrc,
-    uint32_t srcDim,
-    float* pDst)
+// The blit chain needs the input cubemap format to be a blit source, a blit destination and linear filterable under the
+// input cubemap tiling.
+bool GenIBL::IsInputCubemapBlitSupported()
 {
-    uint32_t dstDim = srcDim / 2;
-    for (uint32_t face = 0; face < 6; face++)
-    {
-        uint32_t faceSrcPixelStartId = face * (srcDim * srcDim);
-        float* pFaceSrc = &pSrc[3 * faceSrcPixelStartId];
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(m_physicalDevice, InputCubemapFormat, &formatProperties);
 
-        uint32_t faceDstPixelStartId = face * (dstDim * dstDim);
-        float* pFaceDst = &pDst[3 * faceDstPixelStartId];
+    VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+                                            VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                            VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
 
-        GenHalfMipmapLinearMean(pFaceSrc, srcDim, pFaceDst);
-    }
+    return (formatProperties.linearTilingFeatures & requiredFeatures) == requiredFeatures;
 }
 
 // ================================================================================================================
-void GenIBL::CmdGenInputCubemapMipMaps(
+// The mipmaps are built on the host by the multithreaded SIMD kernels into the mip chain arena. The whole chain,
+// including the level 0, goes through one staging buffer that mirrors the arena layout in two submits:
+// - The level 0, which is 3/4 of the chain, is submitted on the second gfx command buffer before the mips are built, so
+//   its copy runs on the GPU while the host builds the rest of the levels.
+// - Each finished level is copied into the mapped staging memory by a pool task while the next level is being built.
+//   The levels 1 and up are then recorded as regions of one copy command on the cmdBuffer, and that submit is waited.
+void GenIBL::CmdGenInputCubemapMipMapsOnHost(
     VkCommandBuffer cmdBuffer)
 {
     constexpr bool DbgDump = false;
 
-    // Prepare 9 mipmap chain data.
-    uint32_t mipMapNum = 9;
+    // A chain over the stream budget goes level by level through the staging ring instead. A level is streamed right
+    // after it's built.
+    if ((m_streamBudgetBytes != 0) && (m_inputMipChain.GetArenaBytesCnt() > m_streamBudgetBytes))
+    {
+        StreamInputMipLevel(0);
+        m_inputMipChain.BuildMips(m_threadPool, [this](uint32_t mipLevel) { StreamInputMipLevel(mipLevel); });
+        return;
+    }
+
+    VkBuffer stagingBuffer;
+    VmaAllocation stagingBufferAlloc;
+    CreateVmaVkBuffer(VMA_MEMORY_USAGE_AUTO,
+                      VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+                      VK_SHARING_MODE_EXCLUSIVE,
+                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                      m_inputMipChain.GetArenaBytesCnt(),
+                      &stagingBuffer,
+                      &stagingBufferAlloc);
+
+    VmaAllocationInfo stagingBufferAllocInfo;
+    vmaGetAllocationInfo(*m_pAllocator, stagingBufferAlloc, &stagingBufferAllocInfo);
+    char* pStagingData = static_cast<char*>(stagingBufferAllocInfo.pMappedData);
+
+    auto getMipCopy = [this](uint32_t mipLevel)
+    {
+        uint32_t mipDim = m_inputMipChain.GetLevelDim(mipLevel);
+
+        VkBufferImageCopy mipCopy{};
+        {
+            mipCopy.bufferOffset = m_inputMipChain.GetLevelOffsetInBytes(mipLevel);
+
+            mipCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            mipCopy.imageSubresource.mipLevel = mipLevel;
+            mipCopy.imageSubresource.baseArrayLayer = 0;
+            mipCopy.imageSubresource.layerCount = 6;
+
+            mipCopy.imageExtent = { mipDim, mipDim, 1 };
+        }
+        return mipCopy;
+    };
 
-    m_pHdrCubemapMips.resize(mipMapNum + 1);
-    m_pHdrCubemapMips[0] = m_hdrCubeMapInfo.pData;
+    // The level 0 submit also moves all the levels to the transfer dst layout. The later submit on the same queue is
+    // ordered after the barrier.
+    const VkDeviceSize level0BytesCnt = m_inputMipChain.GetLevelBytesCnt(0);
+    memcpy(pStagingData, m_inputMipChain.GetLevelData(0), level0BytesCnt);
+    VK_CHECK(vmaFlushAllocation(*m_pAllocator, stagingBufferAlloc, 0, level0BytesCnt));
 
-    for (uint32_t mipLevel = 0; mipLevel < mipMapNum; mipLevel++)
+    VkCommandBuffer level0CmdBuffer = GetGfxCmdBuffer(1);
+
+    VkCommandBufferBeginInfo beginInfo{};
     {
-        uint32_t dstDivFactor = 2 << mipLevel;
-        uint32_t mipPixelCnt = (m_hdrCubeMapInfo.width / dstDivFactor) * (m_hdrCubeMapInfo.height / dstDivFactor);
-        float* pDstMip = new float[3 * mipPixelCnt];
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    }
+    VK_CHECK(vkBeginCommandBuffer(level0CmdBuffer, &beginInfo));
 
-        m_pHdrCubemapMips[mipLevel + 1] = pDstMip;
+    VkImageMemoryBarrier undefToDstBarrier{};
+    {
+        undefToDstBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        undefToDstBarrier.image = m_hdrCubeMapImage;
+        undefToDstBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        undefToDstBarrier.subresourceRange.baseMipLevel = 0;
+        undefToDstBarrier.subresourceRange.levelCount = InputCubemapMipLevels;
+        undefToDstBarrier.subresourceRange.baseArrayLayer = 0;
+        undefToDstBarrier.subresourceRange.layerCount = 6;
+        undefToDstBarrier.srcAccessMask = 0;
+        undefToDstBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        undefToDstBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        undefToDstBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    }
 
-        uint32_t srcDivFactor = 1 << mipLevel;
-        GenHalfCubemapMipmapLinearMean(m_pHdrCubemapMips[mipLevel],
-                                       m_hdrCubeMapInfo.width / srcDivFactor,
-                                       pDstMip);
+    vkCmdPipelineBarrier(
+        level0CmdBuffer,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &undefToDstBarrier);
+
+    VkBufferImageCopy level0Copy = getMipCopy(0);
+    vkCmdCopyBufferToImage(
+        level0CmdBuffer,
+        stagingBuffer,
+        m_hdrCubeMapImage,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        1, &level0Copy);
+
+    VK_CHECK(vkEndCommandBuffer(level0CmdBuffer));
+    m_gfxTimeline.Submit(level0CmdBuffer);
+
+    std::vector<std::future<void>> levelCopies;
+    levelCopies.reserve(InputCubemapMipLevels - 1);
+    m_inputMipChain.BuildMips(m_threadPool, [&](uint32_t mipLevel)
+    {
+        levelCopies.push_back(m_threadPool.Submit([this, pStagingData, mipLevel]()
+        {
+            memcpy(pStagingData + m_inputMipChain.GetLevelOffsetInBytes(mipLevel),
+                   m_inputMipChain.GetLevelData(mipLevel),
+                   m_inputMipChain.GetLevelBytesCnt(mipLevel));
+        }));
+    });
 
+    for (std::future<void>& levelCopy : levelCopies)
+    {
+        levelCopy.get();
+    }
+    VK_CHECK(vmaFlushAllocation(*m_pAllocator, stagingBufferAlloc, 0, VK_WHOLE_SIZE));
+    SharedLib::AddTraceBytes(SharedLib::TraceUploadBytes, m_inputMipChain.GetArenaBytesCnt());
+
+    std::vector<VkBufferImageCopy> mipCopies;
+    mipCopies.reserve(InputCubemapMipLevels - 1);
+    for (uint32_t mipLevel = 1; mipLevel < InputCubemapMipLevels; mipLevel++)
+    {
         if (DbgDump)
         {
+            uint32_t mipDim = m_inputMipChain.GetLevelDim(mipLevel);
             std::string outputPathName = SOURCE_PATH;
-            outputPathName += ("/mip" + std::to_string(mipLevel + 1) + ".hdr");
-            SharedLib::SaveImgHdr(outputPathName,
-                                  m_hdrCubeMapInfo.width / dstDivFactor,
-                                  m_hdrCubeMapInfo.height / dstDivFactor,
-                                  3, pDstMip);
+            outputPathName += ("/mip" + std::to_string(mipLevel) + ".hdr");
+            SharedLib::SaveImgHdr(outputPathName, mipDim, 6 * mipDim, 4, m_inputMipChain.GetLevelData(mipLevel));
         }
 
-        uint32_t mipBytesCnt = 3 * sizeof(float) *
-                               (m_hdrCubeMapInfo.width / dstDivFactor) *
-                               (m_hdrCubeMapInfo.height / dstDivFactor);
+        mipCopies.push_back(getMipCopy(mipLevel));
+    }
+
+    VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+
+    vkCmdCopyBufferToImage(
+        cmdBuffer,
+        stagingBuffer,
+        m_hdrCubeMapImage,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        (uint32_t)mipCopies.size(), mipCopies.data());
+
+    VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+
+    // The timeline value of this submit is reached after the level 0 submit as well.
+    m_gfxTimeline.SubmitAndWait(cmdBuffer);
+    vkResetCommandBuffer(cmdBuffer, 0);
+    vkResetCommandBuffer(level0CmdBuffer, 0);
 
-        VkImageSubresourceRange mipSubResRangeForLayoutTrans{};
+    vmaDestroyBuffer(*m_pAllocator, stagingBuffer, stagingBufferAlloc);
+}
+
+// ================================================================================================================
+// Only the level 0 leaves the host. In one command buffer:
+// - All the levels go to the transfer dst layout and the level 0 is copied from the staging buffer.
+// - The rest of the levels are blitted down from the level 0 (CmdBlitInputCubemapMips(...)).
+// - All the levels are finally put back to the transfer dst layout, so both modes leave the image in the same state.
+// A level 0 over the stream budget goes through the staging ring before the command buffer, which then only transfers
+// the rest of the levels.
+void GenIBL::CmdGenInputCubemapMipMapsOnGpu(
+    VkCommandBuffer cmdBuffer)
+{
+    const VkDeviceSize level0BytesCnt = m_inputMipChain.GetLevelBytesCnt(0);
+    const bool isLevel0Streamed = (m_streamBudgetBytes != 0) && (level0BytesCnt > m_streamBudgetBytes);
+
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    VmaAllocation stagingBufferAlloc = VK_NULL_HANDLE;
+    if (isLevel0Streamed)
+    {
+        StreamInputMipLevel(0);
+    }
+    else
+    {
+        CreateVmaVkBuffer(VMA_MEMORY_USAGE_AUTO,
+                          VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+                          VK_SHARING_MODE_EXCLUSIVE,
+                          VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                          level0BytesCnt,
+                          &stagingBuffer,
+                          &stagingBufferAlloc);
+
+        VmaAllocationInfo stagingBufferAllocInfo;
+        vmaGetAllocationInfo(*m_pAllocator, stagingBufferAlloc, &stagingBufferAllocInfo);
+        memcpy(stagingBufferAllocInfo.pMappedData, m_inputMipChain.GetLevelData(0), level0BytesCnt);
+        VK_CHECK(vmaFlushAllocation(*m_pAllocator, stagingBufferAlloc, 0, VK_WHOLE_SIZE));
+        SharedLib::AddTraceBytes(SharedLib::TraceUploadBytes, level0BytesCnt);
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    {
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    }
+    VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+    m_gpuTimer.CmdBeginPass(cmdBuffer, "Input cubemap mip blits");
+
+    VkImageMemoryBarrier undefToDstBarrier{};
+    {
+        undefToDstBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        undefToDstBarrier.image = m_hdrCubeMapImage;
+        undefToDstBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        undefToDstBarrier.subresourceRange.baseMipLevel = isLevel0Streamed ? 1 : 0;
+        undefToDstBarrier.subresourceRange.levelCount = isLevel0Streamed ? InputCubemapMipLevels - 1 : InputCubemapMipLevels;
+        undefToDstBarrier.subresourceRange.baseArrayLayer = 0;
+        undefToDstBarrier.subresourceRange.layerCount = 6;
+        undefToDstBarrier.srcAccessMask = 0;
+        undefToDstBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        undefToDstBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        undefToDstBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    }
+
+    vkCmdPipelineBarrier(
+        cmdBuffer,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &undefToDstBarrier);
+
+    if (isLevel0Streamed == false)
+    {
+        VkBufferImageCopy level0Copy{};
         {
-            mipSubResRangeForLayoutTrans.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            mipSubResRangeForLayoutTrans.baseArrayLayer = 0;
-            mipSubResRangeForLayoutTrans.layerCount = 6;
-            mipSubResRangeForLayoutTrans.baseMipLevel = mipLevel + 1;
-            mipSubResRangeForLayoutTrans.levelCount = 1;
+            level0Copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            level0Copy.imageSubresource.mipLevel = 0;
+            level0Copy.imageSubresource.baseArrayLayer = 0;
+            level0Copy.imageSubresource.layerCount = 6;
+            level0Copy.imageExtent = { m_hdrCubeMapInfo.width, m_hdrCubeMapInfo.width, 1 };
         }
 
-        VkBufferImageCopy mipCopy{};
+        vkCmdCopyBufferToImage(
+            cmdBuffer,
+            stagingBuffer,
+            m_hdrCubeMapImage,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &level0Copy);
+    }
+
+    CmdBlitInputCubemapMips(cmdBuffer);
+
+    m_gpuTimer.CmdEndPass(cmdBuffer);
+    VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+
+    m_gfxTimeline.SubmitAndWait(cmdBuffer);
+    vkResetCommandBuffer(cmdBuffer, 0);
+    m_gpuTimer.Resolve();
+
+    if (isLevel0Streamed == false)
+    {
+        vmaDestroyBuffer(*m_pAllocator, stagingBuffer, stagingBufferAlloc);
+    }
+}
+
+// ================================================================================================================
+// Each level i is blitted from the level i - 1 with a linear filter, which is a 2x2 box filter for the halved
+// dimensions. The level i - 1 goes to the transfer src layout right before it's read.
+void GenIBL::CmdBlitInputCubemapMips(
+    VkCommandBuffer cmdBuffer)
+{
+    for (uint32_t mipLevel = 1; mipLevel < InputCubemapMipLevels; mipLevel++)
+    {
+        int32_t srcDim = (int32_t)(m_hdrCubeMapInfo.width >> (mipLevel - 1));
+        int32_t dstDim = (int32_t)(m_hdrCubeMapInfo.width >> mipLevel);
+
+        VkImageMemoryBarrier dstToSrcBarrier{};
         {
-            VkExtent3D extent{};
-            {
-                extent.width = m_hdrCubeMapInfo.width / dstDivFactor;
-                extent.height = m_hdrCubeMapInfo.width / dstDivFactor;
-                extent.depth = 1;
-            }
+            dstToSrcBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            dstToSrcBarrier.image = m_hdrCubeMapImage;
+            dstToSrcBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            dstToSrcBarrier.subresourceRange.baseMipLevel = mipLevel - 1;
+            dstToSrcBarrier.subresourceRange.levelCount = 1;
+            dstToSrcBarrier.subresourceRange.baseArrayLayer = 0;
+            dstToSrcBarrier.subresourceRange.layerCount = 6;
+            dstToSrcBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            dstToSrcBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            dstToSrcBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            dstToSrcBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        }
 
-            mipCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            mipCopy.imageSubresource.mipLevel = mipLevel + 1;
-            mipCopy.imageSubresource.baseArrayLayer = 0;
-            mipCopy.imageSubresource.layerCount = 6;
+        vkCmdPipelineBarrier(
+            cmdBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            0, nullptr,
+            0, nullptr,
+            1, &dstToSrcBarrier);
 
-            mipCopy.imageExtent = extent;
+        VkImageBlit mipBlit{};
+        {
+            mipBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            mipBlit.srcSubresource.mipLevel = mipLevel - 1;
+            mipBlit.srcSubresource.baseArrayLayer = 0;
+            mipBlit.srcSubresource.layerCount = 6;
+            mipBlit.srcOffsets[1] = { srcDim, srcDim, 1 };
+
+            mipBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            mipBlit.dstSubresource.mipLevel = mipLevel;
+            mipBlit.dstSubresource.baseArrayLayer = 0;
+            mipBlit.dstSubresource.layerCount = 6;
+            mipBlit.dstOffsets[1] = { dstDim, dstDim, 1 };
         }
 
-        SharedLib::SendImgDataToGpu(cmdBuffer,
-                                    m_device,
-                                    m_graphicsQueue,
-                                    m_pHdrCubemapMips[mipLevel + 1],
-                                    mipBytesCnt,
-                                    m_hdrCubeMapImage,
-                                    mipSubResRangeForLayoutTrans,
-                                    VK_IMAGE_LAYOUT_UNDEFINED,
-                                    mipCopy,
-                                    *m_pAllocator);
-    }
-}
\ No newline at end of file
+        vkCmdBlitImage(cmdBuffer,
+                       m_hdrCubeMapImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       m_hdrCubeMapImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       1, &mipBlit,
+                       VK_FILTER_LINEAR);
+    }
+
+    // The last level is still in the transfer dst layout. Put the others back.
+    VkImageMemoryBarrier srcToDstBarrier{};
+    {
+        srcToDstBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        srcToDstBarrier.image = m_hdrCubeMapImage;
+        srcToDstBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        srcToDstBarrier.subresourceRange.baseMipLevel = 0;
+        srcToDstBarrier.subresourceRange.levelCount = InputCubemapMipLevels - 1;
+        srcToDstBarrier.subresourceRange.baseArrayLayer = 0;
+        srcToDstBarrier.subresourceRange.layerCount = 6;
+        srcToDstBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        srcToDstBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        srcToDstBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        srcToDstBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    }
+
+    vkCmdPipelineBarrier(
+        cmdBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &srcToDstBarrier);
+}
+
+// ================================================================================================================
+// The rows of a level are the 6 faces one after another, which is the vStrip layout of the arena.
+void GenIBL::StreamInputMipLevel(
+    uint32_t mipLevel)
+{
+    uint32_t mipDim = m_inputMipChain.GetLevelDim(mipLevel);
+    const char* pLevelData = reinterpret_cast<const char*>(m_inputMipChain.GetLevelData(mipLevel));
+    const uint64_t rowBytesCnt = 4 * sizeof(float) * uint64_t(mipDim);
+
+    VkExtent2D mipExtent{};
+    {
+        mipExtent.width = mipDim;
+        mipExtent.height = mipDim;
+    }
+
+    SharedLib::StreamRowsToImg(m_device,
+                               m_graphicsQueue,
+                               m_gfxCmdPool,
+                               *m_pAllocator,
+                               m_hdrCubeMapImage,
+                               mipLevel,
+                               6,
+                               mipExtent,
+                               4 * sizeof(float),
+                               VK_IMAGE_LAYOUT_UNDEFINED,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               m_streamBudgetBytes,
+                               [=](uint32_t rowBegin, uint32_t rowCnt, void* pDst)
+                               {
+                                   memcpy(pDst, pLevelData + rowBegin * rowBytesCnt, rowCnt * rowBytesCnt);
+                                   return true;
+                               });
+}
+
+// ================================================================================================================
+void GenIBL::BakeInputCubemap(
+    bool             outputDiffuseIrradianceCubemap,
+    IblBakeProducts& products)
+{
+    SharedLib::ScopedTraceTimer bakeTimer("BakeInputCubemap");
+    products.faceDim = m_hdrCubeMapInfo.width;
+
+    // Blur the input cubemap of the diffuse irradiance map rendering -- Equivalent to generating mipmaps.
+    // It also sends the input hdri level 0 to its gpu cubemap image in the same submit. An equirect input is reprojected
+    // to the level 0 on the GPU instead, and the cubemap never goes through the host.
+    if (m_isEquirectInput)
+    {
+        auto reprojectStart = std::chrono::steady_clock::now();
+        ReprojectEquirectToInputCubemap(products.backgroundCubemap);
+        std::chrono::duration<double, std::milli> reprojectTime = std::chrono::steady_clock::now() - reprojectStart;
+        std::cout << "Input equirect reprojection and mipmaps (gpu) time: " << reprojectTime.count() << " ms" << std::endl;
+    }
+    else
+    {
+        auto mipGenStart = std::chrono::steady_clock::now();
+        CmdGenInputCubemapMipMaps(GetGfxCmdBuffer(0));
+        std::chrono::duration<double, std::milli> mipGenTime = std::chrono::steady_clock::now() - mipGenStart;
+        std::cout << "Input cubemap mipmaps (" << (m_inputMipGenMode == InputMipGenMode::Gpu ? "gpu" : "cpu")
+                  << ") time: " << mipGenTime.count() << " ms" << std::endl;
+    }
+
+    // Render the diffuse irradiance map. The SH9 mode only needs the input cubemap layout transition.
+    GenDiffuseIrradianceCubemap();
+
+    // The SH9 mode projects the input cubemap after it's in the shader read layout.
+    products.hasIrradianceSH9 = (m_irradianceMode == IrradianceMode::SH9);
+    if (products.hasIrradianceSH9)
+    {
+        auto sh9Start = std::chrono::steady_clock::now();
+        products.irradianceSH9 = GenDiffuseIrradianceSH9();
+        std::chrono::duration<double, std::milli> sh9Time = std::chrono::steady_clock::now() - sh9Start;
+        std::cout << "Diffuse irradiance SH9 (" << (m_sh9OnGpu ? "gpu" : "cpu") << ") time: "
+                  << sh9Time.count() << " ms" << std::endl;
+
+        if (outputDiffuseIrradianceCubemap)
+        {
+            GenDiffuseIrradianceCubemapFromSH9(products.irradianceSH9);
+        }
+    }
+
+    // The compute mode uses the push constant instead of waiting for draw completes and ubo updates.
+    GenPrefilterEnvMap();
+
+    ReadBackIblCubemaps(outputDiffuseIrradianceCubemap, products);
+}
+
+// ================================================================================================================
+// All the cubemaps are one request of the readback manager, so they go to one reused staging buffer back to back. The
+// face reordering is left to the writer on the host, so the readback is a single copy submit instead of a format pass
+// and a submit per cubemap.
+void GenIBL::ReadBackIblCubemaps(
+    bool             readDiffuseIrradiance,
+    IblBakeProducts& products)
+{
+    SharedLib::ScopedTraceTimer readBackTimer("ReadBackIblCubemaps");
+    uint32_t faceDim = m_hdrCubeMapInfo.width;
+
+    std::vector<VkImageMemoryBarrier> colorAttToSrcBarriers;
+    std::vector<SharedLib::ReadbackRegion> readbackRegions;
+
+    auto addCubemapRegion = [&](VkImage img, uint32_t mipLevel)
+    {
+        uint32_t mipDim = faceDim >> mipLevel;
+
+        VkImageMemoryBarrier colorAttToSrcBarrier{};
+        {
+            colorAttToSrcBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            colorAttToSrcBarrier.image = img;
+            colorAttToSrcBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            colorAttToSrcBarrier.subresourceRange.baseMipLevel = mipLevel;
+            colorAttToSrcBarrier.subresourceRange.levelCount = 1;
+            colorAttToSrcBarrier.subresourceRange.baseArrayLayer = 0;
+            colorAttToSrcBarrier.subresourceRange.layerCount = 6;
+            colorAttToSrcBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            colorAttToSrcBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            colorAttToSrcBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            colorAttToSrcBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        }
+        colorAttToSrcBarriers.push_back(colorAttToSrcBarrier);
+
+        SharedLib::ReadbackRegion region{};
+        {
+            region.srcImg = img;
+            region.subres.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.subres.mipLevel = mipLevel;
+            region.subres.baseArrayLayer = 0;
+            region.subres.layerCount = 6;
+            region.extent = { mipDim, mipDim, 1 };
+            region.texelBytes = sizeof(float) * 4;
+        }
+        readbackRegions.push_back(region);
+    };
+
+    if (readDiffuseIrradiance)
+    {
+        addCubemapRegion(m_diffuseIrradianceCubemap, 0);
+    }
+
+    for (uint32_t i = 0; i < RoughnessLevels; i++)
+    {
+        addCubemapRegion(m_preFilterEnvMapCubemap, i);
+    }
+
+    VkCommandBuffer cmdBuffer = GetGfxCmdBuffer(0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    {
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    }
+    VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+    m_gpuTimer.CmdBeginPass(cmdBuffer, "IBL cubemaps readback");
+
+    vkCmdPipelineBarrier(
+        cmdBuffer,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        (uint32_t)colorAttToSrcBarriers.size(), colorAttToSrcBarriers.data());
+
+    uint64_t readbackTicket = m_readbackManager.CmdReadImgs(cmdBuffer, readbackRegions);
+
+    m_gpuTimer.CmdEndPass(cmdBuffer);
+    VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+
+    m_readbackManager.Submit(cmdBuffer, readbackTicket);
+    m_readbackManager.Wait(readbackTicket);
+    vkResetCommandBuffer(cmdBuffer, 0);
+    m_gpuTimer.Resolve();
+
+    // The writers read the mapped staging buffer directly. It stays out of the pool until the ticket is released.
+    const SharedLib::ReadbackData& readbackData = m_readbackManager.GetData(readbackTicket);
+    auto regionData = [&readbackData](uint32_t regionIdx)
+    {
+        return reinterpret_cast<const float*>(readbackData.pData + readbackData.regionOffsets[regionIdx]);
+    };
+
+    uint32_t regionIdx = 0;
+    products.pDiffuseIrradianceCubemap = readDiffuseIrradiance ? regionData(regionIdx++) : nullptr;
+
+    products.prefilterEnvMapMips.resize(RoughnessLevels);
+    for (uint32_t i = 0; i < RoughnessLevels; i++)
+    {
+        products.prefilterEnvMapMips[i] = regionData(regionIdx++);
+    }
+
+    products.readbackTicket = readbackTicket;
+}
@@ -1,6 +1,13 @@
 #pragma once
 #include "../../SharedLibrary/Application/Application.h"
 #include "../../SharedLibrary/Pipeline/Pipeline.h"
+#include "../../SharedLibrary/Utils/ThreadUtils.h"
+#include "../../SharedLibrary/Utils/GpuTraceUtils.h"
+#include "GenIBLConsts.h"
+#include "CubemapMipChain.h"
+#include "SphericalHarmonics.h"
+#include "EnvBrdfLut.h"
+#include "GenIBLBatch.h"
 
 VK_DEFINE_HANDLE(VmaAllocation);
 
@@ -11,11 +18,68 @@ struct ImgInfo
     float*   pData;
 };
 
-constexpr int CameraScreenBufferSizeInFloats = 4 * 3 * 6 + 4 + 2;
+constexpr int CameraScreenBufferSizeInFloats = 4 * 3 * 6 + 4 + 4;
 constexpr int CameraScreenBufferSizeInBytes = sizeof(float) * CameraScreenBufferSizeInFloats;
 constexpr VkFormat HdriRenderTargetFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
-constexpr uint32_t RoughnessLevels = 8;
-constexpr uint32_t EnvBrdfMapDim = 1024;
+constexpr VkFormat InputCubemapFormat = VK_FORMAT_R32G32B32A32_SFLOAT; // RGBA so the host mip kernels can use SIMD.
+constexpr uint32_t PrefilterWorkgroupDim = 8;   // Specialization constant 0 of the prefilterEnvMap_comp.hlsl.
+
+// Rows of a face reduced by one workgroup of the sh9Project_comp.hlsl.
+constexpr uint32_t SH9ProjectRowsPerGroup = 8;
+
+// The workgroup dim of the equirectToCubemap_comp.hlsl.
+constexpr uint32_t EquirectWorkgroupDim = 8;
+
+// Where the input cubemap mipmaps are built.
+// - Host: The multithreaded SIMD kernels build all the levels and the whole chain is uploaded.
+// - Gpu: Only the level 0 is uploaded and the rest levels are blitted down on the device.
+enum class InputMipGenMode
+{
+    Host,
+    Gpu
+};
+
+// How the prefilter environment map is generated.
+// - Graphics: A multiview pass for each roughness level, which needs a UBO update and a submit per level.
+// - Compute: One dispatch per roughness level through storage image views. All the dispatches are recorded in one
+//   command buffer without barriers in between, so the small mips can run together.
+enum class PrefilterEnvMapMode
+{
+    Graphics,
+    Compute
+};
+
+// The push constant of the prefilterEnvMap_comp.hlsl.
+struct PrefilterPushConstant
+{
+    float    roughness;
+    uint32_t mipDim;
+    float    sampleLod;
+    uint32_t sampleCount;
+};
+
+// The push constant of the equirectToCubemap_comp.hlsl.
+struct EquirectPushConstant
+{
+    uint32_t faceDim;
+    float    radianceClamp;
+};
+
+// A decoded equirectangular input. The texels are RGBA32F rows with the full radiance. The reprojection clamps it for
+// the bake and keeps it for the background.
+struct EquirectInput
+{
+    uint32_t           width;
+    uint32_t           height;
+    std::vector<float> rgba;
+};
+
+// The push constant of the envBrdf_frag.hlsl.
+struct EnvBrdfPushConstant
+{
+    float    viewportWidthHeight[2];
+    uint32_t sampleCount;
+};
 
 class GenIBL : public SharedLib::Application
 {
@@ -25,25 +89,81 @@ public:
 
     virtual void AppInit() override;
 
-    VkDescriptorSet GetDiffIrrPreFilterEnvMapDesSet() { return m_diffIrrPreFilterEnvMapDesSet0; }
     VkImage GetDiffuseIrradianceCubemap() { return m_diffuseIrradianceCubemap; }
-    VkImageView GetDiffuseIrradianceCubemapView() { return m_diffuseIrradianceCubemapImageView; }
     ImgInfo GetInputHdriInfo() { return m_hdrCubeMapInfo; }
-    VkPipelineLayout GetDiffuseIrradiancePipelineLayout() { return m_diffuseIrradiancePipelineLayout; }
-    VkPipeline GetDiffuseIrradiancePipeline() { return m_diffuseIrradiancePipeline.GetVkPipeline(); }
     VkImage GetInputCubemap() { return m_hdrCubeMapImage; }
-    VkImageView GetInputCubemapImgView() { return m_diffuseIrradianceCubemapImageView; }
     VkImage GetPrefilterEnvMap() { return m_preFilterEnvMapCubemap; }
-    VkImage GetEnvBrdfOutputImg() { return m_envBrdfOutputImg; }
-    VkImageView GetEnvBrdfOutputImgView() { return m_envBrdfOutputImgView; }
-    VkPipeline GetEnvBrdfPipeline() { return m_envBrdfPipeline.GetVkPipeline(); }
-    VkPipelineLayout GetEnvBrdfPipelineLayout() { return m_envBrdfPipelineLayout; }
 
-    void ReadInCubemap(const std::string& namePath);
+    void SetInputMipGenMode(InputMipGenMode mode) { m_inputMipGenMode = mode; } // Has to be set before the first decode.
+
+    // A non-zero budget decodes the Radiance inputs in row bands and uploads a chain bigger than it through a staging
+    // ring of this many bytes, instead of one staging buffer of the whole chain.
+    void SetStreamBudget(uint64_t bytes) { m_streamBudgetBytes = bytes; }
+    void SetPrefilterEnvMapMode(PrefilterEnvMapMode mode) { m_prefilterEnvMapMode = mode; } // Has to be set before AppInit().
+    void SetPrefilterFis(bool useFis) { m_prefilterFis = useFis; } // Filtered importance sampling. Has to be set before AppInit().
+    void SetIrradianceMode(IrradianceMode mode) { m_irradianceMode = mode; } // Has to be set before AppInit().
+    void SetSH9OnGpu(bool onGpu) { m_sh9OnGpu = onGpu; } // Has to be set before AppInit().
+
+    // The inputs are equirectangular panoramas instead of vStrip cubemaps. Has to be set before AppInit().
+    void SetEquirectInput(bool isEquirect) { m_isEquirectInput = isEquirect; }
+
+    // Has to be set before AppInit(). A cached LUT doesn't need to be generated, which skips all the env brdf resources.
+    void SetEnvBrdfLut(const EnvBrdfLutParams& params, bool generate) { m_envBrdfLutParams = params; m_genEnvBrdfLut = generate; }
+
+    // Reads a vStrip cubemap into the level 0 of the mipChain, which only has the level 0 in the InputMipGenMode::Gpu. It
+    // only touches the host memory and the thread pool, so the batch mode decodes the next input on another thread while
+    // the current one is on the GPU.
+    bool DecodeCubemap(const std::string& namePath, CubemapMipChain& mipChain);
+
+    // Takes the decoded input over and gives the previous chain back, so its arena is reused by the next decode.
+    // After AppInit(), the resources sized by the input are only recreated when the face dim changes.
+    void SetInputCubemap(CubemapMipChain& decodedCubemap);
+
+    // The equirect input versions of the DecodeCubemap(...) and the SetInputCubemap(...). The face dim of the input
+    // cubemap is half of the equirect height, like the SphericalToCubemap output.
+    bool DecodeEquirect(const std::string& namePath, EquirectInput& equirect);
+    void SetInputEquirect(EquirectInput& decodedEquirect);
+
+    // Generates all the input dependent products of the current input and reads them back to the host.
+    void BakeInputCubemap(bool outputDiffuseIrradianceCubemap, IblBakeProducts& products);
+
+    // Puts the input cubemap in the shader read layout and renders the convolution mode diffuse irradiance cubemap.
+    void GenDiffuseIrradianceCubemap();
     void GenPrefilterEnvMap();
 
-    void CmdGenInputCubemapMipMaps(VkCommandBuffer cmdBuffer); // Down scale the input cubemap first and then up scale it up to upgrade
+    // Builds all the input cubemap mips and leaves all the levels in the VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL.
+    void CmdGenInputCubemapMipMaps(VkCommandBuffer cmdBuffer);
+
+    // Returns the irradiance SH9 of the input cubemap. The GPU path needs the input cubemap in the shader read layout.
+    SH9Rgb GenDiffuseIrradianceSH9();
+
+    // Fills the diffuse irradiance cubemap with the SH9 and leaves it in the VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    // which is what the rendered one is in.
+    void GenDiffuseIrradianceCubemapFromSH9(const SH9Rgb& irradianceSH);
+
+    // Renders the env brdf LUT straight into its RG format and reads the texels back in the envBrdf.bin layout.
+    void GenEnvBrdfLut(std::vector<char>& texels);
+
+    // Copies the diffuse irradiance cubemap (Optional) and all the prefilter env map mips to the host in one submit.
+    // Both have to be in the VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, which is where their generation leaves them.
+    // The products point into the mapped staging buffer until their readbackTicket is released.
+    void ReadBackIblCubemaps(bool readDiffuseIrradiance, IblBakeProducts& products);
 private:
+    void UpdateInputSizeDependentResources(uint32_t prevFaceDim); // Called after a new input is set.
+    void RecreateInputSizeDependentResources();
+
+    void CmdGenInputCubemapMipMapsOnHost(VkCommandBuffer cmdBuffer); // Uploads the level 0 while the rest levels are built.
+    void CmdGenInputCubemapMipMapsOnGpu(VkCommandBuffer cmdBuffer);  // Uploads the level 0 and blits the rest in one submit.
+    bool IsInputCubemapBlitSupported();
+
+    // Records the blits of the levels 1 and up from the level 0, which has to be in the VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+    // like the rest of the levels. All the levels end in the VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL.
+    void CmdBlitInputCubemapMips(VkCommandBuffer cmdBuffer);
+
+    // Uploads one finished level of the input mip chain through the staging ring and leaves it in the
+    // VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL.
+    void StreamInputMipLevel(uint32_t mipLevel);
+
     // Shared pipeline resources
     void InitDiffIrrPreFilterEnvMapDescriptorSets();
     void InitDiffIrrPreFilterEnvMapDescriptorSetLayout();
@@ -55,6 +175,35 @@ private:
     void DestroyDiffuseIrradiancePipelineResourses();
 
     void InitDiffuseIrradianceOutputObjects();
+    void DestroyDiffuseIrradianceOutputObjects();
+
+    // Diffuse Irradiance SH9
+    void InitSH9ProjectDescriptorSet();
+    void InitSH9ProjectPipelineLayout();
+    void InitSH9ProjectShaderModule();
+    void InitSH9ProjectPipeline();
+    void AllocSH9ProjectDescriptorSet();
+    void DestroySH9ProjectResources();
+    void DestroySH9ProjectInputObjects();
+
+    SH9Rgb ProjectInputCubemapToSH9OnGpu();
+
+    // Equirect input
+    void InitEquirectReprojectDescriptorSet();
+    void InitEquirectReprojectShaderModule();
+    void InitEquirectReprojectPipelineLayout();
+    void InitEquirectReprojectPipeline();
+    void DestroyEquirectReprojectResources();
+
+    void InitEquirectReprojectOutputObjects(); // Sized by the input cubemap face dim.
+    void DestroyEquirectReprojectOutputObjects();
+    void InitEquirectImgObjects();             // Sized by the equirect input.
+    void DestroyEquirectImgObjects();
+    void UpdateEquirectReprojectDescriptorSet();
+
+    // Uploads the equirect input, reprojects it to the input cubemap level 0 and blits the rest of the levels in one
+    // submit. The full radiance faces are read back to the backgroundCubemap in the same submit.
+    void ReprojectEquirectToInputCubemap(std::vector<float>& backgroundCubemap);
 
     // Prefilter Environment Map
     void InitPrefilterEnvMapPipeline();
@@ -63,7 +212,20 @@ private:
     void DestroyPrefilterEnvMapPipelineResourses();
 
     void InitPrefilterEnvMapOutputObjects();
-    void UpdateRoughnessInUbo(float roughness, float imgDim);
+    void DestroyPrefilterEnvMapOutputObjects();
+    void UpdateRoughnessInUbo(float roughness, float imgDim, uint32_t sampleCount);
+    uint32_t GetPrefilterSampleCount(uint32_t roughnessLevel);
+
+    void InitPrefilterEnvMapComputePipeline();
+    void InitPrefilterEnvMapComputePipelineLayout();
+    void InitPrefilterEnvMapComputeShaderModule();
+    void InitPrefilterEnvMapStorageDescriptorSets();
+    void AllocPrefilterEnvMapStorageDescriptorSets();
+    void DestroyPrefilterEnvMapComputeResources();
+    bool IsPrefilterEnvMapComputeSupported();
+
+    void GenPrefilterEnvMapGraphics();
+    void GenPrefilterEnvMapCompute();
 
     // Environment brdf
     void InitEnvBrdfPipeline();
@@ -78,6 +240,7 @@ private:
     void DestroyInputCubemapRenderObjs();
 
     void InitCameraScreenUbo();
+    void UpdateCameraScreenUbo();
     void DestroyCameraScreenUbo();
 
     // Shared pipeline resources
@@ -95,6 +258,18 @@ private:
     VmaAllocation m_diffuseIrradianceCubemapAlloc;
     VkImageView   m_diffuseIrradianceCubemapImageView;
 
+    // Resources for the SH9 diffuse irradiance. The GPU projection reads the input level 0 through a 2D array view.
+    IrradianceMode        m_irradianceMode;
+    bool                  m_sh9OnGpu;
+    VkShaderModule        m_sh9ProjectCsShaderModule;
+    VkPipelineLayout      m_sh9ProjectPipelineLayout;
+    VkPipeline            m_sh9ProjectPipeline;
+    VkDescriptorSetLayout m_sh9ProjectDesSetLayout;
+    VkDescriptorSet       m_sh9ProjectDesSet;
+    VkImageView           m_hdrCubeMapLevel0ArrayView;
+    VkBuffer              m_sh9PartialSumsBuffer;
+    VmaAllocation         m_sh9PartialSumsAlloc;
+
     // Resources for the prefilter environment map
     SharedLib::Pipeline m_preFilterEnvMapPipeline; // Specular split-sum 1st element.
     VkShaderModule      m_preFilterEnvMapVsShaderModule;
@@ -105,7 +280,19 @@ private:
     VmaAllocation            m_preFilterEnvMapCubemapAlloc;
     std::vector<VkImageView> m_preFilterEnvMapCubemapImageViews; // The render target needs different views to specify different mip levels.
 
-    // Resrouces for the environment brdf
+    // Resources for the compute prefilter environment map. The storage image of each mip is in its own set 1.
+    PrefilterEnvMapMode          m_prefilterEnvMapMode;
+    bool                         m_prefilterFis;
+    VkShaderModule               m_preFilterEnvMapCsShaderModule;
+    VkPipelineLayout             m_preFilterEnvMapComputePipelineLayout;
+    VkPipeline                   m_preFilterEnvMapComputePipeline;
+    VkDescriptorSetLayout        m_preFilterEnvMapStorageDesSetLayout;
+    std::vector<VkDescriptorSet> m_preFilterEnvMapStorageDesSets;
+
+    // Resrouces for the environment brdf. The render target is in the LUT format.
+    EnvBrdfLutParams    m_envBrdfLutParams;
+    bool                m_genEnvBrdfLut;
+    VkFormat            m_envBrdfLutVkFormat;
     SharedLib::Pipeline m_envBrdfPipeline; // Specular split-sum 2st element.
     VkShaderModule      m_envBrdfVsShaderModule;
     VkShaderModule      m_envBrdfPsShaderModule;
@@ -121,9 +308,35 @@ private:
     VmaAllocation m_hdrCubeMapAlloc;
     ImgInfo       m_hdrCubeMapInfo;
 
-    std::vector<float*> m_pHdrCubemapMips;
+    CubemapMipChain       m_inputMipChain; // Its level 0 is the m_hdrCubeMapInfo.pData. The Gpu mode only has the level 0.
+    InputMipGenMode       m_inputMipGenMode;
+    uint64_t              m_streamBudgetBytes;
+    SharedLib::ThreadPool m_threadPool;
+
+    // Resources for the equirect input. The reprojection writes the clamped faces to a storage image that is copied to the
+    // input cubemap level 0, and the full radiance faces to a host visible buffer.
+    bool                  m_isEquirectInput;
+    EquirectInput         m_equirectInput;
+    VkImage               m_equirectImage;
+    VmaAllocation         m_equirectImageAlloc;
+    VkImageView           m_equirectImageView;
+    VkSampler             m_equirectSampler;
+    VkExtent2D            m_equirectImageExtent;
+    VkShaderModule        m_equirectReprojectCsShaderModule;
+    VkDescriptorSetLayout m_equirectReprojectDesSetLayout;
+    VkDescriptorSet       m_equirectReprojectDesSet;
+    VkPipelineLayout      m_equirectReprojectPipelineLayout;
+    VkPipeline            m_equirectReprojectPipeline;
+    VkImage               m_reprojectedCubemap;
+    VmaAllocation         m_reprojectedCubemapAlloc;
+    VkImageView           m_reprojectedCubemapView;
+    VkBuffer              m_backgroundBuffer;
+    VmaAllocation         m_backgroundAlloc;
 
     // Camera and screen info buffer for cubemap gen (Diffuse irradiance and prefilter env map).
     VkBuffer      m_uboCameraScreenBuffer;
     VmaAllocation m_uboCameraScreenAlloc;
+
+    // Times every submitted pass when the trace is on.
+    SharedLib::GpuTraceTimer m_gpuTimer;
 };
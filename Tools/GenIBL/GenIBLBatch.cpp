@@ -0,0 +1,522 @@
+#include "GenIBLBatch.h"
+#include "GenIBLConsts.h"
+#include "GenIBLCpu.h"
+#include "../../SharedLibrary/Utils/StrPathUtils.h"
+#include "../../SharedLibrary/Utils/DiskOpsUtils.h"
+#include "../../SharedLibrary/Utils/HdrIngestUtils.h"
+#include "../../SharedLibrary/Utils/HdrStreamUtils.h"
+#include "../../SharedLibrary/Utils/MathUtils.h"
+#include "../../SharedLibrary/Utils/OctahedralUtils.h"
+#include "../../SharedLibrary/Utils/TraceUtils.h"
+#include "../../SharedLibrary/Utils/ThreadUtils.h"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <limits>
+
+// ================================================================================================================
+void GetIblBakeJobs(
+    const std::string&       inputDir,
+    const std::string&       outputDir,
+    std::vector<IblBakeJob>& jobs)
+{
+    std::vector<std::string> fileNames;
+    SharedLib::GetAllFileNames(inputDir, fileNames);
+    std::sort(fileNames.begin(), fileNames.end());
+
+    for (const std::string& fileName : fileNames)
+    {
+        std::filesystem::path inputPathName = std::filesystem::path(inputDir) / fileName;
+
+        std::string extension = inputPathName.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return (char)std::tolower(c); });
+
+        if ((extension != ".hdr") || (std::filesystem::is_regular_file(inputPathName) == false))
+        {
+            continue;
+        }
+
+        // The bake cache keys are set after the jobs are listed.
+        IblBakeJob job{};
+        {
+            job.inputPathName = inputPathName.string();
+            job.outputDir = outputDir + "/" + inputPathName.stem().string();
+            job.hasCacheKey = false;
+            job.cacheKey = SharedLib::BakeCacheKey{};
+        }
+        jobs.push_back(std::move(job));
+    }
+}
+
+// ================================================================================================================
+void GetIblBakeOutputFiles(
+    bool                      hasIrradianceSH9,
+    bool                      hasIrradianceCubemap,
+    const IblOutputOptions&   outputOptions,
+    std::vector<std::string>& files)
+{
+    files.clear();
+    if (hasIrradianceSH9)
+    {
+        files.push_back("diffuse_irradiance_sh9.txt");
+    }
+
+    if (outputOptions.hdr)
+    {
+        if (hasIrradianceCubemap)
+        {
+            files.push_back("diffuse_irradiance_cubemap.hdr");
+        }
+
+        for (uint32_t i = 0; i < RoughnessLevels; i++)
+        {
+            files.push_back("prefilterEnvMaps/prefilterMip" + std::to_string(i) + ".hdr");
+        }
+
+        if (outputOptions.octahedral)
+        {
+            for (uint32_t i = 0; i < RoughnessLevels; i++)
+            {
+                files.push_back("prefilterEnvMapsOct/prefilterMip" + std::to_string(i) + ".hdr");
+            }
+        }
+
+        files.push_back("background_cubemap.hdr");
+    }
+
+    if (outputOptions.ktx2)
+    {
+        if (hasIrradianceCubemap)
+        {
+            files.push_back("diffuse_irradiance_cubemap.ktx2");
+        }
+
+        files.push_back("prefilterEnvMap.ktx2");
+        if (outputOptions.octahedral)
+        {
+            files.push_back("prefilterEnvMapOct.ktx2");
+        }
+        files.push_back("background_cubemap.ktx2");
+    }
+
+    files.push_back("envBrdf.bin");
+    if (outputOptions.envBrdfHdr)
+    {
+        files.push_back("envBrdf.hdr");
+    }
+}
+
+// ================================================================================================================
+// RGBA32F texels to the KTX2 format. The alpha isn't meaningful in the products, so it's always 1.
+static void PackRgbaToKtx2(
+    const float*          pRgba,
+    uint64_t              texelCnt,
+    SharedLib::Ktx2Format format,
+    std::vector<char>&    dst)
+{
+    dst.resize(texelCnt * SharedLib::Ktx2TexelBytes(format));
+    if (format == SharedLib::Ktx2Format::RGBA16F)
+    {
+        uint16_t* pDst = reinterpret_cast<uint16_t*>(dst.data());
+        for (uint64_t i = 0; i < texelCnt; i++)
+        {
+            pDst[4 * i]     = SharedLib::FloatToHalf(pRgba[4 * i]);
+            pDst[4 * i + 1] = SharedLib::FloatToHalf(pRgba[4 * i + 1]);
+            pDst[4 * i + 2] = SharedLib::FloatToHalf(pRgba[4 * i + 2]);
+            pDst[4 * i + 3] = SharedLib::FloatToHalf(1.f);
+        }
+    }
+    else
+    {
+        float* pDst = reinterpret_cast<float*>(dst.data());
+        for (uint64_t i = 0; i < texelCnt; i++)
+        {
+            pDst[4 * i]     = pRgba[4 * i];
+            pDst[4 * i + 1] = pRgba[4 * i + 1];
+            pDst[4 * i + 2] = pRgba[4 * i + 2];
+            pDst[4 * i + 3] = 1.f;
+        }
+    }
+}
+
+// ================================================================================================================
+// The levels are the rendered RGBA32F layers. Their faces are reordered like the SaveCubemap(...) ones.
+static bool SaveCubemapKtx2(
+    const std::string&               namePath,
+    uint32_t                         faceDim,
+    const std::vector<const float*>& rgbaLevels,
+    SharedLib::Ktx2Format            format)
+{
+    std::vector<std::vector<char>> levels(rgbaLevels.size());
+    std::vector<const void*> pLevels(rgbaLevels.size());
+    std::vector<float> vulkanFaces;
+    for (uint32_t level = 0; level < rgbaLevels.size(); level++)
+    {
+        uint32_t levelDim = std::max(faceDim >> level, 1u);
+        uint64_t texelCnt = 6 * uint64_t(levelDim) * levelDim;
+
+        vulkanFaces.resize(4 * texelCnt);
+        GenIBLCpu::ToVulkanCubemapFaces(levelDim, rgbaLevels[level], 4, vulkanFaces.data());
+        PackRgbaToKtx2(vulkanFaces.data(), texelCnt, format, levels[level]);
+        pLevels[level] = levels[level].data();
+    }
+
+    SharedLib::Ktx2ImageDesc desc{};
+    {
+        desc.format = format;
+        desc.width = faceDim;
+        desc.height = faceDim;
+        desc.faceCnt = 6;
+        desc.levelCnt = (uint32_t)rgbaLevels.size();
+    }
+    return SharedLib::SaveKtx2(namePath, desc, pLevels.data());
+}
+
+// ================================================================================================================
+// The pRgba faces are already in the Vulkan order, so they go to the KTX2 cube without a reordering.
+static bool SaveVulkanFacesKtx2(
+    const std::string&    namePath,
+    uint32_t              faceDim,
+    const float*          pRgba,
+    SharedLib::Ktx2Format format)
+{
+    std::vector<char> level;
+    PackRgbaToKtx2(pRgba, 6 * uint64_t(faceDim) * faceDim, format, level);
+    const void* pLevel = level.data();
+
+    SharedLib::Ktx2ImageDesc desc{};
+    {
+        desc.format = format;
+        desc.width = faceDim;
+        desc.height = faceDim;
+        desc.faceCnt = 6;
+        desc.levelCnt = 1;
+    }
+    return SharedLib::SaveKtx2(namePath, desc, &pLevel);
+}
+
+// ================================================================================================================
+// A rendered RGBA32F cubemap level to an RGBA32F octahedral map of OctahedralDimFromFaceDim(levelDim). The faces are
+// reordered first, since the octahedral directions are the Vulkan cubemap ones.
+static void CubemapLevelToOctahedral(
+    uint32_t            levelDim,
+    const float*        pRgbaLevel,
+    std::vector<float>& octahedral)
+{
+    std::vector<float> vulkanFaces(4 * 6 * uint64_t(levelDim) * levelDim);
+    GenIBLCpu::ToVulkanCubemapFaces(levelDim, pRgbaLevel, 4, vulkanFaces.data());
+
+    uint32_t octDim = SharedLib::OctahedralDimFromFaceDim(levelDim);
+    octahedral.resize(4 * uint64_t(octDim) * octDim);
+    SharedLib::CubemapToOctahedral(vulkanFaces.data(), levelDim, octDim, octahedral.data());
+}
+
+// ================================================================================================================
+// The levels are the rendered RGBA32F layers. Every level is converted on its own, so the chain keeps the prefilter
+// roughness per mip instead of a box filtered one.
+static bool SaveOctahedralKtx2(
+    const std::string&               namePath,
+    uint32_t                         faceDim,
+    const std::vector<const float*>& rgbaLevels,
+    SharedLib::Ktx2Format            format)
+{
+    std::vector<std::vector<char>> levels(rgbaLevels.size());
+    std::vector<const void*> pLevels(rgbaLevels.size());
+    std::vector<float> octahedral;
+    for (uint32_t level = 0; level < rgbaLevels.size(); level++)
+    {
+        uint32_t levelDim = std::max(faceDim >> level, 1u);
+        CubemapLevelToOctahedral(levelDim, rgbaLevels[level], octahedral);
+        PackRgbaToKtx2(octahedral.data(), octahedral.size() / 4, format, levels[level]);
+        pLevels[level] = levels[level].data();
+    }
+
+    SharedLib::Ktx2ImageDesc desc{};
+    {
+        desc.format = format;
+        desc.width = SharedLib::OctahedralDimFromFaceDim(faceDim);
+        desc.height = SharedLib::OctahedralDimFromFaceDim(faceDim);
+        desc.faceCnt = 1;
+        desc.levelCnt = (uint32_t)rgbaLevels.size();
+    }
+    return SharedLib::SaveKtx2(namePath, desc, pLevels.data());
+}
+
+// ================================================================================================================
+// The input is already a vStrip in the Vulkan faces. It's decoded again instead of taken from the input mip chain,
+// because the chain is clamped and the background should keep the full radiance. A Radiance file is decoded in row
+// bands of bandBytesCnt RGBE bytes straight into the KTX2 level, so only the level and one band are in the memory. The
+// task already runs on the write pool, so the band is ingested on this thread.
+static bool SaveBackgroundKtx2(
+    const std::string&    inputPathName,
+    const std::string&    namePath,
+    SharedLib::Ktx2Format format,
+    uint64_t              bandBytesCnt)
+{
+    const SharedLib::HdrIngestFormat ingestFormat = static_cast<SharedLib::HdrIngestFormat>(format);
+    const float radianceClamp = std::numeric_limits<float>::max();
+
+    std::vector<char> level;
+    uint32_t faceDim = 0;
+
+    SharedLib::HdrScanlineReader hdrStream;
+    if (hdrStream.Open(inputPathName))
+    {
+        faceDim = hdrStream.GetWidth();
+        uint32_t rowCnt = hdrStream.GetHeight();
+        if (rowCnt != 6 * faceDim)
+        {
+            std::cerr << "The input cubemap isn't a vStrip: " << inputPathName << std::endl;
+            return false;
+        }
+
+        const uint64_t dstRowBytesCnt = uint64_t(faceDim) * SharedLib::HdrIngestTexelBytes(ingestFormat);
+        level.resize(rowCnt * dstRowBytesCnt);
+
+        uint32_t rowsPerBand = (uint32_t)std::min<uint64_t>(std::max<uint64_t>(bandBytesCnt / hdrStream.GetRgbeRowBytesCnt(), 1), rowCnt);
+        std::vector<uint8_t> rgbeBand(rowsPerBand * hdrStream.GetRgbeRowBytesCnt());
+        for (uint32_t bandRowBegin = 0; bandRowBegin < rowCnt; bandRowBegin += rowsPerBand)
+        {
+            uint32_t bandRowCnt = std::min(rowsPerBand, rowCnt - bandRowBegin);
+            if (hdrStream.ReadRgbeRows(bandRowCnt, rgbeBand.data()) == false)
+            {
+                std::cerr << "Cannot read the input cubemap: " << inputPathName << std::endl;
+                return false;
+            }
+
+            SharedLib::IngestRgbeTexels(rgbeBand.data(),
+                                        uint64_t(bandRowCnt) * faceDim,
+                                        ingestFormat,
+                                        radianceClamp,
+                                        level.data() + bandRowBegin * dstRowBytesCnt);
+        }
+    }
+    else
+    {
+        // Not a Radiance layout that streams, so it's decoded as a whole like the input decode does.
+        int components, width, height;
+        float* pRgbData = SharedLib::ReadImg(inputPathName, components, width, height);
+        if (pRgbData == nullptr)
+        {
+            std::cerr << "Cannot read the input cubemap: " << inputPathName << std::endl;
+            return false;
+        }
+
+        if ((components != 3) || (height != 6 * width))
+        {
+            std::cerr << "The input cubemap isn't an RGB vStrip: " << inputPathName << std::endl;
+            SharedLib::ReleaseImg(pRgbData);
+            return false;
+        }
+
+        faceDim = (uint32_t)width;
+        uint64_t texelCnt = uint64_t(width) * height;
+        level.resize(texelCnt * SharedLib::HdrIngestTexelBytes(ingestFormat));
+        SharedLib::IngestRgbTexels(pRgbData, texelCnt, ingestFormat, radianceClamp, level.data());
+        SharedLib::ReleaseImg(pRgbData);
+    }
+
+    const void* pLevel = level.data();
+    SharedLib::Ktx2ImageDesc desc{};
+    {
+        desc.format = format;
+        desc.width = faceDim;
+        desc.height = faceDim;
+        desc.faceCnt = 6;
+        desc.levelCnt = 1;
+    }
+    return SharedLib::SaveKtx2(namePath, desc, &pLevel);
+}
+
+// ================================================================================================================
+// The folders are made and the stale links are dropped before any task runs, so the tasks never share a path.
+bool WriteIblBakeOutputs(
+    const IblBakeJob&        job,
+    const IblBakeProducts&   products,
+    const EnvBrdfLutParams&  envBrdfLutParams,
+    const std::vector<char>& envBrdfLut,
+    const IblOutputOptions&  outputOptions,
+    SharedLib::ThreadPool&   writePool)
+{
+    SharedLib::ScopedTraceTimer writeTimer("WriteIblBakeOutputs");
+
+    std::error_code errCode;
+    std::filesystem::create_directories(job.outputDir, errCode);
+    if (errCode)
+    {
+        std::cerr << "Cannot create the output folder: " << job.outputDir << std::endl;
+        return false;
+    }
+
+    bool hasIrradianceCubemap = (products.pDiffuseIrradianceCubemap != nullptr);
+
+    // An equirect input has its background reprojected by the bake. Otherwise the input file is the background.
+    bool hasBackgroundCubemap = (products.backgroundCubemap.empty() == false);
+
+    // The outputs of a previous run may be hard links into the bake cache.
+    std::vector<std::string> outputFiles;
+    GetIblBakeOutputFiles(products.hasIrradianceSH9, hasIrradianceCubemap, outputOptions, outputFiles);
+    SharedLib::UnlinkBakeOutputs(job.outputDir, outputFiles);
+
+    std::string prefilterOutputDir = job.outputDir + "/prefilterEnvMaps";
+    std::string prefilterOctOutputDir = job.outputDir + "/prefilterEnvMapsOct";
+    if (outputOptions.hdr)
+    {
+        SharedLib::CleanOrCreateDir(prefilterOutputDir);
+        if (outputOptions.octahedral)
+        {
+            SharedLib::CleanOrCreateDir(prefilterOctOutputDir);
+        }
+    }
+
+    // The tasks are handed out in this order, so the largest files are queued first and the pool ends about together.
+    std::vector<std::pair<std::string, std::function<bool()>>> fileWrites;
+
+    if (outputOptions.ktx2)
+    {
+        fileWrites.push_back({ "prefilterEnvMap.ktx2", [&]()
+        {
+            return SaveCubemapKtx2(job.outputDir + "/prefilterEnvMap.ktx2", products.faceDim, products.prefilterEnvMapMips, outputOptions.ktx2Format);
+        }});
+
+        if (outputOptions.octahedral)
+        {
+            fileWrites.push_back({ "prefilterEnvMapOct.ktx2", [&]()
+            {
+                return SaveOctahedralKtx2(job.outputDir + "/prefilterEnvMapOct.ktx2", products.faceDim, products.prefilterEnvMapMips, outputOptions.ktx2Format);
+            }});
+        }
+
+        fileWrites.push_back({ "background_cubemap.ktx2", [&]()
+        {
+            if (hasBackgroundCubemap)
+            {
+                return SaveVulkanFacesKtx2(job.outputDir + "/background_cubemap.ktx2",
+                                           products.faceDim,
+                                           products.backgroundCubemap.data(),
+                                           outputOptions.ktx2Format);
+            }
+            else
+            {
+                uint64_t bandBytesCnt = (outputOptions.streamBudgetBytes != 0) ? outputOptions.streamBudgetBytes : InputDecodeBandBytes;
+                return SaveBackgroundKtx2(job.inputPathName,
+                                          job.outputDir + "/background_cubemap.ktx2",
+                                          outputOptions.ktx2Format,
+                                          bandBytesCnt);
+            }
+        }});
+
+        if (hasIrradianceCubemap)
+        {
+            fileWrites.push_back({ "diffuse_irradiance_cubemap.ktx2", [&]()
+            {
+                return SaveCubemapKtx2(job.outputDir + "/diffuse_irradiance_cubemap.ktx2",
+                                       products.faceDim,
+                                       { products.pDiffuseIrradianceCubemap },
+                                       outputOptions.ktx2Format);
+            }});
+        }
+    }
+
+    if (outputOptions.hdr)
+    {
+        for (uint32_t i = 0; i < products.prefilterEnvMapMips.size(); i++)
+        {
+            std::string currentMipName = "prefilterMip" + std::to_string(i) + ".hdr";
+            fileWrites.push_back({ currentMipName, [&, i, currentMipName]()
+            {
+                return GenIBLCpu::SaveCubemap(prefilterOutputDir + "/" + currentMipName,
+                                              products.faceDim >> i,
+                                              products.prefilterEnvMapMips[i]);
+            }});
+        }
+
+        if (outputOptions.octahedral)
+        {
+            for (uint32_t i = 0; i < products.prefilterEnvMapMips.size(); i++)
+            {
+                std::string currentMipName = "prefilterMip" + std::to_string(i) + ".hdr";
+                fileWrites.push_back({ "prefilterEnvMapsOct/" + currentMipName, [&, i, currentMipName]()
+                {
+                    uint32_t levelDim = std::max(products.faceDim >> i, 1u);
+                    std::vector<float> octahedral;
+                    CubemapLevelToOctahedral(levelDim, products.prefilterEnvMapMips[i], octahedral);
+
+                    uint32_t octDim = SharedLib::OctahedralDimFromFaceDim(levelDim);
+                    return SharedLib::SaveImgHdr(prefilterOctOutputDir + "/" + currentMipName, octDim, octDim, 4, octahedral.data());
+                }});
+            }
+        }
+
+        if (hasIrradianceCubemap)
+        {
+            fileWrites.push_back({ "diffuse_irradiance_cubemap.hdr", [&]()
+            {
+                return GenIBLCpu::SaveCubemap(job.outputDir + "/diffuse_irradiance_cubemap.hdr",
+                                              products.faceDim,
+                                              products.pDiffuseIrradianceCubemap);
+            }});
+        }
+
+        // Copy and paste the input cubemap to the package. The reprojected equirect is the same vStrip as the
+        // SphericalToCubemap output.
+        fileWrites.push_back({ "background_cubemap.hdr", [&]()
+        {
+            if (hasBackgroundCubemap)
+            {
+                return SharedLib::SaveImgHdr(job.outputDir + "/background_cubemap.hdr",
+                                             products.faceDim,
+                                             6 * products.faceDim,
+                                             4,
+                                             const_cast<float*>(products.backgroundCubemap.data()));
+            }
+
+            std::error_code copyErrCode;
+            std::filesystem::copy_file(job.inputPathName,
+                                       job.outputDir + "/background_cubemap.hdr",
+                                       std::filesystem::copy_options::overwrite_existing,
+                                       copyErrCode);
+            if (copyErrCode)
+            {
+                std::cerr << "Cannot copy the input cubemap to: " << job.outputDir << std::endl;
+                return false;
+            }
+            return true;
+        }});
+    }
+
+    fileWrites.push_back({ "envBrdf.bin", [&]()
+    {
+        return OutputEnvBrdfLut(job.outputDir, envBrdfLutParams, envBrdfLut, outputOptions.envBrdfHdr);
+    }});
+
+    if (products.hasIrradianceSH9)
+    {
+        fileWrites.push_back({ "diffuse_irradiance_sh9.txt", [&]()
+        {
+            return SaveSH9(job.outputDir + "/diffuse_irradiance_sh9.txt", products.irradianceSH9);
+        }});
+    }
+
+    // One flag per task instead of a shared one, so the tasks don't write to the same memory.
+    std::vector<uint8_t> isWritten(fileWrites.size(), 0);
+    writePool.ParallelFor((uint32_t)fileWrites.size(), [&fileWrites, &isWritten](uint32_t i)
+    {
+        SharedLib::ScopedTraceTimer fileTimer("Write", fileWrites[i].first, "disk");
+        isWritten[i] = fileWrites[i].second() ? 1 : 0;
+    });
+
+    bool isAllWritten = true;
+    for (uint32_t i = 0; i < fileWrites.size(); i++)
+    {
+        if (isWritten[i] == 0)
+        {
+            std::cerr << "Cannot write " << fileWrites[i].first << " to: " << job.outputDir << std::endl;
+            isAllWritten = false;
+        }
+    }
+    return isAllWritten;
+}
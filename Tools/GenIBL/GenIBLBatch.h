@@ -0,0 +1,94 @@
+#pragma once
+#include "SphericalHarmonics.h"
+#include "EnvBrdfLut.h"
+#include "../../SharedLibrary/Utils/BakeCacheUtils.h"
+#include "../../SharedLibrary/Utils/Ktx2Utils.h"
+#include <string>
+#include <vector>
+
+namespace SharedLib
+{
+    class ThreadPool;
+}
+
+// Bump it when a change of the bake math changes the outputs, so the stale bake cache entries are missed.
+constexpr uint32_t IblBakeVersion = 1;
+
+// The workers of the output write pool. The files of a job are encoded and written on them and the calling thread.
+// The pool is apart from the bake pools, so the writes of an input don't wait behind the mipmaps of the next one.
+constexpr uint32_t IblOutputWriteThreadCnt = 4;
+
+// How the diffuse irradiance is generated. Both backends have both modes.
+// - Convolution: The hemisphere of every output texel is integrated, e.g. by the diffuseIrradiance_frag.hlsl.
+// - SH9: The input cubemap is projected to 9 RGB spherical harmonics coefficients in one reduction. The coefficients
+//   are the output, and the cubemap can be reconstructed from them.
+enum class IrradianceMode
+{
+    Convolution,
+    SH9
+};
+
+// One input of a run and the folder its outputs go to.
+struct IblBakeJob
+{
+    std::string             inputPathName;
+    std::string             outputDir;
+    bool                    hasCacheKey = false; // False when the bake cache is off or the input cannot be hashed.
+    SharedLib::BakeCacheKey cacheKey{};
+};
+
+// Everything that one input bakes. The cubemaps are the RGBA32F layers as they are rendered, and their faces are
+// reordered when they are written.
+// - The GPU bake leaves the cubemaps in the mapped staging buffer of its readback, so they are written without a copy.
+//   The readbackTicket is released after the writes.
+// - The CPU bake keeps them in the hostCubemaps.
+struct IblBakeProducts
+{
+    uint32_t                        faceDim;
+    bool                            hasIrradianceSH9;
+    SH9Rgb                          irradianceSH9;
+    const float*                    pDiffuseIrradianceCubemap; // Null when it's not an output.
+    std::vector<const float*>       prefilterEnvMapMips;       // The face dim of the mip i is faceDim >> i.
+    std::vector<float>              backgroundCubemap;         // The full radiance faces of an equirect input, already
+                                                               // in the Vulkan order. Empty when the input file is
+                                                               // the background.
+    uint64_t                        readbackTicket;            // 0 when the cubemaps are not in a readback.
+    std::vector<std::vector<float>> hostCubemaps;
+};
+
+// The file formats of a run.
+// - hdr: The vStrip Radiance files. One file per prefilter mip under prefilterEnvMaps/.
+// - ktx2: One KTX2 file per cubemap with all its mips, in the Vulkan face and level order and in the ktx2Format, which
+//   the samples upload without a decode. The background keeps the unclamped input radiance.
+// - octahedral: The prefilter env map is also output as octahedral 2D maps of 2 * faceDim (OctahedralUtils.h), in the
+//   formats above: prefilterEnvMapOct.ktx2 with one level per roughness and prefilterEnvMapsOct/ with one file per mip.
+struct IblOutputOptions
+{
+    bool                  hdr;
+    bool                  ktx2;
+    SharedLib::Ktx2Format ktx2Format; // RGBA16F or RGBA32F.
+    bool                  envBrdfHdr; // Also the envBrdf.hdr to view the LUT.
+    bool                  octahedral;
+    uint64_t              streamBudgetBytes; // The RGBE band of the background decode. 0 means the InputDecodeBandBytes.
+};
+
+// Every *.hdr file in the inputDir becomes a job whose outputs go to <outputDir>/<input file name without extension>.
+// The jobs are sorted by the file name, so a run always bakes in the same order.
+void GetIblBakeJobs(const std::string& inputDir, const std::string& outputDir, std::vector<IblBakeJob>& jobs);
+
+// The files of a job relative to its output folder. They are also what its bake cache entry holds.
+void GetIblBakeOutputFiles(bool                      hasIrradianceSH9,
+                           bool                      hasIrradianceCubemap,
+                           const IblOutputOptions&   outputOptions,
+                           std::vector<std::string>& files);
+
+// Writes all the files of a job and returns after the last one is on the disk. Every file is encoded and written as its
+// own task on the writePool, so the prefilter mips, the KTX2 files and the LUT are written concurrently. It only
+// touches the host memory and the disk, so the batch mode runs it on its own thread while the next input is on the GPU.
+// Returns false when any file isn't written, so the job's outputs are incomplete and shouldn't go to the bake cache.
+bool WriteIblBakeOutputs(const IblBakeJob&        job,
+                         const IblBakeProducts&   products,
+                         const EnvBrdfLutParams&  envBrdfLutParams,
+                         const std::vector<char>& envBrdfLut,
+                         const IblOutputOptions&  outputOptions,
+                         SharedLib::ThreadPool&   writePool);
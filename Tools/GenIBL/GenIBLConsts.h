@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+
+// The GenIBL parameters that don't depend on the graphics API. Both the Vulkan backend and the CPU backend use them, so
+// their outputs have the same layout.
+
+constexpr uint32_t RoughnessLevels = 8;
+constexpr uint32_t EnvBrdfMapDim = 1024;      // The default of the --envBrdfDim.
+constexpr uint32_t EnvBrdfSampleCount = 1024; // The default of the --envBrdfSamples.
+constexpr uint32_t InputCubemapMipLevels = 10;
+constexpr float    InputRadianceClamp = 50.f;
+constexpr uint64_t InputDecodeBandBytes = 8 * 1024 * 1024; // The RGBE band of a .hdr input decode without a stream budget.
+constexpr uint32_t PrefilterSampleCount = 1024; // Samples per texel of every roughness without the filtered importance sampling.
+
+// Samples per texel of each roughness level with the filtered importance sampling. The mirror level needs one lookup and
+// the wider lobes need more samples to cover their area, but the mip filtering keeps all of them far below 1024.
+constexpr uint32_t PrefilterFisSampleBudget[RoughnessLevels] = { 1, 32, 48, 64, 96, 128, 128, 128 };
+
+// The camera basis of each output cubemap face -- Front, back, top, bottom, right, left. A texel (x, y) in [-1, 1] of a
+// face looks at view + x * right - y * up. The 4th element is the padding of the float3 array in the UBO.
+constexpr float CubemapFaceViews[6 * 4] =
+{
+     1.f,  0.f,  0.f, 0.f,
+    -1.f,  0.f,  0.f, 0.f,
+     0.f,  1.f,  0.f, 0.f,
+     0.f, -1.f,  0.f, 0.f,
+     0.f,  0.f,  1.f, 0.f,
+     0.f,  0.f, -1.f, 0.f
+};
+
+constexpr float CubemapFaceRights[6 * 4] =
+{
+     0.f,  0.f,  1.f, 0.f,
+     0.f,  0.f, -1.f, 0.f,
+     0.f,  0.f,  1.f, 0.f,
+     0.f,  0.f,  1.f, 0.f,
+    -1.f,  0.f,  0.f, 0.f,
+     1.f,  0.f,  0.f, 0.f
+};
+
+constexpr float CubemapFaceUps[6 * 4] =
+{
+     0.f,  1.f,  0.f, 0.f,
+     0.f,  1.f,  0.f, 0.f,
+    -1.f,  0.f,  0.f, 0.f,
+     1.f,  0.f,  0.f, 0.f,
+     0.f,  1.f,  0.f, 0.f,
+     0.f,  1.f,  0.f, 0.f
+};
@@ -0,0 +1,690 @@
+#include <cmath>
+#include "GenIBLCpu.h"
+#include "../../SharedLibrary/Utils/DiskOpsUtils.h"
+#include "../../SharedLibrary/Utils/MathUtils.h"
+#include "../../SharedLibrary/Utils/BrdfUtils.h"
+#include "../../SharedLibrary/Utils/HdrStreamUtils.h"
+#include "../../SharedLibrary/Utils/TraceUtils.h"
+#include <algorithm>
+#include <iostream>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GENIBL_SSE2
+#include <emmintrin.h>
+#endif
+
+// Rows of a band processed by one task.
+static constexpr uint32_t RowsPerBand = 32;
+
+// ================================================================================================================
+// The texel (x, y) of an output face in the output face basis. Same as the fragCoord mapping in the shaders.
+static void OutputTexelDir(
+    uint32_t face,
+    uint32_t x,
+    uint32_t y,
+    uint32_t faceDim,
+    float*   pDir)
+{
+    float ndcX = ((float(x) + 0.5f) / float(faceDim)) * 2.f - 1.f;
+    float ndcY = ((float(y) + 0.5f) / float(faceDim)) * 2.f - 1.f;
+
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        pDir[i] = CubemapFaceViews[4 * face + i] + ndcX * CubemapFaceRights[4 * face + i] - ndcY * CubemapFaceUps[4 * face + i];
+    }
+    SharedLib::NormalizeVec(pDir, 3);
+}
+
+// ================================================================================================================
+// Clamp to edge bilinear filtering of one RGBA32F face.
+static void SampleFaceBilinear(
+    const float* pFace,
+    uint32_t     faceDim,
+    float        u,
+    float        v,
+    float*       pRgb)
+{
+    float x = u * float(faceDim) - 0.5f;
+    float y = v * float(faceDim) - 0.5f;
+    float x0f = floorf(x);
+    float y0f = floorf(y);
+    float fx = x - x0f;
+    float fy = y - y0f;
+
+    int maxIdx = int(faceDim) - 1;
+    int x0 = std::min(std::max(int(x0f), 0), maxIdx);
+    int y0 = std::min(std::max(int(y0f), 0), maxIdx);
+    int x1 = std::min(std::max(int(x0f) + 1, 0), maxIdx);
+    int y1 = std::min(std::max(int(y0f) + 1, 0), maxIdx);
+
+    const float* p00 = pFace + 4 * (uint64_t(y0) * faceDim + x0);
+    const float* p01 = pFace + 4 * (uint64_t(y0) * faceDim + x1);
+    const float* p10 = pFace + 4 * (uint64_t(y1) * faceDim + x0);
+    const float* p11 = pFace + 4 * (uint64_t(y1) * faceDim + x1);
+
+    for (uint32_t c = 0; c < 3; c++)
+    {
+        float top = p00[c] + (p01[c] - p00[c]) * fx;
+        float bottom = p10[c] + (p11[c] - p10[c]) * fx;
+        pRgb[c] = top + (bottom - top) * fy;
+    }
+}
+
+// ================================================================================================================
+// pRgb[i] += max(dot(N[i], srcDir), 0) * srcRadiance for a row of normals in SoA.
+static void AccumulateCosineWeightedRow(
+    const float* pSrcTexel,
+    const float* pNx,
+    const float* pNy,
+    const float* pNz,
+    float*       pR,
+    float*       pG,
+    float*       pB,
+    uint32_t     cnt)
+{
+    uint32_t i = 0;
+
+#if defined(__AVX__)
+    {
+        const __m256 dx = _mm256_set1_ps(pSrcTexel[0]);
+        const __m256 dy = _mm256_set1_ps(pSrcTexel[1]);
+        const __m256 dz = _mm256_set1_ps(pSrcTexel[2]);
+        const __m256 r = _mm256_set1_ps(pSrcTexel[3]);
+        const __m256 g = _mm256_set1_ps(pSrcTexel[4]);
+        const __m256 b = _mm256_set1_ps(pSrcTexel[5]);
+        const __m256 zero = _mm256_setzero_ps();
+        for (; i + 8 <= cnt; i += 8)
+        {
+            __m256 cosTheta = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(pNx + i), dx),
+                                                          _mm256_mul_ps(_mm256_loadu_ps(pNy + i), dy)),
+                                            _mm256_mul_ps(_mm256_loadu_ps(pNz + i), dz));
+            cosTheta = _mm256_max_ps(cosTheta, zero);
+
+            _mm256_storeu_ps(pR + i, _mm256_add_ps(_mm256_loadu_ps(pR + i), _mm256_mul_ps(cosTheta, r)));
+            _mm256_storeu_ps(pG + i, _mm256_add_ps(_mm256_loadu_ps(pG + i), _mm256_mul_ps(cosTheta, g)));
+            _mm256_storeu_ps(pB + i, _mm256_add_ps(_mm256_loadu_ps(pB + i), _mm256_mul_ps(cosTheta, b)));
+        }
+    }
+#elif defined(GENIBL_SSE2)
+    {
+        const __m128 dx = _mm_set1_ps(pSrcTexel[0]);
+        const __m128 dy = _mm_set1_ps(pSrcTexel[1]);
+        const __m128 dz = _mm_set1_ps(pSrcTexel[2]);
+        const __m128 r = _mm_set1_ps(pSrcTexel[3]);
+        const __m128 g = _mm_set1_ps(pSrcTexel[4]);
+        const __m128 b = _mm_set1_ps(pSrcTexel[5]);
+        const __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= cnt; i += 4)
+        {
+            __m128 cosTheta = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pNx + i), dx),
+                                                    _mm_mul_ps(_mm_loadu_ps(pNy + i), dy)),
+                                         _mm_mul_ps(_mm_loadu_ps(pNz + i), dz));
+            cosTheta = _mm_max_ps(cosTheta, zero);
+
+            _mm_storeu_ps(pR + i, _mm_add_ps(_mm_loadu_ps(pR + i), _mm_mul_ps(cosTheta, r)));
+            _mm_storeu_ps(pG + i, _mm_add_ps(_mm_loadu_ps(pG + i), _mm_mul_ps(cosTheta, g)));
+            _mm_storeu_ps(pB + i, _mm_add_ps(_mm_loadu_ps(pB + i), _mm_mul_ps(cosTheta, b)));
+        }
+    }
+#endif
+
+    // Scalar fallback and tail.
+    for (; i < cnt; i++)
+    {
+        float cosTheta = pNx[i] * pSrcTexel[0] + pNy[i] * pSrcTexel[1] + pNz[i] * pSrcTexel[2];
+        cosTheta = std::max(cosTheta, 0.f);
+        pR[i] += cosTheta * pSrcTexel[3];
+        pG[i] += cosTheta * pSrcTexel[4];
+        pB[i] += cosTheta * pSrcTexel[5];
+    }
+}
+
+// ================================================================================================================
+// One GGX sample of the envBrdf_frag.hlsl for a row of NdotV in SoA. pGv is the GeometrySchlickGGX(NdotV, roughness).
+// k is the 'k' of the GeometrySchlickGGX(...). V has no y component, so only the x and z of H matter.
+static void AccumulateEnvBrdfRow(
+    float        hx,
+    float        hz,
+    float        k,
+    const float* pNdotV,
+    const float* pVx,
+    const float* pGv,
+    float*       pA,
+    float*       pB,
+    uint32_t     cnt)
+{
+    float NdotH = std::max(hz, 0.f);
+    uint32_t i = 0;
+
+#if defined(__AVX__)
+    {
+        const __m256 vHx = _mm256_set1_ps(hx);
+        const __m256 vHz = _mm256_set1_ps(hz);
+        const __m256 vNdotH = _mm256_set1_ps(NdotH);
+        const __m256 vK = _mm256_set1_ps(k);
+        const __m256 oneMinusK = _mm256_set1_ps(1.f - k);
+        const __m256 one = _mm256_set1_ps(1.f);
+        const __m256 two = _mm256_set1_ps(2.f);
+        const __m256 zero = _mm256_setzero_ps();
+        for (; i + 8 <= cnt; i += 8)
+        {
+            __m256 NdotV = _mm256_loadu_ps(pNdotV + i);
+            __m256 VdotHRaw = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(pVx + i), vHx), _mm256_mul_ps(NdotV, vHz));
+            __m256 Lz = _mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(two, VdotHRaw), vHz), NdotV);
+
+            __m256 NdotL = _mm256_max_ps(Lz, zero);
+            __m256 VdotH = _mm256_max_ps(VdotHRaw, zero);
+
+            __m256 G = _mm256_mul_ps(_mm256_loadu_ps(pGv + i),
+                                     _mm256_div_ps(NdotL, _mm256_add_ps(_mm256_mul_ps(NdotL, oneMinusK), vK)));
+            __m256 G_Vis = _mm256_div_ps(_mm256_mul_ps(G, VdotH), _mm256_mul_ps(vNdotH, NdotV));
+
+            __m256 t = _mm256_sub_ps(one, VdotH);
+            __m256 t2 = _mm256_mul_ps(t, t);
+            __m256 Fc = _mm256_mul_ps(_mm256_mul_ps(t2, t2), t);
+
+            __m256 valid = _mm256_cmp_ps(Lz, zero, _CMP_GT_OQ);
+            __m256 a = _mm256_and_ps(valid, _mm256_mul_ps(_mm256_sub_ps(one, Fc), G_Vis));
+            __m256 b = _mm256_and_ps(valid, _mm256_mul_ps(Fc, G_Vis));
+
+            _mm256_storeu_ps(pA + i, _mm256_add_ps(_mm256_loadu_ps(pA + i), a));
+            _mm256_storeu_ps(pB + i, _mm256_add_ps(_mm256_loadu_ps(pB + i), b));
+        }
+    }
+#elif defined(GENIBL_SSE2)
+    {
+        const __m128 vHx = _mm_set1_ps(hx);
+        const __m128 vHz = _mm_set1_ps(hz);
+        const __m128 vNdotH = _mm_set1_ps(NdotH);
+        const __m128 vK = _mm_set1_ps(k);
+        const __m128 oneMinusK = _mm_set1_ps(1.f - k);
+        const __m128 one = _mm_set1_ps(1.f);
+        const __m128 two = _mm_set1_ps(2.f);
+        const __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= cnt; i += 4)
+        {
+            __m128 NdotV = _mm_loadu_ps(pNdotV + i);
+            __m128 VdotHRaw = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pVx + i), vHx), _mm_mul_ps(NdotV, vHz));
+            __m128 Lz = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(two, VdotHRaw), vHz), NdotV);
+
+            __m128 NdotL = _mm_max_ps(Lz, zero);
+            __m128 VdotH = _mm_max_ps(VdotHRaw, zero);
+
+            __m128 G = _mm_mul_ps(_mm_loadu_ps(pGv + i),
+                                  _mm_div_ps(NdotL, _mm_add_ps(_mm_mul_ps(NdotL, oneMinusK), vK)));
+            __m128 G_Vis = _mm_div_ps(_mm_mul_ps(G, VdotH), _mm_mul_ps(vNdotH, NdotV));
+
+            __m128 t = _mm_sub_ps(one, VdotH);
+            __m128 t2 = _mm_mul_ps(t, t);
+            __m128 Fc = _mm_mul_ps(_mm_mul_ps(t2, t2), t);
+
+            __m128 valid = _mm_cmpgt_ps(Lz, zero);
+            __m128 a = _mm_and_ps(valid, _mm_mul_ps(_mm_sub_ps(one, Fc), G_Vis));
+            __m128 b = _mm_and_ps(valid, _mm_mul_ps(Fc, G_Vis));
+
+            _mm_storeu_ps(pA + i, _mm_add_ps(_mm_loadu_ps(pA + i), a));
+            _mm_storeu_ps(pB + i, _mm_add_ps(_mm_loadu_ps(pB + i), b));
+        }
+    }
+#endif
+
+    // Scalar fallback and tail.
+    for (; i < cnt; i++)
+    {
+        float NdotV = pNdotV[i];
+        float VdotHRaw = pVx[i] * hx + NdotV * hz;
+        float Lz = 2.f * VdotHRaw * hz - NdotV;
+        if (Lz > 0.f)
+        {
+            float NdotL = Lz;
+            float VdotH = std::max(VdotHRaw, 0.f);
+
+            float G = pGv[i] * (NdotL / (NdotL * (1.f - k) + k));
+            float G_Vis = (G * VdotH) / (NdotH * NdotV);
+
+            float t = 1.f - VdotH;
+            float t2 = t * t;
+            float Fc = t2 * t2 * t;
+
+            pA[i] += (1.f - Fc) * G_Vis;
+            pB[i] += Fc * G_Vis;
+        }
+    }
+}
+
+// ================================================================================================================
+GenIBLCpu::GenIBLCpu() :
+    m_prefilterFis(false),
+    m_streamBudgetBytes(0)
+{}
+
+// ================================================================================================================
+// The same checks as the GenIBL::DecodeCubemap(...). The mip chain also needs a face of at least one texel on its last
+// level.
+bool GenIBLCpu::ReadInCubemap(
+    const std::string& namePath)
+{
+    SharedLib::ScopedTraceTimer readTimer("ReadInCubemap");
+    constexpr uint32_t MinFaceDim = 1u << (InputCubemapMipLevels - 1);
+
+    // The Radiance files are always read in row bands, so there is no float copy of the input. Other inputs fall back
+    // to the whole image decode.
+    SharedLib::HdrScanlineReader hdrStream;
+    if (hdrStream.Open(namePath))
+    {
+        if ((hdrStream.GetHeight() != 6 * hdrStream.GetWidth()) || (hdrStream.GetWidth() < MinFaceDim))
+        {
+            std::cerr << "The input is not a RGB vStrip cubemap with faces of at least " << MinFaceDim << " texels: "
+                      << namePath << std::endl;
+            return false;
+        }
+
+        uint64_t bandBytesCnt = (m_streamBudgetBytes != 0) ? m_streamBudgetBytes : InputDecodeBandBytes;
+        if (m_inputMipChain.InitFromHdrStream(hdrStream, InputCubemapMipLevels, InputRadianceClamp, bandBytesCnt, m_threadPool) == false)
+        {
+            std::cerr << "Cannot read the input cubemap: " << namePath << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        int nrComponents, width, height;
+        float* pRgbData = SharedLib::ReadImg(namePath.c_str(), nrComponents, width, height);
+        if (pRgbData == nullptr)
+        {
+            std::cerr << "Cannot read the input cubemap: " << namePath << std::endl;
+            return false;
+        }
+
+        if ((nrComponents != 3) || (height != 6 * width) || (width < (int)MinFaceDim))
+        {
+            std::cerr << "The input is not a RGB vStrip cubemap with faces of at least " << MinFaceDim << " texels: "
+                      << namePath << std::endl;
+            SharedLib::ReleaseImg(pRgbData);
+            return false;
+        }
+
+        m_inputMipChain.InitFromRgbVStrip(pRgbData, (uint32_t)width, InputCubemapMipLevels, InputRadianceClamp, m_threadPool);
+        SharedLib::ReleaseImg(pRgbData);
+    }
+
+    m_inputMipChain.BuildMips(m_threadPool);
+    return true;
+}
+
+// ================================================================================================================
+void GenIBLCpu::SampleInputCubemap(
+    const float* pDir,
+    float        lod,
+    float*       pRgb)
+{
+    uint32_t face;
+    float u, v;
+    SharedLib::CubemapDirToFaceUv(pDir, &face, &u, &v);
+
+    float maxLod = float(m_inputMipChain.GetLevelCnt() - 1);
+    lod = std::min(std::max(lod, 0.f), maxLod);
+
+    uint32_t level = uint32_t(lod);
+    float levelWeight = lod - float(level);
+
+    uint32_t levelDim = m_inputMipChain.GetLevelDim(level);
+    const float* pFace = m_inputMipChain.GetLevelData(level) + uint64_t(4) * face * levelDim * levelDim;
+    SampleFaceBilinear(pFace, levelDim, u, v, pRgb);
+
+    if (levelWeight > 0.f)
+    {
+        uint32_t nextLevelDim = m_inputMipChain.GetLevelDim(level + 1);
+        const float* pNextFace = m_inputMipChain.GetLevelData(level + 1) + uint64_t(4) * face * nextLevelDim * nextLevelDim;
+
+        float nextRgb[3];
+        SampleFaceBilinear(pNextFace, nextLevelDim, u, v, nextRgb);
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            pRgb[c] += (nextRgb[c] - pRgb[c]) * levelWeight;
+        }
+    }
+}
+
+// ================================================================================================================
+// The exact discrete version of the hemisphere integration in the diffuseIrradiance_frag.hlsl: Every source texel adds
+// its radiance * cos * solid angle. The result is divided by PI like the shader output.
+void GenIBLCpu::GenDiffuseIrradiance(
+    std::vector<float>& rgbaCubemap)
+{
+    SharedLib::ScopedTraceTimer irradianceTimer("GenDiffuseIrradiance");
+    uint32_t faceDim = GetInputFaceDim();
+
+    uint32_t srcLevel = 0;
+    while ((m_inputMipChain.GetLevelDim(srcLevel) > CpuIrradianceSourceDim) &&
+           (srcLevel + 1 < m_inputMipChain.GetLevelCnt()))
+    {
+        srcLevel++;
+    }
+
+    uint32_t srcDim = m_inputMipChain.GetLevelDim(srcLevel);
+    uint32_t srcTexelCnt = 6 * srcDim * srcDim;
+    const float* pSrc = m_inputMipChain.GetLevelData(srcLevel);
+
+    // Each source texel is its direction followed by its radiance weighted by its solid angle over PI.
+    std::vector<float> srcTexels(6 * uint64_t(srcTexelCnt));
+    for (uint32_t face = 0; face < 6; face++)
+    {
+        for (uint32_t row = 0; row < srcDim; row++)
+        {
+            for (uint32_t col = 0; col < srcDim; col++)
+            {
+                uint64_t texelIdx = (uint64_t(face) * srcDim + row) * srcDim + col;
+                float* pSrcTexel = &srcTexels[6 * texelIdx];
+
+                SharedLib::CubemapTexelDir(face, (float(col) + 0.5f) / float(srcDim), (float(row) + 0.5f) / float(srcDim), pSrcTexel);
+                SharedLib::NormalizeVec(pSrcTexel, 3);
+
+                float weight = SharedLib::CubemapTexelSolidAngle(col, row, srcDim) / float(M_PI);
+                for (uint32_t c = 0; c < 3; c++)
+                {
+                    pSrcTexel[3 + c] = pSrc[4 * texelIdx + c] * weight;
+                }
+            }
+        }
+    }
+
+    rgbaCubemap.resize(4 * 6 * uint64_t(faceDim) * faceDim);
+    float* pDst = rgbaCubemap.data();
+
+    uint32_t bandsPerFace = (faceDim + RowsPerBand - 1) / RowsPerBand;
+    m_threadPool.ParallelFor(6 * bandsPerFace, [&](uint32_t taskIdx)
+    {
+        uint32_t face = taskIdx / bandsPerFace;
+        uint32_t band = taskIdx % bandsPerFace;
+        uint32_t rowBegin = band * RowsPerBand;
+        uint32_t rowEnd = std::min(rowBegin + RowsPerBand, faceDim);
+
+        // One output row in SoA. The source loop is the outer loop, so the SIMD lanes are the texels of the row.
+        std::vector<float> rowSoA(6 * faceDim);
+        float* pNx = &rowSoA[0];
+        float* pNy = &rowSoA[faceDim];
+        float* pNz = &rowSoA[2 * faceDim];
+        float* pR = &rowSoA[3 * faceDim];
+        float* pG = &rowSoA[4 * faceDim];
+        float* pB = &rowSoA[5 * faceDim];
+
+        for (uint32_t row = rowBegin; row < rowEnd; row++)
+        {
+            for (uint32_t col = 0; col < faceDim; col++)
+            {
+                float normal[3];
+                OutputTexelDir(face, col, row, faceDim, normal);
+                pNx[col] = normal[0];
+                pNy[col] = normal[1];
+                pNz[col] = normal[2];
+            }
+            std::fill(pR, pR + 3 * faceDim, 0.f);
+
+            for (uint32_t i = 0; i < srcTexelCnt; i++)
+            {
+                AccumulateCosineWeightedRow(&srcTexels[6 * uint64_t(i)], pNx, pNy, pNz, pR, pG, pB, faceDim);
+            }
+
+            float* pDstRow = pDst + 4 * ((uint64_t(face) * faceDim + row) * faceDim);
+            for (uint32_t col = 0; col < faceDim; col++)
+            {
+                pDstRow[4 * col] = pR[col];
+                pDstRow[4 * col + 1] = pG[col];
+                pDstRow[4 * col + 2] = pB[col];
+                pDstRow[4 * col + 3] = 1.f;
+            }
+        }
+    });
+}
+
+// ================================================================================================================
+SH9Rgb GenIBLCpu::GenDiffuseIrradianceSH9()
+{
+    SharedLib::ScopedTraceTimer sh9Timer("GenDiffuseIrradianceSH9");
+    SH9Rgb radianceSH = ProjectCubemapToSH9(m_inputMipChain.GetLevelData(0), GetInputFaceDim(), m_threadPool);
+    return RadianceSH9ToIrradianceSH9(radianceSH);
+}
+
+// ================================================================================================================
+void GenIBLCpu::GenDiffuseIrradianceFromSH9(
+    const SH9Rgb&       irradianceSH,
+    std::vector<float>& rgbaCubemap)
+{
+    SharedLib::ScopedTraceTimer irradianceTimer("GenDiffuseIrradianceFromSH9");
+    uint32_t faceDim = GetInputFaceDim();
+    rgbaCubemap.resize(4 * 6 * uint64_t(faceDim) * faceDim);
+    ReconstructSH9Cubemap(irradianceSH, faceDim, m_threadPool, rgbaCubemap.data());
+}
+
+// ================================================================================================================
+// Same samples as the prefilterEnvMap_comp.hlsl. The GGX samples only depend on the roughness, so their reflected
+// directions are generated once in the tangent space and every texel only rotates them into its own tangent frame.
+// Without the filtered importance sampling, the input is sampled at the lod = roughnessLevel like the compute path.
+void GenIBLCpu::GenPrefilterEnvMapMip(
+    uint32_t            roughnessLevel,
+    std::vector<float>& rgbaCubemap)
+{
+    SharedLib::ScopedTraceTimer prefilterTimer("GenPrefilterEnvMapMip", roughnessLevel);
+    uint32_t faceDim = GetInputFaceDim() >> roughnessLevel;
+    float roughness = float(roughnessLevel) / float(RoughnessLevels - 1);
+    uint32_t sampleCount = m_prefilterFis ? PrefilterFisSampleBudget[roughnessLevel] : PrefilterSampleCount;
+
+    // A mirror lobe has only one direction.
+    bool mirrorLookup = m_prefilterFis && (roughness == 0.f);
+
+    float inputDim = float(GetInputFaceDim());
+    float saTexel = 4.f * float(M_PI) / (6.f * inputDim * inputDim);
+    float maxLod = float(m_inputMipChain.GetLevelCnt() - 1);
+
+    // Each sample is the tangent space L followed by its lod. L = 2 * dot(N, H) * H - N with N = +Z.
+    std::vector<float> samples;
+    samples.reserve(4 * sampleCount);
+    for (uint32_t i = 0; i < sampleCount; i++)
+    {
+        float xi[2];
+        float h[3];
+        SharedLib::Hammersley(i, sampleCount, xi);
+        SharedLib::ImportanceSampleGGXTangent(xi, roughness, h);
+
+        float l[3] = { 2.f * h[2] * h[0], 2.f * h[2] * h[1], 2.f * h[2] * h[2] - 1.f };
+        if (l[2] <= 0.f)
+        {
+            continue;
+        }
+
+        float lod = float(roughnessLevel);
+        if (m_prefilterFis)
+        {
+            float pdf = SharedLib::DistributionGGX(h[2], roughness) / 4.f;
+            float saSample = 1.f / (float(sampleCount) * pdf + 0.0001f);
+            lod = std::min(std::max(0.5f * log2f(saSample / saTexel) + 1.f, 0.f), maxLod);
+        }
+
+        samples.insert(samples.end(), { l[0], l[1], l[2], lod });
+    }
+    uint32_t validSampleCnt = uint32_t(samples.size() / 4);
+
+    rgbaCubemap.resize(4 * 6 * uint64_t(faceDim) * faceDim);
+    float* pDst = rgbaCubemap.data();
+
+    uint32_t bandsPerFace = (faceDim + RowsPerBand - 1) / RowsPerBand;
+    m_threadPool.ParallelFor(6 * bandsPerFace, [&](uint32_t taskIdx)
+    {
+        uint32_t face = taskIdx / bandsPerFace;
+        uint32_t band = taskIdx % bandsPerFace;
+        uint32_t rowBegin = band * RowsPerBand;
+        uint32_t rowEnd = std::min(rowBegin + RowsPerBand, faceDim);
+
+        for (uint32_t row = rowBegin; row < rowEnd; row++)
+        {
+            for (uint32_t col = 0; col < faceDim; col++)
+            {
+                float* pDstTexel = pDst + 4 * ((uint64_t(face) * faceDim + row) * faceDim + col);
+                pDstTexel[3] = 1.f;
+
+                float normal[3];
+                OutputTexelDir(face, col, row, faceDim, normal);
+
+                if (mirrorLookup)
+                {
+                    SampleInputCubemap(normal, 0.f, pDstTexel);
+                    continue;
+                }
+
+                float tangent[3];
+                float bitangent[3];
+                SharedLib::GGXTangentFrame(normal, tangent, bitangent);
+
+                float prefilteredColor[3] = { 0.f, 0.f, 0.f };
+                float totalWeight = 0.f;
+                for (uint32_t i = 0; i < validSampleCnt; i++)
+                {
+                    const float* pSample = &samples[4 * i];
+
+                    // The frame is orthonormal, so L stays normalized and its z is the NdotL.
+                    float l[3];
+                    for (uint32_t j = 0; j < 3; j++)
+                    {
+                        l[j] = tangent[j] * pSample[0] + bitangent[j] * pSample[1] + normal[j] * pSample[2];
+                    }
+                    float NdotL = pSample[2];
+
+                    float rgb[3];
+                    SampleInputCubemap(l, pSample[3], rgb);
+                    for (uint32_t c = 0; c < 3; c++)
+                    {
+                        prefilteredColor[c] += rgb[c] * NdotL;
+                    }
+                    totalWeight += NdotL;
+                }
+
+                for (uint32_t c = 0; c < 3; c++)
+                {
+                    pDstTexel[c] = prefilteredColor[c] / totalWeight;
+                }
+            }
+        }
+    });
+}
+
+// ================================================================================================================
+// Same as the envBrdf_frag.hlsl. The GGX samples of a row only depend on its roughness, so they are generated once per
+// row and the SIMD lanes are the NdotV of the row.
+void GenIBLCpu::GenEnvBrdf(
+    uint32_t            dim,
+    uint32_t            sampleCount,
+    std::vector<float>& rgImg)
+{
+    SharedLib::ScopedTraceTimer envBrdfTimer("GenEnvBrdf");
+    rgImg.resize(2 * uint64_t(dim) * dim);
+    float* pDst = rgImg.data();
+
+    uint32_t bandCnt = (dim + RowsPerBand - 1) / RowsPerBand;
+    m_threadPool.ParallelFor(bandCnt, [&](uint32_t band)
+    {
+        uint32_t rowBegin = band * RowsPerBand;
+        uint32_t rowEnd = std::min(rowBegin + RowsPerBand, dim);
+
+        std::vector<float> rowSoA(5 * dim);
+        float* pNdotV = &rowSoA[0];
+        float* pVx = &rowSoA[dim];
+        float* pGv = &rowSoA[2 * dim];
+        float* pA = &rowSoA[3 * dim];
+        float* pB = &rowSoA[4 * dim];
+
+        std::vector<float> halfVecs(3 * sampleCount);
+
+        for (uint32_t row = rowBegin; row < rowEnd; row++)
+        {
+            float roughness = (float(row) + 0.5f) / float(dim);
+            float k = (roughness * roughness) / 2.f;
+
+            float N[3] = { 0.f, 0.f, 1.f };
+            for (uint32_t i = 0; i < sampleCount; i++)
+            {
+                float xi[2];
+                SharedLib::Hammersley(i, sampleCount, xi);
+                SharedLib::ImportanceSampleGGX(xi, N, roughness, &halfVecs[3 * i]);
+            }
+
+            for (uint32_t col = 0; col < dim; col++)
+            {
+                float NdotV = (float(col) + 0.5f) / float(dim);
+                pNdotV[col] = NdotV;
+                pVx[col] = sqrtf(1.f - NdotV * NdotV);
+                pGv[col] = SharedLib::GeometrySchlickGGX(NdotV, roughness);
+            }
+            std::fill(pA, pA + 2 * dim, 0.f);
+
+            for (uint32_t i = 0; i < sampleCount; i++)
+            {
+                AccumulateEnvBrdfRow(halfVecs[3 * i], halfVecs[3 * i + 2], k, pNdotV, pVx, pGv, pA, pB, dim);
+            }
+
+            float* pDstRow = pDst + 2 * uint64_t(row) * dim;
+            for (uint32_t col = 0; col < dim; col++)
+            {
+                pDstRow[2 * col] = pA[col] / float(sampleCount);
+                pDstRow[2 * col + 1] = pB[col] / float(sampleCount);
+            }
+        }
+    });
+}
+
+// ================================================================================================================
+bool GenIBLCpu::SaveCubemap(
+    const std::string& namePath,
+    uint32_t           faceDim,
+    const float*       pRgbaCubemap)
+{
+    std::vector<float> rgbData(3 * 6 * uint64_t(faceDim) * faceDim);
+    ToVulkanCubemapFaces(faceDim, pRgbaCubemap, 3, rgbData.data());
+    return SharedLib::SaveImgHdr(namePath, faceDim, 6 * faceDim, 3, rgbData.data());
+}
+
+// ================================================================================================================
+// The face reordering of the cubemapFormat_frag.hlsl: The side faces are mirrored horizontally, the top face is
+// transposed and the bottom face is transposed and rotated by 180 degrees.
+void GenIBLCpu::ToVulkanCubemapFaces(
+    uint32_t     faceDim,
+    const float* pRgbaCubemap,
+    uint32_t     dstComponents,
+    float*       pDst)
+{
+    SharedLib::ScopedTraceTimer reorderTimer("ToVulkanCubemapFaces");
+    for (uint32_t face = 0; face < 6; face++)
+    {
+        for (uint32_t y = 0; y < faceDim; y++)
+        {
+            for (uint32_t x = 0; x < faceDim; x++)
+            {
+                uint32_t srcX, srcY;
+                if (face == 2)
+                {
+                    srcX = y;
+                    srcY = x;
+                }
+                else if (face == 3)
+                {
+                    srcX = faceDim - 1 - y;
+                    srcY = faceDim - 1 - x;
+                }
+                else
+                {
+                    srcX = faceDim - 1 - x;
+                    srcY = y;
+                }
+
+                const float* pSrcTexel = pRgbaCubemap + 4 * ((uint64_t(face) * faceDim + srcY) * faceDim + srcX);
+                float* pDstTexel = pDst + dstComponents * ((uint64_t(face) * faceDim + y) * faceDim + x);
+                for (uint32_t c = 0; c < dstComponents; c++)
+                {
+                    pDstTexel[c] = pSrcTexel[c];
+                }
+            }
+        }
+    }
+}
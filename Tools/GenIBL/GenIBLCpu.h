@@ -0,0 +1,62 @@
+#pragma once
+#include "GenIBLConsts.h"
+#include "CubemapMipChain.h"
+#include "SphericalHarmonics.h"
+#include "../../SharedLibrary/Utils/ThreadUtils.h"
+#include <string>
+#include <vector>
+
+// The diffuse irradiance convolves the input mip level whose faces are at most this big. The cosine lobe is wide, so a
+// 32x32 face is already far beyond what the lobe can resolve.
+constexpr uint32_t CpuIrradianceSourceDim = 32;
+
+// The headless CPU backend of the GenIBL. It needs no graphics device and generates the same products as the Vulkan
+// backend from the same input mip chain and the same Hammersley/GGX math. So it can run on the machines without a GPU
+// and it is the reference of the GPU outputs.
+// - The cubemap outputs are RGBA32F layers in the output face basis, which are what the Vulkan backend renders.
+// - SaveCubemap(...) reorders the faces like the CubemapFormatTransApp, so the files have the same layout.
+// - Every product is split into face row bands among the thread pool. The inner loops run over the texels of a row in
+//   SoA arrays with the AVX or SSE kernels and a scalar fallback.
+class GenIBLCpu
+{
+public:
+    GenIBLCpu();
+    ~GenIBLCpu() {};
+
+    void SetPrefilterFis(bool useFis) { m_prefilterFis = useFis; }
+
+    // A non-zero budget decodes the Radiance inputs in row bands of at most this many bytes.
+    void SetStreamBudget(uint64_t bytes) { m_streamBudgetBytes = bytes; }
+
+    // Reads the input, clamps it and builds all its mips. Returns false when the input cannot be read or is not a vStrip
+    // cubemap.
+    bool ReadInCubemap(const std::string& namePath);
+    uint32_t GetInputFaceDim() { return m_inputMipChain.GetLevelDim(0); }
+
+    void GenDiffuseIrradiance(std::vector<float>& rgbaCubemap);
+    SH9Rgb GenDiffuseIrradianceSH9();
+    void GenDiffuseIrradianceFromSH9(const SH9Rgb& irradianceSH, std::vector<float>& rgbaCubemap);
+
+    // The roughnessLevel mip of the prefilter environment map. Its face dim is the input face dim >> roughnessLevel.
+    void GenPrefilterEnvMapMip(uint32_t roughnessLevel, std::vector<float>& rgbaCubemap);
+
+    // dim x dim RG32F in the envBrdf.bin layout. The R and G are the scale and the bias of the F0.
+    void GenEnvBrdf(uint32_t dim, uint32_t sampleCount, std::vector<float>& rgImg);
+
+    // Also writes the GPU backend cubemaps read back by the batch mode, which are in the same layers.
+    static bool SaveCubemap(const std::string& namePath, uint32_t faceDim, const float* pRgbaCubemap);
+
+    // The face reordering of the SaveCubemap(...) without the file. It keeps the first dstComponents (3 or 4) of every
+    // texel and the output is in the Vulkan cube map faces.
+    static void ToVulkanCubemapFaces(uint32_t faceDim, const float* pRgbaCubemap, uint32_t dstComponents, float* pDst);
+
+private:
+    // Trilinear sampling of the input mip chain in the Vulkan face convention. The bilinear footprint is clamped to the
+    // face, so the face edges are not seamless.
+    void SampleInputCubemap(const float* pDir, float lod, float* pRgb);
+
+    CubemapMipChain       m_inputMipChain;
+    SharedLib::ThreadPool m_threadPool;
+    bool                  m_prefilterFis;
+    uint64_t              m_streamBudgetBytes;
+};
@@ -1,6 +1,8 @@
 #include "GenIBL.h"
 #include "vk_mem_alloc.h"
 #include "../../SharedLibrary/Utils/VulkanDbgUtils.h"
+#include "../../SharedLibrary/Utils/CmdBufUtils.h"
+#include "../../SharedLibrary/Utils/TraceUtils.h"
 
 // ================================================================================================================
 void GenIBL::InitDiffuseIrradiancePipeline()
@@ -56,7 +58,11 @@ void GenIBL::DestroyDiffuseIrradiancePipelineResourses()
 
     // Destroy the pipeline layout
     vkDestroyPipelineLayout(m_device, m_diffuseIrradiancePipelineLayout, nullptr);
+}
 
+// ================================================================================================================
+void GenIBL::DestroyDiffuseIrradianceOutputObjects()
+{
     vmaDestroyImage(*m_pAllocator, m_diffuseIrradianceCubemap, m_diffuseIrradianceCubemapAlloc);
     vkDestroyImageView(m_device, m_diffuseIrradianceCubemapImageView, nullptr);
 }
@@ -87,7 +93,7 @@ void GenIBL::InitDiffuseIrradianceOutputObjects()
         cubeMapImgInfo.arrayLayers = 6;
         cubeMapImgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
         cubeMapImgInfo.tiling = VK_IMAGE_TILING_LINEAR;
-        cubeMapImgInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        cubeMapImgInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
         // cubeMapImgInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT; // It's just an output. We don't need a cubemap sampler.
         cubeMapImgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     }
@@ -110,4 +116,156 @@ void GenIBL::InitDiffuseIrradianceOutputObjects()
         info.subresourceRange.layerCount = 6;
     }
     VK_CHECK(vkCreateImageView(m_device, &info, nullptr, &m_diffuseIrradianceCubemapImageView));
-}
\ No newline at end of file
+}
+
+// ================================================================================================================
+// The input cubemap goes from the transfer dst to the shader read layout, which the SH9 mode needs as well, and the
+// convolution renders the diffuse irradiance cubemap in the same submit.
+void GenIBL::GenDiffuseIrradianceCubemap()
+{
+    SharedLib::ScopedTraceTimer irradianceTimer("GenDiffuseIrradianceCubemap");
+    VkCommandBuffer cmdBuffer = GetGfxCmdBuffer(0);
+
+    VkImageSubresourceRange inputMipsSubResRange{};
+    {
+        inputMipsSubResRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        inputMipsSubResRange.baseMipLevel = 0;
+        inputMipsSubResRange.levelCount = InputCubemapMipLevels;
+        inputMipsSubResRange.baseArrayLayer = 0;
+        inputMipsSubResRange.layerCount = 6;
+    }
+
+    VkImageSubresourceRange outputSubResRange{};
+    {
+        outputSubResRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        outputSubResRange.baseMipLevel = 0;
+        outputSubResRange.levelCount = 1;
+        outputSubResRange.baseArrayLayer = 0;
+        outputSubResRange.layerCount = 6;
+    }
+
+    // Fill the command buffer
+    VkCommandBufferBeginInfo beginInfo{};
+    {
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    }
+    VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+    m_gpuTimer.CmdBeginPass(cmdBuffer, "Diffuse irradiance");
+
+    // Transfer the layout of the input cubemap mipmaps from transfer dst to shader read.
+    VkImageMemoryBarrier hdrDstToShaderBarrier{};
+    {
+        hdrDstToShaderBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        hdrDstToShaderBarrier.image = m_hdrCubeMapImage;
+        hdrDstToShaderBarrier.subresourceRange = inputMipsSubResRange;
+        hdrDstToShaderBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        hdrDstToShaderBarrier.dstAccessMask = VK_ACCESS_NONE;
+        hdrDstToShaderBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        hdrDstToShaderBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+    vkCmdPipelineBarrier(
+        cmdBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &hdrDstToShaderBarrier);
+
+    if (m_irradianceMode == IrradianceMode::Convolution)
+    {
+        // Transform the layout of the output cubemap from undefined to render target.
+        VkImageMemoryBarrier cubemapRenderTargetTransBarrier{};
+        {
+            cubemapRenderTargetTransBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            cubemapRenderTargetTransBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            cubemapRenderTargetTransBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            cubemapRenderTargetTransBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            cubemapRenderTargetTransBarrier.image = m_diffuseIrradianceCubemap;
+            cubemapRenderTargetTransBarrier.subresourceRange = outputSubResRange;
+        }
+
+        vkCmdPipelineBarrier(cmdBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            0,
+            0, nullptr,
+            0, nullptr,
+            1, &cubemapRenderTargetTransBarrier);
+
+        VkClearValue clearColor = { {{1.0f, 0.0f, 0.0f, 1.0f}} };
+
+        VkRenderingAttachmentInfoKHR renderAttachmentInfo{};
+        {
+            renderAttachmentInfo.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+            renderAttachmentInfo.imageView = m_diffuseIrradianceCubemapImageView;
+            renderAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            renderAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            renderAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            renderAttachmentInfo.clearValue = clearColor;
+        }
+
+        VkExtent2D colorRenderTargetExtent{};
+        {
+            colorRenderTargetExtent.width = m_hdrCubeMapInfo.width;
+            colorRenderTargetExtent.height = m_hdrCubeMapInfo.width;
+        }
+
+        VkRenderingInfoKHR renderInfo{};
+        {
+            renderInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+            renderInfo.renderArea.offset = { 0, 0 };
+            renderInfo.renderArea.extent = colorRenderTargetExtent;
+            renderInfo.layerCount = 6;
+            renderInfo.colorAttachmentCount = 1;
+            renderInfo.viewMask = 0x3F;
+            renderInfo.pColorAttachments = &renderAttachmentInfo;
+        }
+
+        vkCmdBeginRendering(cmdBuffer, &renderInfo);
+
+        // Bind the graphics pipeline
+        vkCmdBindDescriptorSets(cmdBuffer,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            m_diffuseIrradiancePipelineLayout,
+            0, 1, &m_diffIrrPreFilterEnvMapDesSet0,
+            0, NULL);
+
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_diffuseIrradiancePipeline.GetVkPipeline());
+
+        // Set the viewport
+        VkViewport viewport{};
+        {
+            viewport.x = 0.f;
+            viewport.y = 0.f;
+            viewport.width = (float)colorRenderTargetExtent.width;
+            viewport.height = (float)colorRenderTargetExtent.height;
+            viewport.minDepth = 0.f;
+            viewport.maxDepth = 1.f;
+        }
+        vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+
+        // Set the scissor
+        VkRect2D scissor{};
+        {
+            scissor.offset = { 0, 0 };
+            scissor.extent = colorRenderTargetExtent;
+            vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+        }
+
+        vkCmdDraw(cmdBuffer, 6, 1, 0, 0);
+
+        vkCmdEndRendering(cmdBuffer);
+    }
+
+    m_gpuTimer.CmdEndPass(cmdBuffer);
+
+    // Submit all the works recorded before
+    VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+
+    m_gfxTimeline.SubmitAndWait(cmdBuffer);
+
+    vkResetCommandBuffer(cmdBuffer, 0);
+    m_gpuTimer.Resolve();
+}
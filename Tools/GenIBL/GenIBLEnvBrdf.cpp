@@ -1,6 +1,10 @@
 #include "GenIBL.h"
 #include "../../SharedLibrary/Utils/VulkanDbgUtils.h"
+#include "../../SharedLibrary/Utils/CmdBufUtils.h"
+#include "../../SharedLibrary/Utils/TraceUtils.h"
+#include "../../SharedLibrary/Utils/AppUtils.h"
 #include "vk_mem_alloc.h"
+#include <cstring>
 
 // ================================================================================================================
 void GenIBL::InitEnvBrdfPipeline()
@@ -9,7 +13,7 @@ void GenIBL::InitEnvBrdfPipeline()
     {
         envBrdfCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
         envBrdfCreateInfo.colorAttachmentCount = 1;
-        envBrdfCreateInfo.pColorAttachmentFormats = &HdriRenderTargetFormat;
+        envBrdfCreateInfo.pColorAttachmentFormats = &m_envBrdfLutVkFormat;
     }
 
     m_envBrdfPipeline.SetPNext(&envBrdfCreateInfo);
@@ -30,7 +34,7 @@ void GenIBL::InitEnvBrdfPipelineLayout()
     {
         pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
         pushConstantRange.offset = 0;
-        pushConstantRange.size = sizeof(float) * 2;
+        pushConstantRange.size = sizeof(EnvBrdfPushConstant);
     }
 
     // Create pipeline layout
@@ -53,8 +57,12 @@ void GenIBL::InitEnvBrdfShaderModules()
 }
 
 // ================================================================================================================
+// The shader writes float4(A, B, 0, 1). The RG render target drops the rest, so the readback is the LUT as it is stored.
 void GenIBL::InitEnvBrdfOutputObjects()
 {
+    m_envBrdfLutVkFormat = (m_envBrdfLutParams.format == SharedLib::EnvBrdfLutFormat::RG16F) ? VK_FORMAT_R16G16_SFLOAT :
+                                                                                               VK_FORMAT_R32G32_SFLOAT;
+
     VmaAllocationCreateInfo envBrdfMapAllocInfo{};
     {
         envBrdfMapAllocInfo.usage = VMA_MEMORY_USAGE_AUTO;
@@ -63,8 +71,8 @@ void GenIBL::InitEnvBrdfOutputObjects()
 
     VkExtent3D extent{};
     {
-        extent.width = EnvBrdfMapDim;
-        extent.height = EnvBrdfMapDim;
+        extent.width = m_envBrdfLutParams.dim;
+        extent.height = m_envBrdfLutParams.dim;
         extent.depth = 1;
     }
 
@@ -72,12 +80,12 @@ void GenIBL::InitEnvBrdfOutputObjects()
     {
         envBrdfMapImgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
         envBrdfMapImgInfo.imageType = VK_IMAGE_TYPE_2D;
-        envBrdfMapImgInfo.format = HdriRenderTargetFormat;
+        envBrdfMapImgInfo.format = m_envBrdfLutVkFormat;
         envBrdfMapImgInfo.extent = extent;
         envBrdfMapImgInfo.mipLevels = 1;
         envBrdfMapImgInfo.arrayLayers = 1;
         envBrdfMapImgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-        envBrdfMapImgInfo.tiling = VK_IMAGE_TILING_LINEAR;
+        envBrdfMapImgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
         envBrdfMapImgInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
         envBrdfMapImgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     }
@@ -94,7 +102,7 @@ void GenIBL::InitEnvBrdfOutputObjects()
         info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         info.image = m_envBrdfOutputImg;
         info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        info.format = HdriRenderTargetFormat;
+        info.format = m_envBrdfLutVkFormat;
         info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         info.subresourceRange.levelCount = 1;
         info.subresourceRange.layerCount = 1;
@@ -112,4 +120,157 @@ void GenIBL::DestroyEnvBrdfPipelineResources()
 
     vmaDestroyImage(*m_pAllocator, m_envBrdfOutputImg, m_envBrdfOutputImgAlloc);
     vkDestroyImageView(m_device, m_envBrdfOutputImgView, nullptr);
-}
\ No newline at end of file
+}
+
+// ================================================================================================================
+// The rendering, the transition to the transfer source and the readback copy are in one submit.
+void GenIBL::GenEnvBrdfLut(
+    std::vector<char>& texels)
+{
+    SharedLib::ScopedTraceTimer envBrdfTimer("GenEnvBrdfLut");
+    VkCommandBuffer cmdBuffer = GetGfxCmdBuffer(0);
+    uint32_t dim = m_envBrdfLutParams.dim;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    {
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    }
+    VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+    m_gpuTimer.CmdBeginPass(cmdBuffer, "Env brdf LUT");
+
+    VkImageSubresourceRange envBrdfMapSubresource{};
+    {
+        envBrdfMapSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        envBrdfMapSubresource.baseMipLevel = 0;
+        envBrdfMapSubresource.levelCount = 1;
+        envBrdfMapSubresource.baseArrayLayer = 0;
+        envBrdfMapSubresource.layerCount = 1;
+    }
+
+    VkImageMemoryBarrier undefToColorAttBarrier{};
+    {
+        undefToColorAttBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        undefToColorAttBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        undefToColorAttBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        undefToColorAttBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        undefToColorAttBarrier.image = m_envBrdfOutputImg;
+        undefToColorAttBarrier.subresourceRange = envBrdfMapSubresource;
+    }
+
+    vkCmdPipelineBarrier(cmdBuffer,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &undefToColorAttBarrier);
+
+    VkRenderingAttachmentInfoKHR renderAttachmentInfo{};
+    {
+        renderAttachmentInfo.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+        renderAttachmentInfo.imageView = m_envBrdfOutputImgView;
+        renderAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        renderAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        renderAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    }
+
+    VkRenderingInfoKHR renderInfo{};
+    {
+        renderInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+        renderInfo.renderArea.offset = { 0, 0 };
+        renderInfo.renderArea.extent = { dim, dim };
+        renderInfo.layerCount = 1;
+        renderInfo.colorAttachmentCount = 1;
+        renderInfo.pColorAttachments = &renderAttachmentInfo;
+    }
+
+    vkCmdBeginRendering(cmdBuffer, &renderInfo);
+
+    EnvBrdfPushConstant pushConstant{};
+    {
+        pushConstant.viewportWidthHeight[0] = float(dim);
+        pushConstant.viewportWidthHeight[1] = float(dim);
+        pushConstant.sampleCount = m_envBrdfLutParams.sampleCount;
+    }
+
+    vkCmdPushConstants(cmdBuffer,
+                       m_envBrdfPipelineLayout,
+                       VK_SHADER_STAGE_FRAGMENT_BIT,
+                       0, sizeof(EnvBrdfPushConstant), &pushConstant);
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_envBrdfPipeline.GetVkPipeline());
+
+    // Set the viewport
+    VkViewport viewport{};
+    {
+        viewport.x = 0.f;
+        viewport.y = 0.f;
+        viewport.width = float(dim);
+        viewport.height = float(dim);
+        viewport.minDepth = 0.f;
+        viewport.maxDepth = 1.f;
+    }
+    vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+
+    // Set the scissor
+    VkRect2D scissor{};
+    {
+        scissor.offset = { 0, 0 };
+        scissor.extent = { dim, dim };
+    }
+    vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+
+    vkCmdDraw(cmdBuffer, 6, 1, 0, 0);
+
+    vkCmdEndRendering(cmdBuffer);
+
+    VkImageMemoryBarrier colorAttToTransSrcBarrier{};
+    {
+        colorAttToTransSrcBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        colorAttToTransSrcBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        colorAttToTransSrcBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        colorAttToTransSrcBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorAttToTransSrcBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        colorAttToTransSrcBarrier.image = m_envBrdfOutputImg;
+        colorAttToTransSrcBarrier.subresourceRange = envBrdfMapSubresource;
+    }
+
+    vkCmdPipelineBarrier(cmdBuffer,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &colorAttToTransSrcBarrier);
+
+    uint32_t texelBytesCnt = SharedLib::EnvBrdfLutTexelBytes(m_envBrdfLutParams.format);
+
+    SharedLib::ReadbackRegion envBrdfMapRegion{};
+    {
+        envBrdfMapRegion.srcImg = m_envBrdfOutputImg;
+        envBrdfMapRegion.subres.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        envBrdfMapRegion.subres.baseArrayLayer = 0;
+        envBrdfMapRegion.subres.layerCount = 1;
+        envBrdfMapRegion.subres.mipLevel = 0;
+        envBrdfMapRegion.extent = { dim, dim, 1 };
+        envBrdfMapRegion.texelBytes = texelBytesCnt;
+    }
+
+    uint64_t readbackTicket = m_readbackManager.CmdReadImgs(cmdBuffer, { envBrdfMapRegion });
+
+    m_gpuTimer.CmdEndPass(cmdBuffer);
+    VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+
+    m_readbackManager.Submit(cmdBuffer, readbackTicket);
+    m_readbackManager.Wait(readbackTicket);
+
+    vkResetCommandBuffer(cmdBuffer, 0);
+    m_gpuTimer.Resolve();
+
+    // The LUT is copied out once per run. Every job of a batch writes it, and the cached LUT is loaded into the same
+    // texels, so keeping it in the staging buffer would hold a pool buffer for the whole run.
+    const SharedLib::ReadbackData& readbackData = m_readbackManager.GetData(readbackTicket);
+    texels.resize(uint64_t(dim) * dim * texelBytesCnt);
+    memcpy(texels.data(), readbackData.pData + readbackData.regionOffsets[0], texels.size());
+    m_readbackManager.Release(readbackTicket);
+}
@@ -0,0 +1,567 @@
+#include "GenIBL.h"
+#include "vk_mem_alloc.h"
+#include "../../SharedLibrary/Utils/VulkanDbgUtils.h"
+#include "../../SharedLibrary/Utils/CmdBufUtils.h"
+#include "../../SharedLibrary/Utils/DiskOpsUtils.h"
+#include "../../SharedLibrary/Utils/HdrIngestUtils.h"
+#include "../../SharedLibrary/Utils/HdrStreamUtils.h"
+#include "../../SharedLibrary/Utils/TraceUtils.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <iostream>
+
+// ================================================================================================================
+// The equirect keeps the full radiance, since the background is reprojected from it too. The reprojection clamps the
+// bake input. The Radiance files go through the same row bands as the vStrip inputs.
+bool GenIBL::DecodeEquirect(
+    const std::string& namePath,
+    EquirectInput&     equirect)
+{
+    SharedLib::ScopedTraceTimer decodeTimer("DecodeEquirect");
+
+    SharedLib::HdrScanlineReader hdrStream;
+    if (hdrStream.Open(namePath))
+    {
+        if (hdrStream.GetWidth() != 2 * hdrStream.GetHeight())
+        {
+            std::cerr << "The input is not a 2:1 equirectangular image: " << namePath << std::endl;
+            return false;
+        }
+
+        equirect.width = hdrStream.GetWidth();
+        equirect.height = hdrStream.GetHeight();
+        equirect.rgba.resize(4 * uint64_t(equirect.width) * equirect.height);
+
+        uint64_t bandBytesCnt = (m_streamBudgetBytes != 0) ? m_streamBudgetBytes : InputDecodeBandBytes;
+        uint32_t bandRowCnt = (uint32_t)std::max(bandBytesCnt / hdrStream.GetRgbeRowBytesCnt(), uint64_t(1));
+        std::vector<uint8_t> rgbeBand(std::min(bandRowCnt, equirect.height) * hdrStream.GetRgbeRowBytesCnt());
+
+        for (uint32_t rowBegin = 0; rowBegin < equirect.height; rowBegin += bandRowCnt)
+        {
+            uint32_t rowCnt = std::min(bandRowCnt, equirect.height - rowBegin);
+            if (hdrStream.ReadRgbeRows(rowCnt, rgbeBand.data()) == false)
+            {
+                std::cerr << "Cannot read the input equirect: " << namePath << std::endl;
+                return false;
+            }
+
+            SharedLib::IngestRgbeRows(rgbeBand.data(),
+                                      rowCnt,
+                                      equirect.width,
+                                      SharedLib::HdrIngestFormat::RGBA32F,
+                                      FLT_MAX,
+                                      equirect.rgba.data() + 4 * uint64_t(rowBegin) * equirect.width,
+                                      m_threadPool);
+        }
+        return true;
+    }
+
+    int nrComponents, width, height;
+    float* pRgbData = SharedLib::ReadImg(namePath.c_str(), nrComponents, width, height);
+    if (pRgbData == nullptr)
+    {
+        std::cerr << "Cannot read the input equirect: " << namePath << std::endl;
+        return false;
+    }
+
+    if ((nrComponents != 3) || (width != 2 * height))
+    {
+        std::cerr << "The input is not a RGB 2:1 equirectangular image: " << namePath << std::endl;
+        SharedLib::ReleaseImg(pRgbData);
+        return false;
+    }
+
+    equirect.width = (uint32_t)width;
+    equirect.height = (uint32_t)height;
+    equirect.rgba.resize(4 * uint64_t(equirect.width) * equirect.height);
+
+    SharedLib::IngestRgbRows(pRgbData,
+                             equirect.height,
+                             equirect.width,
+                             SharedLib::HdrIngestFormat::RGBA32F,
+                             FLT_MAX,
+                             equirect.rgba.data(),
+                             m_threadPool);
+
+    SharedLib::ReleaseImg(pRgbData);
+    return true;
+}
+
+// ================================================================================================================
+void GenIBL::DestroyEquirectReprojectResources()
+{
+    vkDestroyShaderModule(m_device, m_equirectReprojectCsShaderModule, nullptr);
+    vkDestroyPipeline(m_device, m_equirectReprojectPipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_equirectReprojectPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_equirectReprojectDesSetLayout, nullptr);
+    DestroyEquirectReprojectOutputObjects();
+    DestroyEquirectImgObjects();
+}
+
+// ================================================================================================================
+void GenIBL::DestroyEquirectReprojectOutputObjects()
+{
+    vkDestroyImageView(m_device, m_reprojectedCubemapView, nullptr);
+    vmaDestroyImage(*m_pAllocator, m_reprojectedCubemap, m_reprojectedCubemapAlloc);
+    vmaDestroyBuffer(*m_pAllocator, m_backgroundBuffer, m_backgroundAlloc);
+}
+
+// ================================================================================================================
+void GenIBL::DestroyEquirectImgObjects()
+{
+    vkDestroyImageView(m_device, m_equirectImageView, nullptr);
+    vmaDestroyImage(*m_pAllocator, m_equirectImage, m_equirectImageAlloc);
+    vkDestroySampler(m_device, m_equirectSampler, nullptr);
+
+    m_equirectImage = VK_NULL_HANDLE;
+    m_equirectImageAlloc = VK_NULL_HANDLE;
+    m_equirectImageView = VK_NULL_HANDLE;
+    m_equirectSampler = VK_NULL_HANDLE;
+    m_equirectImageExtent = {};
+}
+
+// ================================================================================================================
+// The reprojected faces are a storage image, since the input cubemap is a linear tiling image that can't be a storage
+// image everywhere. The background buffer is host visible, so the full radiance faces are read back without a copy.
+void GenIBL::InitEquirectReprojectOutputObjects()
+{
+    uint32_t faceDim = m_hdrCubeMapInfo.width;
+
+    VmaAllocationCreateInfo reprojectedAllocInfo{};
+    {
+        reprojectedAllocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+        reprojectedAllocInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+    }
+
+    VkImageCreateInfo reprojectedImgInfo{};
+    {
+        reprojectedImgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        reprojectedImgInfo.imageType = VK_IMAGE_TYPE_2D;
+        reprojectedImgInfo.format = InputCubemapFormat;
+        reprojectedImgInfo.extent = { faceDim, faceDim, 1 };
+        reprojectedImgInfo.mipLevels = 1;
+        reprojectedImgInfo.arrayLayers = 6;
+        reprojectedImgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        reprojectedImgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        reprojectedImgInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        reprojectedImgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+
+    VK_CHECK(vmaCreateImage(*m_pAllocator,
+                            &reprojectedImgInfo,
+                            &reprojectedAllocInfo,
+                            &m_reprojectedCubemap,
+                            &m_reprojectedCubemapAlloc,
+                            nullptr));
+
+    VkImageViewCreateInfo reprojectedViewInfo{};
+    {
+        reprojectedViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        reprojectedViewInfo.image = m_reprojectedCubemap;
+        reprojectedViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+        reprojectedViewInfo.format = InputCubemapFormat;
+        reprojectedViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        reprojectedViewInfo.subresourceRange.baseMipLevel = 0;
+        reprojectedViewInfo.subresourceRange.levelCount = 1;
+        reprojectedViewInfo.subresourceRange.baseArrayLayer = 0;
+        reprojectedViewInfo.subresourceRange.layerCount = 6;
+    }
+    VK_CHECK(vkCreateImageView(m_device, &reprojectedViewInfo, nullptr, &m_reprojectedCubemapView));
+
+    CreateVmaVkBuffer(VMA_MEMORY_USAGE_AUTO,
+                      VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+                      VK_SHARING_MODE_EXCLUSIVE,
+                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                      sizeof(float) * 4 * 6 * uint64_t(faceDim) * faceDim,
+                      &m_backgroundBuffer,
+                      &m_backgroundAlloc);
+}
+
+// ================================================================================================================
+// The repeat U wraps the longitude seam like the ToCubeMap.frag sampler does.
+void GenIBL::InitEquirectImgObjects()
+{
+    m_equirectImageExtent.width = m_equirectInput.width;
+    m_equirectImageExtent.height = m_equirectInput.height;
+
+    VmaAllocationCreateInfo equirectAllocInfo{};
+    {
+        equirectAllocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+        equirectAllocInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+    }
+
+    VkImageCreateInfo equirectImgInfo{};
+    {
+        equirectImgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        equirectImgInfo.imageType = VK_IMAGE_TYPE_2D;
+        equirectImgInfo.format = InputCubemapFormat;
+        equirectImgInfo.extent = { m_equirectImageExtent.width, m_equirectImageExtent.height, 1 };
+        equirectImgInfo.mipLevels = 1;
+        equirectImgInfo.arrayLayers = 1;
+        equirectImgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        equirectImgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        equirectImgInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        equirectImgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+
+    VK_CHECK(vmaCreateImage(*m_pAllocator,
+                            &equirectImgInfo,
+                            &equirectAllocInfo,
+                            &m_equirectImage,
+                            &m_equirectImageAlloc,
+                            nullptr));
+
+    VkImageViewCreateInfo equirectViewInfo{};
+    {
+        equirectViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        equirectViewInfo.image = m_equirectImage;
+        equirectViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        equirectViewInfo.format = InputCubemapFormat;
+        equirectViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        equirectViewInfo.subresourceRange.levelCount = 1;
+        equirectViewInfo.subresourceRange.layerCount = 1;
+    }
+    VK_CHECK(vkCreateImageView(m_device, &equirectViewInfo, nullptr, &m_equirectImageView));
+
+    VkSamplerCreateInfo samplerInfo{};
+    {
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.minLod = 0.f;
+        samplerInfo.maxLod = 0.f;
+        samplerInfo.maxAnisotropy = 1.0f;
+    }
+    VK_CHECK(vkCreateSampler(m_device, &samplerInfo, nullptr, &m_equirectSampler));
+}
+
+// ================================================================================================================
+void GenIBL::InitEquirectReprojectDescriptorSet()
+{
+    VkDescriptorSetLayoutBinding equirectBinding{};
+    {
+        equirectBinding.binding = 0;
+        equirectBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        equirectBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        equirectBinding.descriptorCount = 1;
+    }
+
+    VkDescriptorSetLayoutBinding cubemapFacesBinding{};
+    {
+        cubemapFacesBinding.binding = 1;
+        cubemapFacesBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        cubemapFacesBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        cubemapFacesBinding.descriptorCount = 1;
+    }
+
+    VkDescriptorSetLayoutBinding backgroundBinding{};
+    {
+        backgroundBinding.binding = 2;
+        backgroundBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        backgroundBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        backgroundBinding.descriptorCount = 1;
+    }
+
+    VkDescriptorSetLayoutBinding desSetLayoutBindings[3] = { equirectBinding, cubemapFacesBinding, backgroundBinding };
+
+    VkDescriptorSetLayoutCreateInfo desSetLayoutInfo{};
+    {
+        desSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        desSetLayoutInfo.bindingCount = 3;
+        desSetLayoutInfo.pBindings = desSetLayoutBindings;
+    }
+
+    VK_CHECK(vkCreateDescriptorSetLayout(m_device,
+                                         &desSetLayoutInfo,
+                                         nullptr,
+                                         &m_equirectReprojectDesSetLayout));
+
+    VkDescriptorSetAllocateInfo desSetAllocInfo{};
+    {
+        desSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        desSetAllocInfo.descriptorPool = m_descriptorPool;
+        desSetAllocInfo.pSetLayouts = &m_equirectReprojectDesSetLayout;
+        desSetAllocInfo.descriptorSetCount = 1;
+    }
+
+    VK_CHECK(vkAllocateDescriptorSets(m_device,
+                                      &desSetAllocInfo,
+                                      &m_equirectReprojectDesSet));
+}
+
+// ================================================================================================================
+// Both the equirect image and the outputs can be recreated between the inputs, so the set is written before every
+// reprojection instead of being reallocated with them.
+void GenIBL::UpdateEquirectReprojectDescriptorSet()
+{
+    VkDescriptorImageInfo equirectImgInfo{};
+    {
+        equirectImgInfo.imageView = m_equirectImageView;
+        equirectImgInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        equirectImgInfo.sampler = m_equirectSampler;
+    }
+
+    VkDescriptorImageInfo cubemapFacesImgInfo{};
+    {
+        cubemapFacesImgInfo.imageView = m_reprojectedCubemapView;
+        cubemapFacesImgInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+
+    VkDescriptorBufferInfo backgroundBufferInfo{};
+    {
+        backgroundBufferInfo.buffer = m_backgroundBuffer;
+        backgroundBufferInfo.offset = 0;
+        backgroundBufferInfo.range = VK_WHOLE_SIZE;
+    }
+
+    VkWriteDescriptorSet writeEquirectDesSet{};
+    {
+        writeEquirectDesSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeEquirectDesSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writeEquirectDesSet.dstSet = m_equirectReprojectDesSet;
+        writeEquirectDesSet.dstBinding = 0;
+        writeEquirectDesSet.pImageInfo = &equirectImgInfo;
+        writeEquirectDesSet.descriptorCount = 1;
+    }
+
+    VkWriteDescriptorSet writeCubemapFacesDesSet{};
+    {
+        writeCubemapFacesDesSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeCubemapFacesDesSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writeCubemapFacesDesSet.dstSet = m_equirectReprojectDesSet;
+        writeCubemapFacesDesSet.dstBinding = 1;
+        writeCubemapFacesDesSet.pImageInfo = &cubemapFacesImgInfo;
+        writeCubemapFacesDesSet.descriptorCount = 1;
+    }
+
+    VkWriteDescriptorSet writeBackgroundDesSet{};
+    {
+        writeBackgroundDesSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeBackgroundDesSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writeBackgroundDesSet.dstSet = m_equirectReprojectDesSet;
+        writeBackgroundDesSet.dstBinding = 2;
+        writeBackgroundDesSet.pBufferInfo = &backgroundBufferInfo;
+        writeBackgroundDesSet.descriptorCount = 1;
+    }
+
+    VkWriteDescriptorSet writeDesSets[3] = { writeEquirectDesSet, writeCubemapFacesDesSet, writeBackgroundDesSet };
+    vkUpdateDescriptorSets(m_device, 3, writeDesSets, 0, NULL);
+}
+
+// ================================================================================================================
+void GenIBL::InitEquirectReprojectShaderModule()
+{
+    m_equirectReprojectCsShaderModule = CreateShaderModule("/hlsl/equirectToCubemap_comp.spv");
+}
+
+// ================================================================================================================
+void GenIBL::InitEquirectReprojectPipelineLayout()
+{
+    VkPushConstantRange range{};
+    {
+        range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        range.offset = 0;
+        range.size = sizeof(EquirectPushConstant);
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    {
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_equirectReprojectDesSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &range;
+    }
+
+    VK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_equirectReprojectPipelineLayout));
+}
+
+// ================================================================================================================
+void GenIBL::InitEquirectReprojectPipeline()
+{
+    VkComputePipelineCreateInfo pipelineInfo{};
+    {
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage = CreateDefaultShaderStgCreateInfo(m_equirectReprojectCsShaderModule, VK_SHADER_STAGE_COMPUTE_BIT);
+        pipelineInfo.layout = m_equirectReprojectPipelineLayout;
+    }
+
+    VK_CHECK(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_equirectReprojectPipeline));
+}
+
+// ================================================================================================================
+// The equirect goes through the staging ring first. Then one command buffer:
+// - Reprojects it to the 6 faces: The clamped ones to the storage image and the full radiance ones to the background
+//   buffer.
+// - Copies the storage image to the input cubemap level 0 and blits the rest of the levels down from it.
+// So the input cubemap leaves it in the same state as the CmdGenInputCubemapMipMaps(...) leaves it, and the cubemap
+// never goes through the host or a file.
+void GenIBL::ReprojectEquirectToInputCubemap(
+    std::vector<float>& backgroundCubemap)
+{
+    uint32_t faceDim = m_hdrCubeMapInfo.width;
+
+    if ((m_equirectImageExtent.width != m_equirectInput.width) ||
+        (m_equirectImageExtent.height != m_equirectInput.height))
+    {
+        VK_CHECK(vkQueueWaitIdle(m_graphicsQueue));
+        DestroyEquirectImgObjects();
+        InitEquirectImgObjects();
+    }
+    UpdateEquirectReprojectDescriptorSet();
+
+    const char* pEquirectData = reinterpret_cast<const char*>(m_equirectInput.rgba.data());
+    const uint64_t rowBytesCnt = 4 * sizeof(float) * uint64_t(m_equirectInput.width);
+
+    SharedLib::StreamRowsToImg(m_device,
+                               m_graphicsQueue,
+                               m_gfxCmdPool,
+                               *m_pAllocator,
+                               m_equirectImage,
+                               0,
+                               1,
+                               m_equirectImageExtent,
+                               4 * sizeof(float),
+                               VK_IMAGE_LAYOUT_UNDEFINED,
+                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                               (m_streamBudgetBytes != 0) ? m_streamBudgetBytes : UINT64_MAX,
+                               [=](uint32_t rowBegin, uint32_t rowCnt, void* pDst)
+                               {
+                                   memcpy(pDst, pEquirectData + rowBegin * rowBytesCnt, rowCnt * rowBytesCnt);
+                                   return true;
+                               });
+
+    VkCommandBuffer cmdBuffer = GetGfxCmdBuffer(0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    {
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    }
+    VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+    m_gpuTimer.CmdBeginPass(cmdBuffer, "Equirect reprojection and mip blits");
+
+    VkImageMemoryBarrier undefToGeneralBarrier{};
+    {
+        undefToGeneralBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        undefToGeneralBarrier.image = m_reprojectedCubemap;
+        undefToGeneralBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        undefToGeneralBarrier.subresourceRange.baseMipLevel = 0;
+        undefToGeneralBarrier.subresourceRange.levelCount = 1;
+        undefToGeneralBarrier.subresourceRange.baseArrayLayer = 0;
+        undefToGeneralBarrier.subresourceRange.layerCount = 6;
+        undefToGeneralBarrier.srcAccessMask = 0;
+        undefToGeneralBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        undefToGeneralBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        undefToGeneralBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+
+    vkCmdPipelineBarrier(cmdBuffer,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &undefToGeneralBarrier);
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_equirectReprojectPipeline);
+
+    vkCmdBindDescriptorSets(cmdBuffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        m_equirectReprojectPipelineLayout,
+        0, 1, &m_equirectReprojectDesSet,
+        0, NULL);
+
+    EquirectPushConstant pushConstant{};
+    {
+        pushConstant.faceDim = faceDim;
+        pushConstant.radianceClamp = InputRadianceClamp;
+    }
+
+    vkCmdPushConstants(cmdBuffer,
+                       m_equirectReprojectPipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT,
+                       0, sizeof(EquirectPushConstant), &pushConstant);
+
+    uint32_t groupCnt = (faceDim + EquirectWorkgroupDim - 1) / EquirectWorkgroupDim;
+    vkCmdDispatch(cmdBuffer, groupCnt, groupCnt, 6);
+
+    // The reprojected faces go to the copy, the background to the host and the whole input cubemap to the transfer dst.
+    VkMemoryBarrier backgroundToHostBarrier{};
+    {
+        backgroundToHostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        backgroundToHostBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        backgroundToHostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    }
+
+    VkImageMemoryBarrier generalToSrcBarrier = undefToGeneralBarrier;
+    {
+        generalToSrcBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        generalToSrcBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        generalToSrcBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        generalToSrcBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    }
+
+    VkImageMemoryBarrier undefToDstBarrier{};
+    {
+        undefToDstBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        undefToDstBarrier.image = m_hdrCubeMapImage;
+        undefToDstBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        undefToDstBarrier.subresourceRange.baseMipLevel = 0;
+        undefToDstBarrier.subresourceRange.levelCount = InputCubemapMipLevels;
+        undefToDstBarrier.subresourceRange.baseArrayLayer = 0;
+        undefToDstBarrier.subresourceRange.layerCount = 6;
+        undefToDstBarrier.srcAccessMask = 0;
+        undefToDstBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        undefToDstBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        undefToDstBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    }
+
+    VkImageMemoryBarrier toCopyBarriers[2] = { generalToSrcBarrier, undefToDstBarrier };
+
+    vkCmdPipelineBarrier(cmdBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        1, &backgroundToHostBarrier,
+        0, nullptr,
+        2, toCopyBarriers);
+
+    VkImageCopy level0Copy{};
+    {
+        level0Copy.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        level0Copy.srcSubresource.mipLevel = 0;
+        level0Copy.srcSubresource.baseArrayLayer = 0;
+        level0Copy.srcSubresource.layerCount = 6;
+        level0Copy.dstSubresource = level0Copy.srcSubresource;
+        level0Copy.extent = { faceDim, faceDim, 1 };
+    }
+
+    vkCmdCopyImage(cmdBuffer,
+                   m_reprojectedCubemap, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   m_hdrCubeMapImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   1, &level0Copy);
+
+    CmdBlitInputCubemapMips(cmdBuffer);
+
+    m_gpuTimer.CmdEndPass(cmdBuffer);
+    VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+
+    m_gfxTimeline.SubmitAndWait(cmdBuffer);
+
+    vkResetCommandBuffer(cmdBuffer, 0);
+    m_gpuTimer.Resolve();
+
+    VK_CHECK(vmaInvalidateAllocation(*m_pAllocator, m_backgroundAlloc, 0, VK_WHOLE_SIZE));
+
+    VmaAllocationInfo backgroundAllocInfo;
+    vmaGetAllocationInfo(*m_pAllocator, m_backgroundAlloc, &backgroundAllocInfo);
+
+    backgroundCubemap.resize(4 * 6 * uint64_t(faceDim) * faceDim);
+    memcpy(backgroundCubemap.data(), backgroundAllocInfo.pMappedData, sizeof(float) * backgroundCubemap.size());
+    SharedLib::AddTraceBytes(SharedLib::TraceReadbackBytes, sizeof(float) * backgroundCubemap.size());
+}
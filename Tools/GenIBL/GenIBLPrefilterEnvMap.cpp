@@ -2,6 +2,7 @@
 #include "vk_mem_alloc.h"
 #include "../../SharedLibrary/Utils/VulkanDbgUtils.h"
 #include "../../SharedLibrary/Utils/CmdBufUtils.h"
+#include "../../SharedLibrary/Utils/TraceUtils.h"
 
 // ================================================================================================================
 void GenIBL::DestroyPrefilterEnvMapPipelineResourses()
@@ -11,7 +12,11 @@ void GenIBL::DestroyPrefilterEnvMapPipelineResourses()
 
     // Destroy the pipeline layout
     vkDestroyPipelineLayout(m_device, m_preFilterEnvMapPipelineLayout, nullptr);
+}
 
+// ================================================================================================================
+void GenIBL::DestroyPrefilterEnvMapOutputObjects()
+{
     vmaDestroyImage(*m_pAllocator, m_preFilterEnvMapCubemap, m_preFilterEnvMapCubemapAlloc);
 
     for (uint32_t i = 0; i < m_preFilterEnvMapCubemapImageViews.size(); i++)
@@ -61,6 +66,25 @@ void GenIBL::InitPrefilterEnvMapPipeline()
     shaderStgsInfo[1] = CreateDefaultShaderStgCreateInfo(m_preFilterEnvMapPsShaderModule,
         VK_SHADER_STAGE_FRAGMENT_BIT);
 
+    // FILTERED_IMPORTANCE_SAMPLING in the prefilterEnvMap_frag.hlsl.
+    VkBool32 useFis = m_prefilterFis ? VK_TRUE : VK_FALSE;
+
+    VkSpecializationMapEntry fisMapEntry{};
+    {
+        fisMapEntry.constantID = 0;
+        fisMapEntry.offset = 0;
+        fisMapEntry.size = sizeof(VkBool32);
+    }
+
+    VkSpecializationInfo specInfo{};
+    {
+        specInfo.mapEntryCount = 1;
+        specInfo.pMapEntries = &fisMapEntry;
+        specInfo.dataSize = sizeof(VkBool32);
+        specInfo.pData = &useFis;
+    }
+    shaderStgsInfo[1].pSpecializationInfo = &specInfo;
+
     m_preFilterEnvMapPipeline.SetShaderStageInfo(shaderStgsInfo, 2);
     m_preFilterEnvMapPipeline.SetPipelineLayout(m_preFilterEnvMapPipelineLayout);
     m_preFilterEnvMapPipeline.CreatePipeline(m_device);
@@ -93,6 +117,10 @@ void GenIBL::InitPrefilterEnvMapOutputObjects()
         cubeMapImgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
         cubeMapImgInfo.tiling = VK_IMAGE_TILING_LINEAR;
         cubeMapImgInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        if (m_prefilterEnvMapMode == PrefilterEnvMapMode::Compute)
+        {
+            cubeMapImgInfo.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+        }
         // cubeMapImgInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT; // It's just an output. We don't need a cubemap sampler.
         cubeMapImgInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     }
@@ -124,8 +152,9 @@ void GenIBL::InitPrefilterEnvMapOutputObjects()
 
 // ================================================================================================================
 void GenIBL::UpdateRoughnessInUbo(
-    float roughness,
-    float imgDim)
+    float    roughness,
+    float    imgDim,
+    uint32_t sampleCount)
 {
     float near = 1.f;
     float nearWidthHeight[2] = { 2.f, 2.f };
@@ -135,6 +164,7 @@ void GenIBL::UpdateRoughnessInUbo(
     m_screenCameraData[73] = roughness;
     memcpy(&m_screenCameraData[74], nearWidthHeight, sizeof(nearWidthHeight));
     memcpy(&m_screenCameraData[76], viewportWidthHeight, sizeof(viewportWidthHeight));
+    memcpy(&m_screenCameraData[78], &sampleCount, sizeof(sampleCount));
 
     // Send data to the GPU buffer
     CopyRamDataToGpuBuffer(m_screenCameraData,
@@ -143,8 +173,29 @@ void GenIBL::UpdateRoughnessInUbo(
                            sizeof(m_screenCameraData));
 }
 
+// ================================================================================================================
+uint32_t GenIBL::GetPrefilterSampleCount(
+    uint32_t roughnessLevel)
+{
+    return m_prefilterFis ? PrefilterFisSampleBudget[roughnessLevel] : PrefilterSampleCount;
+}
+
 // ================================================================================================================
 void GenIBL::GenPrefilterEnvMap()
+{
+    SharedLib::ScopedTraceTimer prefilterTimer("GenPrefilterEnvMap");
+    if (m_prefilterEnvMapMode == PrefilterEnvMapMode::Compute)
+    {
+        GenPrefilterEnvMapCompute();
+    }
+    else
+    {
+        GenPrefilterEnvMapGraphics();
+    }
+}
+
+// ================================================================================================================
+void GenIBL::GenPrefilterEnvMapGraphics()
 {
     VkCommandBuffer cmdBuffer = GetGfxCmdBuffer(0);
 
@@ -156,6 +207,7 @@ void GenIBL::GenPrefilterEnvMap()
             beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         }
         VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+        m_gpuTimer.CmdBeginPass(cmdBuffer, "Prefilter env map layout");
 
         VkImageSubresourceRange prefilterEnvMapSubresource{};
         {
@@ -184,12 +236,15 @@ void GenIBL::GenPrefilterEnvMap()
             0, nullptr,
             1, &cubemapRenderTargetTransBarrier);
 
+        m_gpuTimer.CmdEndPass(cmdBuffer);
+
         // Submit all the works recorded before
         VK_CHECK(vkEndCommandBuffer(cmdBuffer));
 
-        SharedLib::SubmitCmdBufferAndWait(m_device, m_graphicsQueue, cmdBuffer);
+        m_gfxTimeline.SubmitAndWait(cmdBuffer);
 
         vkResetCommandBuffer(cmdBuffer, 0);
+        m_gpuTimer.Resolve();
     }
 
     // Shared information
@@ -204,6 +259,7 @@ void GenIBL::GenPrefilterEnvMap()
             beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         }
         VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+        m_gpuTimer.CmdBeginPass(cmdBuffer, "Prefilter env map mip " + std::to_string(i));
 
         float currentRoughness = float(i) / float(RoughnessLevels - 1);
         uint32_t divFactor = 1 << i;
@@ -215,7 +271,7 @@ void GenIBL::GenPrefilterEnvMap()
         }
 
         // BUG! The buffer change happens but packets are not submitted to GPU!
-        UpdateRoughnessInUbo(currentRoughness, float(currentRenderDim));
+        UpdateRoughnessInUbo(currentRoughness, float(currentRenderDim), GetPrefilterSampleCount(i));
 
         VkRenderingAttachmentInfoKHR renderAttachmentInfo{};
         {
@@ -273,11 +329,298 @@ void GenIBL::GenPrefilterEnvMap()
 
         vkCmdEndRendering(cmdBuffer);
 
+        m_gpuTimer.CmdEndPass(cmdBuffer);
+
         // Submit all the works recorded before
         VK_CHECK(vkEndCommandBuffer(cmdBuffer));
 
-        SharedLib::SubmitCmdBufferAndWait(m_device, m_graphicsQueue, cmdBuffer);
+        m_gfxTimeline.SubmitAndWait(cmdBuffer);
 
         vkResetCommandBuffer(cmdBuffer, 0);
+        m_gpuTimer.Resolve();
+    }
+}
+// ================================================================================================================
+// The output cubemap is written as a storage image with the linear tiling, and the LocalSizeId execution mode of the
+// compute shader needs the maintenance4.
+bool GenIBL::IsPrefilterEnvMapComputeSupported()
+{
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(m_physicalDevice, HdriRenderTargetFormat, &formatProperties);
+    bool isStorageSupported = (formatProperties.linearTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
+
+    VkPhysicalDeviceMaintenance4Features maintenance4Features{};
+    {
+        maintenance4Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_4_FEATURES;
+    }
+
+    VkPhysicalDeviceFeatures2 features2{};
+    {
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &maintenance4Features;
+    }
+    vkGetPhysicalDeviceFeatures2(m_physicalDevice, &features2);
+
+    return isStorageSupported && (maintenance4Features.maintenance4 == VK_TRUE);
+}
+
+// ================================================================================================================
+void GenIBL::DestroyPrefilterEnvMapComputeResources()
+{
+    vkDestroyShaderModule(m_device, m_preFilterEnvMapCsShaderModule, nullptr);
+    vkDestroyPipeline(m_device, m_preFilterEnvMapComputePipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_preFilterEnvMapComputePipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_preFilterEnvMapStorageDesSetLayout, nullptr);
+}
+
+// ================================================================================================================
+// Each roughness mip gets its own set 1 that only holds its storage image view. The set 0 is shared with the graphics
+// passes.
+void GenIBL::InitPrefilterEnvMapStorageDescriptorSets()
+{
+    VkDescriptorSetLayoutBinding storageImgBinding{};
+    {
+        storageImgBinding.binding = 0;
+        storageImgBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        storageImgBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        storageImgBinding.descriptorCount = 1;
+    }
+
+    VkDescriptorSetLayoutCreateInfo storageDesSetLayoutInfo{};
+    {
+        storageDesSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        storageDesSetLayoutInfo.bindingCount = 1;
+        storageDesSetLayoutInfo.pBindings = &storageImgBinding;
+    }
+
+    VK_CHECK(vkCreateDescriptorSetLayout(m_device,
+                                         &storageDesSetLayoutInfo,
+                                         nullptr,
+                                         &m_preFilterEnvMapStorageDesSetLayout));
+
+    AllocPrefilterEnvMapStorageDescriptorSets();
+}
+
+// ================================================================================================================
+// The sets point at the views of the current prefilter output, so they are reallocated with it.
+void GenIBL::AllocPrefilterEnvMapStorageDescriptorSets()
+{
+    std::vector<VkDescriptorSetLayout> storageDesSetLayouts(RoughnessLevels, m_preFilterEnvMapStorageDesSetLayout);
+    m_preFilterEnvMapStorageDesSets.resize(RoughnessLevels);
+
+    VkDescriptorSetAllocateInfo storageDesSetAllocInfo{};
+    {
+        storageDesSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        storageDesSetAllocInfo.descriptorPool = m_descriptorPool;
+        storageDesSetAllocInfo.pSetLayouts = storageDesSetLayouts.data();
+        storageDesSetAllocInfo.descriptorSetCount = RoughnessLevels;
+    }
+
+    VK_CHECK(vkAllocateDescriptorSets(m_device,
+                                      &storageDesSetAllocInfo,
+                                      m_preFilterEnvMapStorageDesSets.data()));
+
+    std::vector<VkDescriptorImageInfo> storageImgInfos(RoughnessLevels);
+    std::vector<VkWriteDescriptorSet> writeStorageDesSets(RoughnessLevels);
+    for (uint32_t i = 0; i < RoughnessLevels; i++)
+    {
+        VkDescriptorImageInfo& storageImgInfo = storageImgInfos[i];
+        {
+            storageImgInfo.imageView = m_preFilterEnvMapCubemapImageViews[i];
+            storageImgInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        }
+
+        VkWriteDescriptorSet& writeStorageDesSet = writeStorageDesSets[i];
+        {
+            writeStorageDesSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeStorageDesSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writeStorageDesSet.dstSet = m_preFilterEnvMapStorageDesSets[i];
+            writeStorageDesSet.dstBinding = 0;
+            writeStorageDesSet.pImageInfo = &storageImgInfo;
+            writeStorageDesSet.descriptorCount = 1;
+        }
+    }
+
+    vkUpdateDescriptorSets(m_device, RoughnessLevels, writeStorageDesSets.data(), 0, NULL);
+}
+
+// ================================================================================================================
+void GenIBL::InitPrefilterEnvMapComputeShaderModule()
+{
+    m_preFilterEnvMapCsShaderModule = CreateShaderModule("/hlsl/prefilterEnvMap_comp.spv");
+}
+
+// ================================================================================================================
+void GenIBL::InitPrefilterEnvMapComputePipelineLayout()
+{
+    VkDescriptorSetLayout desSetLayouts[2] = { m_diffIrrPreFilterEnvMapDesSet0Layout, m_preFilterEnvMapStorageDesSetLayout };
+
+    VkPushConstantRange range{};
+    {
+        range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        range.offset = 0;
+        range.size = sizeof(PrefilterPushConstant);
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    {
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 2;
+        pipelineLayoutInfo.pSetLayouts = desSetLayouts;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &range;
+    }
+
+    VK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_preFilterEnvMapComputePipelineLayout));
+}
+
+// ================================================================================================================
+void GenIBL::InitPrefilterEnvMapComputePipeline()
+{
+    // WORKGROUP_DIM and FILTERED_IMPORTANCE_SAMPLING in the prefilterEnvMap_comp.hlsl.
+    uint32_t specConstants[2] = { PrefilterWorkgroupDim, m_prefilterFis ? VK_TRUE : VK_FALSE };
+
+    VkSpecializationMapEntry specMapEntries[2] = {};
+    {
+        specMapEntries[0].constantID = 0;
+        specMapEntries[0].offset = 0;
+        specMapEntries[0].size = sizeof(uint32_t);
+
+        specMapEntries[1].constantID = 1;
+        specMapEntries[1].offset = sizeof(uint32_t);
+        specMapEntries[1].size = sizeof(VkBool32);
+    }
+
+    VkSpecializationInfo specInfo{};
+    {
+        specInfo.mapEntryCount = 2;
+        specInfo.pMapEntries = specMapEntries;
+        specInfo.dataSize = sizeof(specConstants);
+        specInfo.pData = specConstants;
+    }
+
+    VkPipelineShaderStageCreateInfo shaderStgInfo = CreateDefaultShaderStgCreateInfo(m_preFilterEnvMapCsShaderModule,
+                                                                                      VK_SHADER_STAGE_COMPUTE_BIT);
+    shaderStgInfo.pSpecializationInfo = &specInfo;
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    {
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage = shaderStgInfo;
+        pipelineInfo.layout = m_preFilterEnvMapComputePipelineLayout;
+    }
+
+    VK_CHECK(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_preFilterEnvMapComputePipeline));
+}
+
+// ================================================================================================================
+// All the roughness mips are written in one command buffer and one submit:
+// - The whole output goes to the general layout for the storage image writes.
+// - One dispatch per mip. The mips don't depend on each other, so there are no barriers between the dispatches.
+// - The output goes to the color attachment layout at the end, which is what the graphics path leaves for the
+//   CubemapFormatTransApp.
+void GenIBL::GenPrefilterEnvMapCompute()
+{
+    VkCommandBuffer cmdBuffer = GetGfxCmdBuffer(0);
+
+    // The UBO is written once for the prefilter layout. The roughness, the viewport and the sample count in it are not
+    // used by the compute shader.
+    UpdateRoughnessInUbo(0.f, float(m_hdrCubeMapInfo.width), 0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    {
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    }
+    VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+    m_gpuTimer.CmdBeginPass(cmdBuffer, "Prefilter env map (compute)");
+
+    VkImageSubresourceRange prefilterEnvMapSubresource{};
+    {
+        prefilterEnvMapSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        prefilterEnvMapSubresource.baseMipLevel = 0;
+        prefilterEnvMapSubresource.levelCount = RoughnessLevels;
+        prefilterEnvMapSubresource.baseArrayLayer = 0;
+        prefilterEnvMapSubresource.layerCount = 6;
     }
-}
\ No newline at end of file
+
+    VkImageMemoryBarrier undefToGeneralBarrier{};
+    {
+        undefToGeneralBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        undefToGeneralBarrier.srcAccessMask = 0;
+        undefToGeneralBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        undefToGeneralBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        undefToGeneralBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        undefToGeneralBarrier.image = m_preFilterEnvMapCubemap;
+        undefToGeneralBarrier.subresourceRange = prefilterEnvMapSubresource;
+    }
+
+    vkCmdPipelineBarrier(cmdBuffer,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &undefToGeneralBarrier);
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_preFilterEnvMapComputePipeline);
+
+    vkCmdBindDescriptorSets(cmdBuffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        m_preFilterEnvMapComputePipelineLayout,
+        0, 1, &m_diffIrrPreFilterEnvMapDesSet0,
+        0, NULL);
+
+    for (uint32_t i = 0; i < RoughnessLevels; i++)
+    {
+        uint32_t currentMipDim = m_hdrCubeMapInfo.width >> i;
+
+        PrefilterPushConstant pushConstant{};
+        {
+            pushConstant.roughness = float(i) / float(RoughnessLevels - 1);
+            pushConstant.mipDim = currentMipDim;
+            pushConstant.sampleLod = float(i);
+            pushConstant.sampleCount = GetPrefilterSampleCount(i);
+        }
+
+        vkCmdBindDescriptorSets(cmdBuffer,
+            VK_PIPELINE_BIND_POINT_COMPUTE,
+            m_preFilterEnvMapComputePipelineLayout,
+            1, 1, &m_preFilterEnvMapStorageDesSets[i],
+            0, NULL);
+
+        vkCmdPushConstants(cmdBuffer,
+                           m_preFilterEnvMapComputePipelineLayout,
+                           VK_SHADER_STAGE_COMPUTE_BIT,
+                           0, sizeof(PrefilterPushConstant), &pushConstant);
+
+        uint32_t groupCnt = (currentMipDim + PrefilterWorkgroupDim - 1) / PrefilterWorkgroupDim;
+        vkCmdDispatch(cmdBuffer, groupCnt, groupCnt, 6);
+    }
+
+    VkImageMemoryBarrier generalToColorAttBarrier{};
+    {
+        generalToColorAttBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        generalToColorAttBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        generalToColorAttBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        generalToColorAttBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        generalToColorAttBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        generalToColorAttBarrier.image = m_preFilterEnvMapCubemap;
+        generalToColorAttBarrier.subresourceRange = prefilterEnvMapSubresource;
+    }
+
+    vkCmdPipelineBarrier(cmdBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &generalToColorAttBarrier);
+
+    m_gpuTimer.CmdEndPass(cmdBuffer);
+    VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+
+    m_gfxTimeline.SubmitAndWait(cmdBuffer);
+
+    vkResetCommandBuffer(cmdBuffer, 0);
+    m_gpuTimer.Resolve();
+}
@@ -0,0 +1,378 @@
+#include "GenIBL.h"
+#include "vk_mem_alloc.h"
+#include "../../SharedLibrary/Utils/VulkanDbgUtils.h"
+#include "../../SharedLibrary/Utils/CmdBufUtils.h"
+#include "../../SharedLibrary/Utils/TraceUtils.h"
+
+// ================================================================================================================
+static uint32_t GetSH9ProjectGroupCntPerFace(
+    uint32_t faceDim)
+{
+    return (faceDim + SH9ProjectRowsPerGroup - 1) / SH9ProjectRowsPerGroup;
+}
+
+// ================================================================================================================
+SH9Rgb GenIBL::GenDiffuseIrradianceSH9()
+{
+    SharedLib::ScopedTraceTimer sh9Timer("GenDiffuseIrradianceSH9");
+    SH9Rgb radianceSH{};
+    if (m_sh9OnGpu)
+    {
+        radianceSH = ProjectInputCubemapToSH9OnGpu();
+    }
+    else
+    {
+        // The level 0 of the mip chain is the clamped input, so both paths project the same radiance.
+        radianceSH = ProjectCubemapToSH9(m_inputMipChain.GetLevelData(0), m_hdrCubeMapInfo.width, m_threadPool);
+    }
+
+    return RadianceSH9ToIrradianceSH9(radianceSH);
+}
+
+// ================================================================================================================
+// The SH9 is evaluated straight into the mapped staging memory, then the copy and the layout transitions go in one
+// submit.
+void GenIBL::GenDiffuseIrradianceCubemapFromSH9(
+    const SH9Rgb& irradianceSH)
+{
+    SharedLib::ScopedTraceTimer irradianceTimer("GenDiffuseIrradianceCubemapFromSH9");
+    uint32_t faceDim = m_hdrCubeMapInfo.width;
+    VkDeviceSize cubemapBytesCnt = sizeof(float) * 4 * 6 * uint64_t(faceDim) * faceDim;
+
+    VkBuffer stagingBuffer;
+    VmaAllocation stagingBufferAlloc;
+    CreateVmaVkBuffer(VMA_MEMORY_USAGE_AUTO,
+                      VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+                      VK_SHARING_MODE_EXCLUSIVE,
+                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                      cubemapBytesCnt,
+                      &stagingBuffer,
+                      &stagingBufferAlloc);
+
+    VmaAllocationInfo stagingBufferAllocInfo;
+    vmaGetAllocationInfo(*m_pAllocator, stagingBufferAlloc, &stagingBufferAllocInfo);
+
+    ReconstructSH9Cubemap(irradianceSH, faceDim, m_threadPool, static_cast<float*>(stagingBufferAllocInfo.pMappedData));
+    VK_CHECK(vmaFlushAllocation(*m_pAllocator, stagingBufferAlloc, 0, VK_WHOLE_SIZE));
+
+    VkCommandBuffer cmdBuffer = GetGfxCmdBuffer(0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    {
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    }
+    VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+    m_gpuTimer.CmdBeginPass(cmdBuffer, "Diffuse irradiance from SH9");
+
+    VkImageSubresourceRange cubemapSubResRange{};
+    {
+        cubemapSubResRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        cubemapSubResRange.baseMipLevel = 0;
+        cubemapSubResRange.levelCount = 1;
+        cubemapSubResRange.baseArrayLayer = 0;
+        cubemapSubResRange.layerCount = 6;
+    }
+
+    VkImageMemoryBarrier undefToDstBarrier{};
+    {
+        undefToDstBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        undefToDstBarrier.image = m_diffuseIrradianceCubemap;
+        undefToDstBarrier.subresourceRange = cubemapSubResRange;
+        undefToDstBarrier.srcAccessMask = 0;
+        undefToDstBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        undefToDstBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        undefToDstBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    }
+
+    vkCmdPipelineBarrier(cmdBuffer,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &undefToDstBarrier);
+
+    VkBufferImageCopy cubemapCopy{};
+    {
+        cubemapCopy.bufferOffset = 0;
+
+        cubemapCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        cubemapCopy.imageSubresource.mipLevel = 0;
+        cubemapCopy.imageSubresource.baseArrayLayer = 0;
+        cubemapCopy.imageSubresource.layerCount = 6;
+
+        cubemapCopy.imageExtent = { faceDim, faceDim, 1 };
+    }
+
+    vkCmdCopyBufferToImage(cmdBuffer,
+                           stagingBuffer,
+                           m_diffuseIrradianceCubemap,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           1, &cubemapCopy);
+
+    VkImageMemoryBarrier dstToColorAttBarrier{};
+    {
+        dstToColorAttBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        dstToColorAttBarrier.image = m_diffuseIrradianceCubemap;
+        dstToColorAttBarrier.subresourceRange = cubemapSubResRange;
+        dstToColorAttBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        dstToColorAttBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        dstToColorAttBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        dstToColorAttBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    }
+
+    vkCmdPipelineBarrier(cmdBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &dstToColorAttBarrier);
+
+    m_gpuTimer.CmdEndPass(cmdBuffer);
+    VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+
+    m_gfxTimeline.SubmitAndWait(cmdBuffer);
+
+    vkResetCommandBuffer(cmdBuffer, 0);
+    m_gpuTimer.Resolve();
+
+    vmaDestroyBuffer(*m_pAllocator, stagingBuffer, stagingBufferAlloc);
+}
+
+// ================================================================================================================
+void GenIBL::DestroySH9ProjectResources()
+{
+    vkDestroyShaderModule(m_device, m_sh9ProjectCsShaderModule, nullptr);
+    vkDestroyPipeline(m_device, m_sh9ProjectPipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_sh9ProjectPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_sh9ProjectDesSetLayout, nullptr);
+    DestroySH9ProjectInputObjects();
+}
+
+// ================================================================================================================
+void GenIBL::DestroySH9ProjectInputObjects()
+{
+    vkDestroyImageView(m_device, m_hdrCubeMapLevel0ArrayView, nullptr);
+    vmaDestroyBuffer(*m_pAllocator, m_sh9PartialSumsBuffer, m_sh9PartialSumsAlloc);
+}
+
+// ================================================================================================================
+// The set holds the input level 0 as a 2D array, so the shader can load the texels of a face by their coordinates,
+// and the host visible buffer that receives one partial sum per workgroup.
+void GenIBL::InitSH9ProjectDescriptorSet()
+{
+    VkDescriptorSetLayoutBinding inputFacesBinding{};
+    {
+        inputFacesBinding.binding = 0;
+        inputFacesBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        inputFacesBinding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        inputFacesBinding.descriptorCount = 1;
+    }
+
+    VkDescriptorSetLayoutBinding partialSumsBinding{};
+    {
+        partialSumsBinding.binding = 1;
+        partialSumsBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        partialSumsBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        partialSumsBinding.descriptorCount = 1;
+    }
+
+    VkDescriptorSetLayoutBinding desSetLayoutBindings[2] = { inputFacesBinding, partialSumsBinding };
+
+    VkDescriptorSetLayoutCreateInfo desSetLayoutInfo{};
+    {
+        desSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        desSetLayoutInfo.bindingCount = 2;
+        desSetLayoutInfo.pBindings = desSetLayoutBindings;
+    }
+
+    VK_CHECK(vkCreateDescriptorSetLayout(m_device,
+                                         &desSetLayoutInfo,
+                                         nullptr,
+                                         &m_sh9ProjectDesSetLayout));
+
+    AllocSH9ProjectDescriptorSet();
+}
+
+// ================================================================================================================
+// The view and the partial sums buffer are sized by the input, so they are recreated with the set for a new input size.
+void GenIBL::AllocSH9ProjectDescriptorSet()
+{
+    VkImageViewCreateInfo arrayViewInfo{};
+    {
+        arrayViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        arrayViewInfo.image = m_hdrCubeMapImage;
+        arrayViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+        arrayViewInfo.format = InputCubemapFormat;
+        arrayViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        arrayViewInfo.subresourceRange.baseMipLevel = 0;
+        arrayViewInfo.subresourceRange.levelCount = 1;
+        arrayViewInfo.subresourceRange.baseArrayLayer = 0;
+        arrayViewInfo.subresourceRange.layerCount = 6;
+    }
+    VK_CHECK(vkCreateImageView(m_device, &arrayViewInfo, nullptr, &m_hdrCubeMapLevel0ArrayView));
+
+    VkDeviceSize partialSumsBytesCnt = sizeof(float) * SH9PartialSumFloatsCnt * 6 *
+                                       GetSH9ProjectGroupCntPerFace(m_hdrCubeMapInfo.width);
+
+    CreateVmaVkBuffer(VMA_MEMORY_USAGE_AUTO,
+                      VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+                      VK_SHARING_MODE_EXCLUSIVE,
+                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                      partialSumsBytesCnt,
+                      &m_sh9PartialSumsBuffer,
+                      &m_sh9PartialSumsAlloc);
+
+    VkDescriptorSetAllocateInfo desSetAllocInfo{};
+    {
+        desSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        desSetAllocInfo.descriptorPool = m_descriptorPool;
+        desSetAllocInfo.pSetLayouts = &m_sh9ProjectDesSetLayout;
+        desSetAllocInfo.descriptorSetCount = 1;
+    }
+
+    VK_CHECK(vkAllocateDescriptorSets(m_device,
+                                      &desSetAllocInfo,
+                                      &m_sh9ProjectDesSet));
+
+    VkDescriptorImageInfo inputFacesImgInfo{};
+    {
+        inputFacesImgInfo.imageView = m_hdrCubeMapLevel0ArrayView;
+        inputFacesImgInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+    VkDescriptorBufferInfo partialSumsBufferInfo{};
+    {
+        partialSumsBufferInfo.buffer = m_sh9PartialSumsBuffer;
+        partialSumsBufferInfo.offset = 0;
+        partialSumsBufferInfo.range = partialSumsBytesCnt;
+    }
+
+    VkWriteDescriptorSet writeInputFacesDesSet{};
+    {
+        writeInputFacesDesSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeInputFacesDesSet.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        writeInputFacesDesSet.dstSet = m_sh9ProjectDesSet;
+        writeInputFacesDesSet.dstBinding = 0;
+        writeInputFacesDesSet.pImageInfo = &inputFacesImgInfo;
+        writeInputFacesDesSet.descriptorCount = 1;
+    }
+
+    VkWriteDescriptorSet writePartialSumsDesSet{};
+    {
+        writePartialSumsDesSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writePartialSumsDesSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writePartialSumsDesSet.dstSet = m_sh9ProjectDesSet;
+        writePartialSumsDesSet.dstBinding = 1;
+        writePartialSumsDesSet.pBufferInfo = &partialSumsBufferInfo;
+        writePartialSumsDesSet.descriptorCount = 1;
+    }
+
+    VkWriteDescriptorSet writeDesSets[2] = { writeInputFacesDesSet, writePartialSumsDesSet };
+    vkUpdateDescriptorSets(m_device, 2, writeDesSets, 0, NULL);
+}
+
+// ================================================================================================================
+void GenIBL::InitSH9ProjectShaderModule()
+{
+    m_sh9ProjectCsShaderModule = CreateShaderModule("/hlsl/sh9Project_comp.spv");
+}
+
+// ================================================================================================================
+void GenIBL::InitSH9ProjectPipelineLayout()
+{
+    VkPushConstantRange range{};
+    {
+        range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        range.offset = 0;
+        range.size = sizeof(uint32_t);
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    {
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_sh9ProjectDesSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &range;
+    }
+
+    VK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_sh9ProjectPipelineLayout));
+}
+
+// ================================================================================================================
+void GenIBL::InitSH9ProjectPipeline()
+{
+    VkComputePipelineCreateInfo pipelineInfo{};
+    {
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage = CreateDefaultShaderStgCreateInfo(m_sh9ProjectCsShaderModule, VK_SHADER_STAGE_COMPUTE_BIT);
+        pipelineInfo.layout = m_sh9ProjectPipelineLayout;
+    }
+
+    VK_CHECK(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_sh9ProjectPipeline));
+}
+
+// ================================================================================================================
+// One dispatch reduces the whole level 0 to a few thousands partial sums. Reading them back is a few hundreds KB at
+// most, and the host sums them up in the same order as the CPU path does.
+SH9Rgb GenIBL::ProjectInputCubemapToSH9OnGpu()
+{
+    uint32_t faceDim = m_hdrCubeMapInfo.width;
+    uint32_t groupCntPerFace = GetSH9ProjectGroupCntPerFace(faceDim);
+
+    VkCommandBuffer cmdBuffer = GetGfxCmdBuffer(0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    {
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    }
+    VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+    m_gpuTimer.CmdBeginPass(cmdBuffer, "SH9 projection");
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_sh9ProjectPipeline);
+
+    vkCmdBindDescriptorSets(cmdBuffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        m_sh9ProjectPipelineLayout,
+        0, 1, &m_sh9ProjectDesSet,
+        0, NULL);
+
+    vkCmdPushConstants(cmdBuffer,
+                       m_sh9ProjectPipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT,
+                       0, sizeof(uint32_t), &faceDim);
+
+    vkCmdDispatch(cmdBuffer, groupCntPerFace, 6, 1);
+
+    VkMemoryBarrier partialSumsToHostBarrier{};
+    {
+        partialSumsToHostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        partialSumsToHostBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        partialSumsToHostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    }
+
+    vkCmdPipelineBarrier(cmdBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        1, &partialSumsToHostBarrier,
+        0, nullptr,
+        0, nullptr);
+
+    m_gpuTimer.CmdEndPass(cmdBuffer);
+    VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+
+    m_gfxTimeline.SubmitAndWait(cmdBuffer);
+
+    vkResetCommandBuffer(cmdBuffer, 0);
+    m_gpuTimer.Resolve();
+
+    VK_CHECK(vmaInvalidateAllocation(*m_pAllocator, m_sh9PartialSumsAlloc, 0, VK_WHOLE_SIZE));
+
+    VmaAllocationInfo partialSumsAllocInfo;
+    vmaGetAllocationInfo(*m_pAllocator, m_sh9PartialSumsAlloc, &partialSumsAllocInfo);
+
+    return ReduceSH9PartialSums(static_cast<const float*>(partialSumsAllocInfo.pMappedData), 6 * groupCntPerFace);
+}
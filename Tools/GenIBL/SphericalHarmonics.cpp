@@ -0,0 +1,223 @@
+#include <cmath>
+#include "SphericalHarmonics.h"
+#include "GenIBLConsts.h"
+#include "../../SharedLibrary/Utils/ThreadUtils.h"
+#include "../../SharedLibrary/Utils/MathUtils.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// Rows of a band processed by one task.
+static constexpr uint32_t RowsPerBand = 32;
+
+// ================================================================================================================
+void EvalSH9Basis(
+    const float* pDir,
+    float*       pBasis)
+{
+    float x = pDir[0];
+    float y = pDir[1];
+    float z = pDir[2];
+
+    pBasis[0] = 0.282095f;
+    pBasis[1] = 0.488603f * y;
+    pBasis[2] = 0.488603f * z;
+    pBasis[3] = 0.488603f * x;
+    pBasis[4] = 1.092548f * x * y;
+    pBasis[5] = 1.092548f * y * z;
+    pBasis[6] = 0.315392f * (3.f * z * z - 1.f);
+    pBasis[7] = 1.092548f * x * z;
+    pBasis[8] = 0.546274f * (x * x - y * y);
+}
+
+// ================================================================================================================
+SH9Rgb ProjectCubemapToSH9(
+    const float*           pRgbaCubemap,
+    uint32_t               faceDim,
+    SharedLib::ThreadPool& threadPool)
+{
+    uint32_t bandsPerFace = (faceDim + RowsPerBand - 1) / RowsPerBand;
+    uint32_t taskCnt = 6 * bandsPerFace;
+
+    std::vector<float> partialSums(uint64_t(taskCnt) * SH9PartialSumFloatsCnt, 0.f);
+
+    threadPool.ParallelFor(taskCnt, [&](uint32_t taskIdx)
+    {
+        uint32_t face = taskIdx / bandsPerFace;
+        uint32_t band = taskIdx % bandsPerFace;
+        uint32_t rowBegin = band * RowsPerBand;
+        uint32_t rowEnd = std::min(rowBegin + RowsPerBand, faceDim);
+
+        const float* pFace = pRgbaCubemap + uint64_t(4) * face * faceDim * faceDim;
+
+        // Accumulate in double. A 2k face has millions of texels that are added to the same 28 sums.
+        double sums[SH9PartialSumFloatsCnt] = {};
+        for (uint32_t row = rowBegin; row < rowEnd; row++)
+        {
+            for (uint32_t col = 0; col < faceDim; col++)
+            {
+                float dir[3];
+                SharedLib::CubemapTexelDir(face, (float(col) + 0.5f) / float(faceDim), (float(row) + 0.5f) / float(faceDim), dir);
+                SharedLib::NormalizeVec(dir, 3);
+
+                float basis[SH9CoeffsCnt];
+                EvalSH9Basis(dir, basis);
+
+                float solidAngle = SharedLib::CubemapTexelSolidAngle(col, row, faceDim);
+                const float* pTexel = pFace + uint64_t(4) * (uint64_t(row) * faceDim + col);
+
+                for (uint32_t i = 0; i < SH9CoeffsCnt; i++)
+                {
+                    float weight = basis[i] * solidAngle;
+                    sums[3 * i]     += pTexel[0] * weight;
+                    sums[3 * i + 1] += pTexel[1] * weight;
+                    sums[3 * i + 2] += pTexel[2] * weight;
+                }
+                sums[3 * SH9CoeffsCnt] += solidAngle;
+            }
+        }
+
+        float* pPartialSum = &partialSums[uint64_t(taskIdx) * SH9PartialSumFloatsCnt];
+        for (uint32_t i = 0; i < SH9PartialSumFloatsCnt; i++)
+        {
+            pPartialSum[i] = (float)sums[i];
+        }
+    });
+
+    return ReduceSH9PartialSums(partialSums.data(), taskCnt);
+}
+
+// ================================================================================================================
+SH9Rgb ReduceSH9PartialSums(
+    const float* pPartialSums,
+    uint32_t     partialSumsCnt)
+{
+    double sums[SH9PartialSumFloatsCnt] = {};
+    for (uint32_t i = 0; i < partialSumsCnt; i++)
+    {
+        const float* pPartialSum = pPartialSums + uint64_t(i) * SH9PartialSumFloatsCnt;
+        for (uint32_t j = 0; j < SH9PartialSumFloatsCnt; j++)
+        {
+            sums[j] += pPartialSum[j];
+        }
+    }
+
+    double solidAngleScale = 4.0 * M_PI / sums[3 * SH9CoeffsCnt];
+
+    SH9Rgb sh{};
+    for (uint32_t i = 0; i < SH9CoeffsCnt; i++)
+    {
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            sh.coeffs[i][c] = float(sums[3 * i + c] * solidAngleScale);
+        }
+    }
+    return sh;
+}
+
+// ================================================================================================================
+// Ramamoorthi and Hanrahan -- An Efficient Representation for Irradiance Environment Maps.
+// The cosine lobe band factors are A0 = PI, A1 = 2PI/3 and A2 = PI/4. The diffuse irradiance cubemap stores E / PI.
+SH9Rgb RadianceSH9ToIrradianceSH9(
+    const SH9Rgb& radianceSH)
+{
+    constexpr float BandFactors[SH9CoeffsCnt] = { 1.f,
+                                                  2.f / 3.f, 2.f / 3.f, 2.f / 3.f,
+                                                  0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+
+    SH9Rgb irradianceSH{};
+    for (uint32_t i = 0; i < SH9CoeffsCnt; i++)
+    {
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            irradianceSH.coeffs[i][c] = radianceSH.coeffs[i][c] * BandFactors[i];
+        }
+    }
+    return irradianceSH;
+}
+
+// ================================================================================================================
+void ReconstructSH9Cubemap(
+    const SH9Rgb&          sh,
+    uint32_t               faceDim,
+    SharedLib::ThreadPool& threadPool,
+    float*                 pRgbaCubemap)
+{
+    uint32_t bandsPerFace = (faceDim + RowsPerBand - 1) / RowsPerBand;
+
+    threadPool.ParallelFor(6 * bandsPerFace, [&](uint32_t taskIdx)
+    {
+        uint32_t face = taskIdx / bandsPerFace;
+        uint32_t band = taskIdx % bandsPerFace;
+        uint32_t rowBegin = band * RowsPerBand;
+        uint32_t rowEnd = std::min(rowBegin + RowsPerBand, faceDim);
+
+        const float* pView = &CubemapFaceViews[4 * face];
+        const float* pRight = &CubemapFaceRights[4 * face];
+        const float* pUp = &CubemapFaceUps[4 * face];
+
+        float* pFace = pRgbaCubemap + uint64_t(4) * face * faceDim * faceDim;
+
+        for (uint32_t row = rowBegin; row < rowEnd; row++)
+        {
+            float y = ((float(row) + 0.5f) / float(faceDim)) * 2.f - 1.f;
+            for (uint32_t col = 0; col < faceDim; col++)
+            {
+                float x = ((float(col) + 0.5f) / float(faceDim)) * 2.f - 1.f;
+
+                float dir[3];
+                for (uint32_t i = 0; i < 3; i++)
+                {
+                    dir[i] = pView[i] + x * pRight[i] - y * pUp[i];
+                }
+                SharedLib::NormalizeVec(dir, 3);
+
+                float basis[SH9CoeffsCnt];
+                EvalSH9Basis(dir, basis);
+
+                float* pTexel = pFace + uint64_t(4) * (uint64_t(row) * faceDim + col);
+                for (uint32_t c = 0; c < 3; c++)
+                {
+                    float val = 0.f;
+                    for (uint32_t i = 0; i < SH9CoeffsCnt; i++)
+                    {
+                        val += sh.coeffs[i][c] * basis[i];
+                    }
+                    // The order 2 reconstruction can ring below zero around very bright spots.
+                    pTexel[c] = std::max(val, 0.f);
+                }
+                pTexel[3] = 1.f;
+            }
+        }
+    });
+}
+
+// ================================================================================================================
+bool SaveSH9(
+    const std::string& namePath,
+    const SH9Rgb&      sh)
+{
+    std::ofstream shFile(namePath);
+    if (shFile.is_open() == false)
+    {
+        std::cerr << "Cannot open the SH9 output file: " << namePath << std::endl;
+        return false;
+    }
+
+    shFile << "# Diffuse irradiance SH9 (RGB). E(n) / PI = sum(coeff_i * Y_i(n)).\n";
+    shFile << "# Order: Y00, Y1-1, Y10, Y11, Y2-2, Y2-1, Y20, Y21, Y22.\n";
+    shFile.precision(9);
+    for (uint32_t i = 0; i < SH9CoeffsCnt; i++)
+    {
+        shFile << sh.coeffs[i][0] << " " << sh.coeffs[i][1] << " " << sh.coeffs[i][2] << "\n";
+    }
+
+    shFile.close();
+    if (shFile.fail())
+    {
+        std::cerr << "Cannot write the SH9 output file: " << namePath << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace SharedLib
+{
+    class ThreadPool;
+}
+
+constexpr uint32_t SH9CoeffsCnt = 9;
+
+// A partial sum of the projection is 27 weighted radiance sums followed by the solid angle sum. The CPU tasks and the
+// sh9Project_comp.hlsl workgroups produce the same layout, so they share one final reduction.
+constexpr uint32_t SH9PartialSumFloatsCnt = 3 * SH9CoeffsCnt + 1;
+
+// 9 RGB coefficients of the order 2 real spherical harmonics.
+// The order is: Y00, Y1-1, Y10, Y11, Y2-2, Y2-1, Y20, Y21, Y22.
+struct SH9Rgb
+{
+    float coeffs[SH9CoeffsCnt][3];
+};
+
+// pDir has to be normalized.
+void EvalSH9Basis(const float* pDir, float* pBasis);
+
+// Projects a RGBA32F vStrip cubemap in the Vulkan face convention to the radiance SH9.
+// The faces are split into row bands among the thread pool and the partial sums are reduced in a fixed order, so the
+// result doesn't depend on the thread count.
+SH9Rgb ProjectCubemapToSH9(const float* pRgbaCubemap, uint32_t faceDim, SharedLib::ThreadPool& threadPool);
+
+// Sums the partial sums in order and rescales the result so that the solid angles sum up to 4 PI exactly.
+SH9Rgb ReduceSH9PartialSums(const float* pPartialSums, uint32_t partialSumsCnt);
+
+// Convolves the radiance with the clamped cosine lobe and divides it by PI, so evaluating the result at a normal gives
+// the same value as the diffuse irradiance cubemap at that normal.
+SH9Rgb RadianceSH9ToIrradianceSH9(const SH9Rgb& radianceSH);
+
+// Evaluates the SH9 at every texel of a RGBA32F vStrip cubemap. The faces use the GenIBL output face basis, so the
+// result can replace the rendered diffuse irradiance cubemap.
+void ReconstructSH9Cubemap(const SH9Rgb& sh, uint32_t faceDim, SharedLib::ThreadPool& threadPool, float* pRgbaCubemap);
+
+// A text file with one 'r g b' line per coefficient.
+bool SaveSH9(const std::string& namePath, const SH9Rgb& sh);
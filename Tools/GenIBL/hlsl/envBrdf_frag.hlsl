@@ -4,6 +4,7 @@
 struct PushConstant
 {
     float2 viewportWidthHeight;
+    uint   sampleCount;
 };
 
 [[vk::push_constant]] const PushConstant i_pushConstant;
@@ -31,7 +32,7 @@ float4 main(
 
     float3 N = float3(0.0, 0.0, 1.0);
 
-    const uint SAMPLE_COUNT = 1024u;
+    const uint SAMPLE_COUNT = i_pushConstant.sampleCount;
 
     for(uint i = 0u; i < SAMPLE_COUNT; ++i)
     {
@@ -0,0 +1,63 @@
+// Reprojects an equirectangular input to the 6 faces of the input cubemap level 0. It's the in memory version of the
+// SphericalToCubemap, so the faces are in the Vulkan order (X+, X-, Y+, Y-, Z+, Z-) and the same as its vStrip output.
+// The SV_DispatchThreadID.z is the face id.
+// - o_cubeMapFaces gets the radiance clamped for the bake, like the DecodeCubemap(...) clamps a vStrip input.
+// - o_background gets the full radiance, which is the background cubemap output.
+#define WORKGROUP_DIM 8 // Same as the EquirectWorkgroupDim in the GenIBL.h.
+#define PI 3.1415926535897932384626433832795
+
+struct PushConstant
+{
+    uint  faceDim;
+    float radianceClamp;
+};
+
+Texture2D<float4> i_equirectTexture : register(t0);
+SamplerState samplerState : register(s0);
+
+[[vk::binding(1, 0)]] RWTexture2DArray<float4> o_cubeMapFaces;
+[[vk::binding(2, 0)]] RWStructuredBuffer<float4> o_background;
+
+[[vk::push_constant]] const PushConstant i_pushConstant;
+
+// The Vulkan cube face convention, which is what the TextureCube sampling of the input cubemap uses.
+float3 CubemapTexelDir(uint face, float2 uv)
+{
+    float sc = 2.0 * uv.x - 1.0;
+    float tc = 2.0 * uv.y - 1.0;
+
+    switch (face)
+    {
+    case 0:  return float3(1.0, -tc, -sc);
+    case 1:  return float3(-1.0, -tc, sc);
+    case 2:  return float3(sc, 1.0, tc);
+    case 3:  return float3(sc, -1.0, -tc);
+    case 4:  return float3(sc, -tc, 1.0);
+    default: return float3(-sc, -tc, -1.0);
+    }
+}
+
+[numthreads(WORKGROUP_DIM, WORKGROUP_DIM, 1)]
+void main(
+    uint3 dispatchThreadId : SV_DispatchThreadID)
+{
+    uint faceDim = i_pushConstant.faceDim;
+    if ((dispatchThreadId.x >= faceDim) || (dispatchThreadId.y >= faceDim))
+    {
+        return;
+    }
+
+    uint face = dispatchThreadId.z;
+    float3 dir = CubemapTexelDir(face, (float2(dispatchThreadId.xy) + 0.5) / float(faceDim));
+
+    // The longitude starts at the -X and the latitude goes down the rows, as in the ToCubeMap.frag of the
+    // SphericalToCubemap.
+    float lon = atan2(dir.z, dir.x);
+    float lat = atan2(dir.y, sqrt(dir.x * dir.x + dir.z * dir.z));
+    float2 uv = float2((lon + PI) / (2.0 * PI), 0.5 - lat / PI);
+
+    float3 radiance = i_equirectTexture.SampleLevel(samplerState, uv, 0.0).rgb;
+
+    o_cubeMapFaces[dispatchThreadId] = float4(min(radiance, i_pushConstant.radianceClamp), 1.0);
+    o_background[(face * faceDim + dispatchThreadId.y) * faceDim + dispatchThreadId.x] = float4(radiance, 1.0);
+}
@@ -0,0 +1,100 @@
+#include <GGXModel.hlsl>
+#include <hammersley.hlsl>
+#include "prefilterSampling.hlsl"
+
+// The compute version of the prefilterEnvMap_frag.hlsl.
+// One dispatch fills all 6 faces of one roughness mip: The SV_DispatchThreadID.z is the face/view id.
+// The workgroup dim and the sampling method are specialization constants, so the app can tune them without recompiling.
+[[vk::constant_id(0)]] const uint WORKGROUP_DIM = 8;
+[[vk::constant_id(1)]] const bool FILTERED_IMPORTANCE_SAMPLING = false;
+
+// Same layout as the UBO of the prefilterEnvMap_frag.hlsl. Only the face basis and the near plane are used here. The
+// roughness and the viewport size come from the push constant, so the UBO doesn't change between mips.
+struct CameraInfoUbo
+{
+    float3 view[6];
+    float3 right[6];
+    float3 up[6];
+    float  near;
+    float roughness;
+    float2 nearWidthHeight;
+    float2 viewportWidthHeight;
+};
+
+struct PushConstant
+{
+    float roughness;
+    uint  mipDim;
+    float sampleLod; // log2(inputDim / mipDim), which is what the fragment shader version gets from the derivatives.
+    uint  sampleCount; // The sample budget of the current roughness.
+};
+
+TextureCube i_cubeMapTexture : register(t0);
+SamplerState samplerState : register(s0);
+
+cbuffer UBO0 : register(b1) { CameraInfoUbo i_cameraInfo; }
+
+[[vk::binding(0, 1)]] RWTexture2DArray<float4> o_prefilterEnvMapMip;
+
+[[vk::push_constant]] const PushConstant i_pushConstant;
+
+[numthreads(WORKGROUP_DIM, WORKGROUP_DIM, 1)]
+void main(
+    uint3 dispatchThreadId : SV_DispatchThreadID)
+{
+    uint mipDim = i_pushConstant.mipDim;
+    if ((dispatchThreadId.x >= mipDim) || (dispatchThreadId.y >= mipDim))
+    {
+        return;
+    }
+
+    uint viewId = dispatchThreadId.z;
+
+    // Map the texel center to [-1.f, 1.f]. It's the same as the fragCoord in the fragment shader version.
+    float x = (((float(dispatchThreadId.x) + 0.5f) / float(mipDim)) * 2.f) - 1.f;
+    float y = (((float(dispatchThreadId.y) + 0.5f) / float(mipDim)) * 2.f) - 1.f;
+
+    float nearWorldWidth = i_cameraInfo.nearWidthHeight[0];
+    float nearWorldHeight = i_cameraInfo.nearWidthHeight[1];
+
+    float3 curRight = i_cameraInfo.right[viewId];
+    float3 curView  = i_cameraInfo.view[viewId];
+    float3 curUp    = i_cameraInfo.up[viewId];
+
+    float3 normalDir = x * (nearWorldWidth / 2.f) * curRight +
+                       (-y) * (nearWorldHeight / 2.f) * curUp +
+                       curView * i_cameraInfo.near;
+
+    float3 N = normalize(normalDir);
+    float3 R = N;
+    float3 V = R;
+
+    const uint SAMPLE_COUNT = i_pushConstant.sampleCount;
+
+    if (FILTERED_IMPORTANCE_SAMPLING)
+    {
+        float3 fisColor = PrefilterFilteredImportanceSampling(i_cubeMapTexture, samplerState, N, i_pushConstant.roughness, SAMPLE_COUNT);
+        o_prefilterEnvMapMip[dispatchThreadId] = float4(fisColor, 1.f);
+        return;
+    }
+
+    float totalWeight = 0.0;
+    float3 prefilteredColor = float3(0.f, 0.f, 0.f);
+
+    for(uint i = 0u; i < SAMPLE_COUNT; ++i)
+    {
+        float2 Xi = Hammersley(i, SAMPLE_COUNT);
+        float3 H  = ImportanceSampleGGX(Xi, N, i_pushConstant.roughness);
+        float3 L  = normalize(2.0 * dot(V, H) * H - V);
+        float NdotL = max(dot(N, L), 0.0);
+        if(NdotL > 0.0)
+        {
+            // There are no screen space derivatives in the compute shader, so the lod has to be explicit.
+            prefilteredColor += i_cubeMapTexture.SampleLevel(samplerState, L, i_pushConstant.sampleLod).rgb * NdotL;
+            totalWeight      += NdotL;
+        }
+    }
+    prefilteredColor = prefilteredColor / totalWeight;
+
+    o_prefilterEnvMapMip[dispatchThreadId] = float4(prefilteredColor, 1.f);
+}
@@ -1,5 +1,8 @@
 #include <GGXModel.hlsl>
 #include <hammersley.hlsl>
+#include "prefilterSampling.hlsl"
+
+[[vk::constant_id(0)]] const bool FILTERED_IMPORTANCE_SAMPLING = false;
 
 // We assume the 2x2x2 box in the world space with camera at the center.
 // So, the near distance is always 1.
@@ -15,6 +18,7 @@ struct CameraInfoUbo
     float roughness;
     float2 nearWidthHeight; // Near plane's width and height in the world.
     float2 viewportWidthHeight; // Screen width and height in the unit of pixels.
+    uint   sampleCount; // The sample budget of the current roughness.
 };
 
 TextureCube i_cubeMapTexture : register(t0);
@@ -54,9 +58,13 @@ float4 main(
     float3 R = N;
     float3 V = R;
 
-    float3 irradiance = float3(0.f, 0.f, 0.f);
+    const uint SAMPLE_COUNT = i_cameraInfo.sampleCount;
+
+    if (FILTERED_IMPORTANCE_SAMPLING)
+    {
+        return float4(PrefilterFilteredImportanceSampling(i_cubeMapTexture, samplerState, N, i_cameraInfo.roughness, SAMPLE_COUNT), 1.f);
+    }
 
-    const uint SAMPLE_COUNT = 1024u;
     float totalWeight = 0.0;   
     float3 prefilteredColor = float3(0.f, 0.f, 0.f); 
 
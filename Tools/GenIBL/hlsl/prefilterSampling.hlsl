@@ -0,0 +1,69 @@
+// Shared by the prefilterEnvMap_frag.hlsl and the prefilterEnvMap_comp.hlsl.
+// The GGXModel.hlsl and the hammersley.hlsl have to be included before this file.
+
+// Same 'a' as the ImportanceSampleGGX(...), so the pdf matches the samples that it generates.
+float DistributionGGX(float NdotH, float roughness)
+{
+    const float PI = 3.14159265359;
+
+    float a = roughness*roughness + 0.001;
+    float a2 = a * a;
+    float denom = NdotH * NdotH * (a2 - 1.0) + 1.0;
+
+    return a2 / (PI * denom * denom);
+}
+
+// Filtered importance sampling -- GPU Gems 3, Chapter 20.
+// Each GGX sample reads the input cubemap mip whose texel solid angle matches the solid angle that the sample covers.
+// A low pdf sample stands for a large part of the lobe, so it reads a blurrier mip. That removes the aliasing that the
+// base level sampling needs a lot of samples to average out, so a few dozens samples give the same noise level.
+float3 PrefilterFilteredImportanceSampling(
+    TextureCube  envMap,
+    SamplerState envSampler,
+    float3       N,
+    float        roughness,
+    uint         sampleCount)
+{
+    const float PI = 3.14159265359;
+
+    // A mirror lobe has only one direction.
+    if (roughness == 0.0)
+    {
+        return envMap.SampleLevel(envSampler, N, 0).rgb;
+    }
+
+    uint faceWidth, faceHeight, levelCnt;
+    envMap.GetDimensions(0, faceWidth, faceHeight, levelCnt);
+
+    float saTexel = 4.0 * PI / (6.0 * float(faceWidth) * float(faceWidth));
+    float maxLod = float(levelCnt - 1);
+
+    // N = V = R, so the VdotH and the NdotH are the same and the pdf reduces to D / 4.
+    float3 V = N;
+
+    float totalWeight = 0.0;
+    float3 prefilteredColor = float3(0.f, 0.f, 0.f);
+
+    for(uint i = 0u; i < sampleCount; ++i)
+    {
+        float2 Xi = Hammersley(i, sampleCount);
+        float3 H  = ImportanceSampleGGX(Xi, N, roughness);
+        float3 L  = normalize(2.0 * dot(V, H) * H - V);
+        float NdotL = max(dot(N, L), 0.0);
+        if(NdotL > 0.0)
+        {
+            float NdotH = saturate(dot(N, H));
+            float pdf = DistributionGGX(NdotH, roughness) / 4.0;
+
+            float saSample = 1.0 / (float(sampleCount) * pdf + 0.0001);
+
+            // The +1 bias trades a bit of sharpness for less noise. It's what the original method uses.
+            float lod = clamp(0.5 * log2(saSample / saTexel) + 1.0, 0.0, maxLod);
+
+            prefilteredColor += envMap.SampleLevel(envSampler, L, lod).rgb * NdotL;
+            totalWeight      += NdotL;
+        }
+    }
+
+    return prefilteredColor / totalWeight;
+}
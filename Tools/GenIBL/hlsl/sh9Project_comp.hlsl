@@ -0,0 +1,124 @@
+// Projects the input cubemap level 0 to the radiance SH9. It's the GPU version of the ProjectCubemapToSH9(...).
+// One workgroup reduces SH9_ROWS_PER_GROUP rows of a face to one partial sum: 27 weighted radiance sums followed by the
+// solid angle sum. The SV_GroupID.y is the face id. The host sums the partial sums up with the ReduceSH9PartialSums(...).
+#define SH9_THREADS_PER_GROUP 64
+#define SH9_ROWS_PER_GROUP 8 // Same as the SH9ProjectRowsPerGroup in the GenIBL.h.
+#define SH9_PARTIAL_SUM_FLOATS 28
+
+struct PushConstant
+{
+    uint faceDim;
+};
+
+[[vk::binding(0, 0)]] Texture2DArray<float4> i_cubeMapFaces;
+[[vk::binding(1, 0)]] RWStructuredBuffer<float> o_partialSums;
+
+[[vk::push_constant]] const PushConstant i_pushConstant;
+
+groupshared float gs_sums[SH9_THREADS_PER_GROUP][SH9_PARTIAL_SUM_FLOATS];
+
+// The Vulkan cube face convention, which is what the TextureCube sampling of the input cubemap uses.
+float3 CubemapTexelDir(uint face, float2 uv)
+{
+    float sc = 2.0 * uv.x - 1.0;
+    float tc = 2.0 * uv.y - 1.0;
+
+    switch (face)
+    {
+    case 0:  return float3(1.0, -tc, -sc);
+    case 1:  return float3(-1.0, -tc, sc);
+    case 2:  return float3(sc, 1.0, tc);
+    case 3:  return float3(sc, -1.0, -tc);
+    case 4:  return float3(sc, -tc, 1.0);
+    default: return float3(-sc, -tc, -1.0);
+    }
+}
+
+float CubemapAreaElement(float x, float y)
+{
+    return atan2(x * y, sqrt(x * x + y * y + 1.0));
+}
+
+float CubemapTexelSolidAngle(uint2 texel, uint faceDim)
+{
+    float invDim = 1.0 / float(faceDim);
+
+    float x0 = 2.0 * float(texel.x) * invDim - 1.0;
+    float y0 = 2.0 * float(texel.y) * invDim - 1.0;
+    float x1 = x0 + 2.0 * invDim;
+    float y1 = y0 + 2.0 * invDim;
+
+    return CubemapAreaElement(x0, y0) - CubemapAreaElement(x0, y1) - CubemapAreaElement(x1, y0) + CubemapAreaElement(x1, y1);
+}
+
+[numthreads(SH9_THREADS_PER_GROUP, 1, 1)]
+void main(
+    uint3 groupId : SV_GroupID,
+    uint  threadIdx : SV_GroupIndex)
+{
+    uint faceDim = i_pushConstant.faceDim;
+    uint face = groupId.y;
+    uint rowBegin = groupId.x * SH9_ROWS_PER_GROUP;
+    uint rowEnd = min(rowBegin + SH9_ROWS_PER_GROUP, faceDim);
+
+    float sums[SH9_PARTIAL_SUM_FLOATS];
+    for (uint i = 0; i < SH9_PARTIAL_SUM_FLOATS; i++)
+    {
+        sums[i] = 0.0;
+    }
+
+    // The threads stride along the rows, so the neighbour threads read the neighbour texels.
+    uint texelCnt = (rowEnd - rowBegin) * faceDim;
+    for (uint texelIdx = threadIdx; texelIdx < texelCnt; texelIdx += SH9_THREADS_PER_GROUP)
+    {
+        uint2 texel = uint2(texelIdx % faceDim, rowBegin + texelIdx / faceDim);
+
+        float3 dir = normalize(CubemapTexelDir(face, (float2(texel) + 0.5) / float(faceDim)));
+        float solidAngle = CubemapTexelSolidAngle(texel, faceDim);
+        float3 radiance = i_cubeMapFaces.Load(int4(texel, face, 0)).rgb * solidAngle;
+
+        float basis[9];
+        basis[0] = 0.282095;
+        basis[1] = 0.488603 * dir.y;
+        basis[2] = 0.488603 * dir.z;
+        basis[3] = 0.488603 * dir.x;
+        basis[4] = 1.092548 * dir.x * dir.y;
+        basis[5] = 1.092548 * dir.y * dir.z;
+        basis[6] = 0.315392 * (3.0 * dir.z * dir.z - 1.0);
+        basis[7] = 1.092548 * dir.x * dir.z;
+        basis[8] = 0.546274 * (dir.x * dir.x - dir.y * dir.y);
+
+        for (uint i = 0; i < 9; i++)
+        {
+            sums[3 * i]     += radiance.r * basis[i];
+            sums[3 * i + 1] += radiance.g * basis[i];
+            sums[3 * i + 2] += radiance.b * basis[i];
+        }
+        sums[27] += solidAngle;
+    }
+
+    for (uint i = 0; i < SH9_PARTIAL_SUM_FLOATS; i++)
+    {
+        gs_sums[threadIdx][i] = sums[i];
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    // Tree reduction in the shared memory.
+    for (uint stride = SH9_THREADS_PER_GROUP / 2; stride > 0; stride /= 2)
+    {
+        if (threadIdx < stride)
+        {
+            for (uint i = 0; i < SH9_PARTIAL_SUM_FLOATS; i++)
+            {
+                gs_sums[threadIdx][i] += gs_sums[threadIdx + stride][i];
+            }
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    if (threadIdx < SH9_PARTIAL_SUM_FLOATS)
+    {
+        uint groupIdx = face * ((faceDim + SH9_ROWS_PER_GROUP - 1) / SH9_ROWS_PER_GROUP) + groupId.x;
+        o_partialSums[groupIdx * SH9_PARTIAL_SUM_FLOATS + threadIdx] = gs_sums[0][threadIdx];
+    }
+}
@@ -1,17 +1,31 @@
+// The GenIBLCpu target builds this file with the GENIBL_CPU_ONLY. It only has the cpu backend, so it needs neither the
+// Vulkan SDK nor the RenderDoc.
+#ifndef GENIBL_CPU_ONLY
 #include "vk_mem_alloc.h"
+#include "GenIBL.h"
+#include "renderdoc_app.h"
+#include <Windows.h>
+constexpr bool HasGpuBackend = true;
+#else
+constexpr bool HasGpuBackend = false;
+#endif
+
 #include "args.hxx"
 
-#include "GenIBL.h"
-#include "../../SharedLibrary/Utils/CmdBufUtils.h"
-#include "../../SharedLibrary/Utils/VulkanDbgUtils.h"
+#include "GenIBLBatch.h"
+#include "GenIBLCpu.h"
 #include "../../SharedLibrary/Utils/StrPathUtils.h"
-#include "../../SharedLibrary/Utils/AppUtils.h"
 #include "../../SharedLibrary/Utils/DiskOpsUtils.h"
+#include "../../SharedLibrary/Utils/BakeCacheUtils.h"
+#include "../../SharedLibrary/Utils/TraceUtils.h"
+#include "../../SharedLibrary/Utils/ThreadUtils.h"
 
-#include "renderdoc_app.h"
-#include <Windows.h>
 #include <cassert>
+#include <cstdlib>
 #include <filesystem>
+#include <chrono>
+#include <future>
+#include <iostream>
 
 // Adjustable Parameters:
 // * The input HDRI color clamp.
@@ -22,12 +36,33 @@ int main(
     char** argv)
 {
     args::ArgumentParser parser("This tool takes a cubemap as input and output its image based lighting data.",
-        "E.g. GenIBL.exe --srcPath ./img.hdr --dstPath ./iblOutput");
+        "E.g. GenIBL.exe --srcPath ./img.hdr --dstPath ./iblOutput or GenIBL.exe --srcDir ./hdris --dstPath ./iblOutputs");
     args::HelpFlag help(parser, "help", "Display this help menu", { 'h', "help" });
     args::CompletionFlag completion(parser, { "complete" });
 
     args::ValueFlag<std::string> inputPath(parser, "", "The input cubemap image.", { 'i', "srcPath" });
+    args::ValueFlag<std::string> inputDir(parser, "", "A folder of input cubemaps (*.hdr) baked in one run. The outputs of each go to <dstPath>/<input file name without extension>.", { "srcDir" });
     args::ValueFlag<std::string> outputPath(parser, "", "The output image based lighting data output folder.", { 'o', "dstPath" });
+    args::ValueFlag<std::string> backend(parser, "", "The backend generating the IBL data: 'gpu' (Default) or 'cpu'. The cpu backend needs no graphics device and ignores the --mipGen, --prefilter and --shGpu. The GenIBLCpu build only has the cpu backend, which is its default.", { "backend" });
+    args::Flag equirect(parser, "", "The inputs are 2:1 equirectangular images instead of vStrip cubemaps. They are reprojected to the input cubemap on the GPU, like the SphericalToCubemap does, and the cubemap never goes to a file unless the hdr outputs have the background_cubemap.hdr. Implies the --mipGen gpu and the --shGpu, and needs the gpu backend.", { "equirect" });
+    args::ValueFlag<std::string> mipGenMode(parser, "", "Where the input cubemap mipmaps are generated: 'cpu' (Default) or 'gpu'.", { "mipGen" });
+    args::ValueFlag<std::string> prefilterMode(parser, "", "How the prefilter environment map is generated: 'compute' (Default) or 'graphics'.", { "prefilter" });
+    args::Flag prefilterFis(parser, "", "Prefilter with the filtered importance sampling and the per roughness sample budget.", { "prefilterFis" });
+    args::ValueFlag<std::string> irradianceMode(parser, "", "How the diffuse irradiance is generated: 'conv' (Default) or 'sh9'.", { "irradiance" });
+    args::Flag sh9OnGpu(parser, "", "Project the input cubemap to the SH9 on the GPU instead of the CPU.", { "shGpu" });
+    args::Flag sh9Cubemap(parser, "", "Also output the diffuse irradiance cubemap reconstructed from the SH9.", { "shCubemap" });
+    args::ValueFlag<uint32_t> envBrdfDim(parser, "", "The env brdf LUT width and height. 1024 by default.", { "envBrdfDim" });
+    args::ValueFlag<uint32_t> envBrdfSamples(parser, "", "The GGX samples per env brdf LUT texel. 1024 by default.", { "envBrdfSamples" });
+    args::ValueFlag<std::string> envBrdfFormat(parser, "", "The envBrdf.bin texel format: 'rg16f' (Default) or 'rg32f'.", { "envBrdfFormat" });
+    args::Flag envBrdfHdr(parser, "", "Also output the env brdf LUT as the envBrdf.hdr to view it.", { "envBrdfHdr" });
+    args::ValueFlag<std::string> outputFormat(parser, "", "The cubemap output files: 'hdr' (One vStrip file per cubemap and prefilter mip), 'ktx2' (One KTX2 file per cubemap with all its mips) or 'both' (Default).", { "outputFormat" });
+    args::Flag octahedral(parser, "", "Also output the prefilter env map as octahedral 2D maps: prefilterEnvMapOct.ktx2 and prefilterEnvMapsOct/, which the PBR IBL samples prefer to the cubemap.", { "octahedral" });
+    args::ValueFlag<std::string> ktx2Format(parser, "", "The texel format of the KTX2 outputs: 'rgba16f' (Default) or 'rgba32f'.", { "ktx2Format" });
+    args::ValueFlag<std::string> cacheDir(parser, "", "The cache folder of the env brdf LUT and the bake cache. The system temp folder by default.", { "cacheDir" });
+    args::ValueFlag<uint32_t> streamBudgetMB(parser, "", "Decode the .hdr inputs in row bands of at most this many MB and upload the input mip chain through a staging ring of the same size, instead of uploading it as a whole. 0 by default, which uploads it as a whole with 8 MB decode bands.", { "streamBudgetMB" });
+    args::ValueFlag<std::string> tracePath(parser, "", "Write a Chrome tracing JSON of the run to this file: the CPU stages, the GPU passes and the uploaded, read back and disk bytes. Open it in chrome://tracing or ui.perfetto.dev.", { "trace" });
+    args::ValueFlag<std::string> device(parser, "", "The Vulkan device: an index of the printed device list, 'cpu' for a CPU implementation like the lavapipe, or a part of the device name. The VULKAN_DICT_DEVICE environment variable by default, and otherwise the best scored device.", { "device" });
+    args::Flag noBakeCache(parser, "", "Always bake the inputs. By default, an input whose bytes and bake parameters are unchanged since a previous run reuses its cached outputs.", { "noBakeCache" });
 
     try
     {
@@ -51,9 +86,30 @@ int main(
     }
 
     // Create or clean folder, path manipulation -- Make sure that they are absolute paths.
-    std::string inputPathName;
-    std::string outputDir;
+    std::vector<IblBakeJob> bakeJobs;
     {
+        std::string outputDir;
+        if (outputPath)
+        {
+            bool isValid = SharedLib::GetAbsolutePathName(outputPath.Get(), outputDir);
+            if (isValid == false)
+            {
+                std::cerr << "Invalid output Path!" << std::endl;
+                return 1;
+            }
+        }
+        else
+        {
+            std::cerr << "Cannot find the output directory!" << std::endl;
+            return 1;
+        }
+
+        if (inputPath && inputDir)
+        {
+            std::cerr << "The --srcPath and the --srcDir cannot be used together!" << std::endl;
+            return 1;
+        }
+
         if (inputPath)
         {
             if (SharedLib::IsFile(inputPath.Get()) == false)
@@ -62,6 +118,7 @@ int main(
                 return 1;
             }
 
+            std::string inputPathName;
             bool isValid = SharedLib::GetAbsolutePathName(inputPath.Get(), inputPathName);
             std::cout << "Read File From: " << inputPathName << std::endl;
             if (isValid == false)
@@ -69,538 +126,574 @@ int main(
                 std::cerr << "Invalid input Path!" << std::endl;
                 return 1;
             }
+
+            IblBakeJob job{};
+            {
+                job.inputPathName = inputPathName;
+                job.outputDir = outputDir;
+                job.hasCacheKey = false;
+                job.cacheKey = SharedLib::BakeCacheKey{};
+            }
+            bakeJobs.push_back(std::move(job));
         }
-        else
+        else if (inputDir)
         {
-            std::cerr << "Cannot find the input Path!" << std::endl;
-            return 1;
-        }
+            std::string inputDirName;
+            bool isValid = SharedLib::GetAbsolutePathName(inputDir.Get(), inputDirName);
+            if ((isValid == false) || (std::filesystem::is_directory(inputDirName) == false))
+            {
+                std::cerr << "Invalid input directory!" << std::endl;
+                return 1;
+            }
 
-        if (outputPath)
-        {
-            bool isValid = SharedLib::GetAbsolutePathName(outputPath.Get(), outputDir);
-            if (isValid == false)
+            GetIblBakeJobs(inputDirName, outputDir, bakeJobs);
+            if (bakeJobs.empty())
             {
-                std::cerr << "Invalid output Path!" << std::endl;
+                std::cerr << "There is no *.hdr file in the input directory!" << std::endl;
                 return 1;
             }
+            std::cout << "Read " << bakeJobs.size() << " Files From: " << inputDirName << std::endl;
         }
         else
         {
-            std::cerr << "Cannot find the output directory!" << std::endl;
+            std::cerr << "Cannot find the input Path!" << std::endl;
             return 1;
         }
     }
 
-    // Start application
+    // The streamed decode gives the same texels, so it is not a bake parameter.
+    uint64_t streamBudgetBytes = streamBudgetMB ? uint64_t(streamBudgetMB.Get()) * 1024 * 1024 : 0;
+
+    IrradianceMode diffuseIrradianceMode = IrradianceMode::Convolution;
+    if (irradianceMode)
     {
-        GenIBL app;
-        app.ReadInCubemap(inputPathName);
-        app.AppInit();
+        if (irradianceMode.Get() == "sh9")
+        {
+            diffuseIrradianceMode = IrradianceMode::SH9;
+        }
+        else if (irradianceMode.Get() != "conv")
+        {
+            std::cerr << "Invalid irradiance mode! It should be 'conv' or 'sh9'." << std::endl;
+            return 1;
+        }
+    }
 
-        SharedLib::CubemapFormatTransApp cubemapFormatTransApp{};
+    bool useCpuBackend = (HasGpuBackend == false);
+    if (backend)
+    {
+        if (backend.Get() == "cpu")
+        {
+            useCpuBackend = true;
+        }
+        else if (backend.Get() != "gpu")
+        {
+            std::cerr << "Invalid backend! It should be 'gpu' or 'cpu'." << std::endl;
+            return 1;
+        }
+        else if (HasGpuBackend == false)
+        {
+            std::cerr << "The GenIBLCpu has no gpu backend! Use the GenIBL for it." << std::endl;
+            return 1;
+        }
+    }
 
-        // Common data used in the CmdBuffer filling process.
-        VkCommandBuffer cmdBuffer = app.GetGfxCmdBuffer(0);
-        VkQueue         gfxQueue = app.GetGfxQueue();
-        VkDevice        device = app.GetVkDevice();
-        VmaAllocator    allocator = *app.GetVmaAllocator();
-        VkDescriptorSet pipelineDescriptorSet = app.GetDiffIrrPreFilterEnvMapDesSet();
+    if (equirect && useCpuBackend)
+    {
+        std::cerr << "The --equirect needs the gpu backend! Convert the inputs with the SphericalToCubemap for the cpu backend." << std::endl;
+        return 1;
+    }
 
-        VkImageSubresourceRange cubemapSubResRangeLayer6Level1{};
+#ifndef GENIBL_CPU_ONLY
+    InputMipGenMode inputMipGenMode = InputMipGenMode::Host;
+    if (mipGenMode)
+    {
+        if (mipGenMode.Get() == "gpu")
         {
-            cubemapSubResRangeLayer6Level1.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            cubemapSubResRangeLayer6Level1.baseMipLevel = 0;
-            cubemapSubResRangeLayer6Level1.levelCount = 1;
-            cubemapSubResRangeLayer6Level1.baseArrayLayer = 0;
-            cubemapSubResRangeLayer6Level1.layerCount = 6;
+            inputMipGenMode = InputMipGenMode::Gpu;
         }
-
-        VkImageSubresourceRange cubemapSubResRangeLayer6Level10{};
+        else if (mipGenMode.Get() != "cpu")
         {
-            cubemapSubResRangeLayer6Level10.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            cubemapSubResRangeLayer6Level10.baseMipLevel = 0;
-            cubemapSubResRangeLayer6Level10.levelCount = 10;
-            cubemapSubResRangeLayer6Level10.baseArrayLayer = 0;
-            cubemapSubResRangeLayer6Level10.layerCount = 6;
+            std::cerr << "Invalid mipGen mode! It should be 'cpu' or 'gpu'." << std::endl;
+            return 1;
         }
+    }
 
-        VkClearValue clearColor = { {{1.0f, 0.0f, 0.0f, 1.0f}} };
+    PrefilterEnvMapMode prefilterEnvMapMode = PrefilterEnvMapMode::Compute;
+    if (prefilterMode)
+    {
+        if (prefilterMode.Get() == "graphics")
+        {
+            prefilterEnvMapMode = PrefilterEnvMapMode::Graphics;
+        }
+        else if (prefilterMode.Get() != "compute")
+        {
+            std::cerr << "Invalid prefilter mode! It should be 'compute' or 'graphics'." << std::endl;
+            return 1;
+        }
+    }
 
-        ImgInfo inputHdriInfo = app.GetInputHdriInfo();
+    // The equirect input only exists on the GPU, so its mips and its SH9 projection are done there.
+    bool useSH9OnGpu = sh9OnGpu.Get();
+    if (equirect)
+    {
+        inputMipGenMode = InputMipGenMode::Gpu;
+        useSH9OnGpu = true;
+    }
+#endif
 
-        // Init resources used by the CubemapFormatTransApp.
-        VkExtent3D cubemapExtent3D{};
+    EnvBrdfLutParams envBrdfLutParams{ EnvBrdfMapDim, EnvBrdfSampleCount, SharedLib::EnvBrdfLutFormat::RG16F };
+    {
+        if (envBrdfDim)
         {
-            cubemapExtent3D.width = inputHdriInfo.width;
-            cubemapExtent3D.height = inputHdriInfo.width;
-            cubemapExtent3D.depth = 1;
+            envBrdfLutParams.dim = envBrdfDim.Get();
         }
 
-        cubemapFormatTransApp.SetInputCubemapImg(app.GetDiffuseIrradianceCubemap(),
-                                                 cubemapExtent3D,
-                                                 cubemapSubResRangeLayer6Level1);
-
-        SharedLib::VulkanInfos formatTransVkInfo{};
+        if (envBrdfSamples)
         {
-            formatTransVkInfo.device = device;
-            formatTransVkInfo.pAllocator = app.GetVmaAllocator();
-            formatTransVkInfo.descriptorPool = app.GetDescriptorPool();
-            formatTransVkInfo.gfxCmdPool = app.GetGfxCmdPool();
-            formatTransVkInfo.gfxQueue = gfxQueue;
+            envBrdfLutParams.sampleCount = envBrdfSamples.Get();
         }
-        cubemapFormatTransApp.GetVkInfos(formatTransVkInfo);
-        cubemapFormatTransApp.Init();
 
-        // Send input hdri buffer data to its gpu cubemap image.
+        if (envBrdfFormat)
         {
-            VkBufferImageCopy hdrBufToImgCopy{};
+            if (envBrdfFormat.Get() == "rg32f")
             {
-                VkExtent3D extent{};
-                {
-                    extent.width = inputHdriInfo.width;
-                    extent.height = inputHdriInfo.width;
-                    extent.depth = 1;
-                }
-
-                hdrBufToImgCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                hdrBufToImgCopy.imageSubresource.mipLevel = 0;
-                hdrBufToImgCopy.imageSubresource.baseArrayLayer = 0;
-                hdrBufToImgCopy.imageSubresource.layerCount = 6;
-
-                hdrBufToImgCopy.imageExtent = extent;
+                envBrdfLutParams.format = SharedLib::EnvBrdfLutFormat::RG32F;
+            }
+            else if (envBrdfFormat.Get() != "rg16f")
+            {
+                std::cerr << "Invalid env brdf format! It should be 'rg16f' or 'rg32f'." << std::endl;
+                return 1;
             }
-
-            SharedLib::SendImgDataToGpu(cmdBuffer,
-                device,
-                gfxQueue,
-                inputHdriInfo.pData,
-                3 * sizeof(float) * inputHdriInfo.width * inputHdriInfo.height,
-                app.GetInputCubemap(),
-                cubemapSubResRangeLayer6Level1,
-                VK_IMAGE_LAYOUT_UNDEFINED,
-                hdrBufToImgCopy,
-                allocator);
         }
 
-        // Blur the input cubemap of the diffuse irradiance map rendering -- Equivalent to generating mipmaps.
+        if ((envBrdfLutParams.dim == 0) || (envBrdfLutParams.sampleCount == 0))
         {
-            app.CmdGenInputCubemapMipMaps(cmdBuffer);
+            std::cerr << "The env brdf LUT dim and sample count have to be positive!" << std::endl;
+            return 1;
         }
+    }
 
-        // Render the diffuse irradiance map
+    IblOutputOptions outputOptions{ true, true, SharedLib::Ktx2Format::RGBA16F, envBrdfHdr.Get(), octahedral.Get(), streamBudgetBytes };
+    {
+        if (outputFormat)
         {
-            // Fill the command buffer
-            VkCommandBufferBeginInfo beginInfo{};
+            if (outputFormat.Get() == "hdr")
             {
-                beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                outputOptions.ktx2 = false;
             }
-            VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
-
-            // Transfer the layout of the input cubemap mipmaps from transfer dst to shader read.
-            VkImageMemoryBarrier hdrDstToShaderBarrier{};
+            else if (outputFormat.Get() == "ktx2")
             {
-                hdrDstToShaderBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                hdrDstToShaderBarrier.image = app.GetInputCubemap();
-                hdrDstToShaderBarrier.subresourceRange = cubemapSubResRangeLayer6Level10;
-                hdrDstToShaderBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                hdrDstToShaderBarrier.dstAccessMask = VK_ACCESS_NONE;
-                hdrDstToShaderBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                hdrDstToShaderBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                outputOptions.hdr = false;
             }
-
-            vkCmdPipelineBarrier(
-                cmdBuffer,
-                VK_PIPELINE_STAGE_TRANSFER_BIT,
-                VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                0,
-                0, nullptr,
-                0, nullptr,
-                1, &hdrDstToShaderBarrier);
-
-            // Transform the layout of the output cubemap from undefined to render target.
-            VkImageMemoryBarrier cubemapRenderTargetTransBarrier{};
+            else if (outputFormat.Get() != "both")
             {
-                cubemapRenderTargetTransBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                cubemapRenderTargetTransBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-                cubemapRenderTargetTransBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-                cubemapRenderTargetTransBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-                cubemapRenderTargetTransBarrier.image = app.GetDiffuseIrradianceCubemap();
-                cubemapRenderTargetTransBarrier.subresourceRange = cubemapSubResRangeLayer6Level1;
+                std::cerr << "Invalid output format! It should be 'hdr', 'ktx2' or 'both'." << std::endl;
+                return 1;
             }
+        }
 
-            vkCmdPipelineBarrier(cmdBuffer,
-                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                0,
-                0, nullptr,
-                0, nullptr,
-                1, &cubemapRenderTargetTransBarrier);
-
-            VkRenderingAttachmentInfoKHR renderAttachmentInfo{};
+        if (ktx2Format)
+        {
+            if (ktx2Format.Get() == "rgba32f")
             {
-                renderAttachmentInfo.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
-                renderAttachmentInfo.imageView = app.GetDiffuseIrradianceCubemapView();
-                renderAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-                renderAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-                renderAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-                renderAttachmentInfo.clearValue = clearColor;
+                outputOptions.ktx2Format = SharedLib::Ktx2Format::RGBA32F;
             }
-
-            VkExtent2D colorRenderTargetExtent{};
+            else if (ktx2Format.Get() != "rgba16f")
             {
-                colorRenderTargetExtent.width = inputHdriInfo.width;
-                colorRenderTargetExtent.height = inputHdriInfo.width;
+                std::cerr << "Invalid KTX2 format! It should be 'rgba16f' or 'rgba32f'." << std::endl;
+                return 1;
             }
+        }
+    }
 
-            VkRenderingInfoKHR renderInfo{};
-            {
-                renderInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
-                renderInfo.renderArea.offset = { 0, 0 };
-                renderInfo.renderArea.extent = colorRenderTargetExtent;
-                renderInfo.layerCount = 6;
-                renderInfo.colorAttachmentCount = 1;
-                renderInfo.viewMask = 0x3F;
-                renderInfo.pColorAttachments = &renderAttachmentInfo;
-            }
+    std::string cacheDirName = cacheDir ? cacheDir.Get() : (std::filesystem::temp_directory_path() / "GenIBLCache").string();
 
-            vkCmdBeginRendering(cmdBuffer, &renderInfo);
+    // The convolution always outputs the cubemap.
+    bool outputDiffuseIrradianceCubemap = (diffuseIrradianceMode == IrradianceMode::Convolution) || sh9Cubemap.Get();
 
-            // Bind the graphics pipeline
-            vkCmdBindDescriptorSets(cmdBuffer,
-                VK_PIPELINE_BIND_POINT_GRAPHICS,
-                app.GetDiffuseIrradiancePipelineLayout(),
-                0, 1, &pipelineDescriptorSet,
-                0, NULL);
+    // The trace covers everything after the argument parsing, the bake cache included.
+    if (tracePath)
+    {
+        SharedLib::BeginTrace(tracePath.Get());
+        SharedLib::SetTraceThreadName("main");
+    }
 
-            vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app.GetDiffuseIrradiancePipeline());
+    // The bake cache. The inputs whose bytes and bake parameters are unchanged since a previous run are fetched from
+    // <cacheDir>/bakes, and only the rest are baked. The parameters cover everything that changes the output bytes, so
+    // the backends and the modes don't share the entries.
+    std::string bakeCacheDir = cacheDirName + "/bakes";
+    std::vector<std::string> bakeOutputFiles;
+    GetIblBakeOutputFiles(diffuseIrradianceMode == IrradianceMode::SH9, outputDiffuseIrradianceCubemap, outputOptions, bakeOutputFiles);
 
-            // Set the viewport
-            VkViewport viewport{};
+    size_t inputsCnt = bakeJobs.size();
+    if (noBakeCache.Get() == false)
+    {
+        std::string bakeParams = "GenIBL v" + std::to_string(IblBakeVersion);
+        {
+            bakeParams += " backend=" + std::string(useCpuBackend ? "cpu" : "gpu");
+#ifndef GENIBL_CPU_ONLY
+            if (useCpuBackend == false)
             {
-                viewport.x = 0.f;
-                viewport.y = 0.f;
-                viewport.width = (float)colorRenderTargetExtent.width;
-                viewport.height = (float)colorRenderTargetExtent.height;
-                viewport.minDepth = 0.f;
-                viewport.maxDepth = 1.f;
+                bakeParams += " mipGen=" + std::string(inputMipGenMode == InputMipGenMode::Gpu ? "gpu" : "cpu");
+                bakeParams += " prefilter=" + std::string(prefilterEnvMapMode == PrefilterEnvMapMode::Graphics ? "graphics" : "compute");
+                bakeParams += " shGpu=" + std::to_string(useSH9OnGpu);
+                if (equirect)
+                {
+                    bakeParams += " equirect=1";
+                }
             }
-            vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
-
-            // Set the scissor
-            VkRect2D scissor{};
+#endif
+            bakeParams += " irradiance=" + std::string(diffuseIrradianceMode == IrradianceMode::SH9 ? "sh9" : "conv");
+            bakeParams += " irradianceCubemap=" + std::to_string(outputDiffuseIrradianceCubemap);
+            bakeParams += " roughnessLevels=" + std::to_string(RoughnessLevels);
+            bakeParams += " inputMips=" + std::to_string(InputCubemapMipLevels);
+            bakeParams += " clamp=" + std::to_string(InputRadianceClamp);
+            bakeParams += " fis=" + std::to_string(prefilterFis.Get());
+            if (prefilterFis.Get())
             {
-                scissor.offset = { 0, 0 };
-                scissor.extent = colorRenderTargetExtent;
-                vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+                for (uint32_t i = 0; i < RoughnessLevels; i++)
+                {
+                    bakeParams += (i == 0 ? " fisSamples=" : ",") + std::to_string(PrefilterFisSampleBudget[i]);
+                }
+            }
+            else
+            {
+                bakeParams += " samples=" + std::to_string(PrefilterSampleCount);
+            }
+            bakeParams += " envBrdf=" + std::to_string(envBrdfLutParams.dim) + "x" + std::to_string(envBrdfLutParams.sampleCount) +
+                          (envBrdfLutParams.format == SharedLib::EnvBrdfLutFormat::RG16F ? "_rg16f" : "_rg32f") +
+                          "_v" + std::to_string(EnvBrdfLutVersion);
+            bakeParams += " envBrdfHdr=" + std::to_string(envBrdfHdr.Get());
+            bakeParams += " hdr=" + std::to_string(outputOptions.hdr);
+            bakeParams += " ktx2=" + std::to_string(outputOptions.ktx2);
+            if (outputOptions.ktx2)
+            {
+                bakeParams += " ktx2Format=" + std::to_string((uint32_t)outputOptions.ktx2Format);
+            }
+            if (outputOptions.octahedral)
+            {
+                bakeParams += " octahedral=1";
             }
-
-            vkCmdDraw(cmdBuffer, 6, 1, 0, 0);
-
-            vkCmdEndRendering(cmdBuffer);
-
-            // Submit all the works recorded before
-            VK_CHECK(vkEndCommandBuffer(cmdBuffer));
-
-            SharedLib::SubmitCmdBufferAndWait(device, gfxQueue, cmdBuffer);
-
-            vkResetCommandBuffer(cmdBuffer, 0);
         }
 
-        // Reformat the diffuse irradiance map since it's a cubemap
+        SharedLib::ScopedTraceTimer fetchTimer("Bake cache fetch", "disk");
+        auto fetchStart = std::chrono::steady_clock::now();
+        std::vector<IblBakeJob> missedJobs;
+        for (IblBakeJob& job : bakeJobs)
         {
-            // Fill the command buffer
-            VkCommandBufferBeginInfo beginInfo{};
+            job.hasCacheKey = SharedLib::MakeBakeCacheKey(job.inputPathName, bakeParams, job.cacheKey);
+            if (job.hasCacheKey && SharedLib::FetchBakeCacheEntry(bakeCacheDir, job.cacheKey, job.outputDir))
             {
-                beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                std::cout << "From the bake cache: " << job.inputPathName << std::endl;
+                continue;
             }
-            VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+            missedJobs.push_back(std::move(job));
+        }
+        bakeJobs = std::move(missedJobs);
 
-            cubemapFormatTransApp.CmdConvertCubemapFormat(cmdBuffer);
+        std::chrono::duration<double, std::milli> fetchTime = std::chrono::steady_clock::now() - fetchStart;
+        std::cout << "Bake cache: " << inputsCnt - bakeJobs.size() << " of " << inputsCnt << " inputs hit. Time: "
+                  << fetchTime.count() << " ms" << std::endl;
+    }
 
-            // Submit all the works recorded before
-            VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+    // Nothing to bake, so neither the env brdf LUT nor a Vulkan context is needed.
+    if (bakeJobs.empty())
+    {
+        SharedLib::EndTrace();
+        if (inputDir == false)
+        {
+            system("pause");
+        }
+        return 0;
+    }
 
-            SharedLib::SubmitCmdBufferAndWait(device, gfxQueue, cmdBuffer);
+    // The env brdf LUT doesn't depend on the input, so it's generated once per parameter set and then read from the cache.
+    std::vector<char> envBrdfLut;
+    bool envBrdfLutCached = LoadCachedEnvBrdfLut(cacheDirName, envBrdfLutParams, envBrdfLut);
+    if (envBrdfLutCached)
+    {
+        std::cout << "Env brdf LUT from the cache: " << GetEnvBrdfLutCachePathName(cacheDirName, envBrdfLutParams) << std::endl;
+    }
 
-            vkResetCommandBuffer(cmdBuffer, 0);
-        }
+    // The files of an input are encoded and written concurrently on this pool.
+    SharedLib::ThreadPool outputWritePool(IblOutputWriteThreadCnt);
 
-        // Save the vulkan format diffuse irradiance cubemap to the disk
-        {
-            std::string outputCubemapPathName = outputDir + "/diffuse_irradiance_cubemap.hdr";
-            cubemapFormatTransApp.DumpOutputCubemapToDisk(outputCubemapPathName);
-        }
+    // The headless CPU backend. It outputs the same files as the Vulkan backend and never creates a Vulkan instance.
+    // Its stages already share all the cores, so the inputs are baked one after another.
+    if (useCpuBackend)
+    {
+        GenIBLCpu cpuApp;
+        cpuApp.SetPrefilterFis(prefilterFis.Get());
+        cpuApp.SetStreamBudget(streamBudgetBytes);
 
-        // Rendering the prefilter environment map
-        // TODO: Use the push constant instead of waiting for draw completes and ubo updates.
+        // The environment brdf map. It doesn't depend on the input.
+        if (envBrdfLutCached == false)
         {
-            app.GenPrefilterEnvMap();
+            auto envBrdfStart = std::chrono::steady_clock::now();
+            std::vector<float> envBrdfData;
+            cpuApp.GenEnvBrdf(envBrdfLutParams.dim, envBrdfLutParams.sampleCount, envBrdfData);
+            PackEnvBrdfLut(envBrdfData.data(), 2, envBrdfLutParams, envBrdfLut);
+            std::chrono::duration<double, std::milli> envBrdfTime = std::chrono::steady_clock::now() - envBrdfStart;
+            std::cout << "Environment brdf map (cpu) time: " << envBrdfTime.count() << " ms" << std::endl;
+
+            StoreCachedEnvBrdfLut(cacheDirName, envBrdfLutParams, envBrdfLut);
         }
 
-        // Reformat the prefilter environment map and dump out
+        // A job whose input cannot be read is skipped, like in the gpu batch.
+        uint32_t failedJobsCnt = 0;
+        for (const IblBakeJob& job : bakeJobs)
         {
-            cubemapFormatTransApp.Destroy();
-            std::string prefilterOutputDir = outputDir + "/prefilterEnvMaps";
-            SharedLib::CleanOrCreateDir(prefilterOutputDir);
+            SharedLib::ScopedTraceTimer jobTimer("Bake", job.inputPathName);
 
-            for (uint32_t i = 0; i < RoughnessLevels; i++)
             {
-                uint32_t divFactor = 1 << i;
-                uint32_t currentMipDim = inputHdriInfo.width / divFactor;
-                VkExtent3D currentMipExtent{};
+                auto readStart = std::chrono::steady_clock::now();
+                bool isRead = cpuApp.ReadInCubemap(job.inputPathName);
+                std::chrono::duration<double, std::milli> readTime = std::chrono::steady_clock::now() - readStart;
+                if (isRead == false)
                 {
-                    currentMipExtent.width = currentMipDim;
-                    currentMipExtent.height = currentMipDim;
-                    currentMipExtent.depth = 1;
+                    failedJobsCnt++;
+                    continue;
                 }
+                std::cout << "Input cubemap read and mipmaps (cpu) time: " << readTime.count() << " ms" << std::endl;
+            }
 
-                VkImageSubresourceRange currentMipSubres{};
-                {
-                    currentMipSubres.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                    currentMipSubres.baseMipLevel = i;
-                    currentMipSubres.levelCount = 1;
-                    currentMipSubres.baseArrayLayer = 0;
-                    currentMipSubres.layerCount = 6;
-                }
+            // The irradiance cubemap and the prefilter mips are in the host cubemaps of the products.
+            IblBakeProducts products{};
+            products.faceDim = cpuApp.GetInputFaceDim();
+            products.hostCubemaps.resize(1 + RoughnessLevels);
+            std::vector<float>& diffuseIrradianceCubemap = products.hostCubemaps[0];
 
-                cubemapFormatTransApp.SetInputCubemapImg(app.GetPrefilterEnvMap(), 
-                                                         currentMipExtent,
-                                                         currentMipSubres);
-                cubemapFormatTransApp.Init();
+            // The diffuse irradiance.
+            {
+                auto irradianceStart = std::chrono::steady_clock::now();
+                if (diffuseIrradianceMode == IrradianceMode::SH9)
+                {
+                    products.hasIrradianceSH9 = true;
+                    products.irradianceSH9 = cpuApp.GenDiffuseIrradianceSH9();
 
-                // Fill the command buffer
-                VkCommandBufferBeginInfo beginInfo{};
+                    if (outputDiffuseIrradianceCubemap)
+                    {
+                        cpuApp.GenDiffuseIrradianceFromSH9(products.irradianceSH9, diffuseIrradianceCubemap);
+                    }
+                }
+                else
                 {
-                    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                    cpuApp.GenDiffuseIrradiance(diffuseIrradianceCubemap);
                 }
-                VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
-
-                cubemapFormatTransApp.CmdConvertCubemapFormat(cmdBuffer);
-
-                // Submit all the works recorded before
-                VK_CHECK(vkEndCommandBuffer(cmdBuffer));
-
-                SharedLib::SubmitCmdBufferAndWait(device, gfxQueue, cmdBuffer);
-
-                vkResetCommandBuffer(cmdBuffer, 0);
-
-                std::string currentMipName = "prefilterMip" + std::to_string(i) + ".hdr";
-                std::string prefilterEnvMapPathName = prefilterOutputDir + "/" + currentMipName;
+                products.pDiffuseIrradianceCubemap = diffuseIrradianceCubemap.empty() ? nullptr : diffuseIrradianceCubemap.data();
+                std::chrono::duration<double, std::milli> irradianceTime = std::chrono::steady_clock::now() - irradianceStart;
+                std::cout << "Diffuse irradiance (cpu) time: " << irradianceTime.count() << " ms" << std::endl;
+            }
 
-                cubemapFormatTransApp.DumpOutputCubemapToDisk(prefilterEnvMapPathName);
+            // The prefilter environment map. The KTX2 output needs all the mips at once, so they are all kept.
+            {
+                products.prefilterEnvMapMips.resize(RoughnessLevels);
 
-                cubemapFormatTransApp.Destroy();
+                auto prefilterStart = std::chrono::steady_clock::now();
+                for (uint32_t i = 0; i < RoughnessLevels; i++)
+                {
+                    cpuApp.GenPrefilterEnvMapMip(i, products.hostCubemaps[1 + i]);
+                    products.prefilterEnvMapMips[i] = products.hostCubemaps[1 + i].data();
+                }
+                std::chrono::duration<double, std::milli> prefilterTime = std::chrono::steady_clock::now() - prefilterStart;
+                std::cout << "Prefilter environment map (cpu) time: " << prefilterTime.count() << " ms" << std::endl;
             }
-        }
 
-        // RenderDoc debug starts
-        RENDERDOC_API_1_6_0* rdoc_api = NULL;
-        {
-            if (HMODULE mod = GetModuleHandleA("renderdoc.dll"))
+            bool isWritten = WriteIblBakeOutputs(job, products, envBrdfLutParams, envBrdfLut, outputOptions, outputWritePool);
+            if (isWritten == false)
             {
-                pRENDERDOC_GetAPI RENDERDOC_GetAPI = (pRENDERDOC_GetAPI)GetProcAddress(mod, "RENDERDOC_GetAPI");
-                int ret = RENDERDOC_GetAPI(eRENDERDOC_API_Version_1_6_0, (void**)&rdoc_api);
-                assert(ret == 1);
+                failedJobsCnt++;
+                continue;
             }
 
-            if (rdoc_api)
+            if (job.hasCacheKey)
             {
-                std::cout << "Frame capture starts." << std::endl;
-                rdoc_api->StartFrameCapture(NULL, NULL);
+                SharedLib::StoreBakeCacheEntry(bakeCacheDir, job.cacheKey, job.outputDir, bakeOutputFiles);
             }
         }
 
-        // Render the envBrdf map
+        std::cout << "Baked " << bakeJobs.size() - failedJobsCnt << " of " << bakeJobs.size() << " uncached inputs." << std::endl;
+
+        // Headless runs are scripted, so there is no pause at the end.
+        SharedLib::EndTrace();
+        return (failedJobsCnt == 0) ? 0 : 1;
+    }
+
+#ifndef GENIBL_CPU_ONLY
+    // Start application
+    // One Vulkan context and one set of pipelines bake all the inputs. Three stages overlap:
+    // - The next input is decoded on a worker thread.
+    // - The current input is convolved on the GPU and read back to the host.
+    // - The outputs of the previous input are encoded and written on another worker thread, which fans the files out
+    //   over the output write pool.
+    // At most one decoded input and one set of products wait, so the host memory stays bounded for any batch size.
+    uint32_t failedJobsCnt = 0;
+    {
+        GenIBL app;
+        app.SetInputMipGenMode(inputMipGenMode);
+        app.SetStreamBudget(streamBudgetBytes);
+        app.SetPrefilterEnvMapMode(prefilterEnvMapMode);
+        app.SetPrefilterFis(prefilterFis.Get());
+        app.SetIrradianceMode(diffuseIrradianceMode);
+        app.SetSH9OnGpu(useSH9OnGpu);
+        app.SetEquirectInput(equirect.Get());
+        app.SetEnvBrdfLut(envBrdfLutParams, envBrdfLutCached == false);
+        if (device)
         {
-            // Fill the command buffer
-            VkCommandBufferBeginInfo beginInfo{};
-            {
-                beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            }
-            VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+            app.SetPhysicalDeviceSelector(device.Get());
+        }
 
-            // Transform the layout of the output image to the color attachment
-            VkImageSubresourceRange envBrdfMapSubresource{};
-            {
-                envBrdfMapSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                envBrdfMapSubresource.baseMipLevel = 0;
-                envBrdfMapSubresource.levelCount = 1;
-                envBrdfMapSubresource.baseArrayLayer = 0;
-                envBrdfMapSubresource.layerCount = 1;
-            }
+        auto batchStart = std::chrono::steady_clock::now();
 
-            VkImageMemoryBarrier envBrdfRenderTargetTransBarrier{};
+        // The decode thread fills the decodedInput, and SetInputCubemap(...) hands the previous input's arena back to it.
+        // The equirect inputs go to the decodedEquirect in the same way.
+        CubemapMipChain decodedInput;
+        EquirectInput decodedEquirect{};
+        const bool isEquirectInput = equirect.Get();
+        auto decodeInput = [&app, &bakeJobs, &decodedInput, &decodedEquirect, isEquirectInput](size_t jobIdx)
+        {
+            return std::async(std::launch::async, [&app, &bakeJobs, &decodedInput, &decodedEquirect, isEquirectInput, jobIdx]()
             {
-                envBrdfRenderTargetTransBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                envBrdfRenderTargetTransBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-                envBrdfRenderTargetTransBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-                envBrdfRenderTargetTransBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-                envBrdfRenderTargetTransBarrier.image = app.GetEnvBrdfOutputImg();
-                envBrdfRenderTargetTransBarrier.subresourceRange = envBrdfMapSubresource;
-            }
+                SharedLib::SetTraceThreadName("decode");
+                if (isEquirectInput)
+                {
+                    return app.DecodeEquirect(bakeJobs[jobIdx].inputPathName, decodedEquirect);
+                }
+                return app.DecodeCubemap(bakeJobs[jobIdx].inputPathName, decodedInput);
+            });
+        };
 
-            vkCmdPipelineBarrier(cmdBuffer,
-                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                0,
-                0, nullptr,
-                0, nullptr,
-                1, &envBrdfRenderTargetTransBarrier);
+        std::future<bool> inputDecode = decodeInput(0);
+        std::future<bool> outputWrite; // False when the outputs of its job are incomplete.
+        uint64_t writtenReadbackTicket = 0; // The readback that the outputWrite reads from.
+        bool isAppInit = false;
 
-            VkRenderingAttachmentInfoKHR renderAttachmentInfo{};
-            {
-                renderAttachmentInfo.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
-                renderAttachmentInfo.imageView = app.GetEnvBrdfOutputImgView();
-                renderAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-                renderAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-                renderAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-                renderAttachmentInfo.clearValue = clearColor;
-            }
+        for (size_t jobIdx = 0; jobIdx < bakeJobs.size(); jobIdx++)
+        {
+            const IblBakeJob& job = bakeJobs[jobIdx];
 
-            VkRenderingInfoKHR renderInfo{};
+            bool isDecoded = inputDecode.get();
+            if (isDecoded)
             {
-                renderInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
-                renderInfo.renderArea.offset = { 0, 0 };
-                renderInfo.renderArea.extent = { EnvBrdfMapDim, EnvBrdfMapDim };
-                renderInfo.layerCount = 1;
-                renderInfo.colorAttachmentCount = 1;
-                renderInfo.pColorAttachments = &renderAttachmentInfo;
+                if (isEquirectInput)
+                {
+                    app.SetInputEquirect(decodedEquirect);
+                }
+                else
+                {
+                    app.SetInputCubemap(decodedInput);
+                }
             }
 
-            vkCmdBeginRendering(cmdBuffer, &renderInfo);
-
-            float data[2] = { EnvBrdfMapDim, EnvBrdfMapDim };
-            vkCmdPushConstants(cmdBuffer,
-                               app.GetEnvBrdfPipelineLayout(),
-                               VK_SHADER_STAGE_FRAGMENT_BIT,
-                               0, sizeof(float) * 2, data);
-
-            vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app.GetEnvBrdfPipeline());
-
-            // Set the viewport
-            VkViewport viewport{};
+            if (jobIdx + 1 < bakeJobs.size())
             {
-                viewport.x = 0.f;
-                viewport.y = 0.f;
-                viewport.width = (float)EnvBrdfMapDim;
-                viewport.height = (float)EnvBrdfMapDim;
-                viewport.minDepth = 0.f;
-                viewport.maxDepth = 1.f;
+                inputDecode = decodeInput(jobIdx + 1);
             }
-            vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
 
-            // Set the scissor
-            VkRect2D scissor{};
+            if (isDecoded == false)
             {
-                scissor.offset = { 0, 0 };
-                scissor.extent = { EnvBrdfMapDim, EnvBrdfMapDim };
+                failedJobsCnt++;
+                continue;
             }
-            vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
-
-            vkCmdDraw(cmdBuffer, 6, 1, 0, 0);
 
-            vkCmdEndRendering(cmdBuffer);
+            // The input size dependent resources are created from the first decoded input.
+            if (isAppInit == false)
+            {
+                app.AppInit();
+                isAppInit = true;
 
-            // Submit all the works recorded before
-            VK_CHECK(vkEndCommandBuffer(cmdBuffer));
+                // RenderDoc debug starts
+                RENDERDOC_API_1_6_0* rdoc_api = NULL;
+                {
+                    if (HMODULE mod = GetModuleHandleA("renderdoc.dll"))
+                    {
+                        pRENDERDOC_GetAPI RENDERDOC_GetAPI = (pRENDERDOC_GetAPI)GetProcAddress(mod, "RENDERDOC_GetAPI");
+                        int ret = RENDERDOC_GetAPI(eRENDERDOC_API_Version_1_6_0, (void**)&rdoc_api);
+                        assert(ret == 1);
+                    }
+
+                    if (rdoc_api)
+                    {
+                        std::cout << "Frame capture starts." << std::endl;
+                        rdoc_api->StartFrameCapture(NULL, NULL);
+                    }
+                }
 
-            SharedLib::SubmitCmdBufferAndWait(device, gfxQueue, cmdBuffer);
+                // Render the envBrdf map once for the whole batch. A cached one skips it.
+                if (envBrdfLutCached == false)
+                {
+                    auto envBrdfStart = std::chrono::steady_clock::now();
+                    app.GenEnvBrdfLut(envBrdfLut);
+                    std::chrono::duration<double, std::milli> envBrdfTime = std::chrono::steady_clock::now() - envBrdfStart;
+                    std::cout << "Environment brdf map (gpu) time: " << envBrdfTime.count() << " ms" << std::endl;
 
-            vkResetCommandBuffer(cmdBuffer, 0);
-        }
+                    StoreCachedEnvBrdfLut(cacheDirName, envBrdfLutParams, envBrdfLut);
+                }
 
-        // Dump the envBrdf map
-        {
-            // Transfer the envBrdf map from color attachment layout to the copy dst and copy it to a buffer to dump.
-            // Fill the command buffer
-            VkCommandBufferBeginInfo beginInfo{};
-            {
-                beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                // End RenderDoc debug
+                if (rdoc_api)
+                {
+                    std::cout << "Frame capture ends." << std::endl;
+                    rdoc_api->EndFrameCapture(NULL, NULL);
+                }
             }
-            VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
 
-            // Transform the layout of the output image to the color attachment
-            VkImageSubresourceRange envBrdfMapSubresource{};
-            {
-                envBrdfMapSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                envBrdfMapSubresource.baseMipLevel = 0;
-                envBrdfMapSubresource.levelCount = 1;
-                envBrdfMapSubresource.baseArrayLayer = 0;
-                envBrdfMapSubresource.layerCount = 1;
-            }
+            std::cout << "Bake [" << jobIdx + 1 << "/" << bakeJobs.size() << "]: " << job.inputPathName << std::endl;
 
-            VkImageSubresourceLayers envBrdfMapSubresLayers{};
-            {
-                envBrdfMapSubresLayers.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                envBrdfMapSubresLayers.baseArrayLayer = 0;
-                envBrdfMapSubresLayers.layerCount = 1;
-                envBrdfMapSubresLayers.mipLevel = 0;
-            }
+            IblBakeProducts products{};
+            app.BakeInputCubemap(outputDiffuseIrradianceCubemap, products);
 
-            VkImageMemoryBarrier envBrdfRenderTargetTransBarrier{};
+            // Wait for the previous writes before queuing the new ones. Then their staging buffer goes back to the pool,
+            // so the readbacks alternate between two staging buffers.
+            if (outputWrite.valid())
             {
-                envBrdfRenderTargetTransBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                envBrdfRenderTargetTransBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-                envBrdfRenderTargetTransBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-                envBrdfRenderTargetTransBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-                envBrdfRenderTargetTransBarrier.image = app.GetEnvBrdfOutputImg();
-                envBrdfRenderTargetTransBarrier.subresourceRange = envBrdfMapSubresource;
+                if (outputWrite.get() == false)
+                {
+                    failedJobsCnt++;
+                }
+                app.GetReadbackManager().Release(writtenReadbackTicket);
             }
+            writtenReadbackTicket = products.readbackTicket;
 
-            vkCmdPipelineBarrier(cmdBuffer,
-                VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT,
-                VK_PIPELINE_STAGE_TRANSFER_BIT,
-                0,
-                0, nullptr,
-                0, nullptr,
-                1, &envBrdfRenderTargetTransBarrier);
-
-            // Submit all the works recorded before
-            VK_CHECK(vkEndCommandBuffer(cmdBuffer));
-
-            SharedLib::SubmitCmdBufferAndWait(device, gfxQueue, cmdBuffer);
-
-            vkResetCommandBuffer(cmdBuffer, 0);
-            
-            // Dump the buffer to the disk.
-            uint32_t bufferDwordsCnt = EnvBrdfMapDim * EnvBrdfMapDim * 4;
-            float* pEnvBrdfMapData = new float[bufferDwordsCnt];
-
-            SharedLib::CopyImgToRam(cmdBuffer,
-                                    device,
-                                    gfxQueue,
-                                    allocator,
-                                    app.GetEnvBrdfOutputImg(),
-                                    envBrdfMapSubresLayers,
-                                    { EnvBrdfMapDim, EnvBrdfMapDim, 1},
-                                    4, sizeof(float), pEnvBrdfMapData);
-            
-            uint32_t outputDwordsCnt = EnvBrdfMapDim * EnvBrdfMapDim * 3;
-            float* pEnvBrdfOutputData = new float[outputDwordsCnt];
-
-            SharedLib::Img4EleTo3Ele(pEnvBrdfMapData, pEnvBrdfOutputData, EnvBrdfMapDim* EnvBrdfMapDim);
-
-            std::string envBrdfMapPathName = outputDir + "/envBrdf.hdr";
-            SharedLib::SaveImgHdr(envBrdfMapPathName, EnvBrdfMapDim, EnvBrdfMapDim, 3, pEnvBrdfOutputData);
-
-            delete[] pEnvBrdfMapData;
-            delete[] pEnvBrdfOutputData;
+            outputWrite = std::async(std::launch::async,
+                [&job, &envBrdfLutParams, &envBrdfLut, &outputOptions, &outputWritePool, &bakeCacheDir, &bakeOutputFiles, products = std::move(products)]()
+                {
+                    SharedLib::SetTraceThreadName("write");
+                    bool isWritten = WriteIblBakeOutputs(job, products, envBrdfLutParams, envBrdfLut, outputOptions, outputWritePool);
+
+                    // An incomplete job isn't cached, so the next run bakes it again.
+                    if (isWritten && job.hasCacheKey)
+                    {
+                        SharedLib::StoreBakeCacheEntry(bakeCacheDir, job.cacheKey, job.outputDir, bakeOutputFiles);
+                    }
+                    return isWritten;
+                });
         }
 
-        // Copy and paste the input cubemap to the package
+        if (outputWrite.valid())
         {
-            std::string backgroundCubemapOutputPathName = outputDir + "/background_cubemap.hdr";
-            std::filesystem::copy_file(inputPathName, backgroundCubemapOutputPathName);
+            if (outputWrite.get() == false)
+            {
+                failedJobsCnt++;
+            }
+            app.GetReadbackManager().Release(writtenReadbackTicket);
         }
 
-        // End RenderDoc debug
-        if (rdoc_api)
-        {
-            std::cout << "Frame capture ends." << std::endl;
-            rdoc_api->EndFrameCapture(NULL, NULL);
-        }
+        std::chrono::duration<double, std::milli> batchTime = std::chrono::steady_clock::now() - batchStart;
+        std::cout << "Baked " << bakeJobs.size() - failedJobsCnt << " of " << bakeJobs.size() << " uncached inputs. Time: "
+                  << batchTime.count() << " ms" << std::endl;
+    }
+
+    // The app is destroyed, so all the GPU passes are resolved.
+    SharedLib::EndTrace();
+
+    // The batch mode is scripted, so only the single input run pauses at the end.
+    if (inputDir)
+    {
+        return (failedJobsCnt == 0) ? 0 : 1;
     }
 
     system("pause");
+    return (failedJobsCnt == 0) ? 0 : 1;
+#endif
 }
@@ -0,0 +1,377 @@
+#include "EquirectToCubemapCpu.h"
+#include "../../SharedLibrary/Utils/MathUtils.h"
+#include "../../SharedLibrary/Utils/DiskOpsUtils.h"
+#include "../../SharedLibrary/Utils/HdrStreamUtils.h"
+#include "../../SharedLibrary/Utils/HdrIngestUtils.h"
+#include "../../SharedLibrary/Utils/OctahedralUtils.h"
+#include "../../SharedLibrary/Utils/TraceUtils.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include <emmintrin.h>
+
+// Rows of a resampling tile.
+static constexpr uint32_t RowsPerTile = 8;
+
+// Rows of the Radiance input that are run length decoded before they are spread among the workers.
+static constexpr uint32_t RowsPerDecodeBand = 256;
+
+// ================================================================================================================
+// The rotations of the InitSceneBufferInfo(), in the order of the rendered faces: Front, Back, Top, Bottom, Right, Left.
+// The matrices are row major and rotate the point on the y = 1 face plane.
+static void GenFaceRotationMats(
+    float* pMats)
+{
+    memset(pMats, 0, sizeof(float) * 9);
+    pMats[0] = 1.f;
+    pMats[4] = 1.f;
+    pMats[8] = 1.f;
+
+    SharedLib::GenRotationMatZ(M_PI, pMats + 9);
+    SharedLib::GenRotationMatX(M_PI / 2.f, pMats + 18);
+    SharedLib::GenRotationMatX(-M_PI / 2.f, pMats + 27);
+    SharedLib::GenRotationMatZ(-M_PI / 2.f, pMats + 36);
+    SharedLib::GenRotationMatZ(M_PI / 2.f, pMats + 45);
+}
+
+// ================================================================================================================
+static inline __m128 Select(
+    __m128 mask,
+    __m128 a,
+    __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// ================================================================================================================
+// The Cephes atanf on a ratio in [0, 1]: a reduction by tan(pi/8) and a degree 9 odd polynomial, about 1e-7 radians
+// away from the atan2f(...). Both 0 inputs give 0, like the atan2f(0, 0).
+static inline __m128 Atan2(
+    __m128 y,
+    __m128 x)
+{
+    const __m128 signMask = _mm_set1_ps(-0.f);
+    __m128 absY = _mm_andnot_ps(signMask, y);
+    __m128 absX = _mm_andnot_ps(signMask, x);
+
+    __m128 isSteep = _mm_cmpgt_ps(absY, absX);
+    __m128 num = _mm_min_ps(absY, absX);
+    __m128 den = _mm_max_ps(_mm_max_ps(absY, absX), _mm_set1_ps(FLT_MIN));
+    __m128 t = _mm_div_ps(num, den);
+
+    const __m128 one = _mm_set1_ps(1.f);
+    __m128 isReduced = _mm_cmpgt_ps(t, _mm_set1_ps(0.4142135623730950f));
+    t = Select(isReduced, _mm_div_ps(_mm_sub_ps(t, one), _mm_add_ps(t, one)), t);
+
+    __m128 z = _mm_mul_ps(t, t);
+    __m128 poly = _mm_set1_ps(8.05374449538e-2f);
+    poly = _mm_sub_ps(_mm_mul_ps(poly, z), _mm_set1_ps(1.38776856032e-1f));
+    poly = _mm_add_ps(_mm_mul_ps(poly, z), _mm_set1_ps(1.99777106478e-1f));
+    poly = _mm_sub_ps(_mm_mul_ps(poly, z), _mm_set1_ps(3.33329491539e-1f));
+    __m128 a = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(poly, z), t), t);
+    a = _mm_add_ps(a, _mm_and_ps(isReduced, _mm_set1_ps((float)M_PI / 4.f)));
+
+    // Back to the octant of (x, y).
+    a = Select(isSteep, _mm_sub_ps(_mm_set1_ps((float)M_PI / 2.f), a), a);
+    a = Select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps((float)M_PI), a), a);
+    return _mm_or_ps(a, _mm_and_ps(y, signMask));
+}
+
+// ================================================================================================================
+// The bilinear filter of the VK_FILTER_LINEAR with the VK_SAMPLER_ADDRESS_MODE_REPEAT on both axes. A texel is one
+// register, so the filter is 3 lerps of the 4 channels.
+static inline __m128 SampleBilinearRepeat(
+    const float* pRgba,
+    uint32_t     width,
+    uint32_t     height,
+    float        u,
+    float        v)
+{
+    auto loadTexel = [=](int32_t x, int32_t y)
+    {
+        return _mm_loadu_ps(pRgba + 4 * (uint64_t(y) * width + x));
+    };
+
+    float texelX = u * (float)width - 0.5f;
+    float texelY = v * (float)height - 0.5f;
+    float floorX = floorf(texelX);
+    float floorY = floorf(texelY);
+
+    int32_t x0 = (int32_t)floorX % (int32_t)width;
+    int32_t y0 = (int32_t)floorY % (int32_t)height;
+    x0 += (x0 < 0) ? width : 0;
+    y0 += (y0 < 0) ? height : 0;
+    int32_t x1 = (x0 + 1 == (int32_t)width) ? 0 : x0 + 1;
+    int32_t y1 = (y0 + 1 == (int32_t)height) ? 0 : y0 + 1;
+
+    __m128 tx = _mm_set1_ps(texelX - floorX);
+    __m128 ty = _mm_set1_ps(texelY - floorY);
+    __m128 top = loadTexel(x0, y0);
+    __m128 bottom = loadTexel(x0, y1);
+    top = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(loadTexel(x1, y0), top), tx));
+    bottom = _mm_add_ps(bottom, _mm_mul_ps(_mm_sub_ps(loadTexel(x1, y1), bottom), tx));
+    return _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), ty));
+}
+
+// ================================================================================================================
+EquirectToCubemapCpu::EquirectToCubemapCpu() :
+    m_hdriRgba(),
+    m_width(0),
+    m_height(0),
+    m_rotMats(),
+    m_faceDim(0),
+    m_superSampleCnt(0),
+    m_threadPool()
+{}
+
+// ================================================================================================================
+// A Radiance input is decoded band by band, so only a small RGBE band is kept next to the RGBA32F copy.
+bool EquirectToCubemapCpu::ReadInHdri(
+    const std::string& namePath,
+    float&             maxRadiance)
+{
+    SharedLib::ScopedTraceTimer readTimer("ReadInHdri");
+
+    // The HDRI isn't clamped, as in the GPU path.
+    constexpr float RadianceClamp = FLT_MAX;
+    maxRadiance = 0.f;
+
+    SharedLib::HdrScanlineReader hdriStream;
+    if (hdriStream.Open(namePath))
+    {
+        m_width = hdriStream.GetWidth();
+        m_height = hdriStream.GetHeight();
+        m_hdriRgba.resize(4 * uint64_t(m_width) * m_height);
+
+        std::vector<uint8_t> rgbeBand;
+        for (uint32_t rowBegin = 0; rowBegin < m_height; rowBegin += RowsPerDecodeBand)
+        {
+            uint32_t rowCnt = std::min(RowsPerDecodeBand, m_height - rowBegin);
+            rgbeBand.resize(rowCnt * hdriStream.GetRgbeRowBytesCnt());
+            if (hdriStream.ReadRgbeRows(rowCnt, rgbeBand.data()) == false)
+            {
+                return false;
+            }
+
+            float* pDst = m_hdriRgba.data() + 4 * uint64_t(rowBegin) * m_width;
+            float bandMax = SharedLib::IngestRgbeRows(rgbeBand.data(),
+                                                      rowCnt,
+                                                      m_width,
+                                                      SharedLib::HdrIngestFormat::RGBA32F,
+                                                      RadianceClamp,
+                                                      pDst,
+                                                      m_threadPool);
+            maxRadiance = std::max(maxRadiance, bandMax);
+        }
+        return true;
+    }
+
+    int nrComponents, width, height;
+    float* pRgb = SharedLib::ReadImg(namePath, nrComponents, width, height);
+    if (pRgb == nullptr)
+    {
+        return false;
+    }
+
+    m_width = (uint32_t)width;
+    m_height = (uint32_t)height;
+    m_hdriRgba.resize(4 * uint64_t(m_width) * m_height);
+    maxRadiance = SharedLib::IngestRgbRows(pRgb,
+                                           m_height,
+                                           m_width,
+                                           SharedLib::HdrIngestFormat::RGBA32F,
+                                           RadianceClamp,
+                                           m_hdriRgba.data(),
+                                           m_threadPool);
+    SharedLib::ReleaseImg(pRgb);
+    return true;
+}
+
+// ================================================================================================================
+uint32_t EquirectToCubemapCpu::GetDefaultSuperSampleCnt(
+    uint32_t faceDim)
+{
+    uint32_t superSampleCnt = (GetDefaultFaceDim() + faceDim - 1) / std::max(faceDim, 1u);
+    return std::clamp(superSampleCnt, 1u, MaxSuperSampleCnt);
+}
+
+// ================================================================================================================
+// The subsample (sx, sy) of the output texel (x, y) is at (x + (sx + 0.5) / n, y + (sy + 0.5) / n). It is mapped back
+// through the face reordering to the rendered face and then projected like the fragment at that position.
+void EquirectToCubemapCpu::BuildFaceRowUvs(
+    uint32_t face,
+    uint32_t row,
+    float*   pRowUvs)
+{
+    const float* pRotMat = m_rotMats + 9 * face;
+    const uint32_t n = m_superSampleCnt;
+    const float dim = (float)m_faceDim;
+    const __m128 dimVec = _mm_set1_ps(dim);
+    const __m128 twoOverDim = _mm_set1_ps(2.f / dim);
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 laneOffsets = _mm_set_ps(3.f, 2.f, 1.f, 0.f);
+
+    for (uint32_t sy = 0; sy < n; sy++)
+    {
+        const __m128 outY = _mm_set1_ps((float)row + (sy + 0.5f) / n);
+        for (uint32_t sx = 0; sx < n; sx++)
+        {
+            const float subOffsetX = (sx + 0.5f) / n;
+            for (uint32_t x = 0; x < m_faceDim; x += 4)
+            {
+                __m128 outX = _mm_add_ps(_mm_set1_ps((float)x + subOffsetX), laneOffsets);
+
+                // The cubemapFormat_frag.hlsl reordering: The side faces are mirrored horizontally, the top face is
+                // transposed and the bottom face is transposed and rotated by 180 degrees.
+                __m128 renderX, renderY;
+                if (face == 2)
+                {
+                    renderX = outY;
+                    renderY = outX;
+                }
+                else if (face == 3)
+                {
+                    renderX = _mm_sub_ps(dimVec, outY);
+                    renderY = _mm_sub_ps(dimVec, outX);
+                }
+                else
+                {
+                    renderX = _mm_sub_ps(dimVec, outX);
+                    renderY = outY;
+                }
+
+                // p = (2i / width - 1, 1, 2j / height - 1) with j = height - gl_FragCoord.y.
+                __m128 p0 = _mm_sub_ps(_mm_mul_ps(renderX, twoOverDim), one);
+                __m128 p2 = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(dimVec, renderY), twoOverDim), one);
+
+                __m128 rot[3];
+                for (uint32_t r = 0; r < 3; r++)
+                {
+                    rot[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(pRotMat[3 * r]), p0), _mm_set1_ps(pRotMat[3 * r + 1])),
+                                        _mm_mul_ps(_mm_set1_ps(pRotMat[3 * r + 2]), p2));
+                }
+
+                __m128 longitude = Atan2(rot[0], rot[1]);
+                __m128 latitude = Atan2(rot[2], _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(rot[0], rot[0]), _mm_mul_ps(rot[1], rot[1]))));
+
+                alignas(16) float u[4];
+                alignas(16) float v[4];
+                _mm_store_ps(u, _mm_mul_ps(_mm_add_ps(longitude, _mm_set1_ps((float)M_PI)), _mm_set1_ps(0.5f / (float)M_PI)));
+                _mm_store_ps(v, _mm_sub_ps(one, _mm_mul_ps(_mm_add_ps(latitude, _mm_set1_ps((float)M_PI / 2.f)),
+                                                           _mm_set1_ps(1.f / (float)M_PI))));
+
+                uint32_t laneCnt = std::min(4u, m_faceDim - x);
+                for (uint32_t lane = 0; lane < laneCnt; lane++)
+                {
+                    float* pUv = pRowUvs + 2 * (uint64_t(x + lane) * n * n + sy * n + sx);
+                    pUv[0] = u[lane];
+                    pUv[1] = v[lane];
+                }
+            }
+        }
+    }
+}
+
+// ================================================================================================================
+void EquirectToCubemapCpu::InitFaceSampling(
+    uint32_t faceDim,
+    uint32_t superSampleCnt)
+{
+    m_faceDim = faceDim;
+    m_superSampleCnt = std::clamp(superSampleCnt, 1u, MaxSuperSampleCnt);
+    GenFaceRotationMats(m_rotMats);
+}
+
+// ================================================================================================================
+// A tile computes the (u, v) of each output row into one row buffer and reuses the buffer for its next row, so the
+// subsamples of a texel are next to each other in the memory without a table of the whole cubemap.
+void EquirectToCubemapCpu::Resample(
+    uint32_t dstComponents,
+    float*   pDst)
+{
+    SharedLib::ScopedTraceTimer resampleTimer("Resample");
+
+    const uint32_t subsampleCnt = m_superSampleCnt * m_superSampleCnt;
+    const __m128 subsampleWeight = _mm_set1_ps(1.f / subsampleCnt);
+
+    uint32_t tilesPerFace = (m_faceDim + RowsPerTile - 1) / RowsPerTile;
+    m_threadPool.ParallelFor(6 * tilesPerFace, [&](uint32_t tileIdx)
+    {
+        uint32_t face = tileIdx / tilesPerFace;
+        uint32_t rowBegin = (tileIdx % tilesPerFace) * RowsPerTile;
+        uint32_t rowEnd = std::min(rowBegin + RowsPerTile, m_faceDim);
+
+        std::vector<float> rowUvs(2 * uint64_t(subsampleCnt) * m_faceDim);
+        for (uint32_t row = rowBegin; row < rowEnd; row++)
+        {
+            BuildFaceRowUvs(face, row, rowUvs.data());
+
+            uint64_t texelBegin = (uint64_t(face) * m_faceDim + row) * m_faceDim;
+            for (uint32_t x = 0; x < m_faceDim; x++)
+            {
+                const float* pUvs = rowUvs.data() + 2 * uint64_t(x) * subsampleCnt;
+                __m128 sum = _mm_setzero_ps();
+                for (uint32_t s = 0; s < subsampleCnt; s++)
+                {
+                    sum = _mm_add_ps(sum, SampleBilinearRepeat(m_hdriRgba.data(), m_width, m_height, pUvs[2 * s], pUvs[2 * s + 1]));
+                }
+
+                alignas(16) float rgba[4];
+                _mm_store_ps(rgba, _mm_mul_ps(sum, subsampleWeight));
+                memcpy(pDst + dstComponents * (texelBegin + x), rgba, sizeof(float) * dstComponents);
+            }
+        }
+    });
+}
+
+// ================================================================================================================
+// The octahedral direction of a subsample is in the cubemap sampling space, whose equirect (u, v) is the one that the
+// faces of the Resample(...) get for the same direction.
+void EquirectToCubemapCpu::ResampleOctahedral(
+    uint32_t octDim,
+    uint32_t superSampleCnt,
+    uint32_t dstComponents,
+    float*   pDst)
+{
+    SharedLib::ScopedTraceTimer resampleTimer("ResampleOctahedral");
+
+    const uint32_t n = std::clamp(superSampleCnt, 1u, MaxSuperSampleCnt);
+    const __m128 subsampleWeight = _mm_set1_ps(1.f / (n * n));
+
+    uint32_t tileCnt = (octDim + RowsPerTile - 1) / RowsPerTile;
+    m_threadPool.ParallelFor(tileCnt, [&](uint32_t tileIdx)
+    {
+        uint32_t rowBegin = tileIdx * RowsPerTile;
+        uint32_t rowEnd = std::min(rowBegin + RowsPerTile, octDim);
+
+        for (uint32_t row = rowBegin; row < rowEnd; row++)
+        {
+            for (uint32_t x = 0; x < octDim; x++)
+            {
+                __m128 sum = _mm_setzero_ps();
+                for (uint32_t sy = 0; sy < n; sy++)
+                {
+                    for (uint32_t sx = 0; sx < n; sx++)
+                    {
+                        float dir[3];
+                        SharedLib::OctahedralUvToDir((x + (sx + 0.5f) / n) / octDim, (row + (sy + 0.5f) / n) / octDim, dir);
+
+                        float longitude = atan2f(dir[2], dir[0]);
+                        float latitude = atan2f(dir[1], sqrtf(dir[0] * dir[0] + dir[2] * dir[2]));
+                        float u = (longitude + (float)M_PI) * (0.5f / (float)M_PI);
+                        float v = 0.5f - latitude / (float)M_PI;
+                        sum = _mm_add_ps(sum, SampleBilinearRepeat(m_hdriRgba.data(), m_width, m_height, u, v));
+                    }
+                }
+
+                alignas(16) float rgba[4];
+                _mm_store_ps(rgba, _mm_mul_ps(sum, subsampleWeight));
+                memcpy(pDst + dstComponents * (uint64_t(row) * octDim + x), rgba, sizeof(float) * dstComponents);
+            }
+        }
+    });
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "../../SharedLibrary/Utils/ThreadUtils.h"
+#include "../../SharedLibrary/Utils/OctahedralUtils.h"
+#include <string>
+#include <vector>
+
+// The CPU engine of the conversion, for the machines without a Vulkan device. It reproduces the ToCubeMap.frag
+// projection, its bilinear REPEAT sampling and the face reordering of the CubemapFormatTransApp, so the output has the
+// same layout as the GPU one: the 6 faces in the Vulkan order (X+, X-, Y+, Y-, Z+, Z-).
+// - The equirect (u, v) of the output samples are computed a row at a time with the SSE2 atan2, right before the row is
+//   resampled, so there is no table of the whole cubemap next to the input.
+// - The supersampling averages a superSampleCnt x superSampleCnt grid of bilinear samples per texel. It is for the faces
+//   that are smaller than the input, where a single bilinear sample aliases.
+// - The resampling is spread among the workers in (face, row band) tiles.
+class EquirectToCubemapCpu
+{
+public:
+    EquirectToCubemapCpu();
+    ~EquirectToCubemapCpu() {};
+
+    static constexpr uint32_t MaxSuperSampleCnt = 4;
+
+    // Decodes the input to RGBA32F. Returns false when it cannot be read. maxRadiance is the largest channel of the input.
+    bool ReadInHdri(const std::string& namePath, float& maxRadiance);
+
+    uint32_t GetInputHdriWidth() { return m_width; }
+    uint32_t GetInputHdriHeight() { return m_height; }
+
+    // The face size of the GPU path and the supersampling that covers the input texels of a face of faceDim.
+    uint32_t GetDefaultFaceDim() { return m_height / 2; }
+    uint32_t GetDefaultSuperSampleCnt(uint32_t faceDim);
+
+    // The output face size and supersampling of the Resample(...).
+    void InitFaceSampling(uint32_t faceDim, uint32_t superSampleCnt);
+
+    // pDst is 6 faces of faceDim x faceDim texels with dstComponents (3 or 4) floats per texel. E.g. 3 is the vertical
+    // strip of the output file.
+    void Resample(uint32_t dstComponents, float* pDst);
+
+    // The octahedral map of the SharedLib OctahedralUtils.h instead of the cubemap. It needs no InitFaceSampling(...). The
+    // default octDim is twice the default face size, which keeps the cubemap angular resolution with fewer texels.
+    uint32_t GetDefaultOctDim() { return SharedLib::OctahedralDimFromFaceDim(GetDefaultFaceDim()); }
+    void ResampleOctahedral(uint32_t octDim, uint32_t superSampleCnt, uint32_t dstComponents, float* pDst);
+
+private:
+    // pRowUvs is the (u, v) per texel and subsample of one row. The subsamples of a texel are together.
+    void BuildFaceRowUvs(uint32_t face, uint32_t row, float* pRowUvs);
+
+    std::vector<float> m_hdriRgba;
+    uint32_t           m_width;
+    uint32_t           m_height;
+
+    float              m_rotMats[6 * 9]; // The rotation of each rendered face.
+    uint32_t           m_faceDim;
+    uint32_t           m_superSampleCnt;
+
+    SharedLib::ThreadPool m_threadPool;
+};
@@ -3,8 +3,12 @@
 #include "../../SharedLibrary/Camera/Camera.h"
 #include "../../SharedLibrary/Utils/MathUtils.h"
 #include "../../SharedLibrary/Utils/DiskOpsUtils.h"
+#include "../../SharedLibrary/Utils/CmdBufUtils.h"
+#include "../../SharedLibrary/Utils/TraceUtils.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cfloat>
 
 #include "vk_mem_alloc.h"
 
@@ -29,6 +33,9 @@ SphericalToCubemap::SphericalToCubemap() :
     m_hdriData(nullptr),
     m_width(0),
     m_height(0),
+    m_hdriStream(),
+    m_streamBudgetBytes(0),
+    m_hdriFormat(SharedLib::HdrIngestFormat::RGBA32F),
     m_outputCubemapExtent()
 {
 }
@@ -37,11 +44,15 @@ SphericalToCubemap::SphericalToCubemap() :
 SphericalToCubemap::~SphericalToCubemap()
 {
     vkDeviceWaitIdle(m_device);
-    delete m_hdriData;
+    if (m_hdriData != nullptr)
+    {
+        SharedLib::ReleaseImg(m_hdriData);
+    }
 
     DestroyHdriGpuObjects();
 
     vmaDestroyBuffer(*m_pAllocator, m_uboBuffer, m_uboAlloc);
+    m_gpuTimer.Destroy();
 
     // Destroy shader modules
     vkDestroyShaderModule(m_device, m_vsShaderModule, nullptr);
@@ -67,6 +78,17 @@ void SphericalToCubemap::DestroyHdriGpuObjects()
 // ================================================================================================================
 void SphericalToCubemap::ReadInHdri(const std::string& namePath)
 {
+    SharedLib::ScopedTraceTimer readTimer("ReadInHdri");
+
+    // The Radiance files are only opened here and decoded during the upload. Other inputs fall back to the whole image
+    // decode.
+    if (m_hdriStream.Open(namePath))
+    {
+        m_width = m_hdriStream.GetWidth();
+        m_height = m_hdriStream.GetHeight();
+        return;
+    }
+
     int nrComponents, width, height;
     m_hdriData = SharedLib::ReadImg(namePath, nrComponents, width, height);
 
@@ -74,6 +96,75 @@ void SphericalToCubemap::ReadInHdri(const std::string& namePath)
     m_height = (uint32_t)height;
 }
 
+// ================================================================================================================
+// The staging ring calls back on this thread band by band. A Radiance band is run length decoded serially into the
+// small RGBE band and then spread among the workers, which write the clamped RGBA texels into the mapped staging.
+bool SphericalToCubemap::UploadInputHdri(
+    float& maxRadiance)
+{
+    SharedLib::ScopedTraceTimer uploadTimer("UploadInputHdri");
+
+    // The HDRI isn't clamped. Only the RGBA16F clamps to its largest finite value.
+    constexpr float RadianceClamp = FLT_MAX;
+
+    const bool isStreamed = (m_hdriData == nullptr);
+    const uint32_t texelBytes = SharedLib::HdrIngestTexelBytes(m_hdriFormat);
+    const uint64_t stagingBudgetBytes = (m_streamBudgetBytes != 0) ? m_streamBudgetBytes : UINT64_MAX;
+
+    VkExtent2D hdriExtent{};
+    {
+        hdriExtent.width = m_width;
+        hdriExtent.height = m_height;
+    }
+
+    std::vector<uint8_t> rgbeBand;
+    maxRadiance = 0.f;
+    bool isUploaded = SharedLib::StreamRowsToImg(m_device,
+                                                 m_graphicsQueue,
+                                                 m_gfxCmdPool,
+                                                 *m_pAllocator,
+                                                 m_inputHdri,
+                                                 0,
+                                                 1,
+                                                 hdriExtent,
+                                                 texelBytes,
+                                                 VK_IMAGE_LAYOUT_UNDEFINED,
+                                                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                                 stagingBudgetBytes,
+                                                 [&](uint32_t rowBegin, uint32_t rowCnt, void* pDst)
+                                                 {
+                                                     float bandMax;
+                                                     if (isStreamed)
+                                                     {
+                                                         rgbeBand.resize(rowCnt * m_hdriStream.GetRgbeRowBytesCnt());
+                                                         if (m_hdriStream.ReadRgbeRows(rowCnt, rgbeBand.data()) == false)
+                                                         {
+                                                             return false;
+                                                         }
+                                                         bandMax = SharedLib::IngestRgbeRows(rgbeBand.data(), rowCnt, m_width, m_hdriFormat, RadianceClamp, pDst, m_threadPool);
+                                                     }
+                                                     else
+                                                     {
+                                                         const float* pRgb = m_hdriData + 3 * uint64_t(rowBegin) * m_width;
+                                                         bandMax = SharedLib::IngestRgbRows(pRgb, rowCnt, m_width, m_hdriFormat, RadianceClamp, pDst, m_threadPool);
+                                                     }
+                                                     maxRadiance = std::max(maxRadiance, bandMax);
+                                                     return true;
+                                                 });
+
+    // The host copies are only needed by the upload.
+    if (isStreamed)
+    {
+        m_hdriStream.Close();
+    }
+    else
+    {
+        SharedLib::ReleaseImg(m_hdriData);
+        m_hdriData = nullptr;
+    }
+    return isUploaded;
+}
+
 // ================================================================================================================
 void SphericalToCubemap::SaveCubemap(
     const std::string& namePath, 
@@ -88,7 +179,7 @@ void SphericalToCubemap::SaveCubemap(
 // ================================================================================================================
 void SphericalToCubemap::InitHdriGpuObjects()
 {
-    assert(m_hdriData != nullptr);
+    assert(m_width != 0 && m_height != 0);
     
     // Create GPU objects
     VmaAllocationCreateInfo hdrAllocInfo{};
@@ -108,7 +199,7 @@ void SphericalToCubemap::InitHdriGpuObjects()
     {
         hdriImgInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
         hdriImgInfo.imageType = VK_IMAGE_TYPE_2D;
-        hdriImgInfo.format = VK_FORMAT_R32G32B32_SFLOAT;
+        hdriImgInfo.format = (VkFormat)m_hdriFormat;
         hdriImgInfo.extent = inputHdriExtent;
         hdriImgInfo.mipLevels = 1;
         hdriImgInfo.arrayLayers = 1;
@@ -130,7 +221,7 @@ void SphericalToCubemap::InitHdriGpuObjects()
         hdriImgViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         hdriImgViewInfo.image = m_inputHdri;
         hdriImgViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        hdriImgViewInfo.format = VK_FORMAT_R32G32B32_SFLOAT;
+        hdriImgViewInfo.format = (VkFormat)m_hdriFormat;
         hdriImgViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         hdriImgViewInfo.subresourceRange.levelCount = 1;
         hdriImgViewInfo.subresourceRange.layerCount = 1;
@@ -450,14 +541,15 @@ void SphericalToCubemap::AppInit()
     std::vector<const char*> instExtensions;
     InitInstance(instExtensions, 0);
 
-    InitPhysicalDevice();
+    // We need the dynamic rendering extension and the multiview extension.
+    const std::vector<const char*> deviceExtensions = { VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME, VK_KHR_MULTIVIEW_EXTENSION_NAME };
+
+    InitPhysicalDevice(deviceExtensions);
     InitGfxQueueFamilyIdx();
 
     // Queue family index should be unique in vk1.2:
     // https://vulkan.lunarg.com/doc/view/1.2.198.0/windows/1.2-extensions/vkspec.html#VUID-VkDeviceCreateInfo-queueFamilyIndex-02802
     std::vector<VkDeviceQueueCreateInfo> deviceQueueInfos = CreateDeviceQueueInfos({ m_graphicsQueueFamilyIdx });
-    // We need the swap chain device extension and the dynamic rendering extension.
-    const std::vector<const char*> deviceExtensions = { VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME, VK_KHR_MULTIVIEW_EXTENSION_NAME };
 
     VkPhysicalDeviceVulkan11Features vulkan11Features{};
     {
@@ -479,6 +571,7 @@ void SphericalToCubemap::AppInit()
 
     InitGfxCommandPool();
     InitGfxCommandBuffers(1);
+    m_gpuTimer.Init(m_physicalDevice, m_device, m_graphicsQueueFamilyIdx);
 
     InitShaderModules();
     InitPipelineDescriptorSetLayout();
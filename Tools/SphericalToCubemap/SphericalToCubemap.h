@@ -1,6 +1,10 @@
 #pragma once
 #include "../../SharedLibrary/Application/Application.h"
 #include "../../SharedLibrary/Pipeline/Pipeline.h"
+#include "../../SharedLibrary/Utils/HdrStreamUtils.h"
+#include "../../SharedLibrary/Utils/HdrIngestUtils.h"
+#include "../../SharedLibrary/Utils/GpuTraceUtils.h"
+#include "../../SharedLibrary/Utils/ThreadUtils.h"
 
 namespace SharedLib
 {
@@ -21,14 +25,22 @@ public:
     void InitShaderModules();
     void InitPipelineDescriptorSet();
 
+    // A non-zero budget bounds the staging memory of the upload, which then goes in row bands. 0 uploads the input in
+    // one band. Set it and the format before AppInit().
+    void SetStreamBudget(uint64_t bytes) { m_streamBudgetBytes = bytes; }
+    void SetHdriFormat(SharedLib::HdrIngestFormat format) { m_hdriFormat = format; }
     void ReadInHdri(const std::string& namePath);
+
+    // A Radiance input is decoded from the file straight into the mapped staging memory in the HDRI format, with the
+    // range check in the same pass. Other inputs are decoded as a whole by ReadInHdri(...) and only reformatted here.
+    // Returns false on a damaged file. maxRadiance is the largest channel of the input.
+    bool UploadInputHdri(float& maxRadiance);
     void SaveCubemap(const std::string& namePath, uint32_t width, uint32_t height, uint32_t components, float* pData);
 
     void InitHdriGpuObjects();
     void DestroyHdriGpuObjects();
     void InitSceneBufferInfo();
 
-    float* GetInputHdriData() { return m_hdriData; }
     uint32_t GetInputHdriWidth() { return m_width; }
     uint32_t GetInputHdriHeight() { return m_height; }
     VkImage GetHdriImg() { return m_inputHdri; }
@@ -38,6 +50,7 @@ public:
     VkImage GetOutputCubemapImg() { return m_outputCubemap; }
     VkPipelineLayout GetPipelineLayout() { return m_pipelineLayout; }
     VkDescriptorSet GetDescriptorSet() { return m_pipelineDescriptorSet0; }
+    SharedLib::GpuTraceTimer& GetGpuTimer() { return m_gpuTimer; }
 
 private:
     VkBuffer      m_uboBuffer;
@@ -50,7 +63,12 @@ private:
 
     uint32_t m_width;
     uint32_t m_height;
-    float*   m_hdriData;
+    float*   m_hdriData; // Only for the non-Radiance inputs. nullptr after the upload.
+
+    SharedLib::HdrScanlineReader m_hdriStream;
+    uint64_t                     m_streamBudgetBytes;
+    SharedLib::HdrIngestFormat   m_hdriFormat;
+    SharedLib::ThreadPool        m_threadPool;
 
     VkImage       m_outputCubemap;
     VmaAllocation m_outputCubemapAlloc;
@@ -64,4 +82,6 @@ private:
     VkDescriptorSetLayout m_pipelineDesSet0Layout;
     VkPipelineLayout      m_pipelineLayout;
     SharedLib::Pipeline   m_pipeline;
+
+    SharedLib::GpuTraceTimer m_gpuTimer;
 };
\ No newline at end of file
@@ -1,26 +1,34 @@
 #include "SphericalToCubemap.h"
+#include "EquirectToCubemapCpu.h"
 #include "args.hxx"
 #include "../../SharedLibrary/Utils/CmdBufUtils.h"
 #include "../../SharedLibrary/Utils/VulkanDbgUtils.h"
 #include "../../SharedLibrary/Utils/AppUtils.h"
+#include "../../SharedLibrary/Utils/BakeCacheUtils.h"
+#include "../../SharedLibrary/Utils/TraceUtils.h"
+#include "../../SharedLibrary/Utils/DiskOpsUtils.h"
 
 #include "renderdoc_app.h"
 #include <Windows.h>
+#include <algorithm>
 #include <cassert>
+#include <filesystem>
 
-bool CheckImgValAbove1(
-    float* pData,
-    uint32_t width,
-    uint32_t height)
+// Bump it when a change of the conversion changes the output, so the stale bake cache entries are missed.
+constexpr uint32_t SphericalToCubemapVersion = 1;
+
+// ================================================================================================================
+static void PrintRangeCheck(
+    float maxRadiance)
 {
-    for (uint32_t i = 0; i < width * height * 3; i++)
+    if (maxRadiance > 1.f)
     {
-        if (pData[i] > 1.f)
-        {
-            return true;
-        }
+        std::cout << "The image has elements that are larger than 1.f." << std::endl;
+    }
+    else
+    {
+        std::cout << "The image doesn't have elements that are larger than 1.f." << std::endl;
     }
-    return false;
 }
 
 // TODO: Some CmdBuffer recording can be packaged.
@@ -34,6 +42,17 @@ int main(
     args::CompletionFlag completion(parser, { "complete" });
 
     args::ValueFlag<std::string> inputPath(parser, "", "The input equirectangular image path.", { 'i', "srcPath"});
+    args::ValueFlag<std::string> cacheDir(parser, "", "The bake cache folder. The system temp folder by default.", { "cacheDir" });
+    args::Flag noBakeCache(parser, "", "Always convert the input. By default, an unchanged input reuses its cached output.", { "noBakeCache" });
+    args::ValueFlag<std::string> tracePath(parser, "", "Write a Chrome tracing JSON of the run to this file: the CPU stages, the GPU passes and the uploaded, read back and disk bytes. Open it in chrome://tracing or ui.perfetto.dev.", { "trace" });
+    args::ValueFlag<uint32_t> streamBudgetMB(parser, "", "Upload the input to the GPU in row bands with at most this many MB of staging memory. A .hdr input is decoded band by band straight into the staging memory. 0 by default, which uploads it in one band.", { "streamBudgetMB" });
+    args::ValueFlag<std::string> hdriFormat(parser, "", "The GPU format of the input: 'rgba32f' (Default) or 'rgba16f', which halves the upload and clamps the radiance to 65504.", { "hdriFormat" });
+    args::Flag cpu(parser, "", "Convert on the CPU without a Vulkan device. The output is the same layout as the GPU one.", { "cpu" });
+    args::ValueFlag<uint32_t> faceDim(parser, "", "The CPU output face size. Half of the input height by default, like the GPU output.", { "faceDim" });
+    args::ValueFlag<uint32_t> superSample(parser, "", "The CPU supersampling: n x n bilinear samples per output texel, at most 4. By default, enough to cover the input texels of a smaller face.", { "superSample" });
+    args::ValueFlag<std::string> device(parser, "", "The Vulkan device: an index of the printed device list, 'cpu' for a CPU implementation like the lavapipe, or a part of the device name. The VULKAN_DICT_DEVICE environment variable by default, and otherwise the best scored device.", { "device" });
+    args::Flag octahedral(parser, "", "Output an octahedral 2D map (output_octahedral.hdr) instead of the cubemap. It is converted on the CPU without a Vulkan device.", { "octahedral" });
+    args::ValueFlag<uint32_t> octDim(parser, "", "The octahedral map width and height. The input height by default, which is twice the cubemap face size.", { "octDim" });
 
     try
     {
@@ -83,6 +102,153 @@ int main(
         std::cout << "Read default file from: " << inputHdrPathName << std::endl;
     }
 
+    SharedLib::HdrIngestFormat inputHdriFormat = SharedLib::HdrIngestFormat::RGBA32F;
+    if (hdriFormat)
+    {
+        if (hdriFormat.Get() == "rgba16f")
+        {
+            inputHdriFormat = SharedLib::HdrIngestFormat::RGBA16F;
+        }
+        else if (hdriFormat.Get() != "rgba32f")
+        {
+            std::cerr << "Invalid HDRI format! It should be 'rgba32f' or 'rgba16f'." << std::endl;
+            return 1;
+        }
+    }
+
+    if ((faceDim || superSample) && (cpu.Get() == false) && (octahedral.Get() == false))
+    {
+        std::cerr << "The --faceDim and the --superSample are only for the --cpu and the --octahedral conversions." << std::endl;
+        return 1;
+    }
+
+    if ((faceDim && octahedral) || (octDim && (octahedral.Get() == false)))
+    {
+        std::cerr << "The --octahedral output size is the --octDim instead of the --faceDim." << std::endl;
+        return 1;
+    }
+
+    std::string outputCubemapDir = isDefault ? std::string(SOURCE_PATH) + "/data" : inputHdrFolderPath;
+    const std::vector<std::string> outputFiles = { octahedral ? "output_octahedral.hdr" : "output_cubemap.hdr" };
+
+    // The trace covers everything after the argument parsing, the bake cache included.
+    if (tracePath)
+    {
+        SharedLib::BeginTrace(tracePath.Get());
+        SharedLib::SetTraceThreadName("main");
+    }
+
+    // The bake cache. An input whose bytes are unchanged since a previous run reuses the cached output, and neither the
+    // input is decoded nor a Vulkan context is created.
+    std::string bakeCacheDir = cacheDir ? cacheDir.Get() : (std::filesystem::temp_directory_path() / "SphericalToCubemapCache").string();
+    SharedLib::BakeCacheKey bakeCacheKey{};
+    bool hasBakeCacheKey = false;
+    if (noBakeCache.Get() == false)
+    {
+        std::string bakeParams = "SphericalToCubemap v" + std::to_string(SphericalToCubemapVersion) +
+                                 " hdriFormat=" + std::to_string((uint32_t)inputHdriFormat);
+        if (octahedral)
+        {
+            bakeParams += " octahedral=1 octDim=" + std::to_string(octDim ? octDim.Get() : 0) +
+                          " superSample=" + std::to_string(superSample ? superSample.Get() : 0);
+        }
+        else if (cpu)
+        {
+            // The defaults are 0, since they only depend on the input, which is already in the key.
+            bakeParams += " backend=cpu faceDim=" + std::to_string(faceDim ? faceDim.Get() : 0) +
+                          " superSample=" + std::to_string(superSample ? superSample.Get() : 0);
+        }
+        hasBakeCacheKey = SharedLib::MakeBakeCacheKey(inputHdrPathName, bakeParams, bakeCacheKey);
+        if (hasBakeCacheKey && SharedLib::FetchBakeCacheEntry(bakeCacheDir, bakeCacheKey, outputCubemapDir))
+        {
+            std::cout << "From the bake cache: " << outputCubemapDir + "/" + outputFiles[0] << std::endl;
+            SharedLib::EndTrace();
+            system("pause");
+            return 0;
+        }
+    }
+
+    // The CPU conversions need neither the Vulkan context nor the RenderDoc.
+    if (octahedral)
+    {
+        EquirectToCubemapCpu cpuApp;
+        float maxRadiance = 0.f;
+        if (cpuApp.ReadInHdri(inputHdrPathName, maxRadiance) == false)
+        {
+            std::cerr << "Cannot read the input: " << inputHdrPathName << std::endl;
+            exit(1);
+        }
+        PrintRangeCheck(maxRadiance);
+
+        uint32_t outputOctDim = octDim ? octDim.Get() : cpuApp.GetDefaultOctDim();
+        if (outputOctDim == 0)
+        {
+            std::cerr << "The output octahedral map size is 0." << std::endl;
+            exit(1);
+        }
+
+        // The octahedral texel covers about the solid angle of the texel of a face of half its size.
+        uint32_t superSampleCnt = superSample ? superSample.Get() : cpuApp.GetDefaultSuperSampleCnt(std::max(outputOctDim / 2, 1u));
+
+        std::vector<float> octahedralMap(3 * uint64_t(outputOctDim) * outputOctDim);
+        cpuApp.ResampleOctahedral(outputOctDim, superSampleCnt, 3, octahedralMap.data());
+
+        {
+            SharedLib::ScopedTraceTimer saveTimer("Save output octahedral map");
+
+            SharedLib::UnlinkBakeOutputs(outputCubemapDir, outputFiles);
+            SharedLib::SaveImgHdr(outputCubemapDir + "/" + outputFiles[0], outputOctDim, outputOctDim, 3, octahedralMap.data());
+
+            if (hasBakeCacheKey)
+            {
+                SharedLib::StoreBakeCacheEntry(bakeCacheDir, bakeCacheKey, outputCubemapDir, outputFiles);
+            }
+        }
+
+        SharedLib::EndTrace();
+        system("pause");
+        return 0;
+    }
+
+    if (cpu)
+    {
+        EquirectToCubemapCpu cpuApp;
+        float maxRadiance = 0.f;
+        if (cpuApp.ReadInHdri(inputHdrPathName, maxRadiance) == false)
+        {
+            std::cerr << "Cannot read the input: " << inputHdrPathName << std::endl;
+            exit(1);
+        }
+        PrintRangeCheck(maxRadiance);
+
+        uint32_t outputFaceDim = faceDim ? faceDim.Get() : cpuApp.GetDefaultFaceDim();
+        if (outputFaceDim == 0)
+        {
+            std::cerr << "The output face size is 0." << std::endl;
+            exit(1);
+        }
+        cpuApp.InitFaceSampling(outputFaceDim, superSample ? superSample.Get() : cpuApp.GetDefaultSuperSampleCnt(outputFaceDim));
+
+        std::vector<float> cubemapVStrip(3 * 6 * uint64_t(outputFaceDim) * outputFaceDim);
+        cpuApp.Resample(3, cubemapVStrip.data());
+
+        {
+            SharedLib::ScopedTraceTimer saveTimer("Save output cubemap");
+
+            SharedLib::UnlinkBakeOutputs(outputCubemapDir, outputFiles);
+            SharedLib::SaveImgHdr(outputCubemapDir + "/" + outputFiles[0], outputFaceDim, 6 * outputFaceDim, 3, cubemapVStrip.data());
+
+            if (hasBakeCacheKey)
+            {
+                SharedLib::StoreBakeCacheEntry(bakeCacheDir, bakeCacheKey, outputCubemapDir, outputFiles);
+            }
+        }
+
+        SharedLib::EndTrace();
+        system("pause");
+        return 0;
+    }
+
     // RenderDoc debug starts
     RENDERDOC_API_1_6_0* rdoc_api = NULL;
     if (HMODULE mod = GetModuleHandleA("renderdoc.dll"))
@@ -98,26 +264,22 @@ int main(
     }
 
     SphericalToCubemap app;
+    app.SetStreamBudget(streamBudgetMB ? uint64_t(streamBudgetMB.Get()) * 1024 * 1024 : 0);
+    app.SetHdriFormat(inputHdriFormat);
+    if (device)
+    {
+        app.SetPhysicalDeviceSelector(device.Get());
+    }
     app.ReadInHdri(inputHdrPathName);
     app.AppInit();
 
     SharedLib::CubemapFormatTransApp cubemapFormatTransApp;
     cubemapFormatTransApp.SetInputCubemapImg(app.GetOutputCubemapImg(), app.GetOutputCubemapExtent());
 
-    if (CheckImgValAbove1(app.GetInputHdriData(), app.GetInputHdriWidth(), app.GetInputHdriHeight()))
-    {
-        std::cout << "The image has elements that are larger than 1.f." << std::endl;
-    }
-    else
-    {
-        std::cout << "The image doesn't have elements that are larger than 1.f." << std::endl;
-    }
-
     // Common data used in the CmdBuffer filling process.
     VkCommandBuffer cmdBuffer = app.GetGfxCmdBuffer(0);
     VkQueue gfxQueue = app.GetGfxQueue();
     VkDevice device = app.GetVkDevice();
-    VmaAllocator allocator = *app.GetVmaAllocator();
     VkDescriptorSet pipelineDescriptorSet = app.GetDescriptorSet();
 
     SharedLib::VulkanInfos formatTransVkInfo{};
@@ -140,44 +302,14 @@ int main(
         cubemapSubResRange.layerCount = 6;
     }
 
-    // Send hdri data to its gpu objects through a staging buffer.
+    // Send hdri data to its gpu objects through a staging buffer. The range check is done in the same pass.
+    float maxRadiance = 0.f;
+    if (app.UploadInputHdri(maxRadiance) == false)
     {
-        VkImageSubresourceRange copySubRange{};
-        {
-            copySubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            copySubRange.baseMipLevel = 0;
-            copySubRange.levelCount = 1;
-            copySubRange.baseArrayLayer = 0;
-            copySubRange.layerCount = 1;
-        }
-
-        VkBufferImageCopy hdrBufToImgCopy{};
-        {
-            VkExtent3D extent{};
-            {
-                extent.width = app.GetInputHdriWidth();
-                extent.height = app.GetInputHdriHeight();
-                extent.depth = 1;
-            }
-
-            hdrBufToImgCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            hdrBufToImgCopy.imageSubresource.mipLevel = 0;
-            hdrBufToImgCopy.imageSubresource.baseArrayLayer = 0;
-            hdrBufToImgCopy.imageSubresource.layerCount = 1;
-
-            hdrBufToImgCopy.imageExtent = extent;
-        }
-
-        SharedLib::SendImgDataToGpu(cmdBuffer, 
-                                       device,
-                                       gfxQueue,
-                                       app.GetInputHdriData(),
-                                       3 * sizeof(float) * app.GetInputHdriWidth() * app.GetInputHdriHeight(),
-                                       app.GetHdriImg(),
-                                       copySubRange,
-                                       hdrBufToImgCopy,
-                                       allocator);
+        std::cerr << "Cannot upload the input: " << inputHdrPathName << std::endl;
+        exit(1);
     }
+    PrintRangeCheck(maxRadiance);
 
     // Draw the Front, Back, Top, Bottom, Right, Left faces to the cubemap.
     {
@@ -187,6 +319,7 @@ int main(
             beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         }
         VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+        app.GetGpuTimer().CmdBeginPass(cmdBuffer, "Equirect to cubemap");
 
         // Transform the layout of the output cubemap from undefined to render target.
         VkImageMemoryBarrier cubemapRenderTargetTransBarrier{};
@@ -270,13 +403,15 @@ int main(
         vkCmdDraw(cmdBuffer, 6, 1, 0, 0);
 
         vkCmdEndRendering(cmdBuffer);
+        app.GetGpuTimer().CmdEndPass(cmdBuffer);
         
         // Submit all the works recorded before
         VK_CHECK(vkEndCommandBuffer(cmdBuffer));
 
-        SharedLib::SubmitCmdBufferAndWait(device, gfxQueue, cmdBuffer);
+        app.GetGfxTimeline().SubmitAndWait(cmdBuffer);
 
         vkResetCommandBuffer(cmdBuffer, 0);
+        app.GetGpuTimer().Resolve();
     }
 
     // Convert output 6 faces images to the Vulkan's cubemap's format
@@ -289,30 +424,31 @@ int main(
         }
         VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
 
+        app.GetGpuTimer().CmdBeginPass(cmdBuffer, "Cubemap format conversion");
         cubemapFormatTransApp.CmdConvertCubemapFormat(cmdBuffer);
+        app.GetGpuTimer().CmdEndPass(cmdBuffer);
 
         // Submit all the works recorded before
         VK_CHECK(vkEndCommandBuffer(cmdBuffer));
 
-        SharedLib::SubmitCmdBufferAndWait(device, gfxQueue, cmdBuffer);
+        app.GetGfxTimeline().SubmitAndWait(cmdBuffer);
 
         vkResetCommandBuffer(cmdBuffer, 0);
+        app.GetGpuTimer().Resolve();
     }
 
     // Save the vulkan format cubemap to the disk
     {
-        std::string outputCubemapPathName = {};
-        if (isDefault)
-        {
-            outputCubemapPathName = SOURCE_PATH;
-            outputCubemapPathName += "/data/output_cubemap.hdr";
-        }
-        else
+        SharedLib::ScopedTraceTimer saveTimer("Save output cubemap");
+
+        // The output of a previous run may be a hard link into the bake cache.
+        SharedLib::UnlinkBakeOutputs(outputCubemapDir, outputFiles);
+        cubemapFormatTransApp.DumpOutputCubemapToDisk(outputCubemapDir + "/" + outputFiles[0]);
+
+        if (hasBakeCacheKey)
         {
-            outputCubemapPathName = inputHdrFolderPath + "/output_cubemap.hdr";
+            SharedLib::StoreBakeCacheEntry(bakeCacheDir, bakeCacheKey, outputCubemapDir, outputFiles);
         }
-
-        cubemapFormatTransApp.DumpOutputCubemapToDisk(outputCubemapPathName);
     }
 
     if (rdoc_api)
@@ -321,5 +457,6 @@ int main(
     }
 
     cubemapFormatTransApp.Destroy();
+    SharedLib::EndTrace();
     system("pause");
 }
\ No newline at end of file